@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "workload.h"
+#include "../src/util.h"
+#include "../src/datalog.h"
+#include "../src/parser/grammar.h"
+#include "../src/parser/parser.h"
+#include "../src/parser/ast.h"
+#include "../src/parser/stream.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double seconds(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // per second, or 0 when the clock saw no time pass, so JSON never gets inf or nan
+    double rate(double amount, double elapsed)
+    {
+        return elapsed > 0 ? amount / elapsed : 0;
+    }
+
+    struct Result
+    {
+        std::string shape;
+        size_t facts;
+        size_t bytes;
+        size_t tokens;
+        double lexMBs;
+        double parseFactsPerSecond;
+        double loadSeconds;
+        size_t derived;
+        double evaluateSeconds;
+        double tuplesPerSecond;
+        size_t queries;
+        double p50;
+        double p90;
+        double p99;
+        double max;
+    };
+
+    double percentile(const std::vector<double>& sorted, double fraction)
+    {
+        if (sorted.empty())
+            return 0;
+        size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+
+    Result run(const LL1Parser& parser, const WorkloadOptions& options, size_t threads)
+    {
+        std::string program = generateWorkload(options);
+        Result result{};
+        result.shape = std::string{ shapeName(options.shape) };
+        result.facts = options.facts;
+        result.bytes = program.size();
+
+        auto start = Clock::now();
+        TokenStream lexed{ parser.lexer(), program };
+        for (const auto& token : lexed)
+            result.tokens += !token.value().empty();
+        result.lexMBs = rate(static_cast<double>(program.size()) / 1e6, seconds(start));
+
+        start = Clock::now();
+        TokenStream tokens{ parser.lexer(), program };
+        DatalogAst ast = parseDatalog(parser, tokens);
+        result.parseFactsPerSecond = rate(static_cast<double>(options.facts), seconds(start));
+
+        DatalogProgram datalog{ threads };
+        start = Clock::now();
+        datalog.load(ast);
+        result.loadSeconds = seconds(start);
+
+        start = Clock::now();
+        auto stats = datalog.evaluateRules();
+        result.evaluateSeconds = seconds(start);
+        result.derived = std::accumulate(std::cbegin(stats.derived), std::cend(stats.derived), size_t{ 0 });
+        result.tuplesPerSecond = rate(static_cast<double>(result.derived), result.evaluateSeconds);
+
+        std::vector<double> latencies;
+        for (const Atom& query : datalog.queries())
+        {
+            start = Clock::now();
+            Relation answer = datalog.evaluate(query);
+            latencies.push_back(seconds(start) * 1e6);
+        }
+        std::sort(std::begin(latencies), std::end(latencies));
+        result.queries = latencies.size();
+        result.p50 = percentile(latencies, 0.5);
+        result.p90 = percentile(latencies, 0.9);
+        result.p99 = percentile(latencies, 0.99);
+        result.max = latencies.empty() ? 0 : latencies.back();
+        return result;
+    }
+
+    void printJson(std::ostream& out, const Result& result)
+    {
+        out << "{\"shape\":\"" << result.shape << "\",\"facts\":" << result.facts << ",\"bytes\":" << result.bytes
+            << ",\"tokens\":" << result.tokens << ",\"lex_mb_per_s\":" << result.lexMBs
+            << ",\"parse_facts_per_s\":" << result.parseFactsPerSecond << ",\"load_s\":" << result.loadSeconds
+            << ",\"derived\":" << result.derived << ",\"evaluate_s\":" << result.evaluateSeconds
+            << ",\"eval_tuples_per_s\":" << result.tuplesPerSecond << ",\"queries\":" << result.queries
+            << ",\"query_us\":{\"p50\":" << result.p50 << ",\"p90\":" << result.p90 << ",\"p99\":" << result.p99
+            << ",\"max\":" << result.max << "}}\n";
+    }
+
+    void printCsvHeader(std::ostream& out)
+    {
+        out << "shape,facts,bytes,tokens,lex_mb_per_s,parse_facts_per_s,load_s,derived,evaluate_s,"
+            "eval_tuples_per_s,queries,query_p50_us,query_p90_us,query_p99_us,query_max_us\n";
+    }
+
+    void printCsv(std::ostream& out, const Result& result)
+    {
+        out << result.shape << "," << result.facts << "," << result.bytes << "," << result.tokens << ","
+            << result.lexMBs << "," << result.parseFactsPerSecond << "," << result.loadSeconds << ","
+            << result.derived << "," << result.evaluateSeconds << "," << result.tuplesPerSecond << ","
+            << result.queries << "," << result.p50 << "," << result.p90 << "," << result.p99 << ","
+            << result.max << "\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    auto args = parseArguments(argc, argv);
+    WorkloadOptions options;
+    const std::vector<WorkloadOptions::Shape> allShapes{ WorkloadOptions::Shape::Chain,
+        WorkloadOptions::Shape::TransitiveClosure, WorkloadOptions::Shape::Triangles };
+    std::vector<WorkloadOptions::Shape> shapes = allShapes;
+    size_t threads = std::thread::hardware_concurrency();
+    bool csv = false;
+
+    try
+    {
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            const std::string& flag = args[i];
+            if (i + 1 == args.size())
+                throw std::invalid_argument{ "missing value for " + flag };
+            const std::string& value = args[++i];
+
+            if (flag == "--shape")
+                shapes = value == "all" ? allShapes : std::vector<WorkloadOptions::Shape>{ parseShape(value) };
+            else if (flag == "--schemes")
+                options.schemes = std::stoul(value);
+            else if (flag == "--facts")
+                options.facts = std::stoul(value);
+            else if (flag == "--string-length")
+                options.stringLength = std::stoul(value);
+            else if (flag == "--nodes")
+                options.nodes = std::stoul(value);
+            else if (flag == "--depth")
+                options.depth = std::stoul(value);
+            else if (flag == "--queries")
+                options.queries = std::stoul(value);
+            else if (flag == "--bound")
+                options.boundQueries = std::stod(value);
+            else if (flag == "--seed")
+                options.seed = static_cast<std::uint32_t>(std::stoul(value));
+            else if (flag == "--threads")
+                threads = std::stoul(value);
+            else if (flag == "--format" && (value == "json" || value == "csv"))
+                csv = value == "csv";
+            else
+                throw std::invalid_argument{ "unknown option " + flag + " " + value };
+        }
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << "ERROR: " << error.what() << "\n"
+            << "USAGE: datalog-bench [--shape chain|closure|triangles|all] [--schemes N] [--facts N]\n"
+            << "    [--string-length N] [--nodes N] [--depth N] [--queries N] [--bound FRACTION]\n"
+            << "    [--seed N] [--threads N] [--format json|csv]\n";
+        return EXIT_FAILURE;
+    }
+
+    LL1Parser parser = DatalogGrammarFactory::createDatalogParser();
+    if (csv)
+        printCsvHeader(std::cout);
+    for (auto shape : shapes)
+    {
+        options.shape = shape;
+        Result result = run(parser, options, threads);
+        if (csv)
+            printCsv(std::cout, result);
+        else
+            printJson(std::cout, result);
+    }
+}
@@ -0,0 +1,127 @@
+#include "workload.h"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    std::string constant(size_t value, size_t length)
+    {
+        std::string text = "n" + std::to_string(value);
+        if (text.size() + 2 < length)
+            text.insert(0, length - 2 - text.size(), 'x');
+        return "'" + text + "'";
+    }
+}
+
+std::string_view shapeName(WorkloadOptions::Shape shape)
+{
+    switch (shape)
+    {
+    case WorkloadOptions::Shape::Chain:
+        return "chain";
+    case WorkloadOptions::Shape::TransitiveClosure:
+        return "closure";
+    case WorkloadOptions::Shape::Triangles:
+        return "triangles";
+    }
+    return "";
+}
+
+WorkloadOptions::Shape parseShape(std::string_view name)
+{
+    for (auto shape : { WorkloadOptions::Shape::Chain, WorkloadOptions::Shape::TransitiveClosure, WorkloadOptions::Shape::Triangles })
+    {
+        if (shapeName(shape) == name)
+            return shape;
+    }
+    throw std::invalid_argument{ "unknown workload shape " + std::string{ name } };
+}
+
+std::string generateWorkload(const WorkloadOptions& options)
+{
+    if (options.schemes == 0 || options.depth == 0)
+        throw std::invalid_argument{ "a workload needs at least one scheme and a positive depth" };
+
+    std::mt19937 random{ options.seed };
+    size_t edges = (options.facts + options.schemes - 1) / options.schemes;
+
+    // chains of depth edges, or a random graph for triangles
+    std::vector<std::pair<size_t, size_t>> graph;
+    size_t nodes = options.nodes;
+    if (options.shape == WorkloadOptions::Shape::Triangles)
+    {
+        if (nodes == 0)
+            nodes = std::max<size_t>(edges / 8, 8);
+        std::uniform_int_distribution<size_t> node{ 0, nodes - 1 };
+        for (size_t i = 0; i < edges; ++i)
+            graph.emplace_back(node(random), node(random));
+    }
+    else
+    {
+        for (size_t i = 0; i < edges; ++i)
+        {
+            size_t chain = i / options.depth;
+            graph.emplace_back(i + chain, i + chain + 1);
+        }
+        if (nodes == 0)
+            nodes = edges + edges / options.depth + 1;
+        std::shuffle(std::begin(graph), std::end(graph), random);
+    }
+
+    std::string program{ "Schemes:\n  edge(A,B)\n" };
+    for (size_t s = 1; s < options.schemes; ++s)
+        program += "  extra" + std::to_string(s) + "(A,B)\n";
+
+    program += "Facts:\n";
+    for (const auto& [from, to] : graph)
+        program += "  edge(" + constant(from, options.stringLength) + "," + constant(to, options.stringLength) + ").\n";
+    std::uniform_int_distribution<size_t> value{ 0, nodes - 1 };
+    for (size_t s = 1; s < options.schemes; ++s)
+    {
+        std::string name = "  extra" + std::to_string(s) + "(";
+        for (size_t i = 0; i < edges && s * edges + i < options.facts; ++i)
+            program += name + constant(value(random), options.stringLength) + "," + constant(value(random), options.stringLength) + ").\n";
+    }
+
+    std::string derived;
+    std::string columns;
+    std::string heads;
+    program += "Rules:\n";
+    switch (options.shape)
+    {
+    case WorkloadOptions::Shape::Chain:
+        program += "  hop2(A,C) :- edge(A,B), edge(B,C).\n";
+        program += "  hop3(A,D) :- edge(A,B), edge(B,C), edge(C,D).\n";
+        derived = "hop3";
+        columns = "Y";
+        heads = "  hop2(A,B)\n  hop3(A,B)\n";
+        break;
+    case WorkloadOptions::Shape::TransitiveClosure:
+        program += "  reach(X,Y) :- edge(X,Y).\n";
+        program += "  reach(X,Z) :- edge(X,Y), reach(Y,Z).\n";
+        derived = "reach";
+        columns = "Y";
+        heads = "  reach(A,B)\n";
+        break;
+    case WorkloadOptions::Shape::Triangles:
+        program += "  triangle(X,Y,Z) :- edge(X,Y), edge(Y,Z), edge(Z,X).\n";
+        derived = "triangle";
+        columns = "Y,Z";
+        heads = "  triangle(A,B,C)\n";
+        break;
+    }
+    program.insert(program.find("Facts:"), heads);
+
+    program += "Queries:\n";
+    std::bernoulli_distribution bound{ options.boundQueries };
+    for (size_t q = 0; q < std::max<size_t>(options.queries, 1); ++q)
+    {
+        std::string first = bound(random) ? constant(value(random), options.stringLength) : std::string{ "X" };
+        program += "  " + derived + "(" + first + "," + columns + ")?\n";
+    }
+
+    return program;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Synthetic Datalog programs for benchmarks. The edge relation carries the
+// rule workload; any further schemes only add facts to lex, parse and load.
+struct WorkloadOptions
+{
+    enum class Shape { Chain, TransitiveClosure, Triangles };
+
+    Shape shape = Shape::TransitiveClosure;
+    size_t schemes = 1;
+    size_t facts = 10000;
+    // length of every quoted constant, quotes included
+    size_t stringLength = 8;
+    // nodes in the edge graph; 0 picks a size that suits the shape
+    size_t nodes = 0;
+    // length of each chain for the chain and transitive closure shapes
+    size_t depth = 16;
+    size_t queries = 100;
+    // share of the queries with a constant in the first column
+    double boundQueries = 0.9;
+    std::uint32_t seed = 1;
+};
+
+std::string_view shapeName(WorkloadOptions::Shape shape);
+WorkloadOptions::Shape parseShape(std::string_view name);
+
+std::string generateWorkload(const WorkloadOptions& options);
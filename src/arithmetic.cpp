@@ -0,0 +1,256 @@
+#include "arithmetic.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DATALOG_ARITHMETIC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    struct Kernels
+    {
+        ArithmeticLevel level;
+        // column[i * stride] for count rows into values, flagging the numbers
+        void (*decode)(const Symbol* column, size_t stride, size_t count, std::int64_t* values, std::uint8_t* valid);
+        // lhs op= rhs, clearing the flag of rows that overflow
+        void (*add)(std::int64_t* lhs, const std::int64_t* rhs, std::uint8_t* valid, size_t count);
+        void (*multiply)(std::int64_t* lhs, const std::int64_t* rhs, std::uint8_t* valid, size_t count);
+    };
+
+    // symbols that are not inline numbers may still be quoted integers
+    void decodeText(const Symbol* column, size_t stride, size_t count, std::int64_t* values, std::uint8_t* valid)
+    {
+        const SymbolTable& symbols = SymbolTable::global();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!valid[i])
+                valid[i] = symbols.numeric(column[i * stride], values[i]);
+        }
+    }
+
+    void decodeScalar(const Symbol* column, size_t stride, size_t count, std::int64_t* values, std::uint8_t* valid)
+    {
+        bool all = true;
+        for (size_t i = 0; i < count; ++i)
+        {
+            Symbol symbol = column[i * stride];
+            values[i] = SymbolTable::numberOf(symbol);
+            valid[i] = SymbolTable::isNumber(symbol);
+            all &= valid[i] != 0;
+        }
+        if (!all)
+            decodeText(column, stride, count, values, valid);
+    }
+
+    void addScalar(std::int64_t* lhs, const std::int64_t* rhs, std::uint8_t* valid, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            valid[i] &= !__builtin_add_overflow(lhs[i], rhs[i], &lhs[i]);
+    }
+
+    void multiplyScalar(std::int64_t* lhs, const std::int64_t* rhs, std::uint8_t* valid, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            valid[i] &= !__builtin_mul_overflow(lhs[i], rhs[i], &lhs[i]);
+    }
+
+    constexpr Kernels scalar{ ArithmeticLevel::Scalar, decodeScalar, addScalar, multiplyScalar };
+
+#ifdef DATALOG_ARITHMETIC_X86
+    // AVX2: the number tag is the sign bit of each 32 bit lane, so one
+    // movemask finds the inline numbers among 8 gathered Symbols
+    __attribute__((target("avx2"))) void decodeAvx2(const Symbol* column, size_t stride, size_t count,
+        std::int64_t* values, std::uint8_t* valid)
+    {
+        const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+            _mm256_set1_epi32(static_cast<int>(stride)));
+        const __m256i payload = _mm256_set1_epi32(static_cast<int>(~SymbolTable::NumberTag));
+        bool all = true;
+        size_t i = 0;
+        for (; i + 8 <= count && stride * 8 < (size_t{ 1 } << 31); i += 8)
+        {
+            __m256i symbols = stride == 1
+                ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i))
+                : _mm256_i32gather_epi32(reinterpret_cast<const int*>(column + i * stride), offsets, 4);
+            int numbers = _mm256_movemask_ps(_mm256_castsi256_ps(symbols));
+            __m256i numbersOnly = _mm256_and_si256(symbols, payload);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), _mm256_cvtepu32_epi64(_mm256_castsi256_si128(numbersOnly)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i + 4), _mm256_cvtepu32_epi64(_mm256_extracti128_si256(numbersOnly, 1)));
+            for (int lane = 0; lane < 8; ++lane)
+                valid[i + static_cast<size_t>(lane)] = static_cast<std::uint8_t>((numbers >> lane) & 1);
+            all &= numbers == 0xff;
+        }
+        if (!all)
+            decodeText(column, stride, i, values, valid);
+        decodeScalar(column + i * stride, stride, count - i, values + i, valid + i);
+    }
+
+    __attribute__((target("avx2"))) void addAvx2(std::int64_t* lhs, const std::int64_t* rhs, std::uint8_t* valid, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+            __m256i sum = _mm256_add_epi64(a, b);
+            // signed overflow: both operands differ in sign from the sum
+            __m256i overflow = _mm256_and_si256(_mm256_xor_si256(a, sum), _mm256_xor_si256(b, sum));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lhs + i), sum);
+            int lanes = _mm256_movemask_pd(_mm256_castsi256_pd(overflow));
+            for (int lane = 0; lane < 4; ++lane)
+                valid[i + static_cast<size_t>(lane)] &= static_cast<std::uint8_t>(((lanes >> lane) & 1) ^ 1);
+        }
+        addScalar(lhs + i, rhs + i, valid + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) void multiplyAvx2(std::int64_t* lhs, const std::int64_t* rhs, std::uint8_t* valid, size_t count)
+    {
+        // AVX2 multiplies 32 bit lanes into 64 bits, which cannot overflow
+        // while both operands are below 2^31, as inline numbers are
+        const __m256i high = _mm256_set1_epi64x(static_cast<std::int64_t>(0xffffffff80000000ull));
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+            if (!_mm256_testz_si256(_mm256_or_si256(a, b), high))
+            {
+                multiplyScalar(lhs + i, rhs + i, valid + i, 4);
+                continue;
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lhs + i), _mm256_mul_epu32(a, b));
+        }
+        multiplyScalar(lhs + i, rhs + i, valid + i, count - i);
+    }
+
+    constexpr Kernels avx2{ ArithmeticLevel::Avx2, decodeAvx2, addAvx2, multiplyAvx2 };
+#endif
+
+    ArithmeticLevel supported()
+    {
+#ifdef DATALOG_ARITHMETIC_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return ArithmeticLevel::Avx2;
+#endif
+        return ArithmeticLevel::Scalar;
+    }
+
+    const Kernels* kernelsFor(ArithmeticLevel level)
+    {
+#ifdef DATALOG_ARITHMETIC_X86
+        if (level == ArithmeticLevel::Avx2)
+            return &avx2;
+#endif
+        return &scalar;
+    }
+
+    std::atomic<const Kernels*>& current()
+    {
+        static std::atomic<const Kernels*> kernels{ kernelsFor(supported()) };
+        return kernels;
+    }
+
+    const Kernels& kernels() { return *current().load(std::memory_order_relaxed); }
+}
+
+ArithmeticLevel arithmeticLevel() { return kernels().level; }
+
+ArithmeticLevel setArithmeticLevel(ArithmeticLevel level)
+{
+    const Kernels* kernels = kernelsFor(std::min(level, supported()));
+    current().store(kernels, std::memory_order_relaxed);
+    return kernels->level;
+}
+
+ArithmeticKernel::ArithmeticKernel(std::vector<Instruction> code)
+    : _code{ std::move(code) }, _constants(_code.size()), _constantValid(_code.size()), _depth{ 0 }
+{
+    size_t depth = 0;
+    for (size_t i = 0; i < _code.size(); ++i)
+    {
+        const Instruction& instruction = _code[i];
+        if (instruction.op == Instruction::Op::Add || instruction.op == Instruction::Op::Multiply)
+        {
+            if (depth < 2)
+                throw std::invalid_argument{ "arithmetic operator without two operands" };
+            --depth;
+            continue;
+        }
+        if (instruction.op == Instruction::Op::Constant)
+        {
+            std::int64_t value = 0;
+            _constantValid[i] = SymbolTable::global().numeric(instruction.value, value);
+            _constants[i] = value;
+        }
+        _depth = std::max(_depth, ++depth);
+    }
+    if (depth != 1)
+        throw std::invalid_argument{ "arithmetic code does not leave one value" };
+}
+
+void ArithmeticKernel::evaluate(const Symbol* rows, size_t arity, size_t count, Symbol* values, std::uint8_t* valid) const
+{
+    const Kernels& kernel = kernels();
+    SymbolTable& symbols = SymbolTable::global();
+    std::vector<std::int64_t> stack(_depth * BatchSize);
+    std::vector<std::uint8_t> flags(_depth * BatchSize);
+
+    for (size_t begin = 0; begin < count; begin += BatchSize)
+    {
+        size_t size = std::min(BatchSize, count - begin);
+        size_t top = 0;
+        for (size_t i = 0; i < _code.size(); ++i)
+        {
+            const Instruction& instruction = _code[i];
+            switch (instruction.op)
+            {
+            case Instruction::Op::Column:
+                kernel.decode(rows + begin * arity + instruction.value, arity, size, stack.data() + top * BatchSize,
+                    flags.data() + top * BatchSize);
+                ++top;
+                break;
+            case Instruction::Op::Constant:
+                std::fill_n(stack.data() + top * BatchSize, size, _constants[i]);
+                std::fill_n(flags.data() + top * BatchSize, size, _constantValid[i]);
+                ++top;
+                break;
+            case Instruction::Op::Add:
+            case Instruction::Op::Multiply:
+            {
+                --top;
+                std::int64_t* lhs = stack.data() + (top - 1) * BatchSize;
+                std::uint8_t* lhsValid = flags.data() + (top - 1) * BatchSize;
+                const std::uint8_t* rhsValid = flags.data() + top * BatchSize;
+                for (size_t row = 0; row < size; ++row)
+                    lhsValid[row] &= rhsValid[row];
+                if (instruction.op == Instruction::Op::Add)
+                    kernel.add(lhs, stack.data() + top * BatchSize, lhsValid, size);
+                else
+                    kernel.multiply(lhs, stack.data() + top * BatchSize, lhsValid, size);
+                break;
+            }
+            }
+        }
+
+        // results that fit are inline numbers; the rest are interned as text
+        const std::int64_t* result = stack.data();
+        bool fits = true;
+        for (size_t row = 0; row < size; ++row)
+        {
+            values[begin + row] = SymbolTable::NumberTag | static_cast<Symbol>(result[row]);
+            valid[begin + row] = flags[row];
+            fits &= !flags[row] || (result[row] >= 0 && result[row] <= SymbolTable::MaxNumber);
+        }
+        if (fits)
+            continue;
+        for (size_t row = 0; row < size; ++row)
+        {
+            if (flags[row] && (result[row] < 0 || result[row] > SymbolTable::MaxNumber))
+                values[begin + row] = symbols.number(result[row]);
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "symbols.h"
+
+// Kernels for arithmetic over whole columns. Each comes in a scalar version
+// and, on x86, an AVX2 version that works on 8 Symbols or 4 values per step;
+// the widest one the CPU supports is chosen the first time a kernel runs.
+enum class ArithmeticLevel { Scalar, Avx2 };
+
+ArithmeticLevel arithmeticLevel();
+// lowers (or restores) the level in use, clamped to what the CPU supports;
+// returns the level now in use
+ArithmeticLevel setArithmeticLevel(ArithmeticLevel level);
+
+// An expression compiled to postfix code over the columns of a row-major
+// relation and constants. It runs a batch of rows at a time: every operand
+// becomes an array of 64 bit values with a flag per row, decoded straight
+// from inline numbers (other symbols are parsed from their text), and each
+// operator is one pass over those arrays. A row whose operand is not a
+// number, or whose result overflows, has no value.
+class ArithmeticKernel
+{
+public:
+    struct Instruction
+    {
+        enum class Op : std::uint8_t { Column, Constant, Add, Multiply };
+
+        Op op;
+        Symbol value;  // the column, or the constant
+    };
+
+    explicit ArithmeticKernel(std::vector<Instruction> code);
+
+    // for count rows of the given arity: values[i] is the row's result and
+    // valid[i] whether it has one
+    void evaluate(const Symbol* rows, size_t arity, size_t count, Symbol* values, std::uint8_t* valid) const;
+
+    static constexpr size_t BatchSize = 1024;
+
+private:
+    std::vector<Instruction> _code;
+    std::vector<std::int64_t> _constants;  // decoded, parallel to _code
+    std::vector<std::uint8_t> _constantValid;
+    size_t _depth;
+};
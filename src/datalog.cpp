@@ -0,0 +1,2105 @@
+#include "datalog.h"
+#include "graph.h"
+#include "triejoin.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+
+namespace
+{
+    std::string textOf(Symbol symbol)
+    {
+        SymbolTable::NumberText buffer;
+        return std::string{ SymbolTable::global().text(symbol, buffer) };
+    }
+
+    void saveTerm(std::vector<std::uint32_t>& fields, const Term& term)
+    {
+        fields.push_back(static_cast<std::uint32_t>(term.kind));
+        fields.push_back(term.value);
+    }
+
+    void saveAtom(Snapshot::Writer& out, const Atom& atom)
+    {
+        std::vector<std::uint32_t> fields;
+        for (const Term& term : atom.terms)
+            saveTerm(fields, term);
+        out.put(atom.name);
+        out.put(atom.terms.size());
+        out.put(fields.data(), fields.size());
+    }
+
+    Symbol restoreSymbol(const std::vector<Symbol>& symbols, std::uint64_t symbol)
+    {
+        // inline numbers are the same in every table
+        if (symbol < SymbolTable::NumberTag * std::uint64_t{ 2 } && SymbolTable::isNumber(static_cast<Symbol>(symbol)))
+            return static_cast<Symbol>(symbol);
+        if (symbol >= symbols.size())
+            throw std::runtime_error{ "snapshot refers to an unknown symbol" };
+        return symbols[symbol];
+    }
+
+    Term restoreTerm(const std::vector<Symbol>& symbols, const std::uint32_t* fields)
+    {
+        auto kind = static_cast<Term::Kind>(fields[0]);
+        if (kind == Term::Kind::Expression)
+            return Term{ kind, fields[1] };
+        if (kind != Term::Kind::Constant && kind != Term::Kind::Variable)
+            throw std::runtime_error{ "snapshot has an unknown term kind" };
+        return Term{ kind, restoreSymbol(symbols, fields[1]) };
+    }
+
+    Atom restoreAtom(Snapshot::Reader& in, const std::vector<Symbol>& symbols)
+    {
+        Atom atom{ restoreSymbol(symbols, in.get()), {} };
+        size_t count = in.get();
+        const std::uint32_t* fields = in.get<std::uint32_t>(2 * count);
+        for (size_t i = 0; i < count; ++i)
+            atom.terms.push_back(restoreTerm(symbols, fields + 2 * i));
+        return atom;
+    }
+}
+
+DatalogProgram::DatalogProgram(size_t threads)
+    : _scheduler{ nullptr }
+{
+    if (threads > 1 && threads == Scheduler::shared().threads())
+    {
+        _scheduler = &Scheduler::shared();
+    }
+    else if (threads > 1)
+    {
+        _ownScheduler = std::make_unique<Scheduler>(threads);
+        _scheduler = _ownScheduler.get();
+    }
+}
+
+void DatalogProgram::load(const DatalogAst& ast, QueryEvaluation evaluation)
+{
+    merge({ &ast }, evaluation);
+}
+
+void DatalogProgram::load(const std::vector<DatalogAst>& inputs, QueryEvaluation evaluation)
+{
+    std::vector<const DatalogAst*> asts;
+    for (const DatalogAst& ast : inputs)
+        asts.push_back(&ast);
+    merge(asts, evaluation);
+}
+
+void DatalogProgram::merge(const std::vector<const DatalogAst*>& inputs, QueryEvaluation evaluation)
+{
+    _times.time("relations", [&] { loadRelations(inputs); });
+    _times.time("rules", [&] {
+        for (const DatalogAst* ast : inputs)
+            loadRules(*ast);
+    });
+    for (const DatalogAst* ast : inputs)
+    {
+        for (std::uint32_t index : ast->queries)
+        {
+            _queries.push_back(query(*ast, index));
+            _answers.push_back(_queries.back().name);
+        }
+    }
+    if (evaluation == QueryEvaluation::Demand || (evaluation == QueryEvaluation::Automatic && selective()))
+        _times.time("magic", [&] { rewriteForQueries(); });
+    _times.time("stratify", [&] { stratify(); });
+    auto derived = derivedRelations();
+    for (size_t r = 0; r < _relations.size(); ++r)
+    {
+        _facts.emplace_back(_relations[r].name(), _relations[r].attributes());
+        if (derived[r])
+            _facts.back().assign(_relations[r].data().data(), _relations[r].size());
+    }
+    _times.time("indexes", [&] { chooseIndexes(); });
+}
+
+void DatalogProgram::loadRelations(const std::vector<const DatalogAst*>& inputs)
+{
+    auto inputName = [&inputs](size_t input) {
+        return inputs[input]->source.empty() ? "input " + std::to_string(input + 1) : inputs[input]->source;
+    };
+    auto signature = [](Symbol name, const std::vector<Symbol>& attributes) {
+        std::string text = textOf(name) + "(";
+        for (size_t i = 0; i < attributes.size(); ++i)
+            text += (i == 0 ? "" : ",") + textOf(attributes[i]);
+        return text + ")";
+    };
+
+    // the input that declared each scheme first
+    std::unordered_map<Symbol, size_t> declaredBy;
+    for (size_t input = 0; input < inputs.size(); ++input)
+    {
+        const DatalogAst& ast = *inputs[input];
+        for (std::uint32_t index : ast.schemes)
+        {
+            const auto& scheme = ast.predicates[index];
+            std::vector<Symbol> attributes;
+            for (std::uint32_t i = 0; i < scheme.count; ++i)
+                attributes.push_back(ast.parameters[scheme.first + i].value);
+
+            auto declared = declaredBy.find(scheme.name);
+            if (declared != std::end(declaredBy))
+            {
+                if (declared->second == input)
+                    throw std::invalid_argument{ "scheme " + textOf(scheme.name) + " is declared twice" };
+                const Relation& existing = relation(scheme.name);
+                if (existing.attributes() != attributes)
+                    throw std::invalid_argument{ "scheme " + signature(scheme.name, attributes) + " in " + inputName(input) +
+                        " conflicts with " + signature(scheme.name, existing.attributes()) + " in " + inputName(declared->second) };
+                continue;
+            }
+
+            declaredBy.emplace(scheme.name, input);
+            _relationIndex.emplace(scheme.name, _relations.size());
+            _relations.emplace_back(scheme.name, attributes);
+        }
+    }
+
+    // every relation is filled from its tables in all inputs on its own, so
+    // relations load in parallel, and a large one is also sorted in parallel,
+    // as when every input holds facts of the same relation
+    std::vector<std::vector<const DatalogAst::FactTable*>> tables(_relations.size());
+    for (const DatalogAst* ast : inputs)
+    {
+        for (const auto& table : ast->facts)
+        {
+            if (!hasRelation(table.name))
+                throw std::invalid_argument{ "facts for undeclared scheme " + textOf(table.name) };
+            if (relation(table.name).arity() != table.arity)
+                throw std::invalid_argument{ "facts for " + textOf(table.name) + " have the wrong arity" };
+            tables[_relationIndex.at(table.name)].push_back(&table);
+        }
+    }
+
+    auto fill = [this, &tables](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; ++r)
+        {
+            Relation& target = _relations[r];
+            size_t rows = target.size();
+            for (const auto* table : tables[r])
+                rows += table->size();
+            target.reserve(rows);
+            for (const auto* table : tables[r])
+            {
+                for (size_t row = 0; row < table->size(); ++row)
+                    target.insert(table->values.data() + row * table->arity);
+            }
+            target.normalize(_scheduler);
+        }
+    };
+    if (_scheduler && _relations.size() > 1)
+        _scheduler->parallelFor(_relations.size(), 1, fill);
+    else
+        fill(0, _relations.size());
+}
+
+void DatalogProgram::loadRules(const DatalogAst& ast)
+{
+    for (const auto& rule : ast.rules)
+    {
+        Rule converted{ convert(ast, ast.predicates[rule.head]), {} };
+        for (std::uint32_t i = 1; i <= rule.count; ++i)
+            converted.body.push_back(convert(ast, ast.predicates[rule.head + i]));
+
+        if (!hasRelation(converted.head.name) || relation(converted.head.name).arity() != converted.head.terms.size())
+            throw std::invalid_argument{ "rule head " + describe(converted.head) + " does not match a scheme" };
+        // the variables the body binds, which the head and expressions use
+        std::vector<Symbol> variables;
+        for (const Atom& atom : converted.body)
+        {
+            for (const Term& term : atom.terms)
+            {
+                if (term.kind == Term::Kind::Variable)
+                    variables.push_back(term.value);
+            }
+        }
+        for (const Term& term : converted.head.terms)
+        {
+            bool bound = term.kind != Term::Kind::Variable
+                || std::find(std::cbegin(variables), std::cend(variables), term.value) != std::cend(variables);
+            if (!bound)
+                throw std::invalid_argument{ "head variable " + describe(term) + " is not bound in " + describe(converted) };
+            requireBound(term, variables, describe(converted));
+        }
+        for (const Atom& atom : converted.body)
+        {
+            for (const Term& term : atom.terms)
+                requireBound(term, variables, describe(converted));
+        }
+        _origins.push_back(_rules.size());
+        _rules.push_back(converted);
+        _joinAlgorithms.push_back(resolve(converted, JoinAlgorithm::Automatic));
+    }
+}
+
+void DatalogProgram::load(const LL1Parser& parser, const std::filesystem::path& filename, QueryEvaluation evaluation)
+{
+    load(parseDatalog(parser, filename, true, _scheduler), evaluation);
+}
+
+void DatalogProgram::load(const LL1Parser& parser, const std::vector<std::filesystem::path>& inputs, QueryEvaluation evaluation)
+{
+    load(parseDatalogInputs(parser, inputs, _scheduler), evaluation);
+}
+
+Atom DatalogProgram::query(const DatalogAst& ast, std::uint32_t predicate)
+{
+    Atom query = convert(ast, ast.predicates[predicate]);
+    std::vector<Symbol> variables;
+    for (const Term& term : query.terms)
+    {
+        if (term.kind == Term::Kind::Variable)
+            variables.push_back(term.value);
+    }
+    for (const Term& term : query.terms)
+        requireBound(term, variables, describe(query));
+    return query;
+}
+
+bool DatalogProgram::demandDriven() const
+{
+    for (size_t q = 0; q < _queries.size(); ++q)
+    {
+        if (_answers[q] != _queries[q].name)
+            return true;
+    }
+    return false;
+}
+
+void DatalogProgram::save(const std::filesystem::path& filename) const
+{
+    settle();
+    Snapshot::Writer out{ filename, _evaluated ? std::uint64_t{ Snapshot::Evaluated } : 0 };
+
+    // every symbol in id order, so a restore that interns them in the same
+    // order into the same table gets the same ids
+    SymbolTable& symbols = SymbolTable::global();
+    size_t count = symbols.size();
+    std::vector<std::uint64_t> offsets{ 0 };
+    offsets.reserve(count + 1);
+    for (Symbol symbol = 0; symbol < count; ++symbol)
+        offsets.push_back(offsets.back() + symbols.text(symbol).size());
+    std::string texts;
+    texts.reserve(offsets.back());
+    for (Symbol symbol = 0; symbol < count; ++symbol)
+        texts += symbols.text(symbol);
+    out.put(count);
+    out.put(offsets.data(), offsets.size());
+    out.put(texts.data(), texts.size());
+
+    out.put(_relations.size());
+    for (size_t r = 0; r < _relations.size(); ++r)
+    {
+        const Relation& stored = _relations[r];
+        out.put(stored.name());
+        out.put(stored.arity());
+        out.put(stored.size());
+        out.put(stored.attributes().data(), stored.arity());
+        out.put(stored.data().data(), stored.size() * stored.arity());
+        out.put(_indexes[r].size());
+        for (const Index& index : _indexes[r])
+            index.save(out);
+        out.put(_facts[r].size());
+        out.put(_facts[r].data().data(), _facts[r].size() * stored.arity());
+    }
+
+    out.put(_rules.size());
+    for (size_t r = 0; r < _rules.size(); ++r)
+    {
+        saveAtom(out, _rules[r].head);
+        out.put(_rules[r].body.size());
+        for (const Atom& atom : _rules[r].body)
+            saveAtom(out, atom);
+        out.put(static_cast<std::uint64_t>(_joinAlgorithms[r]));
+    }
+
+    out.put(_queries.size());
+    for (size_t q = 0; q < _queries.size(); ++q)
+    {
+        saveAtom(out, _queries[q]);
+        out.put(_answers[q]);
+    }
+
+    std::vector<std::uint32_t> fields;
+    for (const Expression& expression : _expressions)
+    {
+        saveTerm(fields, expression.lhs);
+        fields.push_back(static_cast<unsigned char>(expression.op));
+        saveTerm(fields, expression.rhs);
+    }
+    out.put(_expressions.size());
+    out.put(fields.data(), fields.size());
+
+    out.finish();
+}
+
+void DatalogProgram::restore(std::string_view snapshot, bool verify)
+{
+    if (!_relations.empty() || !_rules.empty() || !_queries.empty())
+        throw std::logic_error{ "a snapshot can only be restored into an empty program" };
+
+    auto timer = _times.measure("restore");
+    Snapshot::Reader in{ snapshot, verify };
+
+    SymbolTable& table = SymbolTable::global();
+    std::vector<Symbol> symbols(in.get());
+    const std::uint64_t* offsets = in.get<std::uint64_t>(symbols.size() + 1);
+    const char* texts = in.get<char>(offsets[symbols.size()]);
+    bool renumbered = false;
+    for (size_t symbol = 0; symbol < symbols.size(); ++symbol)
+    {
+        if (offsets[symbol] > offsets[symbol + 1] || offsets[symbol + 1] > offsets[symbols.size()])
+            throw std::runtime_error{ "snapshot symbol table is damaged" };
+        symbols[symbol] = table.intern(std::string_view{ texts + offsets[symbol], offsets[symbol + 1] - offsets[symbol] });
+        renumbered |= symbols[symbol] != symbol;
+    }
+
+    size_t relations = in.get();
+    _indexes.assign(relations, {});
+    for (size_t r = 0; r < relations; ++r)
+    {
+        Symbol name = restoreSymbol(symbols, in.get());
+        size_t arity = in.get();
+        size_t size = in.get();
+        const Symbol* stored = in.get<Symbol>(arity);
+        std::vector<Symbol> attributes;
+        for (size_t column = 0; column < arity; ++column)
+            attributes.push_back(restoreSymbol(symbols, stored[column]));
+        if (hasRelation(name))
+            throw std::runtime_error{ "snapshot has relation " + textOf(name) + " twice" };
+
+        auto restoreRows = [&](Relation& target, size_t size) {
+            const Symbol* rows = in.get<Symbol>(size * arity);
+            if (!renumbered)
+            {
+                target.assign(rows, size);
+                return;
+            }
+            std::vector<Symbol> row(arity);
+            target.reserve(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                for (size_t column = 0; column < arity; ++column)
+                    row[column] = restoreSymbol(symbols, rows[i * arity + column]);
+                target.insert(row.data());
+            }
+            target.normalize();
+        };
+
+        _relationIndex.emplace(name, _relations.size());
+        Relation& target = _relations.emplace_back(name, attributes);
+        restoreRows(target, size);
+
+        size_t indexes = in.get();
+        for (size_t i = 0; i < indexes; ++i)
+        {
+            _indexes[r].push_back(Index::restore(in, arity, !renumbered));
+            if (renumbered)
+                _indexes[r].back().insert(target);
+        }
+        restoreRows(_facts.emplace_back(name, attributes), in.get());
+    }
+
+    size_t rules = in.get();
+    for (size_t r = 0; r < rules; ++r)
+    {
+        Rule rule{ restoreAtom(in, symbols), {} };
+        size_t body = in.get();
+        for (size_t i = 0; i < body; ++i)
+            rule.body.push_back(restoreAtom(in, symbols));
+        auto algorithm = static_cast<JoinAlgorithm>(in.get());
+        if (algorithm > JoinAlgorithm::Leapfrog)
+            throw std::runtime_error{ "snapshot has an unknown join algorithm" };
+        if (!hasRelation(rule.head.name))
+            throw std::runtime_error{ "snapshot rule head " + describe(rule.head) + " does not match a relation" };
+        _joinAlgorithms.push_back(resolve(rule, algorithm));
+        _origins.push_back(_rules.size());
+        _rules.push_back(std::move(rule));
+    }
+    _plans.assign(_rules.size(), {});
+
+    size_t queries = in.get();
+    for (size_t q = 0; q < queries; ++q)
+    {
+        _queries.push_back(restoreAtom(in, symbols));
+        _answers.push_back(restoreSymbol(symbols, in.get()));
+    }
+
+    size_t expressions = in.get();
+    const std::uint32_t* fields = in.get<std::uint32_t>(5 * expressions);
+    for (size_t e = 0; e < expressions; ++e)
+    {
+        const std::uint32_t* expression = fields + 5 * e;
+        _expressions.push_back(Expression{ restoreTerm(symbols, expression), static_cast<char>(expression[2]),
+            restoreTerm(symbols, expression + 3) });
+    }
+
+    stratify();
+    _evaluated = (in.flags() & Snapshot::Evaluated) != 0;
+}
+
+bool DatalogProgram::evaluated() const { return _evaluated; }
+
+bool DatalogProgram::hasRelation(Symbol name) const { return _relationIndex.count(name) > 0; }
+
+const Relation& DatalogProgram::relation(Symbol name) const { return settled(stored(name)); }
+
+const Relation& DatalogProgram::stored(Symbol name) const
+{
+    auto it = _relationIndex.find(name);
+    if (it == std::end(_relationIndex))
+        throw std::out_of_range{ "unknown relation " + textOf(name) };
+    return _relations[it->second];
+}
+
+const Relation& DatalogProgram::settled(const Relation& rows) const
+{
+    if (&rows < _relations.data() || &rows >= _relations.data() + _relations.size())
+        return rows;
+    std::lock_guard<std::mutex> lock{ *_settling };
+    _relations[static_cast<size_t>(&rows - _relations.data())].settle();
+    return rows;
+}
+
+void DatalogProgram::settle() const
+{
+    std::lock_guard<std::mutex> lock{ *_settling };
+    for (Relation& rows : _relations)
+        rows.settle();
+    for (Relation& rows : _facts)
+        rows.settle();
+}
+
+Relation& DatalogProgram::relation(Symbol name)
+{
+    return const_cast<Relation&>(static_cast<const DatalogProgram&>(*this).relation(name));
+}
+
+const std::vector<Index>& DatalogProgram::indexes(Symbol name) const
+{
+    stored(name);
+    return _indexes[_relationIndex.at(name)];
+}
+
+const std::vector<Relation>& DatalogProgram::relations() const
+{
+    settle();
+    return _relations;
+}
+
+const std::vector<Rule>& DatalogProgram::rules() const { return _rules; }
+
+const std::vector<Rule>& DatalogProgram::loadedRules() const { return _loadedRules.empty() ? _rules : _loadedRules; }
+
+size_t DatalogProgram::origin(size_t rule) const { return _origins.at(rule); }
+
+void DatalogProgram::setJoinAlgorithm(size_t rule, JoinAlgorithm algorithm)
+{
+    _joinAlgorithms.at(rule) = resolve(_rules.at(rule), algorithm);
+}
+
+JoinAlgorithm DatalogProgram::joinAlgorithm(size_t rule) const { return _joinAlgorithms.at(rule); }
+
+const std::vector<Stratum>& DatalogProgram::strata() const { return _strata; }
+
+const std::vector<Atom>& DatalogProgram::queries() const { return _queries; }
+
+const std::vector<Symbol>& DatalogProgram::answers() const { return _answers; }
+
+const std::vector<Expression>& DatalogProgram::expressions() const { return _expressions; }
+
+const PhaseTimes& DatalogProgram::times() const { return _times; }
+
+Relation DatalogProgram::evaluate(const Atom& atom) const { return evaluate(atom, stored(atom.name)); }
+
+Relation DatalogProgram::evaluate(const Atom& atom, const Relation& source, std::pmr::memory_resource* resource) const
+{
+    if (source.arity() != atom.terms.size())
+        throw std::invalid_argument{ describe(atom) + " does not match the arity of its scheme" };
+
+    std::vector<std::pair<Symbol, Term>> checks;
+    Atom plain = withoutExpressions(atom, checks);
+    if (!checks.empty())
+    {
+        Relation selected = check(evaluate(plain, source, resource), checks);
+        std::vector<size_t> columns;
+        std::vector<Symbol> variables;
+        for (size_t column = 0; column < selected.arity(); ++column)
+        {
+            Symbol attribute = selected.attributes()[column];
+            if (std::none_of(std::cbegin(checks), std::cend(checks), [attribute](const auto& check) { return check.first == attribute; }))
+            {
+                columns.push_back(column);
+                variables.push_back(attribute);
+            }
+        }
+        return selected.project(columns).rename(variables);
+    }
+
+    // the constants and repeated variables every row must match, and the
+    // first column of each distinct variable
+    std::vector<std::pair<size_t, Symbol>> constants;
+    std::vector<std::pair<size_t, size_t>> repeats;
+    std::vector<size_t> columns;
+    std::vector<Symbol> variables;
+    for (size_t column = 0; column < atom.terms.size(); ++column)
+    {
+        const Term& term = atom.terms[column];
+        if (term.kind == Term::Kind::Constant)
+        {
+            constants.emplace_back(column, term.value);
+            continue;
+        }
+
+        auto seen = std::find(std::cbegin(variables), std::cend(variables), term.value);
+        if (seen == std::cend(variables))
+        {
+            columns.push_back(column);
+            variables.push_back(term.value);
+        }
+        else
+        {
+            repeats.emplace_back(columns[static_cast<size_t>(std::distance(std::cbegin(variables), seen))], column);
+        }
+    }
+    auto matches = [&constants, &repeats](const Symbol* row) {
+        for (const auto& [column, value] : constants)
+        {
+            if (row[column] != value)
+                return false;
+        }
+        for (const auto& [first, column] : repeats)
+        {
+            if (row[first] != row[column])
+                return false;
+        }
+        return true;
+    };
+
+    // select in one pass, starting from the rows an index finds for the
+    // constants if one does
+    size_t length = 0;
+    const Index* index = &source == &stored(atom.name)
+        ? findIndex(atom, bound(atom, {}), length)
+        : nullptr;
+    Relation selected{ source.name(), source.attributes(), resource };
+    if (index == nullptr)
+    {
+        const Relation& rows = settled(source);
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            if (matches(rows.row(i)))
+                selected.insert(rows.row(i));
+        }
+    }
+    else
+    {
+        std::vector<Symbol> key;
+        for (size_t k = 0; k < length; ++k)
+            key.push_back(atom.terms[index->key()[k]].value);
+        bool found = false;
+        index->lookup(key.data(), length, [&selected, &matches, &found](const Symbol* row) {
+            found = true;
+            if (matches(row))
+                selected.insert(row);
+        });
+        index->count(1, found ? 1 : 0);
+        selected.normalize();
+    }
+
+    return selected.project(columns).rename(variables);
+}
+
+Relation DatalogProgram::evaluate(const Rule& rule, size_t delta, const Relation* deltaRelation, std::pmr::memory_resource* resource) const
+{
+    auto r = static_cast<size_t>(&rule - _rules.data());
+    PlanCache* plans = r < _plans.size() ? &_plans[r] : nullptr;
+    return join(rule, _joinAlgorithms[r], delta, deltaRelation, resource, plans);
+}
+
+Relation DatalogProgram::join(const Rule& rule, JoinAlgorithm algorithm, size_t delta, const Relation* deltaRelation,
+    std::pmr::memory_resource* resource, PlanCache* plans) const
+{
+    std::vector<std::pair<Symbol, Term>> checks;
+    Rule plain{ rule.head, {} };
+    for (const Atom& atom : rule.body)
+        plain.body.push_back(withoutExpressions(atom, checks));
+
+    std::optional<Relation> joined;
+    if (algorithm == JoinAlgorithm::Leapfrog)
+    {
+        // the variable order comes from the atoms, so inputs that a sorted
+        // index keeps in it are read from the index instead of sorted again
+        std::vector<std::vector<Symbol>> variables;
+        for (const Atom& atom : plain.body)
+        {
+            variables.emplace_back();
+            for (const Term& term : atom.terms)
+            {
+                if (term.kind == Term::Kind::Variable && std::find(std::cbegin(variables.back()), std::cend(variables.back()), term.value) == std::cend(variables.back()))
+                    variables.back().push_back(term.value);
+            }
+        }
+        std::vector<Symbol> order = leapfrogOrder(variables);
+
+        std::vector<Relation> inputs;
+        for (size_t i = 0; i < plain.body.size() && (inputs.empty() || !inputs.back().empty()); ++i)
+        {
+            const Atom& atom = plain.body[i];
+            std::optional<Relation> ordered;
+            if (deltaRelation == nullptr || i != delta)
+                ordered = inOrder(atom, order, resource);
+            inputs.push_back(ordered ? std::move(*ordered)
+                : evaluate(atom, deltaRelation != nullptr && i == delta ? *deltaRelation : stored(atom.name), resource));
+        }
+        if (inputs.back().empty())
+            return Relation{ rule.head.name, stored(rule.head.name).attributes(), resource };
+        joined = leapfrogJoin(rule.head.name, inputs, order);
+    }
+    else
+    {
+        std::optional<JoinPlan> fresh;
+        const JoinPlan& order = plans != nullptr ? reuse(*plans, plain, delta, deltaRelation)
+            : fresh.emplace(plan(plain, delta, deltaRelation));
+        for (const JoinPlan::Step& step : order.steps)
+        {
+            const Atom& atom = plain.body[step.atom];
+            if (step.index != nullptr)
+            {
+                joined = probe(*joined, atom, *step.index, step.length);
+            }
+            else
+            {
+                Relation current = evaluate(atom, step.delta ? *deltaRelation : stored(atom.name), resource);
+                joined = joined ? joined->join(current, _scheduler) : std::move(current);
+            }
+            if (joined->empty())
+                break;
+        }
+    }
+
+    if (!checks.empty() && !joined->empty())
+        joined = check(*joined, checks);
+    if (joined->empty())
+        return Relation{ rule.head.name, stored(rule.head.name).attributes(), resource };
+
+    std::vector<size_t> columns;
+    for (const Term& term : rule.head.terms)
+    {
+        const auto& attributes = joined->attributes();
+        auto it = std::find(std::cbegin(attributes), std::cend(attributes), term.value);
+        columns.push_back(static_cast<size_t>(std::distance(std::cbegin(attributes), it)));
+    }
+    bool variables = std::all_of(std::cbegin(rule.head.terms), std::cend(rule.head.terms), [](const Term& term) {
+        return term.kind == Term::Kind::Variable;
+    });
+    if (variables)
+        return joined->project(columns).rename(stored(rule.head.name).attributes());
+
+    // constants and expressions in the head: the expressions are computed
+    // over all rows first, and rows without a value are dropped
+    std::vector<std::vector<Symbol>> computed(rule.head.terms.size());
+    std::vector<std::uint8_t> keep(joined->size(), 1);
+    std::vector<std::uint8_t> valid;
+    for (size_t column = 0; column < rule.head.terms.size(); ++column)
+    {
+        if (rule.head.terms[column].kind != Term::Kind::Expression)
+            continue;
+        compute(rule.head.terms[column], *joined, computed[column], valid);
+        for (size_t i = 0; i < keep.size(); ++i)
+            keep[i] &= valid[i];
+    }
+
+    Relation result{ rule.head.name, stored(rule.head.name).attributes(), resource };
+    result.reserve(joined->size());
+    std::vector<Symbol> tuple(rule.head.terms.size());
+    for (size_t i = 0; i < joined->size(); ++i)
+    {
+        if (!keep[i])
+            continue;
+        for (size_t column = 0; column < tuple.size(); ++column)
+        {
+            const Term& term = rule.head.terms[column];
+            if (term.kind == Term::Kind::Variable)
+                tuple[column] = joined->row(i)[columns[column]];
+            else if (term.kind == Term::Kind::Constant)
+                tuple[column] = term.value;
+            else
+                tuple[column] = computed[column][i];
+        }
+        result.insert(tuple.data());
+    }
+    result.normalize();
+    return result;
+}
+
+Atom DatalogProgram::withoutExpressions(const Atom& atom, std::vector<std::pair<Symbol, Term>>& checks) const
+{
+    Atom plain = atom;
+    for (Term& term : plain.terms)
+    {
+        if (term.kind != Term::Kind::Expression)
+            continue;
+        // identifiers cannot start with $, so these never clash with the rule's variables
+        Symbol fresh = SymbolTable::global().intern("$" + std::to_string(checks.size()));
+        checks.emplace_back(fresh, term);
+        term = Term{ Term::Kind::Variable, fresh };
+    }
+    return plain;
+}
+
+Relation DatalogProgram::check(const Relation& rows, const std::vector<std::pair<Symbol, Term>>& checks) const
+{
+    std::vector<std::uint8_t> keep(rows.size(), 1);
+    std::vector<Symbol> values;
+    std::vector<std::uint8_t> valid;
+    for (const auto& [variable, expression] : checks)
+    {
+        const auto& attributes = rows.attributes();
+        auto column = static_cast<size_t>(std::distance(std::cbegin(attributes),
+            std::find(std::cbegin(attributes), std::cend(attributes), variable)));
+        compute(expression, rows, values, valid);
+        for (size_t i = 0; i < rows.size(); ++i)
+            keep[i] &= valid[i] & (rows.row(i)[column] == values[i]);
+    }
+    return rows.filter(keep);
+}
+
+void DatalogProgram::compute(const Term& expression, const Relation& rows, std::vector<Symbol>& values,
+    std::vector<std::uint8_t>& valid) const
+{
+    ArithmeticKernel kernel = compile(expression, rows.attributes());
+    values.resize(rows.size());
+    valid.resize(rows.size());
+    auto run = [&](size_t begin, size_t end) {
+        kernel.evaluate(rows.data().data() + begin * rows.arity(), rows.arity(), end - begin, values.data() + begin,
+            valid.data() + begin);
+    };
+    if (_scheduler && rows.size() >= 2 * Relation::ParallelGrain)
+        _scheduler->parallelFor(rows.size(), Relation::ParallelGrain, run);
+    else
+        run(0, rows.size());
+}
+
+ArithmeticKernel DatalogProgram::compile(const Term& expression, const std::vector<Symbol>& attributes) const
+{
+    using Op = ArithmeticKernel::Instruction::Op;
+    std::vector<ArithmeticKernel::Instruction> code;
+    std::function<void(const Term&)> emit = [&](const Term& term) {
+        if (term.kind == Term::Kind::Constant)
+        {
+            code.push_back({ Op::Constant, term.value });
+            return;
+        }
+        if (term.kind == Term::Kind::Variable)
+        {
+            auto it = std::find(std::cbegin(attributes), std::cend(attributes), term.value);
+            if (it == std::cend(attributes))
+                throw std::invalid_argument{ "variable " + describe(term) + " of " + describe(expression) + " is not bound" };
+            code.push_back({ Op::Column, static_cast<Symbol>(std::distance(std::cbegin(attributes), it)) });
+            return;
+        }
+        const Expression& inner = _expressions[term.value];
+        emit(inner.lhs);
+        emit(inner.rhs);
+        code.push_back({ inner.op == '+' ? Op::Add : Op::Multiply, 0 });
+    };
+    emit(expression);
+    return ArithmeticKernel{ std::move(code) };
+}
+
+void DatalogProgram::variablesOf(const Term& term, std::vector<Symbol>& variables) const
+{
+    if (term.kind == Term::Kind::Variable)
+        variables.push_back(term.value);
+    if (term.kind != Term::Kind::Expression)
+        return;
+    variablesOf(_expressions[term.value].lhs, variables);
+    variablesOf(_expressions[term.value].rhs, variables);
+}
+
+void DatalogProgram::requireBound(const Term& term, const std::vector<Symbol>& variables, const std::string& where) const
+{
+    if (term.kind != Term::Kind::Expression)
+        return;
+    std::vector<Symbol> used;
+    variablesOf(term, used);
+    for (Symbol variable : used)
+    {
+        if (std::find(std::cbegin(variables), std::cend(variables), variable) == std::cend(variables))
+            throw std::invalid_argument{ "variable " + textOf(variable) + " of " + describe(term) + " is not bound in " + where };
+    }
+}
+
+EvaluationStats DatalogProgram::evaluateRules()
+{
+    auto timer = _times.measure("evaluate");
+    settle();
+    EvaluationStats stats;
+    stats.derived.assign(_rules.size(), 0);
+    stats.derivedByPass.assign(_rules.size(), {});
+    stats.passes.assign(_strata.size(), 0);
+    stats.seconds.assign(_strata.size(), 0);
+    if (!_scheduler)
+    {
+        for (size_t s = 0; s < _strata.size(); ++s)
+            evaluate(s, stats);
+    }
+    else
+    {
+        // A stratum only reads relations of the strata before it and writes
+        // its own heads, so it can start once those are done. Each stratum is
+        // evaluated the same way as sequentially, so the result is too.
+        std::vector<size_t> stratumOf(_relations.size(), _strata.size());
+        for (size_t s = 0; s < _strata.size(); ++s)
+        {
+            for (size_t r : _strata[s].rules)
+                stratumOf[_relationIndex.at(_rules[r].head.name)] = s;
+        }
+
+        std::vector<std::vector<size_t>> dependents(_strata.size());
+        std::vector<std::atomic<size_t>> waiting(_strata.size());
+        for (size_t s = 0; s < _strata.size(); ++s)
+        {
+            std::vector<size_t> inputs;
+            for (size_t r : _strata[s].rules)
+            {
+                for (const Atom& atom : _rules[r].body)
+                {
+                    size_t input = stratumOf[_relationIndex.at(atom.name)];
+                    if (input != s && input != _strata.size())
+                        inputs.push_back(input);
+                }
+            }
+            std::sort(std::begin(inputs), std::end(inputs));
+            inputs.erase(std::unique(std::begin(inputs), std::end(inputs)), std::end(inputs));
+            for (size_t input : inputs)
+                dependents[input].push_back(s);
+            waiting[s].store(inputs.size());
+        }
+
+        Scheduler::Group group;
+        std::function<void(size_t)> launch = [&](size_t s) {
+            _scheduler->run(group, [&, s] {
+                evaluate(s, stats);
+                for (size_t next : dependents[s])
+                {
+                    if (waiting[next].fetch_sub(1) == 1)
+                        launch(next);
+                }
+            });
+        };
+        for (size_t s = 0; s < _strata.size(); ++s)
+        {
+            if (waiting[s].load() == 0)
+                launch(s);
+        }
+        _scheduler->wait(group);
+    }
+
+    for (size_t passes : stats.passes)
+        stats.iterations += passes;
+    _evaluated = true;
+    return stats;
+}
+
+void DatalogProgram::evaluate(size_t stratum, EvaluationStats& stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    stats.passes[stratum] = evaluate(_strata[stratum], stats);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.seconds[stratum] = elapsed.count();
+}
+
+size_t DatalogProgram::evaluate(const Stratum& stratum, EvaluationStats& stats)
+{
+    // each rule of the stratum records the tuples it adds in each pass
+    auto record = [&stats](size_t rule, size_t pass, size_t added) {
+        stats.derived[rule] += added;
+        auto& byPass = stats.derivedByPass[rule];
+        if (byPass.size() <= pass)
+            byPass.resize(pass + 1, 0);
+        byPass[pass] += added;
+    };
+
+    // Intermediate relations of a rule live in scratch until its result is
+    // added. The deltas read in a pass and those written for the next live in
+    // two arenas that swap roles, so each pass frees the old deltas at once.
+    std::pmr::monotonic_buffer_resource scratch;
+    std::array<std::pmr::monotonic_buffer_resource, 2> arenas;
+    size_t current = 0;
+
+    // the first pass sees every fact as new
+    std::unordered_map<Symbol, Relation> deltas;
+    for (size_t r : stratum.rules)
+    {
+        const Rule& rule = _rules[r];
+        Relation added = add(rule.head.name, evaluate(rule, 0, nullptr, &scratch));
+        scratch.release();
+        record(r, 0, added.size());
+        if (stratum.recursive)
+        {
+            auto it = deltas.try_emplace(rule.head.name, rule.head.name, added.attributes(), &arenas[current]).first;
+            it->second.unite(added);
+        }
+    }
+
+    // body atoms from earlier strata are complete, so only the heads of this
+    // stratum ever have a delta
+    size_t passes = 1;
+    while (std::any_of(std::cbegin(deltas), std::cend(deltas), [](const auto& delta) { return !delta.second.empty(); }))
+    {
+        std::unordered_map<Symbol, Relation> next;
+        for (size_t r : stratum.rules)
+        {
+            const Rule& rule = _rules[r];
+            for (size_t i = 0; i < rule.body.size(); ++i)
+            {
+                auto delta = deltas.find(rule.body[i].name);
+                if (delta == std::end(deltas) || delta->second.empty())
+                    continue;
+
+                Relation added = add(rule.head.name, evaluate(rule, i, &delta->second, &scratch));
+                scratch.release();
+                record(r, passes, added.size());
+                auto it = next.try_emplace(rule.head.name, rule.head.name, added.attributes(), &arenas[1 - current]).first;
+                it->second.unite(added);
+            }
+        }
+        deltas = std::move(next);
+        arenas[current].release();
+        current = 1 - current;
+        ++passes;
+    }
+
+    return passes;
+}
+
+UpdateStats DatalogProgram::update(const std::vector<FactChange>& changes)
+{
+    if (!_evaluated)
+        evaluateRules();
+    auto timer = _times.measure("update");
+
+    auto empty = [this] {
+        std::vector<Relation> result;
+        for (const Relation& stored : _relations)
+            result.emplace_back(stored.name(), stored.attributes());
+        return result;
+    };
+    std::vector<Relation> retracted = empty();
+    std::vector<Relation> inserted = empty();
+    for (const FactChange& change : changes)
+    {
+        auto it = _relationIndex.find(change.relation);
+        if (it == std::end(_relationIndex))
+            throw std::invalid_argument{ "facts for undeclared scheme " + textOf(change.relation) };
+        if (change.row.size() != _relations[it->second].arity())
+            throw std::invalid_argument{ "facts for " + textOf(change.relation) + " have the wrong arity" };
+        (change.retract ? retracted : inserted)[it->second].insert(change.row.data());
+    }
+
+    // Retracted facts seed the deletions. For a relation only facts fill,
+    // they are the rows of it that were retracted; for one that rules derive
+    // into too, the retracted facts are deleted and rederived if they still
+    // follow from the rules.
+    auto derived = derivedRelations();
+    std::vector<Relation> deleted = empty();
+    for (size_t r = 0; r < _relations.size(); ++r)
+    {
+        retracted[r].normalize();
+        inserted[r].normalize();
+        if (derived[r])
+        {
+            deleted[r] = _facts[r].retract(retracted[r]);
+            _facts[r].stage(inserted[r]);
+        }
+        else
+        {
+            for (size_t i = 0; i < retracted[r].size(); ++i)
+            {
+                if (_relations[r].contains(retracted[r].row(i)))
+                    deleted[r].insert(retracted[r].row(i));
+            }
+        }
+    }
+
+    // Over-delete, with every relation as it was: whatever a rule derives
+    // with one body atom read from the deleted tuples. Lower strata are done
+    // when a stratum starts, so their deletions are read in its first pass.
+    auto index = [this](Symbol name) { return _relationIndex.at(name); };
+    for (const Stratum& stratum : _strata)
+    {
+        std::unordered_map<Symbol, Relation> deltas;
+        for (size_t pass = 0; pass == 0 || !deltas.empty(); ++pass)
+        {
+            std::unordered_map<Symbol, Relation> next;
+            for (size_t r : stratum.rules)
+            {
+                const Rule& rule = _rules[r];
+                for (size_t i = 0; i < rule.body.size(); ++i)
+                {
+                    auto delta = deltas.find(rule.body[i].name);
+                    const Relation* rows = delta != std::end(deltas) ? &delta->second
+                        : pass == 0 ? &deleted[index(rule.body[i].name)]
+                        : nullptr;
+                    if (rows == nullptr || rows->empty())
+                        continue;
+
+                    Relation gone = deleted[index(rule.head.name)].unite(evaluate(rule, i, rows));
+                    if (!gone.empty())
+                        next.try_emplace(rule.head.name, rule.head.name, gone.attributes()).first->second.unite(gone);
+                }
+            }
+            deltas = std::move(next);
+        }
+    }
+
+    UpdateStats stats;
+    for (size_t r = 0; r < _relations.size(); ++r)
+    {
+        deleted[r].normalize();
+        stats.overdeleted += deleted[r].size();
+        if (!deleted[r].empty())
+            retract(_relations[r].name(), deleted[r]);
+    }
+
+    // Rederive and insert, stratum by stratum: a deleted tuple comes back if
+    // it is still a fact or a rule derives it from what is left, which a
+    // rule finds by joining its body with the deleted tuples of its head.
+    // Inserted facts and rederived tuples are then propagated semi-naively.
+    std::vector<Relation> gained = empty();
+    for (size_t r = 0; r < _relations.size(); ++r)
+    {
+        if (!derived[r])
+            gained[r] = stage(_relations[r].name(), inserted[r]);
+    }
+    for (const Stratum& stratum : _strata)
+    {
+        std::unordered_map<Symbol, Relation> deltas;
+        for (size_t r : stratum.rules)
+        {
+            const Rule& rule = _rules[r];
+            size_t head = index(rule.head.name);
+            if (deltas.count(rule.head.name) == 0)
+            {
+                Relation back{ rule.head.name, _relations[head].attributes() };
+                for (size_t i = 0; i < deleted[head].size(); ++i)
+                {
+                    if (_facts[head].contains(deleted[head].row(i)))
+                        back.insert(deleted[head].row(i));
+                }
+                back.normalize();
+                back.unite(inserted[head]);
+                deltas.emplace(rule.head.name, stage(rule.head.name, back));
+            }
+            if (deleted[head].empty())
+                continue;
+
+            Rule rederive{ rule.head, { rule.head } };
+            rederive.body.insert(std::end(rederive.body), std::cbegin(rule.body), std::cend(rule.body));
+            deltas.at(rule.head.name).unite(stage(rule.head.name, join(rederive, JoinAlgorithm::Binary, 0, &deleted[head])));
+        }
+
+        for (size_t pass = 0; pass == 0 || !deltas.empty(); ++pass)
+        {
+            std::unordered_map<Symbol, Relation> next;
+            for (auto& [name, delta] : deltas)
+                gained[index(name)].unite(delta);
+            for (size_t r : stratum.rules)
+            {
+                const Rule& rule = _rules[r];
+                for (size_t i = 0; i < rule.body.size(); ++i)
+                {
+                    auto delta = deltas.find(rule.body[i].name);
+                    const Relation* rows = delta != std::end(deltas) ? &delta->second
+                        : pass == 0 ? &gained[index(rule.body[i].name)]
+                        : nullptr;
+                    if (rows == nullptr || rows->empty())
+                        continue;
+
+                    Relation added = stage(rule.head.name, evaluate(rule, i, rows));
+                    if (!added.empty())
+                        next.try_emplace(rule.head.name, rule.head.name, added.attributes()).first->second.unite(added);
+                }
+            }
+            deltas = std::move(next);
+        }
+    }
+
+    // the tuples deleted and gained again cancel out
+    for (size_t r = 0; r < _relations.size(); ++r)
+    {
+        Relation added = gained[r];
+        added.subtract(deleted[r]);
+        stats.relations.push_back(_relations[r].name());
+        stats.added.push_back(added.size());
+        stats.removed.push_back(deleted[r].size() - (gained[r].size() - added.size()));
+    }
+    return stats;
+}
+
+void DatalogProgram::stratify()
+{
+    // an edge from each head to the predicates its body reads
+    Graph dependencies{ _relations.size() };
+    for (const Rule& rule : _rules)
+    {
+        size_t head = _relationIndex.at(rule.head.name);
+        for (const Atom& atom : rule.body)
+        {
+            auto it = _relationIndex.find(atom.name);
+            if (it == std::end(_relationIndex))
+                throw std::invalid_argument{ "rule body " + describe(atom) + " does not match a scheme" };
+            dependencies.addEdge(head, it->second);
+        }
+    }
+
+    std::vector<size_t> componentOf(_relations.size());
+    auto components = dependencies.components();
+    for (size_t c = 0; c < components.size(); ++c)
+    {
+        for (size_t node : components[c])
+            componentOf[node] = c;
+    }
+
+    std::vector<Stratum> strata(components.size());
+    for (size_t r = 0; r < _rules.size(); ++r)
+        strata[componentOf[_relationIndex.at(_rules[r].head.name)]].rules.push_back(r);
+
+    _strata.clear();
+    for (size_t c = 0; c < components.size(); ++c)
+    {
+        if (strata[c].rules.empty())
+            continue;
+        size_t node = components[c].front();
+        strata[c].recursive = components[c].size() > 1 || dependencies.hasEdge(node, node);
+        _strata.push_back(std::move(strata[c]));
+    }
+}
+
+const std::string& DatalogProgram::rewriteFallback() const { return _rewriteFallback; }
+
+bool DatalogProgram::selective() const
+{
+    auto derived = derivedRelations();
+    bool any = false;
+    for (const Atom& query : _queries)
+    {
+        auto it = _relationIndex.find(query.name);
+        if (it == std::end(_relationIndex) || !derived[it->second])
+            continue;
+        any = true;
+        bool bound = std::any_of(std::cbegin(query.terms), std::cend(query.terms), [](const Term& term) {
+            return term.kind == Term::Kind::Constant;
+        });
+        if (!bound)
+            return false;
+    }
+    return any;
+}
+
+void DatalogProgram::rewriteForQueries()
+{
+    // the rewrite does not carry expressions, or heads that are not all
+    // variables, through
+    for (const Rule& rule : _rules)
+    {
+        for (const Term& term : rule.head.terms)
+        {
+            if (term.kind != Term::Kind::Variable)
+            {
+                _rewriteFallback = describe(rule) + " has a constant or expression in its head";
+                return;
+            }
+        }
+        for (const Atom& atom : rule.body)
+        {
+            for (const Term& term : atom.terms)
+            {
+                if (term.kind == Term::Kind::Expression)
+                {
+                    _rewriteFallback = describe(rule) + " has an expression in its body";
+                    return;
+                }
+            }
+        }
+    }
+
+    SymbolTable& symbols = SymbolTable::global();
+    auto derived = derivedRelations();
+    auto isDerived = [this, &derived](Symbol name) {
+        auto it = _relationIndex.find(name);
+        return it != std::end(_relationIndex) && it->second < derived.size() && derived[it->second];
+    };
+    auto isBound = [](const Term& term, const std::vector<Symbol>& bound) {
+        return term.kind == Term::Kind::Constant
+            || (term.kind == Term::Kind::Variable && std::find(std::cbegin(bound), std::cend(bound), term.value) != std::cend(bound));
+    };
+    // 'b' for each column bound by a variable; constants are only bound
+    // when no variable is, so magic heads never hold a constant next to a
+    // variable (a rule head holds no constants at all)
+    auto adornment = [&isBound](const Atom& atom, const std::vector<Symbol>& bound) {
+        std::string pattern;
+        bool variable = false;
+        for (const Term& term : atom.terms)
+        {
+            pattern += isBound(term, bound) ? 'b' : 'f';
+            variable |= term.kind == Term::Kind::Variable && pattern.back() == 'b';
+        }
+        for (size_t i = 0; variable && i < pattern.size(); ++i)
+        {
+            if (atom.terms[i].kind == Term::Kind::Constant)
+                pattern[i] = 'f';
+        }
+        return pattern;
+    };
+    auto boundTerms = [](const Atom& atom, const std::string& pattern) {
+        std::vector<Term> terms;
+        for (size_t i = 0; i < pattern.size(); ++i)
+        {
+            if (pattern[i] == 'b')
+                terms.push_back(atom.terms[i]);
+        }
+        return terms;
+    };
+    auto magicName = [&symbols](Symbol name, const std::string& pattern) {
+        return symbols.intern("magic^" + textOf(name) + "^" + pattern);
+    };
+    auto addRelation = [this](Symbol name, std::vector<Symbol> attributes) {
+        _relationIndex.emplace(name, _relations.size());
+        _relations.emplace_back(name, std::move(attributes));
+    };
+
+    // the adorned relation for a binding pattern, and its magic relation of
+    // the bound columns, made the first time the pattern is needed
+    std::vector<std::pair<Symbol, std::string>> pending;
+    auto adorned = [&](Symbol name, const std::string& pattern) {
+        Symbol result = symbols.intern(textOf(name) + "^" + pattern);
+        if (hasRelation(result))
+            return result;
+
+        std::vector<Symbol> attributes = stored(name).attributes();
+        std::vector<Symbol> keys;
+        for (size_t i = 0; i < pattern.size(); ++i)
+        {
+            if (pattern[i] == 'b')
+                keys.push_back(attributes[i]);
+        }
+        addRelation(result, attributes);
+        if (!keys.empty())
+            addRelation(magicName(name, pattern), keys);
+        pending.emplace_back(name, pattern);
+        return result;
+    };
+    auto seed = [this, &magicName](Symbol name, const std::string& pattern, const std::vector<Term>& constants) {
+        std::vector<Symbol> row;
+        for (const Term& term : constants)
+            row.push_back(term.value);
+        relation(magicName(name, pattern)).insert(row.data());
+    };
+
+    for (size_t q = 0; q < _queries.size(); ++q)
+    {
+        const Atom& query = _queries[q];
+        if (!isDerived(query.name))
+            continue;
+        std::string pattern = adornment(query, {});
+        _answers[q] = adorned(query.name, pattern);
+        if (pattern.find('b') != std::string::npos)
+            seed(query.name, pattern, boundTerms(query, pattern));
+    }
+
+    std::vector<Rule> rules;
+    std::vector<size_t> origins;
+    for (size_t next = 0; next < pending.size(); ++next)
+    {
+        auto [name, pattern] = pending[next];
+        Symbol head = symbols.intern(textOf(name) + "^" + pattern);
+        bool restricted = pattern.find('b') != std::string::npos;
+
+        // the facts stated for the original relation, which no rule writes to any more
+        Atom stated{ name, {} };
+        for (size_t i = 0; i < pattern.size(); ++i)
+            stated.terms.push_back(Term{ Term::Kind::Variable, symbols.intern("X" + std::to_string(i)) });
+        Rule facts{ Atom{ head, stated.terms }, {} };
+        if (restricted)
+            facts.body.push_back(Atom{ magicName(name, pattern), boundTerms(stated, pattern) });
+        facts.body.push_back(stated);
+        rules.push_back(facts);
+        origins.push_back(Internal);
+
+        for (size_t r = 0; r < _rules.size(); ++r)
+        {
+            const Rule& rule = _rules[r];
+            if (rule.head.name != name)
+                continue;
+
+            std::vector<Symbol> bound;
+            for (size_t i = 0; i < pattern.size(); ++i)
+            {
+                if (pattern[i] == 'b')
+                    bound.push_back(rule.head.terms[i].value);
+            }
+            Rule rewritten{ Atom{ head, rule.head.terms }, {} };
+            if (restricted)
+                rewritten.body.push_back(Atom{ magicName(name, pattern), boundTerms(rule.head, pattern) });
+
+            // sideways information passing: next the first atom with a bound
+            // column, so bindings flow from the head through the body
+            std::vector<bool> used(rule.body.size(), false);
+            for (size_t step = 0; step < rule.body.size(); ++step)
+            {
+                size_t chosen = rule.body.size();
+                for (size_t i = 0; i < rule.body.size() && chosen == rule.body.size(); ++i)
+                {
+                    bool anyBound = std::any_of(std::cbegin(rule.body[i].terms), std::cend(rule.body[i].terms), [&](const Term& term) {
+                        return isBound(term, bound);
+                    });
+                    if (!used[i] && anyBound)
+                        chosen = i;
+                }
+                for (size_t i = 0; i < rule.body.size() && chosen == rule.body.size(); ++i)
+                {
+                    if (!used[i])
+                        chosen = i;
+                }
+                used[chosen] = true;
+                const Atom& atom = rule.body[chosen];
+
+                if (!isDerived(atom.name))
+                {
+                    rewritten.body.push_back(atom);
+                }
+                else
+                {
+                    std::string inner = adornment(atom, bound);
+                    Symbol target = adorned(atom.name, inner);
+                    std::vector<Term> keys = boundTerms(atom, inner);
+                    bool constant = std::none_of(std::cbegin(keys), std::cend(keys), [](const Term& term) {
+                        return term.kind == Term::Kind::Variable;
+                    });
+                    if (!keys.empty() && constant)
+                    {
+                        // bound by constants alone, so asked for whatever the body so far holds
+                        seed(atom.name, inner, keys);
+                    }
+                    else if (!keys.empty())
+                    {
+                        // the magic rule keeps the atoms so far that connect to its head
+                        Rule magic{ Atom{ magicName(atom.name, inner), keys }, {} };
+                        std::vector<Symbol> reached;
+                        for (const Term& term : keys)
+                            reached.push_back(term.value);
+                        std::vector<bool> kept(rewritten.body.size(), false);
+                        for (bool grew = true; grew;)
+                        {
+                            grew = false;
+                            for (size_t i = 0; i < rewritten.body.size(); ++i)
+                            {
+                                const auto& terms = rewritten.body[i].terms;
+                                bool connected = std::any_of(std::cbegin(terms), std::cend(terms), [&reached](const Term& term) {
+                                    return term.kind == Term::Kind::Variable
+                                        && std::find(std::cbegin(reached), std::cend(reached), term.value) != std::cend(reached);
+                                });
+                                if (kept[i] || !connected)
+                                    continue;
+                                kept[i] = grew = true;
+                                for (const Term& term : terms)
+                                {
+                                    if (term.kind == Term::Kind::Variable)
+                                        reached.push_back(term.value);
+                                }
+                            }
+                        }
+                        for (size_t i = 0; i < rewritten.body.size(); ++i)
+                        {
+                            if (kept[i])
+                                magic.body.push_back(rewritten.body[i]);
+                        }
+                        // magic(X) :- magic(X) adds nothing
+                        bool trivial = magic.body.size() == 1 && magic.body[0].name == magic.head.name
+                            && std::equal(std::cbegin(keys), std::cend(keys), std::cbegin(magic.body[0].terms), [](const Term& lhs, const Term& rhs) {
+                                   return lhs.kind == rhs.kind && lhs.value == rhs.value;
+                               });
+                        if (!trivial)
+                        {
+                            rules.push_back(magic);
+                            origins.push_back(Internal);
+                        }
+                    }
+                    rewritten.body.push_back(Atom{ target, atom.terms });
+                }
+
+                for (const Term& term : atom.terms)
+                {
+                    if (term.kind == Term::Kind::Variable)
+                        bound.push_back(term.value);
+                }
+            }
+            rules.push_back(rewritten);
+            origins.push_back(r);
+        }
+    }
+
+    for (Relation& stored : _relations)
+        stored.normalize();
+    _loadedRules = std::move(_rules);
+    _rules = std::move(rules);
+    _origins = std::move(origins);
+    _joinAlgorithms.clear();
+    for (const Rule& rule : _rules)
+        _joinAlgorithms.push_back(resolve(rule, JoinAlgorithm::Automatic));
+}
+
+JoinAlgorithm DatalogProgram::resolve(const Rule& rule, JoinAlgorithm algorithm) const
+{
+    if (algorithm != JoinAlgorithm::Automatic)
+        return algorithm;
+
+    std::vector<std::vector<Symbol>> atoms;
+    for (const Atom& atom : rule.body)
+    {
+        atoms.emplace_back();
+        for (const Term& term : atom.terms)
+        {
+            if (term.kind == Term::Kind::Variable)
+                atoms.back().push_back(term.value);
+        }
+    }
+    return isCyclic(atoms) ? JoinAlgorithm::Leapfrog : JoinAlgorithm::Binary;
+}
+
+std::vector<size_t> DatalogProgram::bound(const Atom& atom, const std::vector<Symbol>& variables) const
+{
+    std::vector<size_t> columns;
+    for (size_t column = 0; column < atom.terms.size(); ++column)
+    {
+        const Term& term = atom.terms[column];
+        if (term.kind == Term::Kind::Constant
+            || (term.kind == Term::Kind::Variable && std::find(std::cbegin(variables), std::cend(variables), term.value) != std::cend(variables)))
+            columns.push_back(column);
+    }
+    return columns;
+}
+
+const Index* DatalogProgram::findIndex(const Atom& atom, const std::vector<size_t>& columns, size_t& length) const
+{
+    auto isBound = [&columns](size_t column) {
+        return std::find(std::cbegin(columns), std::cend(columns), column) != std::cend(columns);
+    };
+
+    const Index* best = nullptr;
+    length = 0;
+    for (const Index& index : _indexes[_relationIndex.at(atom.name)])
+    {
+        const auto& key = index.key();
+        size_t usable = 0;
+        while (usable < key.size() && isBound(key[usable]))
+            ++usable;
+        if (index.kind() == Index::Kind::Hash && usable != key.size())
+            continue;
+        if (usable > length || (usable == length && usable > 0 && index.kind() == Index::Kind::Hash))
+        {
+            best = &index;
+            length = usable;
+        }
+    }
+    return best;
+}
+
+std::optional<Relation> DatalogProgram::inOrder(const Atom& atom, const std::vector<Symbol>& order, std::pmr::memory_resource* resource) const
+{
+    // the constants' columns, then the variables' in the given order
+    std::vector<size_t> constants;
+    std::vector<std::pair<size_t, size_t>> variables;  // place in order, column
+    for (size_t column = 0; column < atom.terms.size(); ++column)
+    {
+        const Term& term = atom.terms[column];
+        if (term.kind == Term::Kind::Constant)
+        {
+            constants.push_back(column);
+            continue;
+        }
+        auto place = static_cast<size_t>(std::distance(std::cbegin(order), std::find(std::cbegin(order), std::cend(order), term.value)));
+        if (std::any_of(std::cbegin(variables), std::cend(variables), [place](const auto& variable) { return variable.first == place; }))
+            return std::nullopt;
+        variables.emplace_back(place, column);
+    }
+    if (variables.empty())
+        return std::nullopt;
+    std::sort(std::begin(variables), std::end(variables));
+
+    for (const Index& index : _indexes[_relationIndex.at(atom.name)])
+    {
+        const auto& indexOrder = index.order();
+        if (index.kind() != Index::Kind::Sorted || indexOrder.size() != atom.terms.size() || index.key().size() < constants.size()
+            || !std::is_permutation(std::cbegin(constants), std::cend(constants), std::cbegin(indexOrder), std::cbegin(indexOrder) + static_cast<std::ptrdiff_t>(constants.size())))
+            continue;
+        bool ordered = std::equal(std::cbegin(variables), std::cend(variables), std::cbegin(indexOrder) + static_cast<std::ptrdiff_t>(constants.size()),
+            [](const auto& variable, size_t column) { return variable.second == column; });
+        if (!ordered)
+            continue;
+
+        std::vector<Symbol> attributes;
+        for (const auto& variable : variables)
+            attributes.push_back(order[variable.first]);
+        std::vector<Symbol> rows;
+        auto put = [&rows, &variables](const Symbol* row) {
+            for (const auto& variable : variables)
+                rows.push_back(row[variable.second]);
+        };
+        if (constants.empty())
+        {
+            index.scan(put);
+        }
+        else
+        {
+            // the key in the index's order of the constant columns
+            std::vector<Symbol> values;
+            for (size_t k = 0; k < constants.size(); ++k)
+                values.push_back(atom.terms[indexOrder[k]].value);
+            index.lookup(values.data(), values.size(), put);
+            index.count(1, rows.empty() ? 0 : 1);
+        }
+
+        Relation result{ atom.name, attributes, resource };
+        result.assign(rows.data(), rows.size() / variables.size());
+        return result;
+    }
+    return std::nullopt;
+}
+
+Relation DatalogProgram::probe(const Relation& outer, const Atom& atom, const Index& index, size_t length) const
+{
+    // where each key value comes from: an outer column, or a constant
+    const auto& attributes = outer.attributes();
+    auto outerColumn = [&attributes](Symbol variable) {
+        return static_cast<size_t>(std::distance(std::cbegin(attributes), std::find(std::cbegin(attributes), std::cend(attributes), variable)));
+    };
+    std::vector<std::pair<bool, Symbol>> keySource;
+    for (size_t k = 0; k < length; ++k)
+    {
+        const Term& term = atom.terms[index.key()[k]];
+        keySource.emplace_back(term.kind == Term::Kind::Constant, term.kind == Term::Kind::Constant
+            ? term.value
+            : static_cast<Symbol>(outerColumn(term.value)));
+    }
+
+    // every column of the atom is checked against a constant, an outer
+    // column, an earlier column, or adds a new variable
+    enum class Check : std::uint8_t { Constant, Outer, Earlier, Added };
+    std::vector<std::pair<Check, size_t>> checks;
+    std::vector<Symbol> resultAttributes = attributes;
+    std::vector<std::pair<Symbol, size_t>> added;  // new variables and their first column
+    for (size_t column = 0; column < atom.terms.size(); ++column)
+    {
+        const Term& term = atom.terms[column];
+        if (term.kind == Term::Kind::Constant)
+        {
+            checks.emplace_back(Check::Constant, term.value);
+            continue;
+        }
+
+        size_t position = outerColumn(term.value);
+        auto earlier = std::find_if(std::cbegin(added), std::cend(added), [&term](const auto& first) { return first.first == term.value; });
+        if (position < attributes.size())
+        {
+            checks.emplace_back(Check::Outer, position);
+        }
+        else if (earlier != std::cend(added))
+        {
+            checks.emplace_back(Check::Earlier, earlier->second);
+        }
+        else
+        {
+            checks.emplace_back(Check::Added, column);
+            added.emplace_back(term.value, column);
+            resultAttributes.push_back(term.value);
+        }
+    }
+
+    auto probeRange = [&](size_t begin, size_t end, auto& rows) {
+        std::vector<Symbol> key(length);
+        size_t hits = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Symbol* current = outer.row(i);
+            for (size_t k = 0; k < length; ++k)
+                key[k] = keySource[k].first ? keySource[k].second : current[keySource[k].second];
+
+            bool found = false;
+            index.lookup(key.data(), length, [&](const Symbol* row) {
+                found = true;
+                for (size_t column = 0; column < checks.size(); ++column)
+                {
+                    const auto& [check, value] = checks[column];
+                    if ((check == Check::Constant && row[column] != value)
+                        || (check == Check::Outer && row[column] != current[value])
+                        || (check == Check::Earlier && row[column] != row[value]))
+                        return;
+                }
+                rows.insert(std::end(rows), current, current + outer.arity());
+                for (size_t column = 0; column < checks.size(); ++column)
+                {
+                    if (checks[column].first == Check::Added)
+                        rows.push_back(row[column]);
+                }
+            });
+            hits += found;
+        }
+        index.count(end - begin, hits);
+    };
+
+    std::pmr::vector<Symbol> rows{ outer.resource() };
+    if (!_scheduler || outer.size() < 2 * Relation::ParallelGrain)
+    {
+        probeRange(0, outer.size(), rows);
+    }
+    else
+    {
+        std::vector<std::vector<Symbol>> pieces(outer.size() / Relation::ParallelGrain);
+        _scheduler->parallelFor(pieces.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t piece = begin; piece < end; ++piece)
+                probeRange(outer.size() * piece / pieces.size(), outer.size() * (piece + 1) / pieces.size(), pieces[piece]);
+        });
+        for (const auto& piece : pieces)
+            rows.insert(std::end(rows), std::cbegin(piece), std::cend(piece));
+    }
+
+    Relation result{ outer.name(), resultAttributes, outer.resource() };
+    result.reserve(rows.size() / resultAttributes.size());
+    for (size_t offset = 0; offset < rows.size(); offset += resultAttributes.size())
+        result.insert(rows.data() + offset);
+    result.normalize();
+    return result;
+}
+
+Relation DatalogProgram::add(Symbol name, const Relation& rows)
+{
+    Relation added = relation(name).unite(rows, _scheduler);
+    if (!added.empty())
+    {
+        for (Index& index : _indexes[_relationIndex.at(name)])
+            index.insert(added);
+    }
+    return added;
+}
+
+Relation DatalogProgram::stage(Symbol name, const Relation& rows)
+{
+    Relation added = _relations[_relationIndex.at(name)].stage(rows);
+    if (!added.empty())
+    {
+        for (Index& index : _indexes[_relationIndex.at(name)])
+            index.insert(added);
+    }
+    return added;
+}
+
+Relation DatalogProgram::retract(Symbol name, const Relation& rows)
+{
+    Relation removed = _relations[_relationIndex.at(name)].retract(rows);
+    if (!removed.empty())
+    {
+        for (Index& index : _indexes[_relationIndex.at(name)])
+            index.erase(removed);
+    }
+    return removed;
+}
+
+std::vector<bool> DatalogProgram::derivedRelations() const
+{
+    std::vector<bool> derived(_relations.size(), false);
+    for (const Rule& rule : _rules)
+        derived[_relationIndex.at(rule.head.name)] = true;
+    return derived;
+}
+
+void DatalogProgram::chooseIndexes()
+{
+    settle();
+    // the distinct sets of bound columns per relation: constants in queries,
+    // and in rule bodies constants plus the variables shared with the rest of
+    // the body, which are bound once the planner has joined its neighbours,
+    // or with a delta atom alone, which recursive rules start from
+    std::vector<std::vector<std::vector<size_t>>> patterns(_relations.size());
+    auto addPattern = [this, &patterns](const Atom& atom, std::vector<size_t> columns) {
+        if (columns.empty())
+            return;
+        auto& known = patterns[_relationIndex.at(atom.name)];
+        if (std::find(std::cbegin(known), std::cend(known), columns) == std::cend(known))
+            known.push_back(columns);
+    };
+    for (size_t q = 0; q < _queries.size(); ++q)
+    {
+        Atom query{ _answers[q], _queries[q].terms };
+        if (hasRelation(query.name))
+            addPattern(query, bound(query, {}));
+    }
+    for (const Rule& rule : _rules)
+    {
+        for (size_t i = 0; i < rule.body.size(); ++i)
+        {
+            std::vector<Symbol> variables;
+            for (size_t j = 0; j < rule.body.size(); ++j)
+            {
+                for (const Term& term : rule.body[j].terms)
+                {
+                    if (j != i && term.kind == Term::Kind::Variable)
+                        variables.push_back(term.value);
+                }
+            }
+            addPattern(rule.body[i], bound(rule.body[i], variables));
+        }
+    }
+    for (const Stratum& stratum : _strata)
+    {
+        if (!stratum.recursive)
+            continue;
+        std::vector<Symbol> heads;
+        for (size_t r : stratum.rules)
+            heads.push_back(_rules[r].head.name);
+        for (size_t r : stratum.rules)
+        {
+            const Rule& rule = _rules[r];
+            for (const Atom& delta : rule.body)
+            {
+                if (std::find(std::cbegin(heads), std::cend(heads), delta.name) == std::cend(heads))
+                    continue;
+                std::vector<Symbol> variables;
+                for (const Term& term : delta.terms)
+                {
+                    if (term.kind == Term::Kind::Variable)
+                        variables.push_back(term.value);
+                }
+                for (const Atom& atom : rule.body)
+                {
+                    if (&atom != &delta)
+                        addPattern(atom, bound(atom, variables));
+                }
+            }
+        }
+    }
+
+    // Patterns that nest share one sorted index whose key lists the columns
+    // of each pattern after those of the smaller ones; a pattern that nests
+    // with no other gets a hash index.
+    _indexes.assign(_relations.size(), {});
+    for (size_t r = 0; r < _relations.size(); ++r)
+    {
+        auto& sets = patterns[r];
+        std::sort(std::begin(sets), std::end(sets), [](const auto& lhs, const auto& rhs) {
+            return lhs.size() != rhs.size() ? lhs.size() < rhs.size() : lhs < rhs;
+        });
+
+        std::vector<std::vector<std::vector<size_t>>> chains;
+        for (const auto& set : sets)
+        {
+            auto chain = std::find_if(std::begin(chains), std::end(chains), [&set](const auto& candidate) {
+                const auto& last = candidate.back();
+                return last.size() < set.size() && std::includes(std::cbegin(set), std::cend(set), std::cbegin(last), std::cend(last));
+            });
+            if (chain == std::end(chains))
+                chains.push_back({ set });
+            else
+                chain->push_back(set);
+        }
+
+        for (const auto& chain : chains)
+        {
+            std::vector<size_t> key;
+            for (const auto& set : chain)
+            {
+                for (size_t column : set)
+                {
+                    if (std::find(std::cbegin(key), std::cend(key), column) == std::cend(key))
+                        key.push_back(column);
+                }
+            }
+            Index::Kind kind = chain.size() == 1 ? Index::Kind::Hash : Index::Kind::Sorted;
+            _indexes[r].emplace_back(kind, key, _relations[r].arity());
+            _indexes[r].back().insert(_relations[r]);
+        }
+    }
+    // plans point into the indexes
+    _plans.assign(_rules.size(), {});
+}
+
+JoinPlan DatalogProgram::plan(const Rule& rule, size_t delta, const Relation* deltaRelation) const
+{
+    // rows of each atom after its selections, and the distinct values of its
+    // variables, assuming columns are independent
+    struct Candidate
+    {
+        double rows;
+        std::vector<std::pair<Symbol, double>> distinct;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < rule.body.size(); ++i)
+    {
+        const Atom& atom = rule.body[i];
+        const Relation& source = deltaRelation != nullptr && i == delta ? *deltaRelation : stored(atom.name);
+        if (source.arity() != atom.terms.size())
+            throw std::invalid_argument{ describe(atom) + " does not match the arity of its scheme" };
+
+        Candidate candidate{ static_cast<double>(source.size()), {} };
+        for (size_t column = 0; column < atom.terms.size(); ++column)
+        {
+            const Term& term = atom.terms[column];
+            double values = std::max<double>(static_cast<double>(source.distinct(column)), 1.0);
+            auto seen = std::find_if(std::begin(candidate.distinct), std::end(candidate.distinct), [&term](const auto& variable) {
+                return variable.first == term.value;
+            });
+            if (term.kind == Term::Kind::Constant || (term.kind == Term::Kind::Variable && seen != std::end(candidate.distinct)))
+                candidate.rows /= values;
+            else if (term.kind == Term::Kind::Variable)
+                candidate.distinct.emplace_back(term.value, values);
+        }
+        if (source.size() > 0)
+            candidate.rows = std::max(candidate.rows, 1.0);
+        for (auto& variable : candidate.distinct)
+            variable.second = std::min(variable.second, std::max(candidate.rows, 1.0));
+        candidates.push_back(std::move(candidate));
+    }
+
+    JoinPlan result;
+    std::vector<std::pair<Symbol, double>> joined;
+    std::vector<bool> used(rule.body.size(), false);
+    double rows = 0;
+    for (size_t step = 0; step < rule.body.size(); ++step)
+    {
+        // estimated rows of joining each remaining atom, preferring connected ones
+        size_t best = rule.body.size();
+        bool bestConnected = false;
+        double bestEstimate = 0;
+        for (size_t i = 0; i < rule.body.size(); ++i)
+        {
+            if (used[i])
+                continue;
+
+            bool connected = false;
+            double estimate = step == 0 ? candidates[i].rows : rows * candidates[i].rows;
+            for (const auto& [variable, values] : candidates[i].distinct)
+            {
+                auto shared = std::find_if(std::cbegin(joined), std::cend(joined), [variable = variable](const auto& other) {
+                    return other.first == variable;
+                });
+                if (shared != std::cend(joined))
+                {
+                    connected = true;
+                    estimate /= std::max(values, shared->second);
+                }
+            }
+
+            bool better = best == rule.body.size()
+                || (connected && !bestConnected)
+                || (connected == bestConnected && estimate < bestEstimate);
+            if (better)
+            {
+                best = i;
+                bestConnected = connected;
+                bestEstimate = estimate;
+            }
+        }
+
+        const Atom& atom = rule.body[best];
+        bool fromDelta = deltaRelation != nullptr && best == delta;
+        JoinPlan::Step chosen{ best, fromDelta, candidates[best].rows, bestEstimate, nullptr, 0 };
+
+        // probing pays when there are fewer rows joined so far than in the relation
+        if (step > 0 && !fromDelta && rows < static_cast<double>(stored(atom.name).size()))
+        {
+            std::vector<Symbol> variables;
+            for (const auto& variable : joined)
+                variables.push_back(variable.first);
+            chosen.index = findIndex(atom, bound(atom, variables), chosen.length);
+        }
+        result.steps.push_back(chosen);
+
+        for (const auto& [variable, values] : candidates[best].distinct)
+        {
+            auto shared = std::find_if(std::begin(joined), std::end(joined), [variable = variable](const auto& other) {
+                return other.first == variable;
+            });
+            if (shared == std::end(joined))
+                joined.emplace_back(variable, values);
+            else
+                shared->second = std::min(shared->second, values);
+        }
+        for (auto& variable : joined)
+            variable.second = std::min(variable.second, std::max(bestEstimate, 1.0));
+        used[best] = true;
+        rows = bestEstimate;
+    }
+
+    return result;
+}
+
+const JoinPlan& DatalogProgram::reuse(PlanCache& plans, const Rule& rule, size_t delta, const Relation* deltaRelation) const
+{
+    if (plans.empty())
+        plans.resize(rule.body.size() + 1);
+    auto& cached = plans[deltaRelation != nullptr ? delta : rule.body.size()];
+
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < rule.body.size(); ++i)
+        sizes.push_back((deltaRelation != nullptr && i == delta ? *deltaRelation : stored(rule.body[i].name)).size());
+    bool stale = !cached;
+    for (size_t i = 0; i < sizes.size() && !stale; ++i)
+        stale = sizes[i] > 2 * cached->sizes[i] || 2 * sizes[i] < cached->sizes[i];
+
+    if (stale)
+        cached = CachedPlan{ plan(rule, delta, deltaRelation), std::move(sizes) };
+    return cached->plan;
+}
+
+void DatalogProgram::answerQueries(std::ostream& out) const
+{
+    for (size_t q = 0; q < _queries.size(); ++q)
+        printAnswer(out, _queries[q], evaluate(_queries[q], stored(_answers[q])));
+}
+
+void DatalogProgram::printAnswer(std::ostream& out, const Atom& query, const Relation& answer) const
+{
+    SymbolTable& symbols = SymbolTable::global();
+    out << describe(query) << "? ";
+    if (answer.empty())
+    {
+        out << "No\n";
+        return;
+    }
+    out << "Yes(" << answer.size() << ")\n";
+    if (answer.arity() == 0)
+        return;
+
+    // rows are stored in Symbol order; print them in text order
+    std::vector<size_t> order(answer.size());
+    std::iota(std::begin(order), std::end(order), 0);
+    std::sort(std::begin(order), std::end(order), [&answer, &symbols](size_t lhs, size_t rhs) {
+        SymbolTable::NumberText leftText;
+        SymbolTable::NumberText rightText;
+        for (size_t column = 0; column < answer.arity(); ++column)
+        {
+            auto left = symbols.text(answer.row(lhs)[column], leftText);
+            auto right = symbols.text(answer.row(rhs)[column], rightText);
+            if (left != right)
+                return left < right;
+        }
+        return false;
+    });
+
+    SymbolTable::NumberText buffer;
+    for (size_t index : order)
+    {
+        out << "  ";
+        for (size_t column = 0; column < answer.arity(); ++column)
+        {
+            if (column > 0)
+                out << ", ";
+            out << symbols.text(answer.attributes()[column]) << "=" << symbols.text(answer.row(index)[column], buffer);
+        }
+        out << "\n";
+    }
+}
+
+std::string DatalogProgram::describe(const Rule& rule) const
+{
+    std::string text = describe(rule.head) + " :- ";
+    for (size_t i = 0; i < rule.body.size(); ++i)
+    {
+        if (i > 0)
+            text += ",";
+        text += describe(rule.body[i]);
+    }
+    return text + ".";
+}
+
+std::string DatalogProgram::describe(const Rule& rule, const JoinPlan& plan) const
+{
+    std::string text = describe(rule) + "\n";
+    for (size_t i = 0; i < plan.steps.size(); ++i)
+    {
+        const JoinPlan::Step& step = plan.steps[i];
+        text += "  " + std::to_string(i + 1) + ". " + describe(rule.body[step.atom]);
+        if (step.delta)
+            text += " delta";
+        if (step.index != nullptr)
+        {
+            text += step.index->kind() == Index::Kind::Hash ? " probe hash(" : " probe sorted(";
+            for (size_t k = 0; k < step.length; ++k)
+                text += (k > 0 ? "," : "") + std::to_string(step.index->key()[k]);
+            text += ")";
+        }
+        else
+        {
+            text += i == 0 ? " scan" : " join";
+        }
+        text += ", ~" + std::to_string(static_cast<size_t>(step.rows)) + " rows"
+            + ", ~" + std::to_string(static_cast<size_t>(step.estimate)) + " joined\n";
+    }
+    return text;
+}
+
+std::string DatalogProgram::describe(const Atom& atom) const
+{
+    std::string text = textOf(atom.name) + "(";
+    for (size_t i = 0; i < atom.terms.size(); ++i)
+    {
+        if (i > 0)
+            text += ",";
+        text += describe(atom.terms[i]);
+    }
+    return text + ")";
+}
+
+std::string DatalogProgram::describe(const Term& term) const
+{
+    if (term.kind != Term::Kind::Expression)
+        return textOf(term.value);
+
+    const Expression& expression = _expressions[term.value];
+    return "(" + describe(expression.lhs) + expression.op + describe(expression.rhs) + ")";
+}
+
+Atom DatalogProgram::convert(const DatalogAst& ast, const DatalogAst::Predicate& predicate)
+{
+    Atom atom{ predicate.name, {} };
+    for (std::uint32_t i = 0; i < predicate.count; ++i)
+        atom.terms.push_back(convert(ast, ast.parameters[predicate.first + i]));
+    return atom;
+}
+
+Term DatalogProgram::convert(const DatalogAst& ast, const DatalogAst::Parameter& parameter)
+{
+    switch (parameter.kind)
+    {
+    case DatalogAst::Parameter::Kind::String:
+        return Term{ Term::Kind::Constant, parameter.value };
+    case DatalogAst::Parameter::Kind::Id:
+        return Term{ Term::Kind::Variable, parameter.value };
+    case DatalogAst::Parameter::Kind::Expression:
+        break;
+    }
+
+    const auto& expression = ast.expressions[parameter.value];
+    Expression converted{ convert(ast, ast.parameters[expression.lhs]), expression.op,
+        convert(ast, ast.parameters[expression.lhs + 1]) };
+
+    // equal expressions share an entry (their operands already do), so
+    // converting the same query again does not add any
+    auto same = [](const Term& lhs, const Term& rhs) { return lhs.kind == rhs.kind && lhs.value == rhs.value; };
+    auto existing = std::find_if(std::cbegin(_expressions), std::cend(_expressions), [&](const Expression& other) {
+        return other.op == converted.op && same(other.lhs, converted.lhs) && same(other.rhs, converted.rhs);
+    });
+    if (existing == std::cend(_expressions))
+        existing = _expressions.insert(std::cend(_expressions), converted);
+    return Term{ Term::Kind::Expression, static_cast<std::uint32_t>(existing - std::cbegin(_expressions)) };
+}
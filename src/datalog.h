@@ -1,9 +1,317 @@
 #pragma once
 
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "arithmetic.h"
+#include "index.h"
+#include "relation.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "symbols.h"
+#include "parser/ast.h"
+#include "parser/parser.h"
 
+struct Term
+{
+    enum class Kind : std::uint8_t { Constant, Variable, Expression };
+
+    Kind kind;
+    std::uint32_t value;  // a Symbol, or an index into the program's expressions
+};
+
+struct Expression
+{
+    Term lhs;
+    char op;
+    Term rhs;
+};
+
+struct Atom
+{
+    Symbol name;
+    std::vector<Term> terms;
+};
+
+struct Rule
+{
+    Atom head;
+    std::vector<Atom> body;
+};
+
+// Rules whose heads form one strongly connected component of the predicate
+// dependency graph. Only recursive strata need more than one pass.
+struct Stratum
+{
+    std::vector<size_t> rules;
+    bool recursive = false;
+};
+
+// How a rule body is joined: pairwise along a JoinPlan, or all at once by
+// leapfrog triejoin, which Automatic picks for cyclic bodies.
+enum class JoinAlgorithm : std::uint8_t { Automatic, Binary, Leapfrog };
+
+// Order in which a rule body is joined. Each step either joins the atom's
+// selected rows or, when it has an index on the columns bound so far, probes
+// that index with every row joined so far.
+struct JoinPlan
+{
+    struct Step
+    {
+        size_t atom;           // index into the rule body
+        bool delta;            // reads the tuples new in the previous pass
+        double rows;           // estimated rows of the atom after its selections
+        double estimate;       // estimated rows joined after this step
+        const Index* index;    // probed, or null to join
+        size_t length;         // key columns looked up in the index
+    };
+
+    std::vector<Step> steps;
+};
+
+struct EvaluationStats
+{
+    size_t iterations = 0;
+    std::vector<size_t> derived;  // new tuples per rule, parallel to rules()
+    std::vector<std::vector<size_t>> derivedByPass;  // per rule, new tuples in each pass of its stratum
+    std::vector<size_t> passes;   // parallel to strata()
+    std::vector<double> seconds;  // wall time per stratum
+};
+
+// A fact to add to or retract from a relation, as a batch passed to update()
+struct FactChange
+{
+    Symbol relation;
+    std::vector<Symbol> row;
+    bool retract = false;
+};
+
+struct UpdateStats
+{
+    std::vector<Symbol> relations;  // the relations' names, parallel to relations()
+    std::vector<size_t> added;    // tuples gained per relation
+    std::vector<size_t> removed;  // tuples lost per relation
+    size_t overdeleted = 0;       // tuples deleted while updating, including those rederived
+};
+
+// How the rules are evaluated for the queries: bottom-up to the whole
+// fixpoint, or goal-directed after a magic sets rewrite, which Automatic
+// picks when every query on a derived relation binds a constant.
+enum class QueryEvaluation : std::uint8_t { Automatic, Full, Demand };
+
+// A loaded Datalog program: one Relation per scheme holding its facts, plus
+// the rules and queries that are evaluated over them.
 class DatalogProgram
 {
 public:
-    //void load(parser, std::string filename);
-};
\ No newline at end of file
+    // with more than one thread, independent strata and large joins and
+    // unions are evaluated in parallel, on the shared scheduler when it has
+    // that many threads and on a pool of the program's own otherwise
+    explicit DatalogProgram(size_t threads = std::thread::hardware_concurrency());
+
+    // After a demand-driven load the rules are the rewritten ones: each
+    // derived relation a query reaches gets an adorned copy per binding
+    // pattern (path^bf) and a magic relation of the bindings asked for
+    // (magic^path^bf), and the original derived relations stay empty.
+    void load(const DatalogAst& ast, QueryEvaluation evaluation = QueryEvaluation::Full);
+    void load(const LL1Parser& parser, const std::filesystem::path& filename,
+        QueryEvaluation evaluation = QueryEvaluation::Full);
+    // Merges inputs parsed separately into one program, taking facts, rules
+    // and queries in input order. Several inputs may declare a scheme if they
+    // declare the same attributes; anything else is a conflict.
+    void load(const std::vector<DatalogAst>& inputs, QueryEvaluation evaluation = QueryEvaluation::Full);
+    // parses files, or directories of them, concurrently with a parser from
+    // DatalogGrammarFactory::createShardParser() and merges them
+    void load(const LL1Parser& parser, const std::vector<std::filesystem::path>& inputs,
+        QueryEvaluation evaluation = QueryEvaluation::Full);
+    bool demandDriven() const;
+    // why a demand-driven load evaluates every rule after all, as the magic
+    // sets rewrite does not carry expressions or constant heads through, or
+    // empty
+    const std::string& rewriteFallback() const;
+    // Converts a query parsed apart from the program, as the ast's
+    // predicates[predicate], for evaluate(). Its expressions are added to
+    // expressions() unless an equal one is there already.
+    Atom query(const DatalogAst& ast, std::uint32_t predicate);
+
+    // Writes the symbol table, relations with their indexes, rules and
+    // queries to a snapshot (see snapshot.h). restore() fills an empty
+    // program from the bytes of one, usually a MappedFile. When the symbols
+    // get the ids they had when saved, as in a process that has built the
+    // same parser, rows and indexes are copied in bulk; otherwise they are
+    // renumbered and re-sorted.
+    void save(const std::filesystem::path& filename) const;
+    void restore(std::string_view snapshot, bool verify = true);
+    // whether evaluateRules() has run, here or before the restored snapshot was saved
+    bool evaluated() const;
+
+    bool hasRelation(Symbol name) const;
+    const Relation& relation(Symbol name) const;
+    // secondary indexes, chosen on load from the columns that queries and
+    // rule bodies bind and kept current as rules add tuples
+    const std::vector<Index>& indexes(Symbol name) const;
+    const std::vector<Relation>& relations() const;
+    const std::vector<Rule>& rules() const;
+    // The rules as loaded, before any rewrite, and for each of rules() the
+    // one it is an adorned copy of, or Internal for a rule the rewrite adds.
+    // Rules restored from a snapshot count as loaded.
+    const std::vector<Rule>& loadedRules() const;
+    size_t origin(size_t rule) const;
+    static constexpr size_t Internal = static_cast<size_t>(-1);
+    void setJoinAlgorithm(size_t rule, JoinAlgorithm algorithm);
+    // never Automatic, which is resolved when set
+    JoinAlgorithm joinAlgorithm(size_t rule) const;
+    // in evaluation order: every stratum comes after the ones it reads from
+    const std::vector<Stratum>& strata() const;
+    const std::vector<Atom>& queries() const;
+    // the relation each query is answered from, parallel to queries()
+    const std::vector<Symbol>& answers() const;
+    const std::vector<Expression>& expressions() const;
+    // time spent in the phases of load() and evaluateRules()
+    const PhaseTimes& times() const;
+
+    // Selects the atom's constants and repeated variables from its relation,
+    // then projects and renames to one column per distinct variable.
+    Relation evaluate(const Atom& atom) const;
+    Relation evaluate(const Atom& atom, const Relation& source,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+    // Evaluates each stratum after the ones it reads from. A non-recursive stratum runs its rules
+    // once; a recursive one is evaluated semi-naively to a fixpoint, where
+    // after the first pass a rule is only re-run with one body atom of the
+    // stratum bound to the tuples its relation gained in the previous pass.
+    EvaluationStats evaluateRules();
+    // Applies a batch of fact changes and brings the derived relations up to
+    // date (evaluating the rules first if they have not been). Retractions
+    // apply before insertions. Deletions follow DRed: everything derived from
+    // a retracted fact is deleted, then whatever still has a derivation is
+    // rederived; insertions and rederived tuples are propagated semi-naively
+    // stratum by stratum. Joins start from the changed tuples, so their cost
+    // follows the size of the change.
+    UpdateStats update(const std::vector<FactChange>& changes);
+    void answerQueries(std::ostream& out) const;
+    // the query followed by No, or by Yes(count) and the rows in text order
+    void printAnswer(std::ostream& out, const Atom& query, const Relation& answer) const;
+
+    // Greedy cost-based order: start from the atom with the fewest rows
+    // after its constant selections, then repeatedly add the connected atom
+    // with the smallest estimated join, estimated from relation sizes and
+    // distinct values per column. Atoms without shared variables come last.
+    JoinPlan plan(const Rule& rule, size_t delta = 0, const Relation* deltaRelation = nullptr) const;
+
+    std::string describe(const Rule& rule) const;
+    std::string describe(const Rule& rule, const JoinPlan& plan) const;
+    std::string describe(const Atom& atom) const;
+    std::string describe(const Term& term) const;
+
+private:
+    struct CachedPlan
+    {
+        JoinPlan plan;
+        std::vector<size_t> sizes;  // of the body atoms' relations when planned
+    };
+    // a rule's join order per delta atom, then for no delta
+    using PlanCache = std::vector<std::optional<CachedPlan>>;
+
+    // joins the rule body (with body[delta] read from deltaRelation when given)
+    // and projects it onto the head's columns, allocating from resource
+    Relation evaluate(const Rule& rule, size_t delta, const Relation* deltaRelation,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+    // the same for any rule, joined with the given algorithm
+    // with plans, the binary join order comes from the rule's PlanCache
+    Relation join(const Rule& rule, JoinAlgorithm algorithm, size_t delta, const Relation* deltaRelation,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource(), PlanCache* plans = nullptr) const;
+    void evaluate(size_t stratum, EvaluationStats& stats);
+    size_t evaluate(const Stratum& stratum, EvaluationStats& stats);
+    JoinAlgorithm resolve(const Rule& rule, JoinAlgorithm algorithm) const;
+    void merge(const std::vector<const DatalogAst*>& inputs, QueryEvaluation evaluation);
+    void loadRelations(const std::vector<const DatalogAst*>& inputs);
+    void loadRules(const DatalogAst& ast);
+    void stratify();
+    // whether every query on a derived relation binds a constant
+    bool selective() const;
+    void rewriteForQueries();
+    // the relations that are the head of some rule
+    std::vector<bool> derivedRelations() const;
+
+    // columns of the atom bound by constants or by the given variables
+    std::vector<size_t> bound(const Atom& atom, const std::vector<Symbol>& variables) const;
+    // the index answering the most of the bound columns and how many key
+    // columns it can look up, or null
+    const Index* findIndex(const Atom& atom, const std::vector<size_t>& columns, size_t& length) const;
+    // The atom's rows with its variables' columns in the given order, read
+    // from a sorted index that already keeps them in that order after the
+    // atom's constants; none if no index does or a variable repeats.
+    std::optional<Relation> inOrder(const Atom& atom, const std::vector<Symbol>& order, std::pmr::memory_resource* resource) const;
+    // joins outer with the atom by looking up each outer row in the index
+    Relation probe(const Relation& outer, const Atom& atom, const Index& index, size_t length) const;
+    // adds rows to a relation and its indexes, returning those that were new
+    Relation add(Symbol name, const Relation& rows);
+    // the same staged beside the stored rows, and its counterpart, so an
+    // update costs what it changes; reads that need the rows settle them
+    Relation stage(Symbol name, const Relation& rows);
+    Relation retract(Symbol name, const Relation& rows);
+    // the relation with its staged changes still pending, which its indexes
+    // and contains() see; for sizes, attributes and index lookups
+    const Relation& stored(Symbol name) const;
+    // rows with their staged changes merged, if they are a stored relation
+    const Relation& settled(const Relation& rows) const;
+    // merges the staged changes of every relation
+    void settle() const;
+    void chooseIndexes();
+    // The cached plan for the rule and delta, planned again once a relation
+    // it was planned from has halved or doubled in size. A rule is only
+    // joined by one thread at a time, so its cache needs no lock.
+    const JoinPlan& reuse(PlanCache& plans, const Rule& rule, size_t delta, const Relation* deltaRelation) const;
+
+    // An expression in a body atom or query stands for a column that must
+    // equal its value: the atom gets a fresh variable there, added to checks,
+    // and the joined rows are checked against it afterwards. In a head it is
+    // the column's value.
+    Atom withoutExpressions(const Atom& atom, std::vector<std::pair<Symbol, Term>>& checks) const;
+    Relation check(const Relation& rows, const std::vector<std::pair<Symbol, Term>>& checks) const;
+    // the value of an expression over each row, evaluated a column at a time
+    void compute(const Term& expression, const Relation& rows, std::vector<Symbol>& values,
+        std::vector<std::uint8_t>& valid) const;
+    ArithmeticKernel compile(const Term& expression, const std::vector<Symbol>& attributes) const;
+    void variablesOf(const Term& term, std::vector<Symbol>& variables) const;
+    // throws unless every variable of the term is one of variables
+    void requireBound(const Term& term, const std::vector<Symbol>& variables, const std::string& where) const;
+
+    Relation& relation(Symbol name);
+    Atom convert(const DatalogAst& ast, const DatalogAst::Predicate& predicate);
+    Term convert(const DatalogAst& ast, const DatalogAst::Parameter& parameter);
+
+    // Updates stage their changes and the first read that needs the rows
+    // settles them, so both are mutable behind the lock.
+    mutable std::vector<Relation> _relations;
+    // facts stated for relations that rules also derive into, parallel to
+    // _relations and empty for the others, whose rows are all facts
+    mutable std::vector<Relation> _facts;
+    std::unique_ptr<std::mutex> _settling = std::make_unique<std::mutex>();
+    std::unordered_map<Symbol, size_t> _relationIndex;
+    std::vector<std::vector<Index>> _indexes;
+    std::vector<Rule> _rules;
+    std::vector<Rule> _loadedRules;  // when the rules were rewritten
+    std::vector<size_t> _origins;
+    std::string _rewriteFallback;
+    std::vector<JoinAlgorithm> _joinAlgorithms;
+    // per rule, reset whenever the rules or the indexes change
+    mutable std::vector<PlanCache> _plans;
+    std::vector<Stratum> _strata;
+    std::vector<Atom> _queries;
+    std::vector<Symbol> _answers;
+    std::vector<Expression> _expressions;
+    Scheduler* _scheduler;
+    std::unique_ptr<Scheduler> _ownScheduler;
+    PhaseTimes _times;
+    bool _evaluated = false;
+};
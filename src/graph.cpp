@@ -0,0 +1,89 @@
+#include "graph.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+Graph::Graph(size_t nodes)
+    : _edges(nodes) {}
+
+void Graph::addEdge(size_t from, size_t to)
+{
+    if (from >= size() || to >= size())
+        throw std::out_of_range{ "edge to a node outside the graph" };
+    if (!hasEdge(from, to))
+        _edges[from].push_back(to);
+}
+
+size_t Graph::size() const { return _edges.size(); }
+
+const std::vector<size_t>& Graph::edges(size_t node) const { return _edges.at(node); }
+
+bool Graph::hasEdge(size_t from, size_t to) const
+{
+    const auto& targets = _edges.at(from);
+    return std::find(std::cbegin(targets), std::cend(targets), to) != std::cend(targets);
+}
+
+std::vector<std::vector<size_t>> Graph::components() const
+{
+    constexpr size_t Unvisited = std::numeric_limits<size_t>::max();
+
+    std::vector<std::vector<size_t>> result;
+    std::vector<size_t> index(size(), Unvisited);
+    std::vector<size_t> low(size(), 0);
+    std::vector<bool> onStack(size(), false);
+    std::vector<size_t> stack;
+    size_t counter = 0;
+
+    // explicit call stack of (node, next edge) so deep chains cannot overflow
+    std::vector<std::pair<size_t, size_t>> calls;
+    for (size_t root = 0; root < size(); ++root)
+    {
+        if (index[root] != Unvisited)
+            continue;
+
+        calls.emplace_back(root, 0);
+        while (!calls.empty())
+        {
+            auto& [node, edge] = calls.back();
+            if (edge == 0 && index[node] == Unvisited)
+            {
+                index[node] = low[node] = counter++;
+                stack.push_back(node);
+                onStack[node] = true;
+            }
+
+            if (edge < _edges[node].size())
+            {
+                size_t target = _edges[node][edge++];
+                if (index[target] == Unvisited)
+                    calls.emplace_back(target, 0);
+                else if (onStack[target])
+                    low[node] = std::min(low[node], index[target]);
+                continue;
+            }
+
+            if (low[node] == index[node])
+            {
+                std::vector<size_t> component;
+                size_t member;
+                do
+                {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    component.push_back(member);
+                } while (member != node);
+                std::sort(std::begin(component), std::end(component));
+                result.push_back(std::move(component));
+            }
+
+            size_t finished = node;
+            calls.pop_back();
+            if (!calls.empty())
+                low[calls.back().first] = std::min(low[calls.back().first], low[finished]);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Directed graph over dense node indices, used for the dependency graph between
+// the predicates of a program.
+class Graph
+{
+public:
+    explicit Graph(size_t nodes);
+
+    void addEdge(size_t from, size_t to);
+    size_t size() const;
+    const std::vector<size_t>& edges(size_t node) const;
+    bool hasEdge(size_t from, size_t to) const;
+
+    // Strongly connected components (Tarjan). A component is listed after every
+    // component it has an edge into, so when edges point from a node to the
+    // nodes it depends on this is an evaluation order.
+    std::vector<std::vector<size_t>> components() const;
+
+private:
+    std::vector<std::vector<size_t>> _edges;
+};
@@ -0,0 +1,336 @@
+#include "index.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+Index::Index(Kind kind, std::vector<size_t> key, size_t arity)
+    : _kind{ kind }, _key{ key }, _arity{ arity }, _size{ 0 }, _sorted{ 0 }, _erasedCount{ 0 }
+{
+    if (_key.empty() || _key.size() > _arity)
+        throw std::invalid_argument{ "index key must name between one and all columns" };
+
+    _order = _key;
+    for (size_t column = 0; column < _arity; ++column)
+    {
+        if (std::find(std::cbegin(_key), std::cend(_key), column) == std::cend(_key))
+            _order.push_back(column);
+    }
+    if (_order.size() != _arity)
+        throw std::invalid_argument{ "index key repeats or exceeds a column" };
+}
+
+Index::Kind Index::kind() const { return _kind; }
+
+const std::vector<size_t>& Index::key() const { return _key; }
+
+const std::vector<size_t>& Index::order() const { return _order; }
+
+size_t Index::size() const { return _size; }
+
+void Index::insert(const Relation& rows)
+{
+    if (rows.arity() != _arity)
+        throw std::invalid_argument{ "index and rows differ in arity" };
+
+    auto first = static_cast<std::uint32_t>(_rows.size() / _arity);
+    _rows.insert(std::end(_rows), std::cbegin(rows.data()), std::cbegin(rows.data()) + static_cast<std::ptrdiff_t>(rows.size() * _arity));
+    _size += rows.size();
+
+    if (_kind == Kind::Hash)
+    {
+        std::vector<Symbol> values(_key.size());
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            auto id = static_cast<std::uint32_t>(first + i);
+            for (size_t k = 0; k < _key.size(); ++k)
+                values[k] = row(id)[_key[k]];
+            _buckets[hash(values.data())].push_back(id);
+        }
+        return;
+    }
+
+    // order the new rows and merge them into the recent ones
+    _erased.resize(_rows.size() / _arity);
+    std::vector<std::uint32_t> added(rows.size());
+    std::iota(std::begin(added), std::end(added), first);
+    auto byRow = [this](std::uint32_t lhs, std::uint32_t rhs) { return less(row(lhs), row(rhs)); };
+    std::sort(std::begin(added), std::end(added), byRow);
+    size_t middle = _recent.size();
+    _recent.insert(std::end(_recent), std::begin(added), std::end(added));
+    std::inplace_merge(std::begin(_recent), std::begin(_recent) + static_cast<std::ptrdiff_t>(middle), std::end(_recent), byRow);
+
+    if (_recent.size() * 8 > _sorted)
+        merge();
+}
+
+void Index::erase(const Relation& rows)
+{
+    if (rows.arity() != _arity)
+        throw std::invalid_argument{ "index and rows differ in arity" };
+
+    if (_kind == Kind::Hash)
+    {
+        std::vector<Symbol> values(_key.size());
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            const Symbol* erased = rows.row(i);
+            for (size_t k = 0; k < _key.size(); ++k)
+                values[k] = erased[_key[k]];
+            auto bucket = _buckets.find(hash(values.data()));
+            if (bucket == std::end(_buckets))
+                continue;
+            std::vector<std::uint32_t>& ids = bucket->second;
+            auto it = std::find_if(std::begin(ids), std::end(ids), [&](std::uint32_t id) {
+                return std::equal(erased, erased + _arity, row(id));
+            });
+            if (it != std::end(ids))
+            {
+                // order within a bucket does not matter, so the last id fills the gap
+                *it = ids.back();
+                ids.pop_back();
+                --_size;
+            }
+            if (ids.empty())
+                _buckets.erase(bucket);
+        }
+        // the rows stay behind until they outnumber the live ones
+        if (_rows.size() > 2 * _size * _arity)
+            compact();
+        return;
+    }
+
+    // mark the rows, and drop them all once they are worth a merge
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        std::optional<std::uint32_t> id = find(rows.row(i));
+        if (!id)
+            continue;
+        _erased[*id] = true;
+        ++_erasedCount;
+        --_size;
+    }
+    if (_erasedCount * 8 > _size)
+        merge();
+}
+
+std::optional<std::uint32_t> Index::find(const Symbol* values) const
+{
+    auto equal = [this, values](std::uint32_t id) { return !less(row(id), values) && !less(values, row(id)); };
+    size_t low = 0;
+    size_t high = _sorted;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (less(row(static_cast<std::uint32_t>(middle)), values))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < _sorted && equal(static_cast<std::uint32_t>(low)) && !_erased[low])
+        return static_cast<std::uint32_t>(low);
+
+    // a row erased and inserted again has an erased copy before it
+    auto recent = std::partition_point(std::cbegin(_recent), std::cend(_recent), [&](std::uint32_t id) {
+        return less(row(id), values);
+    });
+    for (; recent != std::cend(_recent) && equal(*recent); ++recent)
+    {
+        if (!_erased[*recent])
+            return *recent;
+    }
+    return std::nullopt;
+}
+
+void Index::save(Snapshot::Writer& out) const
+{
+    out.put(static_cast<std::uint64_t>(_kind));
+    out.put(_key.size());
+    for (size_t column : _key)
+        out.put(column);
+    out.put(_size);
+    if (_kind == Kind::Sorted)
+    {
+        // the rows in key order, each permuted to it
+        std::vector<Symbol> ordered;
+        ordered.reserve(_size * _arity);
+        scan([this, &ordered](const Symbol* current) {
+            for (size_t column : _order)
+                ordered.push_back(current[column]);
+        });
+        out.put(ordered.data(), ordered.size());
+        return;
+    }
+
+    // bucket hashes, then their row counts, then all rows bucket by bucket
+    std::vector<std::uint64_t> hashes;
+    std::vector<std::uint64_t> counts;
+    hashes.reserve(_buckets.size());
+    counts.reserve(_buckets.size());
+    for (const auto& [hash, ids] : _buckets)
+    {
+        hashes.push_back(hash);
+        counts.push_back(ids.size());
+    }
+    out.put(_buckets.size());
+    out.put(hashes.data(), hashes.size());
+    out.put(counts.data(), counts.size());
+    for (const auto& bucket : _buckets)
+    {
+        for (std::uint32_t id : bucket.second)
+            out.put(row(id), _arity);
+    }
+}
+
+Index Index::restore(Snapshot::Reader& in, size_t arity, bool rows)
+{
+    auto kind = static_cast<Kind>(in.get());
+    if (kind != Kind::Hash && kind != Kind::Sorted)
+        throw std::runtime_error{ "snapshot has an unknown index kind" };
+    size_t length = in.get();
+    if (length > arity)
+        throw std::runtime_error{ "snapshot index key exceeds its relation" };
+    std::vector<size_t> key(length);
+    for (size_t& column : key)
+        column = in.get();
+
+    Index index{ kind, key, arity };
+    size_t size = in.get();
+    if (kind == Kind::Sorted)
+    {
+        const Symbol* sorted = in.get<Symbol>(size * arity);
+        if (rows)
+        {
+            index._rows.resize(size * arity);
+            for (size_t i = 0; i < size; ++i)
+            {
+                for (size_t c = 0; c < arity; ++c)
+                    index._rows[i * arity + index._order[c]] = sorted[i * arity + c];
+            }
+            index._size = size;
+            index._sorted = size;
+            index._erased.assign(size, false);
+        }
+        return index;
+    }
+
+    size_t buckets = in.get();
+    const std::uint64_t* hashes = in.get<std::uint64_t>(buckets);
+    const std::uint64_t* counts = in.get<std::uint64_t>(buckets);
+    if (rows)
+    {
+        index._buckets.reserve(buckets);
+        index._rows.reserve(size * arity);
+    }
+    for (size_t b = 0; b < buckets; ++b)
+    {
+        const Symbol* bucket = in.get<Symbol>(counts[b] * arity);
+        if (!rows)
+            continue;
+        auto first = static_cast<std::uint32_t>(index._rows.size() / arity);
+        index._rows.insert(std::end(index._rows), bucket, bucket + counts[b] * arity);
+        std::vector<std::uint32_t> ids(counts[b]);
+        std::iota(std::begin(ids), std::end(ids), first);
+        index._buckets.emplace(hashes[b], std::move(ids));
+    }
+    if (rows)
+        index._size = size;
+    return index;
+}
+
+void Index::count(size_t lookups, size_t hits) const
+{
+    _usage.lookups.fetch_add(lookups, std::memory_order_relaxed);
+    _usage.hits.fetch_add(hits, std::memory_order_relaxed);
+}
+
+size_t Index::lookups() const { return _usage.lookups.load(std::memory_order_relaxed); }
+
+size_t Index::hits() const { return _usage.hits.load(std::memory_order_relaxed); }
+
+Index::Usage::Usage(const Usage& other)
+    : lookups{ other.lookups.load() }, hits{ other.hits.load() } {}
+
+Index::Usage& Index::Usage::operator=(const Usage& other)
+{
+    lookups.store(other.lookups.load());
+    hits.store(other.hits.load());
+    return *this;
+}
+
+std::uint64_t Index::hash(const Symbol* values) const
+{
+    std::uint64_t result = 0xcbf29ce484222325ull;
+    for (size_t k = 0; k < _key.size(); ++k)
+    {
+        result ^= values[k];
+        result *= 0x100000001b3ull;
+        result ^= result >> 29;
+    }
+    return result;
+}
+
+int Index::compare(const Symbol* row, const Symbol* values, size_t length) const
+{
+    for (size_t k = 0; k < length; ++k)
+    {
+        Symbol value = row[_key[k]];
+        if (value != values[k])
+            return value < values[k] ? -1 : 1;
+    }
+    return 0;
+}
+
+bool Index::less(const Symbol* lhs, const Symbol* rhs) const
+{
+    for (size_t column : _order)
+    {
+        if (lhs[column] != rhs[column])
+            return lhs[column] < rhs[column];
+    }
+    return false;
+}
+
+void Index::merge()
+{
+    if (_recent.empty() && _erasedCount == 0)
+        return;
+
+    // the recent rows are behind the sorted run, so the merged rows go to a new array
+    std::vector<Symbol> merged;
+    merged.reserve(_size * _arity);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < _sorted || j < _recent.size())
+    {
+        std::uint32_t next;
+        if (j == _recent.size() || (i < _sorted && less(row(static_cast<std::uint32_t>(i)), row(_recent[j]))))
+            next = static_cast<std::uint32_t>(i++);
+        else
+            next = _recent[j++];
+        if (_erasedCount == 0 || !_erased[next])
+            merged.insert(std::end(merged), row(next), row(next) + _arity);
+    }
+
+    _rows.swap(merged);
+    _sorted = _size;
+    _recent.clear();
+    _erased.assign(_size, false);
+    _erasedCount = 0;
+}
+
+void Index::compact()
+{
+    std::vector<Symbol> rows;
+    rows.reserve(_size * _arity);
+    for (auto& bucket : _buckets)
+    {
+        for (std::uint32_t& id : bucket.second)
+        {
+            const Symbol* current = row(id);
+            id = static_cast<std::uint32_t>(rows.size() / _arity);
+            rows.insert(std::end(rows), current, current + _arity);
+        }
+    }
+    _rows.swap(rows);
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "relation.h"
+
+namespace Snapshot
+{
+    class Reader;
+    class Writer;
+}
+
+// Secondary index over the rows of a Relation, keyed on some of its columns.
+// A hash index answers lookups on its whole key; a sorted index keeps the rows
+// ordered by its key columns (then the rest) and answers lookups on any prefix
+// of the key. The relation moves its rows whenever it is merged into, so the
+// index keeps one copy of them, in column order, and refers to rows by their
+// position in it; it is kept current by inserting the rows the relation gains.
+//
+// A hash index's buckets hold row ids. A sorted index holds a run of rows in
+// key order and, behind it, the rows inserted since, with their ids in key
+// order; lookups search both, and the recent rows are merged into the run
+// once they are an eighth of its size, so small inserts stay cheap. Erased
+// rows are only marked, and skipped, until they are an eighth of the live
+// ones and the next merge drops them.
+class Index
+{
+public:
+    enum class Kind : std::uint8_t { Hash, Sorted };
+
+    Index(Kind kind, std::vector<size_t> key, size_t arity);
+
+    Kind kind() const;
+    const std::vector<size_t>& key() const;
+    // the key columns, then the others in column order
+    const std::vector<size_t>& order() const;
+    size_t size() const;
+
+    // rows must not be in the index yet
+    void insert(const Relation& rows);
+    // rows must be in the index
+    void erase(const Relation& rows);
+
+    // Calls visit(row) with each row, in relation column order, whose first
+    // length key columns hold values. A hash index needs the whole key.
+    template <typename Visitor>
+    void lookup(const Symbol* values, size_t length, Visitor&& visit) const;
+    // Calls visit(row) with every row, in relation column order; a sorted
+    // index visits them sorted by order().
+    template <typename Visitor>
+    void scan(Visitor&& visit) const;
+
+    // Writes the kind, key and rows as stored, so restoring copies them back
+    // without sorting or hashing. Without rows the index is restored empty,
+    // to be refilled by insert().
+    void save(Snapshot::Writer& out) const;
+    static Index restore(Snapshot::Reader& in, size_t arity, bool rows = true);
+
+    // Lookups made through the index and how many of them found a row. The
+    // callers add their counts once per batch of lookups.
+    void count(size_t lookups, size_t hits) const;
+    size_t lookups() const;
+    size_t hits() const;
+
+private:
+    struct Usage
+    {
+        Usage() = default;
+        Usage(const Usage& other);
+        Usage& operator=(const Usage& other);
+
+        std::atomic<size_t> lookups{ 0 };
+        std::atomic<size_t> hits{ 0 };
+    };
+
+    std::uint64_t hash(const Symbol* values) const;
+    // the row's first length key columns against values
+    int compare(const Symbol* row, const Symbol* values, size_t length) const;
+    // rows in key order, then the other columns
+    bool less(const Symbol* lhs, const Symbol* rhs) const;
+    const Symbol* row(std::uint32_t id) const;
+    // moves the recent rows into the sorted run and drops the erased ones
+    void merge();
+    // the id of a live row equal to values, or none
+    std::optional<std::uint32_t> find(const Symbol* values) const;
+    // drops the rows no bucket refers to
+    void compact();
+
+    Kind _kind;
+    std::vector<size_t> _key;
+    std::vector<size_t> _order;  // key columns, then the others
+    size_t _arity;
+    size_t _size;
+    std::vector<Symbol> _rows;
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> _buckets;
+    size_t _sorted;  // rows at the front of _rows that are in key order
+    std::vector<std::uint32_t> _recent;  // the rest, by id in key order
+    std::vector<bool> _erased;  // by id, rows erased but still in _rows
+    size_t _erasedCount;
+    mutable Usage _usage;
+};
+
+template <typename Visitor>
+void Index::lookup(const Symbol* values, size_t length, Visitor&& visit) const
+{
+    if (_kind == Kind::Hash)
+    {
+        auto bucket = _buckets.find(hash(values));
+        if (bucket == std::end(_buckets))
+            return;
+        for (std::uint32_t id : bucket->second)
+        {
+            if (compare(row(id), values, _key.size()) == 0)
+                visit(row(id));
+        }
+        return;
+    }
+
+    size_t low = 0;
+    size_t high = _sorted;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (compare(row(static_cast<std::uint32_t>(middle)), values, length) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    for (; low < _sorted && compare(row(static_cast<std::uint32_t>(low)), values, length) == 0; ++low)
+    {
+        if (_erasedCount == 0 || !_erased[low])
+            visit(row(static_cast<std::uint32_t>(low)));
+    }
+
+    auto recent = std::partition_point(std::cbegin(_recent), std::cend(_recent), [&](std::uint32_t id) {
+        return compare(row(id), values, length) < 0;
+    });
+    for (; recent != std::cend(_recent) && compare(row(*recent), values, length) == 0; ++recent)
+    {
+        if (_erasedCount == 0 || !_erased[*recent])
+            visit(row(*recent));
+    }
+}
+
+template <typename Visitor>
+void Index::scan(Visitor&& visit) const
+{
+    if (_kind == Kind::Hash)
+    {
+        for (const auto& bucket : _buckets)
+        {
+            for (std::uint32_t id : bucket.second)
+                visit(row(id));
+        }
+        return;
+    }
+
+    auto live = [this](std::uint32_t id) { return _erasedCount == 0 || !_erased[id]; };
+    size_t recent = 0;
+    for (size_t i = 0; i < _sorted; ++i)
+    {
+        auto id = static_cast<std::uint32_t>(i);
+        for (; recent < _recent.size() && less(row(_recent[recent]), row(id)); ++recent)
+        {
+            if (live(_recent[recent]))
+                visit(row(_recent[recent]));
+        }
+        if (live(id))
+            visit(row(id));
+    }
+    for (; recent < _recent.size(); ++recent)
+    {
+        if (live(_recent[recent]))
+            visit(row(_recent[recent]));
+    }
+}
+
+inline const Symbol* Index::row(std::uint32_t id) const { return _rows.data() + size_t{ id } * _arity; }
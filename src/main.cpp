@@ -5,39 +5,248 @@
 #include <filesystem>
 #include <algorithm>
 #include <array>
+#include <optional>
 #include "util.h"
+#include "datalog.h"
+#include "report.h"
+#include "scheduler.h"
+#include "server.h"
 #include "parser/grammar.h"
 #include "parser/parser.h"
+#include "parser/ast.h"
+#include "parser/source.h"
+#include "parser/stream.h"
 namespace fs = std::filesystem;
 
 int main(int argc, char* argv[])
 {
     auto args = parseArguments(argc, argv);
-    if (args.size() != 2) {
-        std::cout << "USAGE: lexer <filename>\n";
+    bool tokensOnly = false;
+    bool plans = false;
+    bool full = false;
+    bool stats = false;
+    bool json = false;
+    std::optional<fs::path> snapshot;
+    // answer requests from stdin, or from a Unix socket when one is given
+    bool serve = false;
+    std::optional<fs::path> socket;
+    std::vector<fs::path> inputs;
+    bool usage = false;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i].rfind("--", 0) != 0)
+            inputs.emplace_back(args[i]);
+        else if (args[i] == "--tokens")
+            tokensOnly = true;
+        else if (args[i] == "--plan")
+            plans = true;
+        else if (args[i] == "--full")
+            full = true;
+        else if (args[i] == "--stats" || args[i] == "--stats=json")
+            stats = true, json = args[i] == "--stats=json";
+        else if (args[i].rfind("--save=", 0) == 0 && args[i].size() > 7)
+            snapshot = args[i].substr(7);
+        else if (args[i] == "--serve")
+            serve = true;
+        else if (args[i].rfind("--serve=", 0) == 0 && args[i].size() > 8)
+            serve = true, socket = args[i].substr(8);
+        else
+            usage = true;
+    }
+    // several files, or a directory, are parts of one program
+    bool sharded = inputs.size() > 1 || (inputs.size() == 1 && fs::is_directory(inputs.front()));
+    bool fromStdin = inputs.size() == 1 && inputs.front() == "-";
+    if (inputs.empty() || usage || (tokensOnly && (plans || full || stats || snapshot || sharded || serve))
+        || (sharded && std::count(std::begin(inputs), std::end(inputs), "-") > 0) || (serve && !socket && fromStdin)) {
+        std::cout << "USAGE: datalog [--tokens|--plan] [--full] [--stats[=json]] [--save=<snapshot>] <filename|snapshot|->\n"
+            << "       datalog [--plan] [--full] [--stats[=json]] [--save=<snapshot>] <filename|directory>...\n"
+            << "       datalog --serve[=<socket>] [--stats[=json]] [--save=<snapshot>] <filename|snapshot|directory>...\n";
         return EXIT_FAILURE;
     }
 
-    fs::path filepath{ args.at(1) };
-    if (!fs::exists(filepath))
+    for (const fs::path& input : inputs)
     {
-        std::cout << "FILE: " << filepath.string() << " not found.\n";
-        return EXIT_FAILURE;
+        if (!fromStdin && !fs::exists(input))
+        {
+            std::cout << "FILE: " << input.string() << " not found.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    fs::path filepath{ inputs.front() };
+
+    LL1Parser parser = DatalogGrammarFactory::createDatalogParser();
+
+    std::vector<TokenType::Id> skipped = parser.lexer().trivia();
+    if (tokensOnly)
+        skipped = { TokenType::Whitespace.id() };
+
+    RunReport report;
+    std::optional<MappedFile> file;
+    std::optional<TokenStream> tokens;
+    if (fromStdin)
+    {
+        tokens.emplace(parser.lexer(), std::cin, skipped);
+    }
+    else if (!sharded)
+    {
+        report.phases.time("read", [&] { file.emplace(filepath); });
+        tokens.emplace(parser.lexer(), file->text(), skipped);
     }
 
-    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    if (tokensOnly)
+    {
+        size_t count = 0;
+        auto print = [&count](const Token& token) {
+            if (token.typeId() == TokenType::Whitespace.id())
+                return;
+            std::cout << token << "\n";
+            ++count;
+        };
+        if (file)
+        {
+            // a mapped file is lexed in chunks on every core
+            Scheduler& scheduler = Scheduler::shared();
+            for (const auto& token : parser.lexer().process(file->text(), scheduler))
+                print(token);
+        }
+        else
+        {
+            for (const auto& token : *tokens)
+                print(token);
+        }
+        std::cout << "Total Tokens = " << count << "\n";
+        return EXIT_SUCCESS;
+    }
 
-    std::ifstream data{ filepath, std::ios::in };
-    Lexer lex{ datalogGrammar.terminals() };
-    auto tokens = lex.process(data);
-    
-    std::vector<Token> filtered;
-    std::copy_if(std::cbegin(tokens), std::cend(tokens), std::back_inserter(filtered), [](const Token& token) {
-        return token.type().name() != TokenType::Whitespace.name();
-    });
-    for (const auto& token : filtered)
+    try
     {
-        std::cout << token << "\n";
+        DatalogProgram program;
+        // selective queries are answered goal-directed unless --full; a
+        // server answers any query, so it evaluates every rule
+        auto evaluation = full || serve ? QueryEvaluation::Full : QueryEvaluation::Automatic;
+        if (file && Snapshot::isSnapshot(file->text()))
+        {
+            report.phases.time("restore", [&] { program.restore(file->text()); });
+        }
+        else if (sharded)
+        {
+            // every file is lexed and parsed into its own AST on its own thread
+            LL1Parser shardParser = DatalogGrammarFactory::createShardParser();
+            Scheduler& scheduler = Scheduler::shared();
+            std::vector<DatalogAst> asts = report.phases.time("parse", [&] {
+                return parseDatalogInputs(shardParser, inputs, &scheduler);
+            });
+            for (const DatalogAst& ast : asts)
+            {
+                report.bytes += ast.bytes;
+                report.tokens += ast.tokens;
+                for (const auto& table : ast.facts)
+                    report.facts += table.size();
+            }
+            report.phases.time("load", [&] { program.load(asts, evaluation); });
+        }
+        else
+        {
+            // the facts of a mapped file are scanned in chunks on every core
+            Scheduler& scheduler = Scheduler::shared();
+            DatalogAst ast = report.phases.time("parse", [&] { return parseDatalog(parser, *tokens, true, &scheduler); });
+            report.bytes = tokens->bytes();
+            report.tokens = tokens->tokens();
+            for (const auto& table : ast.facts)
+                report.facts += table.size();
+            report.phases.time("load", [&] { program.load(ast, evaluation); });
+        }
+
+        if (serve)
+        {
+            // the cold start is paid once, then requests are answered from
+            // the warm relations and the server's cache
+            if (!program.evaluated())
+                report.evaluation = report.phases.time("evaluate", [&] { return program.evaluateRules(); });
+            if (snapshot)
+                report.phases.time("save", [&] { program.save(*snapshot); });
+            if (stats)
+                printReport(std::cerr, report, program, json);
+
+            QueryServer server{ program };
+            std::cerr << "Serving " << program.relations().size() << " relations on "
+                << (socket ? socket->string() : std::string{ "stdin" }) << "\n";
+            if (socket)
+                server.listen(*socket);
+            else
+                server.serve(std::cin, std::cout);
+            return EXIT_SUCCESS;
+        }
+
+        if (plans)
+        {
+            std::cout << "Join Plans\n";
+            if (!program.rewriteFallback().empty())
+                std::cout << "magic sets rewrite skipped: " << program.rewriteFallback() << "\n";
+            for (size_t r = 0; r < program.rules().size(); ++r)
+            {
+                const Rule& rule = program.rules()[r];
+                if (program.joinAlgorithm(r) == JoinAlgorithm::Leapfrog)
+                    std::cout << program.describe(rule) << "\n  leapfrog triejoin\n";
+                else
+                    std::cout << program.describe(rule, program.plan(rule));
+            }
+            std::cout << "\n";
+        }
+
+        std::cout << "Rule Evaluation\n";
+        if (program.evaluated())
+        {
+            std::cout << "Schemes restored from a snapshot of the evaluated rules.\n\n";
+        }
+        else
+        {
+            report.evaluation = report.phases.time("evaluate", [&] { return program.evaluateRules(); });
+            const EvaluationStats& evaluation = report.evaluation;
+            for (size_t s = 0; s < program.strata().size(); ++s)
+            {
+                // the rules as loaded, with what their adorned copies derived;
+                // the rules a magic sets rewrite adds are left out
+                const Stratum& stratum = program.strata()[s];
+                std::vector<std::pair<size_t, size_t>> shown;
+                for (size_t r : stratum.rules)
+                {
+                    size_t origin = program.origin(r);
+                    if (origin == DatalogProgram::Internal)
+                        continue;
+                    auto it = std::find_if(std::begin(shown), std::end(shown), [origin](const auto& rule) { return rule.first == origin; });
+                    if (it == std::end(shown))
+                        shown.emplace_back(origin, evaluation.derived[r]);
+                    else
+                        it->second += evaluation.derived[r];
+                }
+                if (shown.empty())
+                    continue;
+
+                std::cout << "SCC: ";
+                for (const auto& [rule, derived] : shown)
+                    std::cout << (rule == shown.front().first ? "R" : ",R") << rule;
+                std::cout << (stratum.recursive ? " (recursive)" : "") << "\n";
+                for (const auto& [rule, derived] : shown)
+                    std::cout << "  " << program.describe(program.loadedRules()[rule]) << " derived " << derived << "\n";
+                std::cout << "  passes: " << evaluation.passes[s] << "\n";
+            }
+            std::cout << "Schemes populated after " << evaluation.iterations << " passes through the Rules.\n\n";
+        }
+
+        if (snapshot)
+            report.phases.time("save", [&] { program.save(*snapshot); });
+
+        std::cout << "Query Evaluation\n";
+        report.phases.time("queries", [&] { program.answerQueries(std::cout); });
+
+        // on stderr, so the answers on stdout stay the same
+        if (stats)
+            printReport(std::cerr, report, program, json);
+    }
+    catch (const std::exception& error)
+    {
+        std::cout << "ERROR: " << error.what() << "\n";
+        return EXIT_FAILURE;
     }
-    std::cout << "Total Tokens = " << filtered.size() << "\n";
 }
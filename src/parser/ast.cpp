@@ -0,0 +1,256 @@
+#include "ast.h"
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include "facts.h"
+#include "source.h"
+#include "../scheduler.h"
+
+size_t DatalogAst::FactTable::size() const { return arity == 0 ? 0 : values.size() / arity; }
+
+DatalogAst::DatalogAst()
+    : _arena{ std::make_unique<std::pmr::monotonic_buffer_resource>() },
+    predicates{ _arena.get() },
+    parameters{ _arena.get() },
+    expressions{ _arena.get() },
+    schemes{ _arena.get() },
+    rules{ _arena.get() },
+    queries{ _arena.get() },
+    facts{ _arena.get() },
+    _factTables{ _arena.get() } {}
+
+DatalogAst::FactTable& DatalogAst::factTable(Symbol name, std::uint32_t arity)
+{
+    auto key = std::make_pair(name, arity);
+    auto it = _factTables.find(key);
+    if (it != std::end(_factTables))
+        return facts[it->second];
+
+    _factTables.emplace(key, facts.size());
+    return facts.emplace_back(FactTable{ name, arity, std::pmr::vector<Symbol>{ _arena.get() } });
+}
+
+DatalogAstBuilder::DatalogAstBuilder(const LL1Parser& parser, DatalogAst& ast, bool bulkFacts, Scheduler* scheduler)
+    : _parser{ parser },
+    _ast{ ast },
+    _bulkFacts{ bulkFacts },
+    _scheduler{ scheduler },
+    _id{ parser.terminal("ID") },
+    _string{ parser.terminal("STRING") },
+    _add{ parser.terminal("ADD") },
+    _multiply{ parser.terminal("MULTIPLY") },
+    _section{ Construct::Other },
+    _ruleHead{ 0 }
+{
+    for (const auto& production : parser.grammar().productions())
+    {
+        std::string_view name = production.first.name();
+        if (name == "SCHEME") _constructs.push_back(Construct::Scheme);
+        else if (name == "FACT") _constructs.push_back(Construct::Fact);
+        else if (name == "RULE") _constructs.push_back(Construct::Rule);
+        else if (name == "HEAD_PREDICATE") _constructs.push_back(Construct::HeadPredicate);
+        else if (name == "PREDICATE") _constructs.push_back(Construct::Predicate);
+        else if (name == "QUERY") _constructs.push_back(Construct::Query);
+        else if (name == "EXPRESSION") _constructs.push_back(Construct::Expression);
+        else _constructs.push_back(Construct::Other);
+    }
+}
+
+void DatalogAstBuilder::enter(size_t production)
+{
+    Construct construct = _constructs[production];
+    switch (construct)
+    {
+    case Construct::Other:
+        return;
+    case Construct::Rule:
+    case Construct::Query:
+        _section = construct;
+        return;
+    default:
+        _frames.push_back(Frame{ construct, _pending.size(), Symbol{}, false, '\0' });
+        return;
+    }
+}
+
+void DatalogAstBuilder::terminal(const Token& token)
+{
+    if (_frames.empty())
+        return;
+
+    Frame& frame = _frames.back();
+    TokenType::Id type = token.typeId();
+    if (type == _id && !frame.named && frame.construct != Construct::Expression)
+    {
+        frame.name = SymbolTable::global().intern(token.value());
+        frame.named = true;
+    }
+    else if (type == _id)
+    {
+        _pending.push_back(DatalogAst::Parameter{ DatalogAst::Parameter::Kind::Id, SymbolTable::global().intern(token.value()) });
+    }
+    else if (type == _string)
+    {
+        _pending.push_back(DatalogAst::Parameter{ DatalogAst::Parameter::Kind::String, SymbolTable::global().intern(token.value()) });
+    }
+    else if (type == _add || type == _multiply)
+    {
+        frame.op = token.value().front();
+    }
+}
+
+std::vector<std::string> DatalogAstBuilder::shortcuts() const
+{
+    if (!_bulkFacts)
+        return {};
+    return { "FACT_LIST" };
+}
+
+void DatalogAstBuilder::shortcut(size_t, TokenStream& tokens)
+{
+    FactLoader loader{ _parser, _ast, _scheduler };
+    loader.load(tokens);
+}
+
+void DatalogAstBuilder::exit(size_t production)
+{
+    Construct construct = _constructs[production];
+    if (construct == Construct::Other || construct == Construct::Query)
+        return;
+
+    if (construct == Construct::Rule)
+    {
+        auto body = static_cast<std::uint32_t>(_ast.predicates.size() - _ruleHead - 1);
+        _ast.rules.push_back(DatalogAst::Rule{ _ruleHead, body });
+        return;
+    }
+
+    Frame frame = _frames.back();
+    _frames.pop_back();
+    auto first = std::begin(_pending) + static_cast<std::ptrdiff_t>(frame.pending);
+
+    if (construct == Construct::Expression)
+    {
+        if (_pending.size() - frame.pending != 2)
+            throw std::logic_error{ "expression without two operands" };
+
+        auto lhs = static_cast<std::uint32_t>(_ast.parameters.size());
+        _ast.parameters.insert(std::end(_ast.parameters), first, std::end(_pending));
+        _pending.erase(first, std::end(_pending));
+
+        auto index = static_cast<std::uint32_t>(_ast.expressions.size());
+        _ast.expressions.push_back(DatalogAst::Expression{ lhs, frame.op });
+        _pending.push_back(DatalogAst::Parameter{ DatalogAst::Parameter::Kind::Expression, index });
+        return;
+    }
+
+    if (construct == Construct::Fact)
+    {
+        auto& table = _ast.factTable(frame.name, static_cast<std::uint32_t>(_pending.size() - frame.pending));
+        for (auto it = first; it != std::end(_pending); ++it)
+            table.values.push_back(it->value);
+        _pending.erase(first, std::end(_pending));
+        return;
+    }
+
+    auto index = static_cast<std::uint32_t>(_ast.predicates.size());
+    auto parameters = static_cast<std::uint32_t>(_ast.parameters.size());
+    _ast.parameters.insert(std::end(_ast.parameters), first, std::end(_pending));
+    _ast.predicates.push_back(DatalogAst::Predicate{ frame.name, parameters,
+        static_cast<std::uint32_t>(_pending.size() - frame.pending) });
+    _pending.erase(first, std::end(_pending));
+
+    if (construct == Construct::Scheme)
+        _ast.schemes.push_back(index);
+    else if (construct == Construct::HeadPredicate)
+        _ruleHead = index;
+    else if (construct == Construct::Predicate && _section == Construct::Query)
+        _ast.queries.push_back(index);
+}
+
+DatalogAst parseDatalog(const LL1Parser& parser, TokenStream& tokens, bool bulkFacts, Scheduler* scheduler)
+{
+    DatalogAst ast;
+    DatalogAstBuilder builder{ parser, ast, bulkFacts, scheduler };
+    parser.process(tokens, builder);
+    return ast;
+}
+
+DatalogAst parseDatalog(const LL1Parser& parser, const std::filesystem::path& filepath, bool bulkFacts,
+    Scheduler* scheduler)
+{
+    MappedFile file{ filepath };
+    TokenStream tokens{ parser.lexer(), file.text() };
+    DatalogAst ast = parseDatalog(parser, tokens, bulkFacts, scheduler);
+    ast.source = filepath.string();
+    ast.bytes = tokens.bytes();
+    ast.tokens = tokens.tokens();
+    return ast;
+}
+
+std::vector<DatalogAst> parseDatalogInputs(const LL1Parser& parser, const std::vector<std::filesystem::path>& inputs,
+    Scheduler* scheduler, bool bulkFacts)
+{
+    namespace fs = std::filesystem;
+    std::vector<fs::path> files;
+    for (const fs::path& input : inputs)
+    {
+        if (!fs::is_directory(input))
+        {
+            files.push_back(input);
+            continue;
+        }
+        std::vector<fs::path> contents;
+        for (const auto& entry : fs::directory_iterator{ input })
+        {
+            const fs::path& path = entry.path();
+            bool datalog = path.extension() == ".dl" || path.extension() == ".txt";
+            if (entry.is_regular_file() && datalog && path.filename().string().front() != '.')
+                contents.push_back(path);
+        }
+        std::sort(std::begin(contents), std::end(contents));
+        files.insert(std::end(files), std::begin(contents), std::end(contents));
+    }
+
+    // an AST's arrays live in its own arena, so results are moved into place, never assigned
+    std::vector<std::optional<DatalogAst>> parsed(files.size());
+    auto parse = [&](size_t f) {
+        try
+        {
+            parsed[f].emplace(parseDatalog(parser, files[f], bulkFacts, files.size() == 1 ? scheduler : nullptr));
+        }
+        catch (const std::exception& error)
+        {
+            throw std::runtime_error{ files[f].string() + ": " + error.what() };
+        }
+    };
+    if (!scheduler || files.size() < 2)
+    {
+        for (size_t f = 0; f < files.size(); ++f)
+            parse(f);
+    }
+    else
+    {
+        // the load takes as long as the largest file, so start on it first
+        std::vector<std::uintmax_t> sizes;
+        for (const fs::path& file : files)
+            sizes.push_back(fs::file_size(file));
+        std::vector<size_t> order(files.size());
+        std::iota(std::begin(order), std::end(order), 0);
+        std::stable_sort(std::begin(order), std::end(order), [&sizes](size_t lhs, size_t rhs) { return sizes[lhs] > sizes[rhs]; });
+
+        Scheduler::Group group;
+        for (size_t f : order)
+            scheduler->run(group, [&parse, f] { parse(f); });
+        scheduler->wait(group);
+    }
+
+    std::vector<DatalogAst> asts;
+    asts.reserve(files.size());
+    for (auto& ast : parsed)
+        asts.push_back(std::move(*ast));
+    return asts;
+}
+
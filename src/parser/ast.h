@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+#include "parser.h"
+#include "../symbols.h"
+
+class Scheduler;
+
+// Flat result of parsing a Datalog program. Predicates, parameters and
+// expressions live in contiguous arrays and refer to each other by index;
+// identifiers and strings are Symbols in SymbolTable::global(). The arrays are
+// allocated from an arena owned by the AST and freed together with it.
+struct DatalogAst
+{
+    struct Parameter
+    {
+        enum class Kind : std::uint8_t { String, Id, Expression };
+
+        Kind kind;
+        std::uint32_t value;  // a Symbol, or an index into expressions
+    };
+
+    struct Expression
+    {
+        std::uint32_t lhs;  // parameters[lhs] and parameters[lhs + 1] are the operands
+        char op;
+    };
+
+    struct Predicate
+    {
+        Symbol name;
+        std::uint32_t first;  // range into parameters
+        std::uint32_t count;
+    };
+
+    struct Rule
+    {
+        std::uint32_t head;  // predicates[head], followed by count body predicates
+        std::uint32_t count;
+    };
+
+    // every fact of one relation and arity, stored row-major
+    struct FactTable
+    {
+        Symbol name;
+        std::uint32_t arity;
+        std::pmr::vector<Symbol> values;
+
+        size_t size() const;
+    };
+
+    DatalogAst();
+    // Moving keeps the arena, so the arrays stay valid. Assigning would free
+    // the arena the arrays being replaced still use, and is not allowed.
+    DatalogAst(DatalogAst&&) = default;
+    DatalogAst& operator=(DatalogAst&&) = delete;
+
+    // the file it was parsed from, empty for a stream, and how much was read
+    std::string source;
+    size_t bytes = 0;
+    size_t tokens = 0;
+
+private:
+    // declared first, since the arrays below are constructed to use it
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> _arena;
+
+public:
+    std::pmr::vector<Predicate> predicates;
+    std::pmr::vector<Parameter> parameters;
+    std::pmr::vector<Expression> expressions;
+    std::pmr::vector<std::uint32_t> schemes;
+    std::pmr::vector<Rule> rules;
+    std::pmr::vector<std::uint32_t> queries;
+    std::pmr::vector<FactTable> facts;
+
+    FactTable& factTable(Symbol name, std::uint32_t arity);
+
+private:
+    std::pmr::map<std::pair<Symbol, std::uint32_t>, size_t> _factTables;
+};
+
+// Builds a DatalogAst from the derivation reported by an LL1Parser running the
+// grammar from DatalogGrammarFactory.
+class DatalogAstBuilder : public ParseListener
+{
+public:
+    // with bulkFacts the Facts section is read by a FactLoader instead of the
+    // parser, on the scheduler's threads when there is one
+    DatalogAstBuilder(const LL1Parser& parser, DatalogAst& ast, bool bulkFacts = true, Scheduler* scheduler = nullptr);
+
+    void enter(size_t production) override;
+    void exit(size_t production) override;
+    void terminal(const Token& token) override;
+    std::vector<std::string> shortcuts() const override;
+    void shortcut(size_t index, TokenStream& tokens) override;
+
+private:
+    enum class Construct : std::uint8_t { Other, Scheme, Fact, Rule, HeadPredicate, Predicate, Query, Expression };
+
+    struct Frame
+    {
+        Construct construct;
+        size_t pending;  // start of this frame's parameters in _pending
+        Symbol name;
+        bool named;
+        char op;
+    };
+
+    const LL1Parser& _parser;
+    DatalogAst& _ast;
+    bool _bulkFacts;
+    Scheduler* _scheduler;
+    std::vector<Construct> _constructs;
+    TokenType::Id _id;
+    TokenType::Id _string;
+    TokenType::Id _add;
+    TokenType::Id _multiply;
+    std::vector<Frame> _frames;
+    std::vector<DatalogAst::Parameter> _pending;
+    Construct _section;
+    std::uint32_t _ruleHead;
+};
+
+DatalogAst parseDatalog(const LL1Parser& parser, TokenStream& tokens, bool bulkFacts = true, Scheduler* scheduler = nullptr);
+DatalogAst parseDatalog(const LL1Parser& parser, const std::filesystem::path& filepath, bool bulkFacts = true,
+    Scheduler* scheduler = nullptr);
+
+// Parses each input into its own DatalogAst, concurrently when given a
+// scheduler, largest files first; a lone file loads its facts on the
+// scheduler's threads instead. A directory stands for the Datalog files in
+// it (.dl or .txt, not hidden), in name order, and the results are in input
+// order. Errors name the file.
+std::vector<DatalogAst> parseDatalogInputs(const LL1Parser& parser, const std::vector<std::filesystem::path>& inputs,
+    Scheduler* scheduler, bool bulkFacts = true);
@@ -0,0 +1,441 @@
+#include "dfa.h"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include "scan.h"
+#include "../scheduler.h"
+
+namespace
+{
+    // Small automaton for a single Pattern. State 0 is the start state and -1
+    // is dead. A state is committed once the TokenType's matcher would have
+    // answered true, which drops every lower priority candidate. A boundary
+    // state only accepts when the following character is not a letter.
+    struct PatternAutomaton
+    {
+        std::vector<std::array<int, 256>> next;
+        std::vector<bool> accept;
+        std::vector<bool> commit;
+        std::vector<bool> open;
+        std::vector<bool> boundary;
+
+        int addState(bool accepting = false, bool committed = false, bool unterminated = false)
+        {
+            std::array<int, 256> row;
+            row.fill(-1);
+            next.push_back(row);
+            accept.push_back(accepting);
+            commit.push_back(committed);
+            open.push_back(unterminated);
+            boundary.push_back(false);
+            return static_cast<int>(next.size()) - 1;
+        }
+
+        template <typename Predicate>
+        void addEdges(int from, int to, Predicate predicate)
+        {
+            for (int c = 0; c < 256; ++c)
+                if (predicate(c)) next[from][c] = to;
+        }
+
+        void addEdge(int from, int to, char c) { next[from][static_cast<unsigned char>(c)] = to; }
+    };
+
+    bool isAlpha(int c) { return std::isalpha(c) != 0; }
+    bool isAlnum(int c) { return std::isalnum(c) != 0; }
+    bool isSpace(int c) { return std::isspace(c) != 0; }
+
+    int addChain(PatternAutomaton& automaton, const std::string& text)
+    {
+        int state = 0;
+        for (char c : text)
+        {
+            int next = automaton.addState();
+            automaton.addEdge(state, next, c);
+            state = next;
+        }
+        return state;
+    }
+
+    PatternAutomaton buildAutomaton(const Pattern& pattern)
+    {
+        PatternAutomaton automaton;
+        automaton.addState();
+
+        switch (pattern.kind)
+        {
+        case Pattern::Kind::Character:
+        case Pattern::Kind::Sequence:
+        {
+            int last = addChain(automaton, pattern.text);
+            automaton.accept[last] = automaton.commit[last] = true;
+            break;
+        }
+        case Pattern::Kind::Keyword:
+        {
+            // the keyword matcher only looks one character past the keyword, so
+            // trailing digits keep extending the keyword token like getIdentifier
+            int last = addChain(automaton, pattern.text);
+            int tail = automaton.addState(true, true);
+            automaton.accept[last] = automaton.boundary[last] = true;
+            automaton.addEdges(last, tail, [](int c) { return std::isdigit(c) != 0; });
+            automaton.addEdges(tail, tail, isAlnum);
+            break;
+        }
+        case Pattern::Kind::Identifier:
+        {
+            int body = automaton.addState(true, true);
+            automaton.addEdges(0, body, isAlpha);
+            automaton.addEdges(body, body, isAlnum);
+            break;
+        }
+        case Pattern::Kind::Whitespace:
+        {
+            int space = automaton.addState(true, true);
+            automaton.addEdges(0, space, isSpace);
+            break;
+        }
+        case Pattern::Kind::LineComment:
+        {
+            int body = addChain(automaton, pattern.text);
+            automaton.accept[body] = automaton.commit[body] = true;
+            automaton.addEdges(body, body, [](int c) { return c != '\n'; });
+            break;
+        }
+        case Pattern::Kind::BlockComment:
+        {
+            int body = addChain(automaton, pattern.text);
+            int bar = automaton.addState(false, true, true);
+            int end = automaton.addState(true, true);
+            automaton.commit[body] = automaton.open[body] = true;
+            automaton.addEdges(body, body, [](int c) { return c != '|'; });
+            automaton.addEdge(body, bar, '|');
+            automaton.addEdges(bar, body, [](int c) { return c != '|' && c != '#'; });
+            automaton.addEdge(bar, bar, '|');
+            automaton.addEdge(bar, end, '#');
+            break;
+        }
+        case Pattern::Kind::String:
+        {
+            int body = addChain(automaton, pattern.text);
+            int quote = automaton.addState(true, true);
+            automaton.commit[body] = automaton.open[body] = true;
+            automaton.addEdges(body, body, [](int c) { return c != '\''; });
+            automaton.addEdge(body, quote, '\'');
+            automaton.addEdge(quote, body, '\'');
+            break;
+        }
+        case Pattern::Kind::None:
+            break;
+        }
+
+        return automaton;
+    }
+}
+
+DfaLexer::DfaLexer(std::vector<TokenType> types)
+    : _types{ types }
+{
+    _types.insert(std::begin(_types), TokenType::EndOfFile);
+    _types.push_back(TokenType::Whitespace);
+    _types.push_back(TokenType::Undefined);
+    _endOfFile = 0;
+    _undefined = _types.size() - 1;
+    for (const TokenType& type : _types)
+        _ids.push_back(type.id());
+
+    compile();
+}
+
+void DfaLexer::compile()
+{
+    std::vector<PatternAutomaton> automata;
+    std::vector<size_t> owners;
+    for (size_t i = 0; i < _types.size(); ++i)
+    {
+        const TokenType& type = _types[i];
+        if (type.pattern().kind == Pattern::Kind::None)
+        {
+            if (i == _endOfFile || i == _undefined)
+                continue;
+            throw std::invalid_argument{ "token type " + std::string{ type.name() } + " has no pattern" };
+        }
+        automata.push_back(buildAutomaton(type.pattern()));
+        owners.push_back(i);
+    }
+
+    // subset construction over the pattern automata, where a combined state is
+    // the ordered list of (automaton, state) candidates that are still alive
+    using Candidates = std::vector<std::pair<size_t, int>>;
+    std::map<Candidates, State> known;
+    std::vector<Candidates> pending;
+
+    auto intern = [&](const Candidates& candidates) -> State {
+        if (candidates.empty())
+            return Dead;
+
+        auto it = known.find(candidates);
+        if (it != std::end(known))
+            return it->second;
+
+        if (_transitions.size() == 0xFFFF)
+            throw std::length_error{ "token patterns need too many states" };
+
+        State state = static_cast<State>(_transitions.size());
+        known.emplace(candidates, state);
+        pending.push_back(candidates);
+
+        _transitions.emplace_back();
+        _transitions.back().fill(Dead);
+
+        auto accepting = std::find_if(std::cbegin(candidates), std::cend(candidates), [&automata](const auto& candidate) {
+            return automata[candidate.first].accept[candidate.second];
+        });
+        _accept.push_back(accepting == std::cend(candidates)
+            ? NoToken
+            : static_cast<std::int16_t>(owners[accepting->first]));
+        _open.push_back(automata[candidates.front().first].open[candidates.front().second]);
+        return state;
+    };
+
+    _transitions.assign(1, std::array<State, 256>{});
+    _transitions[Dead].fill(Dead);
+    _accept.assign(1, NoToken);
+    _open.assign(1, false);
+
+    Candidates start;
+    for (size_t i = 0; i < automata.size(); ++i)
+        start.emplace_back(i, 0);
+    intern(start);
+
+    while (!pending.empty())
+    {
+        Candidates current = pending.back();
+        pending.pop_back();
+        State from = known.at(current);
+
+        for (int c = 0; c < 256; ++c)
+        {
+            Candidates next;
+            for (const auto& [automaton, state] : current)
+            {
+                int target = automata[automaton].next[state][c];
+                if (target < 0)
+                {
+                    // an accepting candidate that cannot extend has already won
+                    const auto& candidate = automata[automaton];
+                    if (candidate.accept[state] && !(candidate.boundary[state] && isAlpha(c)))
+                        break;
+                    continue;
+                }
+
+                next.emplace_back(automaton, target);
+                if (automata[automaton].commit[target])
+                    break;
+            }
+            _transitions[from][c] = intern(next);
+        }
+    }
+
+    // string and comment bodies leave their state on one or two bytes
+    _exits.assign(_transitions.size(), std::string{});
+    for (State state = Start; state < _transitions.size(); ++state)
+    {
+        std::string exits;
+        for (int c = 0; c < 256 && exits.size() <= MaxExits; ++c)
+        {
+            if (_transitions[state][c] != state)
+                exits.push_back(static_cast<char>(c));
+        }
+        if (!exits.empty() && exits.size() <= MaxExits)
+            _exits[state] = exits;
+    }
+
+    // each whitespace byte is a one byte token of the same type
+    for (char c : std::string_view{ " \t\n\v\f\r" })
+    {
+        State state = _transitions[Start][static_cast<unsigned char>(c)];
+        bool single = state != Dead && _accept[state] != NoToken &&
+            std::all_of(std::cbegin(_transitions[state]), std::cend(_transitions[state]), [](State next) { return next == Dead; });
+        std::optional<TokenType::Id> type;
+        if (single)
+            type = _ids[_accept[state]];
+        if (c == ' ')
+            _spaceToken = type;
+        else if (_spaceToken != type)
+            _spaceToken.reset();
+    }
+}
+
+std::vector<Token> DfaLexer::process(std::istream& data, std::string& text) const
+{
+    text.assign(std::istreambuf_iterator<char>{ data }, std::istreambuf_iterator<char>{});
+    return process(std::string_view{ text });
+}
+
+std::vector<Token> DfaLexer::process(std::string_view text) const
+{
+    std::vector<Token> tokens;
+
+    size_t line = 1;
+    while (!text.empty())
+    {
+        Match match = scan(text, true);
+        std::string_view value = text.substr(0, match.length);
+        tokens.push_back(Token{ match.type, value, line });
+        line += countLines(value);
+        text.remove_prefix(match.length);
+    }
+    tokens.push_back(Token{ endOfFile(), text, line });
+
+    return tokens;
+}
+
+std::vector<Token> DfaLexer::process(std::string_view text, Scheduler& scheduler, size_t chunkSize) const
+{
+    // chunks start after a newline where there is one, which is usually
+    // between tokens
+    chunkSize = std::max<size_t>(chunkSize, 1);
+    std::vector<size_t> starts{ 0 };
+    while (text.size() - starts.back() > chunkSize)
+    {
+        size_t newline = findAny(text, starts.back() + chunkSize, "\n");
+        if (newline + 1 >= text.size())
+            break;
+        starts.push_back(newline + 1);
+    }
+    starts.push_back(text.size());
+    size_t count = starts.size() - 1;
+
+    std::vector<size_t> lines(count + 1, 1);
+    scheduler.parallelFor(count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+            lines[chunk + 1] = countLines(text.substr(starts[chunk], starts[chunk + 1] - starts[chunk]));
+    });
+    std::partial_sum(std::cbegin(lines), std::cend(lines), std::begin(lines));
+
+    std::vector<std::vector<Token>> pieces(count);
+    scheduler.parallelFor(count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+            lex(text, starts[chunk], starts[chunk + 1], chunkSize, lines[chunk], pieces[chunk]);
+    });
+
+    auto offset = [&text](const Token& token) { return static_cast<size_t>(token.value().data() - text.data()); };
+
+    std::vector<Token> tokens;
+    size_t total = 1;
+    for (const auto& piece : pieces)
+        total += piece.size();
+    tokens.reserve(total);
+
+    size_t position = 0;
+    size_t line = 1;
+    for (size_t chunk = 0; chunk < count; ++chunk)
+    {
+        const auto& piece = pieces[chunk];
+        auto it = std::find_if(std::cbegin(piece), std::cend(piece), [&](const Token& token) { return offset(token) >= position; });
+
+        // the previous chunk ended inside a token or the speculation went
+        // astray, so lex for real until a speculative token starts here
+        while (position < starts[chunk + 1] && (it == std::cend(piece) || offset(*it) != position))
+        {
+            Match match = scan(text.substr(position), true);
+            std::string_view value = text.substr(position, match.length);
+            tokens.push_back(Token{ match.type, value, line });
+            line += countLines(value);
+            position += match.length;
+            while (it != std::cend(piece) && offset(*it) < position)
+                ++it;
+        }
+        if (position >= starts[chunk + 1])
+            continue;
+
+        tokens.insert(std::end(tokens), it, std::cend(piece));
+        const Token& last = tokens.back();
+        position = offset(last) + last.value().size();
+        line = last.line() + countLines(last.value());
+    }
+    tokens.push_back(Token{ endOfFile(), text.substr(text.size()), line });
+
+    return tokens;
+}
+
+void DfaLexer::lex(std::string_view text, size_t from, size_t until, size_t limit, size_t line,
+    std::vector<Token>& tokens) const
+{
+    while (from < until)
+    {
+        std::string_view window = text.substr(from, until - from + limit);
+        Match match = scan(window, window.size() == text.size() - from);
+        if (!match.complete)
+            return;
+
+        std::string_view value = text.substr(from, match.length);
+        tokens.push_back(Token{ match.type, value, line });
+        line += countLines(value);
+        from += match.length;
+    }
+}
+
+DfaLexer::Match DfaLexer::scan(std::string_view text, bool final) const
+{
+    State state = Start;
+    std::int16_t type = NoToken;
+    size_t accepted = 0;
+
+    size_t cursor = 0;
+    while (cursor != text.size())
+    {
+        state = _transitions[state][static_cast<unsigned char>(text[cursor])];
+        if (state == Dead)
+            break;
+        ++cursor;
+        if (!_exits[state].empty())
+            cursor = findAny(text, cursor, _exits[state]);
+        if (_accept[state] != NoToken)
+        {
+            type = _accept[state];
+            accepted = cursor;
+        }
+    }
+
+    if (cursor == text.size() && state != Dead)
+    {
+        if (!final)
+            return Match{ _ids[_undefined], cursor, false };
+        if (_open[state])
+            return Match{ _ids[_undefined], cursor, true };
+    }
+    if (type == NoToken)
+        return Match{ _ids[_undefined], 1, true };
+
+    return Match{ _ids[type], accepted, true };
+}
+
+std::vector<TokenType::Id> DfaLexer::trivia() const
+{
+    std::vector<TokenType::Id> ids;
+    for (const TokenType& type : _types)
+    {
+        switch (type.pattern().kind)
+        {
+        case Pattern::Kind::Whitespace:
+        case Pattern::Kind::LineComment:
+        case Pattern::Kind::BlockComment:
+            ids.push_back(type.id());
+            break;
+        default:
+            break;
+        }
+    }
+    return ids;
+}
+
+std::optional<TokenType::Id> DfaLexer::spaceToken() const { return _spaceToken; }
+
+TokenType::Id DfaLexer::endOfFile() const { return _ids[_endOfFile]; }
+
+size_t DfaLexer::stateCount() const { return _transitions.size(); }
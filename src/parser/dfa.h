@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "token.h"
+
+class Scheduler;
+
+// Lexer that compiles the Pattern of every TokenType into one deterministic
+// automaton with a byte indexed transition table. Token ordering and the
+// per-type extent rules are the same as Lexer, so both produce the same tokens.
+class DfaLexer
+{
+public:
+    DfaLexer(std::vector<TokenType> types);
+
+    // tokens view the given text, which must outlive them
+    std::vector<Token> process(std::string_view text) const;
+    // reads the stream into text, which the tokens view and must outlive them
+    std::vector<Token> process(std::istream& data, std::string& text) const;
+    // Lexes chunks of about chunkSize bytes on the scheduler's threads. Each
+    // chunk is lexed speculatively as if a token began at its start, then the
+    // chunks are stitched in order, relexing from where the previous chunk
+    // really ended until the speculative tokens line up again.
+    std::vector<Token> process(std::string_view text, Scheduler& scheduler,
+        size_t chunkSize = DefaultChunkSize) const;
+
+    static constexpr size_t DefaultChunkSize = 1 << 20;
+
+    // Longest token at the start of a non-empty text. Unless final is set, a
+    // token that may continue past the end of the text is reported incomplete.
+    struct Match
+    {
+        TokenType::Id type;
+        size_t length;
+        bool complete;
+    };
+    Match scan(std::string_view text, bool final) const;
+
+    // whitespace and comment types, which a TokenStream skips by default
+    std::vector<TokenType::Id> trivia() const;
+    // the type every whitespace byte lexes to as a token of its own, if any,
+    // so a run of them can be skipped without scanning token by token
+    std::optional<TokenType::Id> spaceToken() const;
+    TokenType::Id endOfFile() const;
+    size_t stateCount() const;
+
+private:
+    using State = std::uint16_t;
+    static constexpr State Dead = 0;
+    static constexpr State Start = 1;
+    static constexpr std::int16_t NoToken = -1;
+    static constexpr size_t MaxExits = 4;
+
+    void compile();
+    // appends the tokens starting in [from, until), giving up at a token that
+    // may end more than limit bytes past until
+    void lex(std::string_view text, size_t from, size_t until, size_t limit, size_t line,
+        std::vector<Token>& tokens) const;
+
+    std::vector<TokenType> _types;
+    std::vector<TokenType::Id> _ids;
+    size_t _undefined;
+    size_t _endOfFile;
+    std::vector<std::array<State, 256>> _transitions;
+    std::vector<std::int16_t> _accept;
+    std::vector<bool> _open;
+    // for states that loop on all but a few bytes, those bytes, so scan can
+    // jump straight to the next one
+    std::vector<std::string> _exits;
+    std::optional<TokenType::Id> _spaceToken;
+};
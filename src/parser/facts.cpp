@@ -0,0 +1,288 @@
+#include "facts.h"
+
+#include <algorithm>
+#include <cctype>
+#include "scan.h"
+#include "../scheduler.h"
+
+namespace
+{
+    // Skips whitespace and comments the way the lexer's trivia patterns do.
+    // Returns false when the text ends before anything significant.
+    bool skipTrivia(std::string_view text, size_t& at)
+    {
+        while (at < text.size())
+        {
+            at = skipSpaces(text, at);
+            if (at == text.size())
+                return false;
+
+            if (text[at] == '#')
+            {
+                if (at + 1 == text.size())
+                    return false;
+
+                if (text[at + 1] == '|')
+                {
+                    size_t end = at + 2;
+                    do
+                    {
+                        end = findAny(text, end, "|");
+                        if (end + 1 >= text.size())
+                            return false;
+                    } while (text[++end] != '#');
+                    at = end + 1;
+                }
+                else
+                {
+                    at = findAny(text, at + 1, "\n");
+                    if (at == text.size())
+                        return false;
+                }
+            }
+            else
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+FactLoader::FactLoader(const LL1Parser& parser, DatalogAst& ast, Scheduler* scheduler, size_t chunkSize)
+    : _lexer{ parser.lexer() },
+    _ast{ ast },
+    _scheduler{ scheduler },
+    _chunkSize{ std::max<size_t>(chunkSize, 1) },
+    _id{ parser.terminal("ID") },
+    _table{ ast.facts.size() } {}
+
+size_t FactLoader::load(TokenStream& tokens)
+{
+    if (_scheduler && _scheduler->threads() > 1 && tokens.exhausted() && tokens.buffered().size() >= 2 * _chunkSize)
+        return loadChunks(tokens);
+
+    SymbolTable& symbols = SymbolTable::global();
+    size_t loaded = 0;
+    while (true)
+    {
+        std::string_view text = tokens.buffered();
+        size_t at = 0;
+        std::string_view name;
+        _strings.clear();
+        Scan scan = scanFact(text, at, name, _strings);
+
+        if (scan == Scan::More && !tokens.exhausted())
+        {
+            tokens.fill();
+            continue;
+        }
+        if (scan != Scan::Done)
+            return loaded;
+
+        auto arity = static_cast<std::uint32_t>(_strings.size());
+        auto& values = table(symbols.intern(name), arity);
+        for (std::string_view value : _strings)
+            values.push_back(symbols.intern(value));
+
+        // name ( strings with commas between them ) .
+        tokens.consume(at, 2 * _strings.size() + 3);
+        ++loaded;
+    }
+}
+
+size_t FactLoader::loadChunks(TokenStream& tokens)
+{
+    std::string_view text = tokens.buffered();
+    std::vector<size_t> starts{ 0 };
+    while (text.size() - starts.back() > _chunkSize)
+    {
+        size_t newline = findAny(text, starts.back() + _chunkSize, "\n");
+        if (newline + 1 >= text.size())
+            break;
+        starts.push_back(newline + 1);
+    }
+    starts.push_back(text.size());
+    size_t count = starts.size() - 1;
+
+    // scans one fact into the piece, or leaves both as they were
+    auto scanInto = [this, &text](Piece& piece, size_t& at) {
+        size_t from = at;
+        size_t first = piece.strings.size();
+        std::string_view name;
+        if (scanFact(text, at, name, piece.strings) != Scan::Done)
+        {
+            at = from;
+            piece.strings.resize(first);
+            return false;
+        }
+        auto start = static_cast<size_t>(name.data() - text.data());
+        auto arity = static_cast<std::uint32_t>(piece.strings.size() - first);
+        piece.facts.push_back(Piece::Fact{ start, at, name, first, arity });
+        return true;
+    };
+
+    std::vector<Piece> speculated(count);
+    _scheduler->parallelFor(count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+        {
+            Piece& piece = speculated[chunk];
+            size_t at = starts[chunk];
+            while (at < starts[chunk + 1] && scanInto(piece, at))
+                ;
+            piece.accepted = piece.facts.size();
+        }
+    });
+
+    std::vector<Piece> rescanned(count);
+    size_t position = 0;
+    bool done = false;
+    for (size_t chunk = 0; chunk < count && !done; ++chunk)
+    {
+        Piece& piece = speculated[chunk];
+        auto it = std::partition_point(std::cbegin(piece.facts), std::cend(piece.facts),
+            [position](const Piece::Fact& fact) { return fact.start < position; });
+
+        while (position < starts[chunk + 1])
+        {
+            size_t next = position;
+            if (!skipTrivia(text, next))
+            {
+                done = true;
+                break;
+            }
+            if (it != std::cend(piece.facts) && it->start == next)
+            {
+                piece.accepted = static_cast<size_t>(it - std::cbegin(piece.facts));
+                position = piece.facts.back().end;
+                break;
+            }
+            if (next >= starts[chunk + 1])
+                break;
+
+            // the previous chunk ended inside a fact or the speculation went
+            // astray, so scan for real until a speculative fact starts here
+            if (!scanInto(rescanned[chunk], position))
+            {
+                done = true;
+                break;
+            }
+            while (it != std::cend(piece.facts) && it->start < position)
+                ++it;
+        }
+    }
+
+    SymbolTable& symbols = SymbolTable::global();
+    auto intern = [&symbols](Piece& piece) {
+        for (size_t f = piece.accepted; f < piece.facts.size(); ++f)
+        {
+            const Piece::Fact& fact = piece.facts[f];
+            piece.symbols.push_back(symbols.intern(fact.name));
+            for (size_t s = fact.first; s < fact.first + fact.arity; ++s)
+                piece.symbols.push_back(symbols.intern(piece.strings[s]));
+        }
+    };
+    _scheduler->parallelFor(count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+        {
+            intern(rescanned[chunk]);
+            intern(speculated[chunk]);
+        }
+    });
+
+    size_t loaded = 0;
+    size_t consumed = 0;
+    for (size_t chunk = 0; chunk < count; ++chunk)
+    {
+        for (const Piece* piece : { &rescanned[chunk], &speculated[chunk] })
+        {
+            const Symbol* symbol = piece->symbols.data();
+            for (size_t f = piece->accepted; f < piece->facts.size(); ++f)
+            {
+                std::uint32_t arity = piece->facts[f].arity;
+                auto& values = table(*symbol, arity);
+                values.insert(std::end(values), symbol + 1, symbol + 1 + arity);
+                symbol += 1 + arity;
+                consumed += 2 * arity + 3;
+                ++loaded;
+            }
+        }
+    }
+
+    tokens.consume(position, consumed);
+    return loaded;
+}
+
+std::pmr::vector<Symbol>& FactLoader::table(Symbol name, std::uint32_t arity)
+{
+    // consecutive facts usually share a relation, so keep appending to the same table
+    if (_table == _ast.facts.size() || _ast.facts[_table].name != name || _ast.facts[_table].arity != arity)
+        _table = static_cast<size_t>(&_ast.factTable(name, arity) - _ast.facts.data());
+    return _ast.facts[_table].values;
+}
+
+FactLoader::Scan FactLoader::scanFact(std::string_view text, size_t& at, std::string_view& name,
+    std::vector<std::string_view>& strings) const
+{
+    auto skip = [&text, &at]() { return skipTrivia(text, at) ? Scan::Done : Scan::More; };
+
+    if (skip() != Scan::Done)
+        return Scan::More;
+
+    // the name must lex as an ID, which rules out the section keywords
+    size_t start = at;
+    while (at < text.size() && std::isalnum(static_cast<unsigned char>(text[at])))
+        ++at;
+    if (at == text.size())
+        return Scan::More;
+    if (at == start)
+        return Scan::Invalid;
+
+    auto match = _lexer.scan(text.substr(start), false);
+    if (!match.complete || match.type != _id || match.length != at - start)
+        return Scan::Invalid;
+    name = text.substr(start, at - start);
+
+    if (skip() != Scan::Done)
+        return Scan::More;
+    if (text[at++] != '(')
+        return Scan::Invalid;
+
+    while (true)
+    {
+        if (skip() != Scan::Done)
+            return Scan::More;
+        if (text[at] != '\'')
+            return Scan::Invalid;
+
+        size_t first = at++;
+        while (true)
+        {
+            at = findAny(text, at, "'");
+            if (at == text.size())
+                return Scan::More;
+            ++at;
+            if (at == text.size())
+                return Scan::More;
+            if (text[at] != '\'')
+                break;
+            ++at;
+        }
+        strings.push_back(text.substr(first, at - first));
+
+        if (skip() != Scan::Done)
+            return Scan::More;
+        char separator = text[at++];
+        if (separator == ')')
+            break;
+        if (separator != ',')
+            return Scan::Invalid;
+    }
+
+    if (skip() != Scan::Done)
+        return Scan::More;
+    if (text[at++] != '.')
+        return Scan::Invalid;
+
+    return Scan::Done;
+}
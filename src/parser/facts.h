@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+#include "ast.h"
+#include "stream.h"
+
+class Scheduler;
+
+// Bulk loader for the Facts section. It scans facts straight from the
+// stream's bytes into the row-major fact tables of a DatalogAst, interning
+// names and strings as it goes and never building Token objects. It stops in
+// front of the first thing that is not a well-formed fact (normally the Rules
+// keyword) and leaves that to the parser.
+class FactLoader
+{
+public:
+    // with a scheduler, input held in memory is scanned in chunks of about
+    // chunkSize bytes on its threads
+    FactLoader(const LL1Parser& parser, DatalogAst& ast, Scheduler* scheduler = nullptr,
+        size_t chunkSize = DefaultChunkSize);
+
+    // returns the number of facts loaded
+    size_t load(TokenStream& tokens);
+
+    static constexpr size_t DefaultChunkSize = 1 << 20;
+
+private:
+    enum class Scan { Done, More, Invalid };
+
+    // facts scanned from one chunk, their strings in order
+    struct Piece
+    {
+        struct Fact
+        {
+            size_t start;  // of the name
+            size_t end;    // just past the '.'
+            std::string_view name;
+            size_t first;  // of its strings
+            std::uint32_t arity;
+        };
+
+        std::vector<Fact> facts;
+        std::vector<std::string_view> strings;
+        size_t accepted = 0;  // facts before this one were speculation gone astray
+        std::vector<Symbol> symbols;  // per accepted fact its name, then its strings
+    };
+
+    // Splits the text at newlines, scans every chunk as if a fact began at its
+    // start, then stitches the chunks in order the way DfaLexer::process does,
+    // rescanning from where the previous chunk ended until a speculative fact
+    // starts there. Only facts that are kept are interned.
+    size_t loadChunks(TokenStream& tokens);
+    // appends the fact's strings, whatever the result
+    Scan scanFact(std::string_view text, size_t& at, std::string_view& name,
+        std::vector<std::string_view>& strings) const;
+    // the values of the table for name/arity
+    std::pmr::vector<Symbol>& table(Symbol name, std::uint32_t arity);
+
+    const DfaLexer& _lexer;
+    DatalogAst& _ast;
+    Scheduler* _scheduler;
+    size_t _chunkSize;
+    TokenType::Id _id;
+    std::vector<std::string_view> _strings;
+    size_t _table;
+};
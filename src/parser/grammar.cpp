@@ -1,6 +1,10 @@
 #include "grammar.h"
+#include <array>
 #include <functional>
+#include <stdexcept>
 #include <string>
+#include "parser.h"
+#include "syntax.h"
 
 Grammar::Grammar(Variable startSymbol)
     : _startSymbol{ startSymbol }
@@ -10,22 +14,28 @@ Grammar::Grammar(Variable startSymbol)
 
 void Grammar::addTerminal(TokenType tokenType) { _terminals.push_back(tokenType); }
 
-void Grammar::addProduction(std::pair<Variable, std::vector<Variable>> production)
+void Grammar::addProduction(Production production)
 {
-    _productions.push_back(production);
     for (const Variable& variable : production.second)
     {
         auto it = std::find_if(std::cbegin(_variables), std::cend(_variables), [&variable](const Variable& candidate) { 
-            return variable.name() == candidate.name();
+            return variable.symbol() == candidate.symbol();
         });
         if (it == std::cend(_variables))
         {
             _variables.push_back(variable);
         }
     }
+    _productions.push_back(std::move(production));
 }
 
-std::vector<TokenType> Grammar::terminals() const { return _terminals; }
+const std::vector<TokenType>& Grammar::terminals() const { return _terminals; }
+
+const std::vector<Variable>& Grammar::variables() const { return _variables; }
+
+const std::vector<Grammar::Production>& Grammar::productions() const { return _productions; }
+
+const Variable& Grammar::startSymbol() const { return _startSymbol; }
 
 bool checkSpecificCharacter(std::istream& stream, char character)
 {
@@ -159,139 +169,94 @@ std::string getString(std::istream& stream)
     return result;
 }
 
+TokenType createTokenType(std::string_view name, Pattern::Kind kind, std::string_view text)
+{
+    std::string value{ text };
+    Pattern pattern{ kind, value };
+    switch (kind)
+    {
+    case Pattern::Kind::Character:
+        return TokenType{ name, [c = value[0]](std::istream& stream) { return checkSpecificCharacter(stream, c); },
+            getSingleCharacterAsString, pattern };
+    case Pattern::Kind::Sequence:
+        return TokenType{ name, [value](std::istream& stream) { return checkSequence(stream, value); },
+            [value](std::istream& stream) { return getSequence(stream, value); }, pattern };
+    case Pattern::Kind::Keyword:
+        return TokenType{ name, [value](std::istream& stream) { return checkKeyword(stream, value); },
+            getIdentifier, pattern };
+    case Pattern::Kind::Identifier:
+        return TokenType{ name, checkIdentifier, getIdentifier, pattern };
+    case Pattern::Kind::LineComment:
+        return TokenType{ name, [c = value[0]](std::istream& stream) { return checkSpecificCharacter(stream, c); },
+            getLineComment, pattern };
+    case Pattern::Kind::BlockComment:
+        return TokenType{ name, [value](std::istream& stream) { return checkSequence(stream, value); },
+            getBlockComment, pattern };
+    case Pattern::Kind::String:
+        return TokenType{ name, [c = value[0]](std::istream& stream) { return checkSpecificCharacter(stream, c); },
+            getString, pattern };
+    default:
+        throw std::invalid_argument{ "no matcher for the pattern of " + std::string{ name } };
+    }
+}
+
 Grammar DatalogGrammarFactory::createDatalogGrammar()
 {
-    Variable datalogProgram{ std::string{ "DATALOG" } };
-    Variable scheme{ std::string{ "SCHEME" } };
-    Variable schemeList{ std::string{ "SCHEME_LIST" } };
-    Variable idList{ std::string{ "ID_LIST" } };
-    Variable fact{ std::string{ "FACT" } };
-    Variable factList{ std::string{ "FACT_LIST" } };
-    Variable rule{ std::string{ "RULE" } };
-    Variable ruleList{ std::string{ "RULE_LIST" } };
-    Variable headPredicate{ std::string{ "HEAD_PREDICATE" } };
-    Variable predicate{ std::string{ "PREDICATE" } };
-    Variable predicateList{ std::string{ "PREDICATE_LIST" } };
-    Variable parameter{ std::string{ "PARAMETER" } };
-    Variable parameterList{ std::string{ "PARAMETER_LIST" } };
-    Variable expression{ std::string{ "EXPRESSION" } };
-    Variable operatorr{ std::string{ "OPERATOR" } };
-    Variable query{ std::string{ "QUERY" } };
-    Variable queryList{ std::string{ "QUERY_LIST" } };
-    Variable stringList{ std::string{ "STRING_LIST" } };
-
-    TokenType COMMENT{ std::string { "COMMENT" },
-        std::bind(checkSequence, std::placeholders::_1, std::string{ "#|" }),
-        getBlockComment };
-    TokenType COMMENT2{ std::string { "COMMENT" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, '#'),
-        getLineComment };
-    TokenType STRING{ std::string{ "STRING" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, '\''),
-        getString };
-    TokenType SCHEMES{ std::string{ "SCHEMES" },
-        std::bind(checkKeyword, std::placeholders::_1, std::string{ "Schemes" }),
-        getIdentifier };
-    TokenType FACTS{ std::string{ "FACTS" },
-        std::bind(checkKeyword, std::placeholders::_1, std::string{ "Facts" }),
-        getIdentifier };
-    TokenType RULES{ std::string{ "RULES" },
-        std::bind(checkKeyword, std::placeholders::_1, std::string{ "Rules" }),
-        getIdentifier };
-    TokenType QUERIES{ std::string{ "QUERIES" },
-        std::bind(checkKeyword, std::placeholders::_1, std::string{ "Queries" }),
-        getIdentifier };
-    TokenType ID{ std::string{ "ID" },
-        checkIdentifier,
-        getIdentifier };
-    TokenType COLDASH{ std::string{ "COLON_DASH" },
-        std::bind(checkSequence, std::placeholders::_1, ":-"),
-        std::bind(getSequence, std::placeholders::_1, ":-") };
-    TokenType COMMA{ std::string{ "COMMA" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, ','),
-        getSingleCharacterAsString };
-    TokenType PERIOD{ std::string{ "PERIOD" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, '.'),
-        getSingleCharacterAsString };
-    TokenType QMARK{ std::string{ "Q_MARK" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, '?'),
-        getSingleCharacterAsString };
-    TokenType LPAREN{ std::string{ "L_PAREN" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, '('),
-        getSingleCharacterAsString };
-    TokenType RPAREN{ std::string{ "R_PAREN" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, ')'),
-        getSingleCharacterAsString };
-    TokenType COLON{ std::string{ "COLON" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, ':'),
-        getSingleCharacterAsString };
-    TokenType MULTIPLY{ std::string{ "MULTIPLY" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, '*'),
-        getSingleCharacterAsString };
-    TokenType ADD{ std::string{ "ADD" },
-        std::bind(checkSpecificCharacter, std::placeholders::_1, '+'),
-        getSingleCharacterAsString };
-
-    Grammar datalogGrammar{ datalogProgram };
-
-    datalogGrammar.addTerminal(COMMENT); 
-    datalogGrammar.addTerminal(COMMENT2);
-    datalogGrammar.addTerminal(STRING);
-    datalogGrammar.addTerminal(SCHEMES);
-    datalogGrammar.addTerminal(FACTS);
-    datalogGrammar.addTerminal(RULES);
-    datalogGrammar.addTerminal(QUERIES);
-    datalogGrammar.addTerminal(ID);
-    datalogGrammar.addTerminal(COLDASH);
-    datalogGrammar.addTerminal(COMMA);
-    datalogGrammar.addTerminal(PERIOD);
-    datalogGrammar.addTerminal(QMARK);
-    datalogGrammar.addTerminal(LPAREN);
-    datalogGrammar.addTerminal(RPAREN);
-    datalogGrammar.addTerminal(COLON);
-    datalogGrammar.addTerminal(MULTIPLY);
-    datalogGrammar.addTerminal(ADD);
-
-    using VarList = std::vector<Variable>;
-    std::vector<Variable> EPSILON;
-    datalogGrammar.addProduction(std::make_pair(datalogProgram,
-        VarList{ { SCHEMES, COLON, scheme, schemeList, FACTS, COLON, factList,
-            RULES, COLON, ruleList, QUERIES, COLON, query, queryList } }));
-    datalogGrammar.addProduction(std::make_pair(scheme,
-        VarList{ { ID, LPAREN, ID, idList, RPAREN } }));
-    datalogGrammar.addProduction(std::make_pair(schemeList, VarList{ { scheme, schemeList } }));
-    datalogGrammar.addProduction(std::make_pair(schemeList, EPSILON));
-    datalogGrammar.addProduction(std::make_pair(idList, VarList{ { COMMA, ID, idList } }));
-    datalogGrammar.addProduction(std::make_pair(idList, EPSILON));
-    datalogGrammar.addProduction(std::make_pair(fact,
-        VarList{ { ID, LPAREN, STRING, stringList, RPAREN, PERIOD } }));
-    datalogGrammar.addProduction(std::make_pair(factList, VarList{ { fact, factList } }));
-    datalogGrammar.addProduction(std::make_pair(factList, EPSILON));
-    datalogGrammar.addProduction(std::make_pair(rule,
-        VarList{ { headPredicate, COLDASH, predicate, predicateList, PERIOD } }));
-    datalogGrammar.addProduction(std::make_pair(ruleList, VarList{ { rule, ruleList } }));
-    datalogGrammar.addProduction(std::make_pair(ruleList, EPSILON));
-    datalogGrammar.addProduction(std::make_pair(headPredicate,
-        VarList{ { ID, LPAREN, ID, idList, RPAREN } }));
-    datalogGrammar.addProduction(std::make_pair(predicate,
-        VarList{ { ID, LPAREN, parameter, parameterList, RPAREN } }));
-    datalogGrammar.addProduction(std::make_pair(predicateList, 
-        VarList{ { COMMA, predicate, predicateList } }));
-    datalogGrammar.addProduction(std::make_pair(predicateList, EPSILON));
-    datalogGrammar.addProduction(std::make_pair(parameter, VarList{ { STRING } }));
-    datalogGrammar.addProduction(std::make_pair(parameter, VarList{ { ID } }));
-    datalogGrammar.addProduction(std::make_pair(parameter, VarList{ { expression } }));
-    datalogGrammar.addProduction(std::make_pair(parameterList, VarList{ { COMMA, parameter, parameterList } }));
-    datalogGrammar.addProduction(std::make_pair(parameterList, EPSILON));
-    datalogGrammar.addProduction(std::make_pair(expression,
-        VarList{ { LPAREN, parameter, operatorr, parameter, RPAREN } }));
-    datalogGrammar.addProduction(std::make_pair(operatorr, VarList{ { ADD } }));
-    datalogGrammar.addProduction(std::make_pair(operatorr, VarList{ { MULTIPLY } }));
-    datalogGrammar.addProduction(std::make_pair(query, VarList{ { predicate, QMARK } }));
-    datalogGrammar.addProduction(std::make_pair(queryList, VarList{ { query, queryList } }));
-    datalogGrammar.addProduction(std::make_pair(queryList, EPSILON));
-    datalogGrammar.addProduction(std::make_pair(stringList, VarList{ { COMMA, STRING, stringList } }));
-    datalogGrammar.addProduction(std::make_pair(stringList, EPSILON));
+    using namespace DatalogSyntax;
+
+    std::vector<Variable> symbols;
+    for (Terminal terminal = Undefined; terminal != TerminalCount; terminal = static_cast<Terminal>(terminal + 1))
+        symbols.emplace_back(terminalNames[terminal]);
+    for (std::string_view name : nonterminalNames)
+        symbols.emplace_back(name);
+
+    Grammar datalogGrammar{ symbols[nonterminal(Datalog)] };
+    for (const Lexeme& lexeme : lexemes)
+        datalogGrammar.addTerminal(createTokenType(terminalNames[lexeme.terminal], lexeme.kind, lexeme.text));
+
+    for (const DatalogSyntax::Production& production : productions)
+    {
+        std::vector<Variable> rhs;
+        for (size_t i = 0; i < production.length; ++i)
+            rhs.push_back(symbols[production.rhs[i]]);
+        datalogGrammar.addProduction(std::make_pair(symbols[nonterminal(production.lhs)], std::move(rhs)));
+    }
 
     return datalogGrammar;
-}
\ No newline at end of file
+}
+
+LL1Parser DatalogGrammarFactory::createDatalogParser()
+{
+    const auto& cells = DatalogSyntax::parseTable.cells;
+    return LL1Parser{ createDatalogGrammar(), std::vector<std::int32_t>(std::cbegin(cells), std::cend(cells)) };
+}
+
+Grammar DatalogGrammarFactory::createShardGrammar()
+{
+    Grammar datalogGrammar = createDatalogGrammar();
+    Grammar shardGrammar{ Variable{ "SHARD" } };
+    for (const TokenType& terminal : datalogGrammar.terminals())
+        shardGrammar.addTerminal(terminal);
+
+    const std::array<std::pair<std::string_view, std::string_view>, 4> sections{ {
+        { "SCHEMES", "SCHEME_LIST" }, { "FACTS", "FACT_LIST" }, { "RULES", "RULE_LIST" }, { "QUERIES", "QUERY_LIST" } } };
+    std::vector<Variable> rhs;
+    for (const auto& section : sections)
+        rhs.emplace_back(std::string{ section.first } + "_SECTION");
+    shardGrammar.addProduction(std::make_pair(Variable{ "SHARD" }, rhs));
+    for (const auto& section : sections)
+    {
+        Variable lhs{ std::string{ section.first } + "_SECTION" };
+        shardGrammar.addProduction(std::make_pair(lhs, std::vector<Variable>{ Variable{ section.first }, Variable{ "COLON" }, Variable{ section.second } }));
+        shardGrammar.addProduction(std::make_pair(lhs, std::vector<Variable>{}));
+    }
+
+    for (const auto& production : datalogGrammar.productions())
+    {
+        if (production.first.symbol() != datalogGrammar.startSymbol().symbol())
+            shardGrammar.addProduction(production);
+    }
+    return shardGrammar;
+}
+
+LL1Parser DatalogGrammarFactory::createShardParser() { return LL1Parser{ createShardGrammar() }; }
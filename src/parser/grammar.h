@@ -3,25 +3,42 @@
 #include <vector>
 #include "token.h"
 
+class LL1Parser;
+
 class Grammar
 {
 public:
+    using Production = std::pair<Variable, std::vector<Variable>>;
+
     Grammar(Variable startSymbol);
 
     void addTerminal(TokenType tokenType);
-    void addProduction(std::pair<Variable, std::vector<Variable>> production);
+    void addProduction(Production production);
 
-    std::vector<TokenType> terminals() const;
+    const std::vector<TokenType>& terminals() const;
+    const std::vector<Variable>& variables() const;
+    const std::vector<Production>& productions() const;
+    const Variable& startSymbol() const;
 
 private:
     std::vector<Variable> _variables;
     std::vector<TokenType> _terminals;
     Variable _startSymbol;
-    std::vector<std::pair<Variable, std::vector<Variable>>> _productions;
+    std::vector<Production> _productions;
 };
 
 class DatalogGrammarFactory
 {
 public:
+    // built from the tables in syntax.h; the parser takes the LL(1) table
+    // computed at compile time instead of deriving it again
     static Grammar createDatalogGrammar();
+    static LL1Parser createDatalogParser();
+
+    // One input of a program split across files: the same sections in the
+    // same order, but each may be left out or empty, so a file can hold only
+    // schemes, only rules or a shard of the facts. Its table is computed at
+    // runtime.
+    static Grammar createShardGrammar();
+    static LL1Parser createShardParser();
 };
\ No newline at end of file
@@ -12,7 +12,9 @@ Lexer::Lexer(std::vector<TokenType> types)
 
 std::vector<Token> Lexer::process(std::istream& data)
 {
-    std::vector<Token> tokens;
+    struct Extent { TokenType::Id type; size_t offset; size_t length; size_t line; };
+    std::vector<Extent> extents;
+    std::string& text = _sources.emplace_back();
 
     size_t line = 1;
     while (!data.eof())
@@ -24,16 +26,17 @@ std::vector<Token> Lexer::process(std::istream& data)
         {
             auto value = it->extractNext(data);
 
-            bool unexpectedEof = data.eof() && it->name() != TokenType::EndOfFile.name();
+            bool unexpectedEof = data.eof() && it->id() != TokenType::EndOfFile.id();
             if (unexpectedEof)
-                tokens.push_back(Token{ TokenType::Undefined, value, line });
+                extents.push_back(Extent{ TokenType::Undefined.id(), text.size(), value.size(), line });
             else
-                tokens.push_back(Token{ *it, value, line });   
+                extents.push_back(Extent{ it->id(), text.size(), value.size(), line });
+            text += value;
 
             line += std::count(std::cbegin(value), std::cend(value), '\n');
 
             if (unexpectedEof)
-                tokens.push_back(Token{ TokenType::EndOfFile, std::string{}, line });
+                extents.push_back(Extent{ TokenType::EndOfFile.id(), text.size(), 0, line });
         }
         else
         {
@@ -41,5 +44,11 @@ std::vector<Token> Lexer::process(std::istream& data)
         }
     }
 
+    std::vector<Token> tokens;
+    tokens.reserve(extents.size());
+    std::string_view view{ text };
+    for (const Extent& extent : extents)
+        tokens.push_back(Token{ extent.type, view.substr(extent.offset, extent.length), extent.line });
+
     return tokens;
 }
\ No newline at end of file
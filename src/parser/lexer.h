@@ -1,5 +1,7 @@
 #pragma once
 
+#include <list>
+#include <string>
 #include <vector>
 #include <fstream>
 #include "token.h"
@@ -8,8 +10,11 @@ class Lexer
 {
 public:
     Lexer(std::vector<TokenType> types);
+
+    // tokens view text owned by the lexer and stay valid for its lifetime
     std::vector<Token> process(std::istream& data);
 
 private:
     std::vector<TokenType> _types;
+    std::list<std::string> _sources;
 };
\ No newline at end of file
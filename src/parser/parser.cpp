@@ -1,17 +1,292 @@
 #include "parser.h"
 
+#include <algorithm>
+#include <sstream>
 #include <stdexcept>
+#include "source.h"
+
+namespace
+{
+    template <typename Items>
+    size_t indexOf(const Items& items, Symbol symbol)
+    {
+        auto it = std::find_if(std::cbegin(items), std::cend(items), [symbol](const auto& item) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(item)>, Symbol>)
+                return item == symbol;
+            else
+                return item.first == symbol;
+        });
+        return static_cast<size_t>(std::distance(std::cbegin(items), it));
+    }
+
+    std::string nameOf(Symbol symbol) { return std::string{ SymbolTable::global().text(symbol) }; }
+
+    std::string describe(const Token& token)
+    {
+        std::ostringstream out;
+        out << token;
+        return out.str();
+    }
+}
 
 LL1Parser::LL1Parser(Grammar grammar)
-    : _grammar{ grammar }
+    : _grammar{ grammar }, _lexer{ grammar.terminals() }
 {
-    // construct parse table and check for first/follow conflicts
-    // throw std::invalid_argument{ "grammar is not LL1" };
+    number();
+    computeTable();
 }
 
-void LL1Parser::process(std::filesystem::path filepath)
+LL1Parser::LL1Parser(Grammar grammar, std::vector<std::int32_t> table)
+    : _grammar{ grammar }, _lexer{ grammar.terminals() }, _table{ std::move(table) }
 {
-    // stream = if file
-    // vec<tokens> = _lexer.process(stream);
-    //
-}
\ No newline at end of file
+    number();
+    if (_table.size() != _nonterminals.size() * _columns)
+        throw std::invalid_argument{ "parse table does not match the grammar" };
+    for (std::int32_t cell : _table)
+    {
+        if (cell != NoProduction && (cell < 0 || static_cast<size_t>(cell) >= _grammar.productions().size()))
+            throw std::invalid_argument{ "parse table names an unknown production" };
+    }
+}
+
+void LL1Parser::number()
+{
+    const auto& productions = _grammar.productions();
+
+    // number the symbols once; everything after this point works on ids
+    TokenType::Id endOfFile = TokenType::EndOfFile.id();
+    _terminals.emplace_back(TokenType::EndOfFile.symbol(), endOfFile);
+    for (const TokenType& terminal : _grammar.terminals())
+    {
+        size_t index = indexOf(_terminals, terminal.symbol());
+        if (index == _terminals.size())
+            _terminals.emplace_back(terminal.symbol(), terminal.id());
+        else if (_terminals[index].second != terminal.id())
+            _aliases.emplace_back(terminal.id(), _terminals[index].second);
+    }
+    for (const auto& production : productions)
+        if (indexOf(_nonterminals, production.first.symbol()) == _nonterminals.size())
+            _nonterminals.push_back(production.first.symbol());
+
+    _start = static_cast<std::uint32_t>(indexOf(_nonterminals, _grammar.startSymbol().symbol()));
+    if (_start == _nonterminals.size())
+        throw std::invalid_argument{ "start symbol has no productions" };
+
+    _columns = 0;
+    for (const auto& terminal : _terminals)
+        _columns = std::max<size_t>(_columns, terminal.second + 1u);
+
+    for (const auto& production : productions)
+    {
+        _rhsOffsets.push_back(_rhs.size());
+        for (const Variable& symbol : production.second)
+        {
+            size_t nonterminal = indexOf(_nonterminals, symbol.symbol());
+            size_t terminal = indexOf(_terminals, symbol.symbol());
+            if (nonterminal != _nonterminals.size())
+                _rhs.push_back(Entry{ Entry::Kind::Nonterminal, static_cast<std::uint32_t>(nonterminal) });
+            else if (terminal != _terminals.size())
+                _rhs.push_back(Entry{ Entry::Kind::Terminal, _terminals[terminal].second });
+            else
+                throw std::invalid_argument{ "symbol " + nameOf(symbol.symbol()) + " is neither a terminal nor a nonterminal" };
+        }
+    }
+    _rhsOffsets.push_back(_rhs.size());
+}
+
+void LL1Parser::computeTable()
+{
+    const auto& productions = _grammar.productions();
+    TokenType::Id endOfFile = TokenType::EndOfFile.id();
+
+    // FIRST and FOLLOW as bitmaps over token ids, iterated to a fixpoint
+    size_t count = _nonterminals.size();
+    std::vector<bool> nullable(count, false);
+    std::vector<std::vector<bool>> first(count, std::vector<bool>(_columns, false));
+    std::vector<std::vector<bool>> follow(count, std::vector<bool>(_columns, false));
+    follow[_start][endOfFile] = true;
+
+    auto merge = [](std::vector<bool>& target, const std::vector<bool>& source) {
+        bool changed = false;
+        for (size_t i = 0; i < target.size(); ++i)
+        {
+            if (source[i] && !target[i])
+                target[i] = changed = true;
+        }
+        return changed;
+    };
+
+    // FIRST of rhs[begin, end) into result, returning whether the sequence is nullable
+    auto firstOf = [&](size_t begin, size_t end, std::vector<bool>& result) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Entry& entry = _rhs[i];
+            if (entry.kind == Entry::Kind::Terminal)
+            {
+                result[entry.value] = true;
+                return false;
+            }
+            merge(result, first[entry.value]);
+            if (!nullable[entry.value])
+                return false;
+        }
+        return true;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t p = 0; p < productions.size(); ++p)
+        {
+            size_t lhs = indexOf(_nonterminals, productions[p].first.symbol());
+            std::vector<bool> result(_columns, false);
+            bool empty = firstOf(_rhsOffsets[p], _rhsOffsets[p + 1], result);
+            changed |= merge(first[lhs], result);
+            if (empty && !nullable[lhs])
+                nullable[lhs] = changed = true;
+        }
+    }
+
+    changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t p = 0; p < productions.size(); ++p)
+        {
+            size_t lhs = indexOf(_nonterminals, productions[p].first.symbol());
+            for (size_t i = _rhsOffsets[p]; i < _rhsOffsets[p + 1]; ++i)
+            {
+                if (_rhs[i].kind != Entry::Kind::Nonterminal)
+                    continue;
+
+                std::vector<bool> result(_columns, false);
+                bool empty = firstOf(i + 1, _rhsOffsets[p + 1], result);
+                changed |= merge(follow[_rhs[i].value], result);
+                if (empty)
+                    changed |= merge(follow[_rhs[i].value], follow[lhs]);
+            }
+        }
+    }
+
+    _table.assign(count * _columns, NoProduction);
+    for (size_t p = 0; p < productions.size(); ++p)
+    {
+        size_t lhs = indexOf(_nonterminals, productions[p].first.symbol());
+        std::vector<bool> predict(_columns, false);
+        if (firstOf(_rhsOffsets[p], _rhsOffsets[p + 1], predict))
+            merge(predict, follow[lhs]);
+
+        for (size_t column = 0; column < _columns; ++column)
+        {
+            if (!predict[column])
+                continue;
+
+            std::int32_t& cell = _table[lhs * _columns + column];
+            if (cell != NoProduction)
+                throw std::invalid_argument{ "grammar is not LL1: " + nameOf(_nonterminals[lhs]) + " on " +
+                    nameOf(TokenType::fromId(static_cast<TokenType::Id>(column)).symbol()) };
+            cell = static_cast<std::int32_t>(p);
+        }
+    }
+}
+
+void LL1Parser::process(TokenStream& tokens, ParseListener& listener) const
+{
+    std::vector<Entry> stack{ Entry{ Entry::Kind::Nonterminal, _start } };
+    Token lookahead = tokens.next();
+
+    std::vector<std::int32_t> shortcuts(_nonterminals.size(), -1);
+    auto names = listener.shortcuts();
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        size_t nonterminal = indexOf(_nonterminals, SymbolTable::global().intern(names[i]));
+        if (nonterminal == _nonterminals.size())
+            throw std::invalid_argument{ "unknown nonterminal " + names[i] };
+        shortcuts[nonterminal] = static_cast<std::int32_t>(i);
+    }
+
+    auto unexpected = [&lookahead]() {
+        return std::runtime_error{ "unexpected token " + describe(lookahead) };
+    };
+
+    while (!stack.empty())
+    {
+        Entry top = stack.back();
+        stack.pop_back();
+
+        switch (top.kind)
+        {
+        case Entry::Kind::Exit:
+            listener.exit(top.value);
+            break;
+        case Entry::Kind::Terminal:
+            if (column(lookahead.typeId()) != top.value)
+                throw unexpected();
+            listener.terminal(lookahead);
+            lookahead = tokens.next();
+            break;
+        case Entry::Kind::Nonterminal:
+        {
+            if (shortcuts[top.value] >= 0)
+            {
+                tokens.unread(lookahead);
+                listener.shortcut(static_cast<size_t>(shortcuts[top.value]), tokens);
+                lookahead = tokens.next();
+            }
+
+            TokenType::Id type = column(lookahead.typeId());
+            std::int32_t production = type < _columns ? _table[top.value * _columns + type] : NoProduction;
+            if (production == NoProduction)
+                throw unexpected();
+
+            listener.enter(static_cast<size_t>(production));
+            stack.push_back(Entry{ Entry::Kind::Exit, static_cast<std::uint32_t>(production) });
+            for (size_t i = _rhsOffsets[production + 1]; i > _rhsOffsets[production]; --i)
+                stack.push_back(_rhs[i - 1]);
+            break;
+        }
+        }
+    }
+
+    if (lookahead.typeId() != TokenType::EndOfFile.id())
+        throw unexpected();
+}
+
+void LL1Parser::process(std::filesystem::path filepath, ParseListener& listener) const
+{
+    MappedFile file{ filepath };
+    TokenStream tokens{ _lexer, file.text() };
+    process(tokens, listener);
+}
+
+TokenType::Id LL1Parser::column(TokenType::Id type) const
+{
+    for (const auto& [alias, first] : _aliases)
+    {
+        if (alias == type)
+            return first;
+    }
+    return type;
+}
+
+const Grammar& LL1Parser::grammar() const { return _grammar; }
+
+const DfaLexer& LL1Parser::lexer() const { return _lexer; }
+
+std::int32_t LL1Parser::predict(std::string_view nonterminal, TokenType::Id lookahead) const
+{
+    size_t index = indexOf(_nonterminals, SymbolTable::global().intern(nonterminal));
+    if (index == _nonterminals.size())
+        throw std::invalid_argument{ "unknown nonterminal " + std::string{ nonterminal } };
+    TokenType::Id type = column(lookahead);
+    return type < _columns ? _table[index * _columns + type] : NoProduction;
+}
+
+TokenType::Id LL1Parser::terminal(std::string_view name) const
+{
+    size_t index = indexOf(_terminals, SymbolTable::global().intern(name));
+    if (index == _terminals.size())
+        throw std::invalid_argument{ "unknown terminal " + std::string{ name } };
+    return _terminals[index].second;
+}
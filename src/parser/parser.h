@@ -1,17 +1,79 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
+#include <vector>
 #include "grammar.h"
 #include "lexer.h"
+#include "dfa.h"
+#include "stream.h"
 
+// Receives the derivation as the parser walks it: enter and exit bracket every
+// expanded production and terminal reports each matched token in order.
+class ParseListener
+{
+public:
+    virtual ~ParseListener() = default;
+
+    virtual void enter(size_t /*production*/) {}
+    virtual void exit(size_t /*production*/) {}
+    virtual void terminal(const Token& /*token*/) {}
+
+    // Nonterminals the listener can read faster than the parser. Before one of
+    // them is expanded, shortcut(index into this list) may consume a prefix of
+    // its derivation straight from the stream; the parser then expands it as
+    // usual from wherever the listener stopped, so only list-like nonterminals
+    // whose remainder derives from the same nonterminal qualify.
+    virtual std::vector<std::string> shortcuts() const { return {}; }
+    virtual void shortcut(size_t /*index*/, TokenStream& /*tokens*/) {}
+};
+
+// Table driven LL(1) parser. The FIRST/FOLLOW sets and the parse table are
+// computed once from the grammar, or taken ready made (indexed by nonterminal
+// in order of first production, then TokenType::Id); parsing only indexes the
+// table by the nonterminal and the lookahead's TokenType::Id. Terminals of a
+// grammar that share a name, such as a line and a block comment, are one
+// terminal, read under the id of the first of them.
 class LL1Parser
 {
 public:
     LL1Parser(Grammar grammar);
-    void process(std::filesystem::path filepath);
+    LL1Parser(Grammar grammar, std::vector<std::int32_t> table);
+
+    void process(TokenStream& tokens, ParseListener& listener) const;
+    void process(std::filesystem::path filepath, ParseListener& listener) const;
+
+    const Grammar& grammar() const;
+    const DfaLexer& lexer() const;
+    TokenType::Id terminal(std::string_view name) const;
+    // the production expanded for nonterminal on lookahead, or -1
+    std::int32_t predict(std::string_view nonterminal, TokenType::Id lookahead) const;
 
 private:
+    struct Entry
+    {
+        enum class Kind : std::uint8_t { Terminal, Nonterminal, Exit };
+
+        Kind kind;
+        std::uint32_t value;
+    };
+
+    static constexpr std::int32_t NoProduction = -1;
+
+    void number();
+    void computeTable();
+    // the table column of a token type, which differs for the later terminals of a name
+    TokenType::Id column(TokenType::Id type) const;
+
     Grammar _grammar;
-    
-};
\ No newline at end of file
+    DfaLexer _lexer;
+    std::vector<Symbol> _nonterminals;
+    std::vector<std::pair<Symbol, TokenType::Id>> _terminals;
+    std::vector<std::pair<TokenType::Id, TokenType::Id>> _aliases;
+    size_t _columns;
+    std::vector<std::int32_t> _table;
+    std::vector<size_t> _rhsOffsets;
+    std::vector<Entry> _rhs;
+    std::uint32_t _start;
+};
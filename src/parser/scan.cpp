@@ -0,0 +1,199 @@
+#include "scan.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DATALOG_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    struct Kernels
+    {
+        ScanLevel level;
+        size_t (*skipSpaces)(const char* text, size_t size, size_t at);
+        size_t (*findAny)(const char* text, size_t size, size_t at, const char* bytes, size_t count);
+        size_t (*countLines)(const char* text, size_t size);
+    };
+
+    bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    size_t skipSpacesScalar(const char* text, size_t size, size_t at)
+    {
+        while (at < size && isSpace(text[at]))
+            ++at;
+        return at;
+    }
+
+    size_t findAnyScalar(const char* text, size_t size, size_t at, const char* bytes, size_t count)
+    {
+        for (; at < size; ++at)
+        {
+            if (std::find(bytes, bytes + count, text[at]) != bytes + count)
+                return at;
+        }
+        return size;
+    }
+
+    size_t countLinesScalar(const char* text, size_t size) { return static_cast<size_t>(std::count(text, text + size, '\n')); }
+
+    constexpr Kernels scalar{ ScanLevel::Scalar, skipSpacesScalar, findAnyScalar, countLinesScalar };
+
+#ifdef DATALOG_SCAN_X86
+    // SSE4.2: the string compare instructions test 16 bytes against a set or
+    // a list of ranges at once and return the index of the first hit
+    constexpr int AnyFlags = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+    constexpr int SpaceFlags = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT;
+
+    __attribute__((target("sse4.2"))) size_t skipSpacesSse42(const char* text, size_t size, size_t at)
+    {
+        const __m128i ranges = _mm_setr_epi8('\t', '\r', ' ', ' ', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        for (; at + 16 <= size; at += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + at));
+            int index = _mm_cmpestri(ranges, 4, chunk, 16, SpaceFlags);
+            if (index < 16)
+                return at + static_cast<size_t>(index);
+        }
+        return skipSpacesScalar(text, size, at);
+    }
+
+    __attribute__((target("sse4.2"))) size_t findAnySse42(const char* text, size_t size, size_t at, const char* bytes, size_t count)
+    {
+        alignas(16) char padded[16]{};
+        std::copy(bytes, bytes + count, padded);
+        const __m128i set = _mm_load_si128(reinterpret_cast<const __m128i*>(padded));
+        for (; at + 16 <= size; at += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + at));
+            int index = _mm_cmpestri(set, static_cast<int>(count), chunk, 16, AnyFlags);
+            if (index < 16)
+                return at + static_cast<size_t>(index);
+        }
+        return findAnyScalar(text, size, at, bytes, count);
+    }
+
+    __attribute__((target("sse4.2,popcnt"))) size_t countLinesSse42(const char* text, size_t size)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+        size_t lines = 0;
+        size_t at = 0;
+        for (; at + 16 <= size; at += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + at));
+            lines += static_cast<size_t>(_mm_popcnt_u32(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)))));
+        }
+        return lines + countLinesScalar(text + at, size - at);
+    }
+
+    // AVX2: compare 32 bytes per step and locate the first hit in the byte mask
+    __attribute__((target("avx2,bmi"))) size_t skipSpacesAvx2(const char* text, size_t size, size_t at)
+    {
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i span = _mm256_set1_epi8('\r' - '\t');
+        for (; at + 32 <= size; at += 32)
+        {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + at));
+            // c - '\t' <= '\r' - '\t' as unsigned bytes covers the control characters
+            __m256i offset = _mm256_sub_epi8(chunk, tab);
+            __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, span), offset);
+            __m256i spaces = _mm256_or_si256(control, _mm256_cmpeq_epi8(chunk, space));
+            auto others = ~static_cast<unsigned>(_mm256_movemask_epi8(spaces));
+            if (others != 0)
+                return at + _tzcnt_u32(others);
+        }
+        return skipSpacesScalar(text, size, at);
+    }
+
+    __attribute__((target("avx2,bmi"))) size_t findAnyAvx2(const char* text, size_t size, size_t at, const char* bytes, size_t count)
+    {
+        __m256i set[16];
+        for (size_t i = 0; i < count; ++i)
+            set[i] = _mm256_set1_epi8(bytes[i]);
+        for (; at + 32 <= size; at += 32)
+        {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + at));
+            __m256i hits = _mm256_cmpeq_epi8(chunk, set[0]);
+            for (size_t i = 1; i < count; ++i)
+                hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, set[i]));
+            auto mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+            if (mask != 0)
+                return at + _tzcnt_u32(mask);
+        }
+        return findAnyScalar(text, size, at, bytes, count);
+    }
+
+    __attribute__((target("avx2,popcnt"))) size_t countLinesAvx2(const char* text, size_t size)
+    {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        size_t lines = 0;
+        size_t at = 0;
+        for (; at + 32 <= size; at += 32)
+        {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + at));
+            lines += static_cast<size_t>(_mm_popcnt_u32(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)))));
+        }
+        return lines + countLinesScalar(text + at, size - at);
+    }
+
+    constexpr Kernels sse42{ ScanLevel::Sse42, skipSpacesSse42, findAnySse42, countLinesSse42 };
+    constexpr Kernels avx2{ ScanLevel::Avx2, skipSpacesAvx2, findAnyAvx2, countLinesAvx2 };
+#endif
+
+    ScanLevel supported()
+    {
+#ifdef DATALOG_SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("popcnt"))
+            return ScanLevel::Avx2;
+        if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+            return ScanLevel::Sse42;
+#endif
+        return ScanLevel::Scalar;
+    }
+
+    const Kernels* kernelsFor(ScanLevel level)
+    {
+#ifdef DATALOG_SCAN_X86
+        if (level == ScanLevel::Avx2)
+            return &avx2;
+        if (level == ScanLevel::Sse42)
+            return &sse42;
+#endif
+        return &scalar;
+    }
+
+    std::atomic<const Kernels*>& current()
+    {
+        static std::atomic<const Kernels*> kernels{ kernelsFor(supported()) };
+        return kernels;
+    }
+
+    const Kernels& kernels() { return *current().load(std::memory_order_relaxed); }
+}
+
+ScanLevel scanLevel() { return kernels().level; }
+
+ScanLevel setScanLevel(ScanLevel level)
+{
+    const Kernels* kernels = kernelsFor(std::min(level, supported()));
+    current().store(kernels, std::memory_order_relaxed);
+    return kernels->level;
+}
+
+size_t skipSpaces(std::string_view text, size_t at)
+{
+    return kernels().skipSpaces(text.data(), text.size(), at);
+}
+
+size_t findAny(std::string_view text, size_t at, std::string_view bytes)
+{
+    if (bytes.empty() || bytes.size() > 16)
+        throw std::invalid_argument{ "findAny takes between 1 and 16 bytes" };
+    return kernels().findAny(text.data(), text.size(), at, bytes.data(), bytes.size());
+}
+
+size_t countLines(std::string_view text) { return kernels().countLines(text.data(), text.size()); }
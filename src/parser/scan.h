@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string_view>
+
+// Byte scanning kernels for the lexers. Each comes in a scalar version and, on
+// x86, SSE4.2 and AVX2 versions that look at 16 or 32 bytes per step; the
+// widest one the CPU supports is chosen the first time a kernel runs.
+enum class ScanLevel { Scalar, Sse42, Avx2 };
+
+ScanLevel scanLevel();
+// lowers (or restores) the level in use, clamped to what the CPU supports;
+// returns the level now in use
+ScanLevel setScanLevel(ScanLevel level);
+
+// first position at or after at that is not ' ', '\t', '\n', '\v', '\f' or '\r'
+size_t skipSpaces(std::string_view text, size_t at);
+// first position at or after at holding one of up to 16 bytes, or text.size()
+size_t findAny(std::string_view text, size_t at, std::string_view bytes);
+size_t countLines(std::string_view text);
@@ -0,0 +1,66 @@
+#include "source.h"
+#include <cerrno>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::filesystem::path& filepath)
+    : _data{ nullptr }, _size{ 0 }
+{
+    int descriptor = ::open(filepath.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        throw std::system_error{ errno, std::generic_category(), "open " + filepath.string() };
+
+    struct stat status;
+    if (::fstat(descriptor, &status) < 0)
+    {
+        int error = errno;
+        ::close(descriptor);
+        throw std::system_error{ error, std::generic_category(), "stat " + filepath.string() };
+    }
+
+    _size = static_cast<size_t>(status.st_size);
+    if (_size > 0)
+    {
+        void* mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            int error = errno;
+            ::close(descriptor);
+            throw std::system_error{ error, std::generic_category(), "mmap " + filepath.string() };
+        }
+        ::madvise(mapping, _size, MADV_SEQUENTIAL);
+        _data = static_cast<const char*>(mapping);
+    }
+
+    ::close(descriptor);
+}
+
+MappedFile::~MappedFile() { release(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _data{ std::exchange(other._data, nullptr) }, _size{ std::exchange(other._size, 0) } {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+    }
+    return *this;
+}
+
+std::string_view MappedFile::text() const { return std::string_view{ _data, _size }; }
+
+void MappedFile::release()
+{
+    if (_data != nullptr)
+        ::munmap(const_cast<char*>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. Tokens lexed from text() are views
+// into the mapping, so the MappedFile must outlive them.
+class MappedFile
+{
+public:
+    MappedFile(const std::filesystem::path& filepath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    std::string_view text() const;
+
+private:
+    void release();
+
+    const char* _data;
+    size_t _size;
+};
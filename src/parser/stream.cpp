@@ -0,0 +1,170 @@
+#include "stream.h"
+#include <algorithm>
+#include "scan.h"
+
+TokenStream::TokenStream(const DfaLexer& lexer, std::string_view text)
+    : TokenStream{ lexer, text, lexer.trivia() } {}
+
+TokenStream::TokenStream(const DfaLexer& lexer, std::string_view text, std::vector<TokenType::Id> skipped)
+    : _lexer{ lexer }, _data{ nullptr }, _chunkSize{ 0 }, _text{ text }, _line{ 1 },
+    _tokens{ 0 }, _bytes{ text.size() }, _exhausted{ true }, _finished{ false }
+{
+    for (TokenType::Id id : skipped)
+    {
+        if (id >= _skipped.size())
+            _skipped.resize(id + 1, false);
+        _skipped[id] = true;
+    }
+    auto space = lexer.spaceToken();
+    _skipSpaces = space && *space < _skipped.size() && _skipped[*space];
+}
+
+TokenStream::TokenStream(const DfaLexer& lexer, std::istream& data, size_t chunkSize)
+    : TokenStream{ lexer, data, lexer.trivia(), chunkSize } {}
+
+TokenStream::TokenStream(const DfaLexer& lexer, std::istream& data, std::vector<TokenType::Id> skipped,
+    size_t chunkSize)
+    : TokenStream{ lexer, std::string_view{}, skipped }
+{
+    _data = &data;
+    _chunkSize = std::max<size_t>(chunkSize, 1);
+    _exhausted = false;
+}
+
+Token TokenStream::next()
+{
+    while (true)
+    {
+        if (_text.empty() && !fill())
+        {
+            _finished = true;
+            return Token{ _lexer.endOfFile(), _text, _line };
+        }
+
+        if (_skipSpaces)
+        {
+            size_t spaces = skipSpaces(_text, 0);
+            _line += countLines(_text.substr(0, spaces));
+            _text.remove_prefix(spaces);
+            if (_text.empty())
+                continue;
+        }
+
+        auto match = _lexer.scan(_text, _exhausted);
+        if (!match.complete)
+        {
+            fill();
+            continue;
+        }
+
+        std::string_view value = _text.substr(0, match.length);
+        size_t line = _line;
+        _line += countLines(value);
+        _text.remove_prefix(match.length);
+
+        if (match.type < _skipped.size() && _skipped[match.type])
+            continue;
+        ++_tokens;
+        return Token{ match.type, value, line };
+    }
+}
+
+bool TokenStream::fill()
+{
+    if (_exhausted)
+        return false;
+
+    // keep the unconsumed tail and read at least as much again, so a token that
+    // spans many chunks is rescanned a logarithmic number of times
+    _buffer.erase(0, _buffer.size() - _text.size());
+    size_t kept = _buffer.size();
+    size_t wanted = std::max(_chunkSize, kept);
+    _buffer.resize(kept + wanted);
+    // Take what the stream has buffered. When it has nothing, wait for input
+    // to arrive and take what arrived with it; a stream that never reports
+    // buffered input, like std::cin synced with stdio, is read a whole chunk
+    // at a time instead, so a long token is not refilled byte by byte.
+    char* to = _buffer.data() + kept;
+    std::streambuf& source = *_data->rdbuf();
+    std::streamsize available = source.in_avail();
+    if (available == 0 && source.sgetc() != std::char_traits<char>::eof())
+        available = source.in_avail();
+    size_t received = 0;
+    if (available > 0)
+        received = static_cast<size_t>(source.sgetn(to, std::min(available, static_cast<std::streamsize>(wanted))));
+    else if (available == 0)
+        received = static_cast<size_t>(source.sgetn(to, static_cast<std::streamsize>(wanted)));
+    _buffer.resize(kept + received);
+    _bytes += received;
+
+    if (received == 0)
+    {
+        _exhausted = true;
+        _data->setstate(std::ios::eofbit);
+    }
+    _text = std::string_view{ _buffer };
+    return received > 0;
+}
+
+void TokenStream::unread(const Token& token)
+{
+    const char* end = _text.data() + _text.size();
+    _text = std::string_view{ token.value().data(), static_cast<size_t>(end - token.value().data()) };
+    _line = token.line();
+    if (token.typeId() != _lexer.endOfFile())
+        --_tokens;
+    _finished = false;
+}
+
+std::string_view TokenStream::buffered() const { return _text; }
+
+void TokenStream::consume(size_t length, size_t tokens)
+{
+    std::string_view consumed = _text.substr(0, length);
+    _line += countLines(consumed);
+    _tokens += tokens;
+    _text.remove_prefix(consumed.size());
+}
+
+bool TokenStream::exhausted() const { return _exhausted; }
+
+bool TokenStream::finished() const { return _finished; }
+
+size_t TokenStream::line() const { return _line; }
+
+size_t TokenStream::tokens() const { return _tokens; }
+
+size_t TokenStream::bytes() const { return _bytes; }
+
+TokenStream::iterator TokenStream::begin() { return iterator{ *this }; }
+
+TokenStream::iterator TokenStream::end() { return iterator{}; }
+
+TokenStream::iterator::iterator()
+    : _stream{ nullptr }, _current{ TokenType::Id{}, std::string_view{}, 0 } {}
+
+TokenStream::iterator::iterator(TokenStream& stream)
+    : _stream{ &stream }, _current{ TokenType::Id{}, std::string_view{}, 0 }
+{
+    if (_stream->finished())
+        _stream = nullptr;
+    else
+        _current = _stream->next();
+}
+
+TokenStream::iterator::reference TokenStream::iterator::operator*() const { return _current; }
+
+TokenStream::iterator::pointer TokenStream::iterator::operator->() const { return &_current; }
+
+TokenStream::iterator& TokenStream::iterator::operator++()
+{
+    if (_stream->finished())
+        _stream = nullptr;
+    else
+        _current = _stream->next();
+    return *this;
+}
+
+bool TokenStream::iterator::operator==(const iterator& other) const { return _stream == other._stream; }
+
+bool TokenStream::iterator::operator!=(const iterator& other) const { return !(*this == other); }
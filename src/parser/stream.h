@@ -0,0 +1,84 @@
+#pragma once
+
+#include <istream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "dfa.h"
+
+// Pull based token source over a DfaLexer. Tokens are produced one at a time
+// and trivia (whitespace and comments unless told otherwise) is dropped. With
+// an istream only the current token and one read chunk are held in memory, so
+// a returned token stays valid until the next call to next().
+class TokenStream
+{
+public:
+    static constexpr size_t DefaultChunkSize = 64 * 1024;
+
+    TokenStream(const DfaLexer& lexer, std::string_view text);
+    TokenStream(const DfaLexer& lexer, std::string_view text, std::vector<TokenType::Id> skipped);
+    TokenStream(const DfaLexer& lexer, std::istream& data, size_t chunkSize = DefaultChunkSize);
+    TokenStream(const DfaLexer& lexer, std::istream& data, std::vector<TokenType::Id> skipped,
+        size_t chunkSize = DefaultChunkSize);
+
+    // the EOF token is returned once the input is exhausted, and on every later call
+    Token next();
+    bool finished() const;
+    size_t line() const;
+    // tokens returned by next() so far, EOF and skipped trivia not included
+    size_t tokens() const;
+    // bytes of input read so far
+    size_t bytes() const;
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Token;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Token*;
+        using reference = const Token&;
+
+        iterator();
+        explicit iterator(TokenStream& stream);
+
+        reference operator*() const;
+        pointer operator->() const;
+        iterator& operator++();
+        bool operator==(const iterator& other) const;
+        bool operator!=(const iterator& other) const;
+
+    private:
+        TokenStream* _stream;
+        Token _current;
+    };
+
+    // iterates every remaining token up to and including EOF
+    iterator begin();
+    iterator end();
+
+    // Raw access for loaders that scan bytes themselves. unread rewinds to the
+    // start of the token last returned by next(); consume takes the number of
+    // tokens the bytes hold, so tokens() counts them; fill reads more input
+    // behind the unconsumed text and reports whether anything arrived.
+    void unread(const Token& token);
+    std::string_view buffered() const;
+    void consume(size_t length, size_t tokens);
+    bool fill();
+    bool exhausted() const;
+
+private:
+    const DfaLexer& _lexer;
+    std::istream* _data;
+    size_t _chunkSize;
+    std::string _buffer;
+    std::string_view _text;
+    size_t _line;
+    size_t _tokens;
+    size_t _bytes;
+    bool _exhausted;
+    bool _finished;
+    std::vector<bool> _skipped;
+    bool _skipSpaces;
+};
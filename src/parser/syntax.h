@@ -0,0 +1,222 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include "token.h"
+
+// The Datalog grammar as compile time data. The terminals are numbered by
+// their TokenType::Id, which the token registry reserves for these names ahead
+// of any other type, and the LL(1) table is computed by constexpr code, so a
+// conflict in the grammar fails the build instead of the first parse.
+// DatalogGrammarFactory builds its Grammar and parser from these tables; the
+// runtime Grammar stays the way to describe any other language.
+//
+// Only the FIRST/FOLLOW sets and the table are computed ahead of time. A
+// parser still builds at startup the Grammar object, the TokenTypes with
+// their std::function matchers, and the DFA the lexer compiles from their
+// patterns, all from the data here.
+namespace DatalogSyntax
+{
+    enum Terminal : TokenType::Id
+    {
+        Undefined, EndOfFile, Whitespace, Comment, String, Schemes, Facts, Rules, Queries, Id,
+        ColonDash, Comma, Period, QMark, LParen, RParen, Colon, Multiply, Add, TerminalCount
+    };
+
+    // numbered in order of their first production, as LL1Parser numbers them
+    enum Nonterminal : std::uint8_t
+    {
+        Datalog, Scheme, SchemeList, IdList, Fact, FactList, Rule, RuleList, HeadPredicate, Predicate,
+        PredicateList, Parameter, ParameterList, Expression, Operator, Query, QueryList, StringList,
+        NonterminalCount
+    };
+
+    inline constexpr std::array<std::string_view, TerminalCount> terminalNames{
+        "UNDEFINED", "EOF", "WHITESPACE", "COMMENT", "STRING", "SCHEMES", "FACTS", "RULES", "QUERIES", "ID",
+        "COLON_DASH", "COMMA", "PERIOD", "Q_MARK", "L_PAREN", "R_PAREN", "COLON", "MULTIPLY", "ADD" };
+
+    inline constexpr std::array<std::string_view, NonterminalCount> nonterminalNames{
+        "DATALOG", "SCHEME", "SCHEME_LIST", "ID_LIST", "FACT", "FACT_LIST", "RULE", "RULE_LIST",
+        "HEAD_PREDICATE", "PREDICATE", "PREDICATE_LIST", "PARAMETER", "PARAMETER_LIST", "EXPRESSION",
+        "OPERATOR", "QUERY", "QUERY_LIST", "STRING_LIST" };
+
+    // in lexer priority order; a comment is either a block or a line
+    struct Lexeme
+    {
+        Terminal terminal;
+        Pattern::Kind kind;
+        std::string_view text;
+    };
+
+    inline constexpr std::array<Lexeme, 17> lexemes{ {
+        { Comment, Pattern::Kind::BlockComment, "#|" },
+        { Comment, Pattern::Kind::LineComment, "#" },
+        { String, Pattern::Kind::String, "'" },
+        { Schemes, Pattern::Kind::Keyword, "Schemes" },
+        { Facts, Pattern::Kind::Keyword, "Facts" },
+        { Rules, Pattern::Kind::Keyword, "Rules" },
+        { Queries, Pattern::Kind::Keyword, "Queries" },
+        { Id, Pattern::Kind::Identifier, "" },
+        { ColonDash, Pattern::Kind::Sequence, ":-" },
+        { Comma, Pattern::Kind::Character, "," },
+        { Period, Pattern::Kind::Character, "." },
+        { QMark, Pattern::Kind::Character, "?" },
+        { LParen, Pattern::Kind::Character, "(" },
+        { RParen, Pattern::Kind::Character, ")" },
+        { Colon, Pattern::Kind::Character, ":" },
+        { Multiply, Pattern::Kind::Character, "*" },
+        { Add, Pattern::Kind::Character, "+" } } };
+
+    // a grammar symbol is coded as its terminal id, or a nonterminal offset by TerminalCount
+    using Code = std::uint8_t;
+
+    constexpr Code nonterminal(Nonterminal value) { return static_cast<Code>(TerminalCount + value); }
+    constexpr bool isTerminal(Code symbol) { return symbol < TerminalCount; }
+
+    struct Production
+    {
+        static constexpr size_t MaxLength = 14;
+
+        constexpr Production(Nonterminal lhs, std::initializer_list<Code> rhs)
+            : lhs{ lhs }, length{ rhs.size() }, rhs{}
+        {
+            size_t i = 0;
+            for (Code symbol : rhs)
+                this->rhs[i++] = symbol;
+        }
+
+        Nonterminal lhs;
+        size_t length;
+        std::array<Code, MaxLength> rhs;
+    };
+
+    inline constexpr std::array<Production, 29> productions{ {
+        { Datalog, { Schemes, Colon, nonterminal(Scheme), nonterminal(SchemeList), Facts, Colon, nonterminal(FactList),
+            Rules, Colon, nonterminal(RuleList), Queries, Colon, nonterminal(Query), nonterminal(QueryList) } },
+        { Scheme, { Id, LParen, Id, nonterminal(IdList), RParen } },
+        { SchemeList, { nonterminal(Scheme), nonterminal(SchemeList) } },
+        { SchemeList, {} },
+        { IdList, { Comma, Id, nonterminal(IdList) } },
+        { IdList, {} },
+        { Fact, { Id, LParen, String, nonterminal(StringList), RParen, Period } },
+        { FactList, { nonterminal(Fact), nonterminal(FactList) } },
+        { FactList, {} },
+        { Rule, { nonterminal(HeadPredicate), ColonDash, nonterminal(Predicate), nonterminal(PredicateList), Period } },
+        { RuleList, { nonterminal(Rule), nonterminal(RuleList) } },
+        { RuleList, {} },
+        { HeadPredicate, { Id, LParen, nonterminal(Parameter), nonterminal(ParameterList), RParen } },
+        { Predicate, { Id, LParen, nonterminal(Parameter), nonterminal(ParameterList), RParen } },
+        { PredicateList, { Comma, nonterminal(Predicate), nonterminal(PredicateList) } },
+        { PredicateList, {} },
+        { Parameter, { String } },
+        { Parameter, { Id } },
+        { Parameter, { nonterminal(Expression) } },
+        { ParameterList, { Comma, nonterminal(Parameter), nonterminal(ParameterList) } },
+        { ParameterList, {} },
+        { Expression, { LParen, nonterminal(Parameter), nonterminal(Operator), nonterminal(Parameter), RParen } },
+        { Operator, { Add } },
+        { Operator, { Multiply } },
+        { Query, { nonterminal(Predicate), QMark } },
+        { QueryList, { nonterminal(Query), nonterminal(QueryList) } },
+        { QueryList, {} },
+        { StringList, { Comma, String, nonterminal(StringList) } },
+        { StringList, {} } } };
+
+    // cells[nonterminal * TerminalCount + lookahead] is a production or -1
+    struct ParseTable
+    {
+        std::array<std::int8_t, NonterminalCount * TerminalCount> cells{};
+        size_t conflicts = 0;
+    };
+
+    static_assert(TerminalCount <= 32, "terminal sets are 32 bit masks");
+
+    constexpr ParseTable computeParseTable()
+    {
+        std::array<bool, NonterminalCount> nullable{};
+        std::array<std::uint32_t, NonterminalCount> first{};
+        std::array<std::uint32_t, NonterminalCount> follow{};
+        follow[Datalog] = 1u << EndOfFile;
+
+        // FIRST of rhs[begin, length) into result, returning whether the sequence is nullable
+        auto firstOf = [&](const Production& production, size_t begin, std::uint32_t& result) {
+            for (size_t i = begin; i < production.length; ++i)
+            {
+                Code symbol = production.rhs[i];
+                if (isTerminal(symbol))
+                {
+                    result |= 1u << symbol;
+                    return false;
+                }
+                result |= first[symbol - TerminalCount];
+                if (!nullable[symbol - TerminalCount])
+                    return false;
+            }
+            return true;
+        };
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const Production& production : productions)
+            {
+                std::uint32_t result = 0;
+                bool empty = firstOf(production, 0, result);
+                changed |= (result & ~first[production.lhs]) != 0;
+                first[production.lhs] |= result;
+                if (empty && !nullable[production.lhs])
+                    nullable[production.lhs] = changed = true;
+            }
+        }
+
+        changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const Production& production : productions)
+            {
+                for (size_t i = 0; i < production.length; ++i)
+                {
+                    if (isTerminal(production.rhs[i]))
+                        continue;
+
+                    std::uint32_t result = 0;
+                    if (firstOf(production, i + 1, result))
+                        result |= follow[production.lhs];
+                    std::uint32_t& target = follow[production.rhs[i] - TerminalCount];
+                    changed |= (result & ~target) != 0;
+                    target |= result;
+                }
+            }
+        }
+
+        ParseTable table;
+        for (auto& cell : table.cells)
+            cell = -1;
+        for (size_t p = 0; p < productions.size(); ++p)
+        {
+            const Production& production = productions[p];
+            std::uint32_t predict = 0;
+            if (firstOf(production, 0, predict))
+                predict |= follow[production.lhs];
+
+            for (size_t column = 0; column < TerminalCount; ++column)
+            {
+                if ((predict & (1u << column)) == 0)
+                    continue;
+
+                std::int8_t& cell = table.cells[production.lhs * TerminalCount + column];
+                if (cell != -1)
+                    ++table.conflicts;
+                cell = static_cast<std::int8_t>(p);
+            }
+        }
+        return table;
+    }
+
+    inline constexpr ParseTable parseTable = computeParseTable();
+    static_assert(parseTable.conflicts == 0, "the Datalog grammar is not LL(1)");
+}
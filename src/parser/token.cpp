@@ -1,16 +1,119 @@
 #include "token.h"
+#include <array>
+#include <atomic>
 #include <cctype>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include "syntax.h"
 
-Variable::Variable(std::string name)
-    : _name{ name } {}
+namespace
+{
+    // A type is identified by its name and pattern: registering the same pair
+    // again gives the same id, so a grammar can be built any number of times,
+    // while a name registered with another pattern, as by another grammar, gets
+    // an id of its own. Types without a pattern cannot be told apart, so their
+    // name may only be registered once.
+    //
+    // The Datalog lexemes own the first ids, so DatalogSyntax can use them as
+    // constants; a reserved type is stored once it is first constructed.
+    // Registering takes the mutex; a stored type is published by id with a
+    // release store into pages allocated as ids are handed out, so looking
+    // one up by id never locks.
+    struct TokenTypeRegistry
+    {
+        using Key = std::tuple<Symbol, Pattern::Kind, std::string>;
+
+        static constexpr size_t PageSize = 256;
+        using Page = std::array<std::atomic<const TokenType*>, PageSize>;
+
+        TokenTypeRegistry()
+            : types(DatalogSyntax::TerminalCount)
+        {
+            auto reserve = [this](DatalogSyntax::Terminal terminal, Pattern::Kind kind, std::string_view text) {
+                ids.emplace(Key{ SymbolTable::global().intern(DatalogSyntax::terminalNames[terminal]), kind, std::string{ text } },
+                    static_cast<TokenType::Id>(terminal));
+            };
+            reserve(DatalogSyntax::Undefined, Pattern::Kind::None, {});
+            reserve(DatalogSyntax::EndOfFile, Pattern::Kind::None, {});
+            reserve(DatalogSyntax::Whitespace, Pattern::Kind::Whitespace, {});
+            for (const DatalogSyntax::Lexeme& lexeme : DatalogSyntax::lexemes)
+                reserve(lexeme.terminal, lexeme.kind, lexeme.text);
+        }
+
+        void store(TokenType::Id id, const TokenType& type)
+        {
+            Page* page = pages[id / PageSize].load(std::memory_order_relaxed);
+            if (page == nullptr)
+            {
+                page = allocated.emplace_back(std::make_unique<Page>()).get();
+                pages[id / PageSize].store(page, std::memory_order_release);
+            }
+            types[id] = std::make_unique<TokenType>(type);
+            (*page)[id % PageSize].store(types[id].get(), std::memory_order_release);
+        }
+
+        const TokenType* find(TokenType::Id id) const
+        {
+            const Page* page = pages[id / PageSize].load(std::memory_order_acquire);
+            return page == nullptr ? nullptr : (*page)[id % PageSize].load(std::memory_order_acquire);
+        }
+
+        std::mutex mutex;
+        std::map<Key, TokenType::Id> ids;
+        std::vector<std::unique_ptr<TokenType>> types;
+        std::vector<std::unique_ptr<Page>> allocated;
+        std::array<std::atomic<Page*>, (size_t{ std::numeric_limits<TokenType::Id>::max() } + 1) / PageSize> pages{};
+    };
 
-std::string Variable::name() const { return _name; }
+    TokenTypeRegistry& registry()
+    {
+        static TokenTypeRegistry instance;
+        return instance;
+    }
+}
+
+Variable::Variable(std::string_view name)
+    : _name{ SymbolTable::global().intern(name) } {}
+
+std::string_view Variable::name() const { return SymbolTable::global().text(_name); }
+
+Symbol Variable::symbol() const { return _name; }
 
 TokenType::TokenType(
-    std::string name,
+    std::string_view name,
     std::function<bool(std::istream&)> matcher,
-    std::function<std::string(std::istream&)> extractor)
-    : Variable{ name }, _matcher{ matcher }, _extractor{ extractor } {}
+    std::function<std::string(std::istream&)> extractor,
+    Pattern pattern)
+    : Variable{ name }, _matcher{ matcher }, _extractor{ extractor }, _pattern{ pattern }
+{
+    auto& types = registry();
+    std::lock_guard<std::mutex> lock{ types.mutex };
+
+    TokenTypeRegistry::Key key{ symbol(), _pattern.kind, _pattern.text };
+    auto it = types.ids.find(key);
+    if (it != std::end(types.ids))
+    {
+        _id = it->second;
+        if (types.types[_id] == nullptr)
+            types.store(_id, *this);
+        else if (_pattern.kind == Pattern::Kind::None)
+            throw std::invalid_argument{ "token type " + std::string{ name } + " is already registered" };
+        return;
+    }
+
+    if (types.types.size() > std::numeric_limits<Id>::max())
+        throw std::length_error{ "too many token types" };
+
+    _id = static_cast<Id>(types.types.size());
+    types.ids.emplace(std::move(key), _id);
+    types.types.emplace_back();
+    types.store(_id, *this);
+}
 
 TokenType TokenType::Undefined{
     std::string{ "UNDEFINED" },
@@ -38,7 +141,7 @@ TokenType TokenType::EndOfFile{
 
         return false;
     },
-    [](std::istream& stream) -> std::string {
+    [](std::istream&) -> std::string {
         return std::string{};
     } };
 
@@ -49,18 +152,38 @@ TokenType TokenType::Whitespace{
     },
     [](std::istream& stream) -> std::string {
         return std::string{ static_cast<char>(stream.get()) };
-    } };
+    },
+    Pattern{ Pattern::Kind::Whitespace, {} } };
 
 bool TokenType::matchesNext(std::istream& data) const { return _matcher(data); }
 
 std::string TokenType::extractNext(std::istream& data) const { return _extractor(data); }
 
+const Pattern& TokenType::pattern() const { return _pattern; }
+
+TokenType::Id TokenType::id() const { return _id; }
+
+const TokenType& TokenType::fromId(Id id)
+{
+    const TokenType* type = registry().find(id);
+    if (type == nullptr)
+    {
+        std::string name = id < DatalogSyntax::TerminalCount ? std::string{ DatalogSyntax::terminalNames[id] } : std::to_string(id);
+        throw std::out_of_range{ "token type " + name + " is not constructed yet" };
+    }
+    return *type;
+}
+
+
+Token::Token(TokenType::Id type, std::string_view value, size_t line)
+    : _value{ value }, _lineNumber{ line }, _type{ type } {}
 
-Token::Token(TokenType type, std::string value, size_t line)
-    : _type{ type }, _value{ value }, _lineNumber{ line } {}
+Token::Token(const TokenType& type, std::string_view value, size_t line)
+    : Token{ type.id(), value, line } {}
 
-TokenType Token::type() const { return _type; }
-std::string Token::value() const { return _value; }
+const TokenType& Token::type() const { return TokenType::fromId(_type); }
+TokenType::Id Token::typeId() const { return _type; }
+std::string_view Token::value() const { return _value; }
 size_t Token::line() const { return _lineNumber; }
 
 std::ostream& operator<<(std::ostream& out, const Token& token)
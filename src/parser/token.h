@@ -1,53 +1,85 @@
 #pragma once
 
+#include <cstdint>
 #include <istream>
 #include <string>
+#include <string_view>
 #include <functional>
+#include "../symbols.h"
 
+// Grammar symbols are named by an interned Symbol, so comparing two of them
+// is an integer compare.
 class Variable
 {
 public:
-    Variable(std::string name);
+    Variable(std::string_view name);
 
-    std::string name() const;
+    std::string_view name() const;
+    Symbol symbol() const;
 
 private:
-    std::string _name;
+    Symbol _name;
 };
 
+// Declarative description of the lexemes a TokenType accepts. The matcher and
+// extractor functions remain the source of truth for the stream Lexer; the
+// pattern lets a DfaLexer compile the whole terminal set into one table.
+struct Pattern
+{
+    enum class Kind { None, Character, Sequence, Keyword, Identifier, Whitespace, LineComment, BlockComment, String };
+
+    Kind kind = Kind::None;
+    std::string text;
+};
+
+// Every TokenType name and pattern is registered once and given a dense Id, so
+// tokens can refer to their type without carrying a copy of the matcher and
+// extractor. The same name with another pattern is another type.
 class TokenType : public Variable
 {
 public:
+    using Id = std::uint16_t;
+
     static TokenType Undefined;
     static TokenType Whitespace;
     static TokenType EndOfFile;
 
     TokenType(
-        std::string name,
+        std::string_view name,
         std::function<bool(std::istream&)> matcher,
-        std::function<std::string(std::istream&)> extractor);
+        std::function<std::string(std::istream&)> extractor,
+        Pattern pattern = Pattern{});
 
     bool matchesNext(std::istream& data) const;
     std::string extractNext(std::istream& data) const;
+    const Pattern& pattern() const;
+    Id id() const;
+
+    static const TokenType& fromId(Id id);
 
 private:
+    Id _id;
     std::function<bool(std::istream&)> _matcher;
     std::function<std::string(std::istream&)> _extractor;
+    Pattern _pattern;
 };
 
 class Token
 {
 public:
-    Token(TokenType type, std::string value, size_t line);
+    // the value is a view into the lexed text, which must outlive the token
+    Token(TokenType::Id type, std::string_view value, size_t line);
+    Token(const TokenType& type, std::string_view value, size_t line);
 
-    TokenType type() const;
-    std::string value() const;
+    const TokenType& type() const;
+    TokenType::Id typeId() const;
+    std::string_view value() const;
     size_t line() const;
 
 private:
-    TokenType _type;
-    std::string _value;
+    std::string_view _value;
     size_t _lineNumber;
+    TokenType::Id _type;
 };
 
 std::ostream& operator<<(std::ostream& out, const Token& token);
\ No newline at end of file
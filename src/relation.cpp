@@ -0,0 +1,608 @@
+#include "relation.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+
+Relation::Relation(Symbol name, std::vector<Symbol> attributes, std::pmr::memory_resource* resource)
+    : _name{ name }, _attributes{ attributes }, _data{ resource }, _size{ 0 }, _staged{ resource } {}
+
+Symbol Relation::name() const { return _name; }
+
+const std::vector<Symbol>& Relation::attributes() const { return _attributes; }
+
+size_t Relation::arity() const { return _attributes.size(); }
+
+size_t Relation::size() const { return _size; }
+
+bool Relation::empty() const { return _size == 0; }
+
+const Symbol* Relation::row(size_t index) const { return _data.data() + index * arity(); }
+
+const std::pmr::vector<Symbol>& Relation::data() const { return _data; }
+
+std::pmr::memory_resource* Relation::resource() const { return _data.get_allocator().resource(); }
+
+bool Relation::contains(const Symbol* tuple) const
+{
+    size_t position = lowerBound(_data.data(), _size, tuple);
+    if (position < _size && !less(tuple, row(position)))
+        return !erased(position);
+    size_t staged = lowerBound(_staged.data(), this->staged(), tuple);
+    return staged < this->staged() && !less(tuple, _staged.data() + staged * arity());
+}
+
+size_t Relation::distinct(size_t column) const
+{
+    if (column >= arity())
+        throw std::out_of_range{ "column outside the relation" };
+    if (_size == 0)
+        return 0;
+
+    size_t samples = std::min(_size, SampleSize);
+    std::vector<Symbol> values(samples);
+    for (size_t i = 0; i < samples; ++i)
+        values[i] = row(i * _size / samples)[column];
+    std::sort(std::begin(values), std::end(values));
+
+    // values seen once in the sample stand for sqrt(rows / samples) values
+    // each (the GEE estimator); the others were probably all seen
+    size_t groups = 0;
+    size_t singles = 0;
+    for (size_t i = 0; i < samples;)
+    {
+        size_t j = i + 1;
+        while (j < samples && values[j] == values[i])
+            ++j;
+        ++groups;
+        singles += j - i == 1;
+        i = j;
+    }
+    if (samples == _size)
+        return groups;
+    // no repeats at all looks like a key
+    if (singles == samples)
+        return _size;
+
+    double scale = std::sqrt(static_cast<double>(_size) / static_cast<double>(samples));
+    double estimate = scale * static_cast<double>(singles) + static_cast<double>(groups - singles);
+    return std::clamp(static_cast<size_t>(estimate), groups, _size);
+}
+
+void Relation::insert(const Symbol* tuple)
+{
+    _data.insert(std::end(_data), tuple, tuple + arity());
+    ++_size;
+}
+
+void Relation::reserve(size_t rows) { _data.reserve(rows * arity()); }
+
+void Relation::normalize(Scheduler* scheduler)
+{
+    if (arity() == 0)
+    {
+        _size = std::min<size_t>(_size, 1);
+        return;
+    }
+
+    std::pmr::vector<std::uint32_t> order(_size, resource());
+    std::iota(std::begin(order), std::end(order), 0);
+    auto byRow = [this](std::uint32_t lhs, std::uint32_t rhs) { return less(row(lhs), row(rhs)); };
+    size_t pieces = scheduler == nullptr ? 1 : std::min(scheduler->threads(), _size / ParallelGrain);
+    if (pieces < 2)
+    {
+        std::sort(std::begin(order), std::end(order), byRow);
+    }
+    else
+    {
+        std::vector<size_t> bounds(pieces + 1);
+        for (size_t piece = 0; piece <= pieces; ++piece)
+            bounds[piece] = _size * piece / pieces;
+        auto at = [&order, &bounds](size_t piece) { return std::begin(order) + static_cast<std::ptrdiff_t>(bounds[piece]); };
+        scheduler->parallelFor(pieces, 1, [&](size_t begin, size_t end) {
+            for (size_t piece = begin; piece < end; ++piece)
+                std::sort(at(piece), at(piece + 1), byRow);
+        });
+        // each round merges neighbouring runs of width pieces into one
+        for (size_t width = 1; width < pieces; width *= 2)
+        {
+            size_t merges = (pieces + 2 * width - 1) / (2 * width);
+            scheduler->parallelFor(merges, 1, [&](size_t begin, size_t end) {
+                for (size_t merge = begin; merge < end; ++merge)
+                {
+                    size_t first = 2 * width * merge;
+                    size_t middle = std::min(first + width, pieces);
+                    size_t last = std::min(first + 2 * width, pieces);
+                    std::inplace_merge(at(first), at(middle), at(last), byRow);
+                }
+            });
+        }
+    }
+
+    std::pmr::vector<Symbol> sorted{ resource() };
+    sorted.reserve(_data.size());
+    size_t rows = 0;
+    for (std::uint32_t index : order)
+    {
+        const Symbol* tuple = row(index);
+        if (rows > 0 && !less(sorted.data() + (rows - 1) * arity(), tuple))
+            continue;
+        sorted.insert(std::end(sorted), tuple, tuple + arity());
+        ++rows;
+    }
+
+    _data.swap(sorted);
+    _size = rows;
+}
+
+void Relation::assign(const Symbol* rows, size_t count)
+{
+    _data.assign(rows, rows + count * arity());
+    _size = arity() == 0 ? std::min<size_t>(count, 1) : count;
+}
+
+Relation Relation::select(size_t column, Symbol value) const
+{
+    Relation result{ _name, _attributes, resource() };
+    for (size_t i = 0; i < _size; ++i)
+    {
+        if (row(i)[column] == value)
+            result.insert(row(i));
+    }
+    return result;
+}
+
+Relation Relation::select(size_t column, size_t other) const
+{
+    Relation result{ _name, _attributes, resource() };
+    for (size_t i = 0; i < _size; ++i)
+    {
+        if (row(i)[column] == row(i)[other])
+            result.insert(row(i));
+    }
+    return result;
+}
+
+Relation Relation::filter(const std::vector<std::uint8_t>& keep) const
+{
+    Relation result{ _name, _attributes, resource() };
+    for (size_t i = 0; i < _size; ++i)
+    {
+        if (keep[i])
+            result.insert(row(i));
+    }
+    return result;
+}
+
+Relation Relation::project(const std::vector<size_t>& columns) const
+{
+    std::vector<Symbol> attributes;
+    for (size_t column : columns)
+        attributes.push_back(_attributes.at(column));
+
+    Relation result{ _name, attributes, resource() };
+    result.reserve(_size);
+    std::vector<Symbol> tuple(columns.size());
+    for (size_t i = 0; i < _size; ++i)
+    {
+        for (size_t c = 0; c < columns.size(); ++c)
+            tuple[c] = row(i)[columns[c]];
+        result.insert(tuple.data());
+    }
+
+    // keeping a prefix of the columns keeps the rows sorted
+    bool prefix = true;
+    for (size_t c = 0; c < columns.size(); ++c)
+        prefix = prefix && columns[c] == c;
+    if (prefix)
+    {
+        Relation unique{ _name, attributes, resource() };
+        for (size_t i = 0; i < result._size; ++i)
+        {
+            if (unique._size == 0 || unique.less(unique.row(unique._size - 1), result.row(i)))
+                unique.insert(result.row(i));
+        }
+        return unique;
+    }
+
+    result.normalize();
+    return result;
+}
+
+Relation Relation::rename(std::vector<Symbol> attributes) const
+{
+    if (attributes.size() != arity())
+        throw std::invalid_argument{ "rename changes the arity" };
+
+    Relation result{ _name, attributes, resource() };
+    result._data = _data;
+    result._size = _size;
+    return result;
+}
+
+Relation Relation::join(const Relation& other, Scheduler* scheduler) const
+{
+    // columns of other that match an attribute here, and the ones it adds
+    std::vector<std::pair<size_t, size_t>> shared;
+    std::vector<size_t> added;
+    std::vector<Symbol> attributes = _attributes;
+    for (size_t column = 0; column < other.arity(); ++column)
+    {
+        auto it = std::find(std::cbegin(_attributes), std::cend(_attributes), other._attributes[column]);
+        if (it == std::cend(_attributes))
+        {
+            added.push_back(column);
+            attributes.push_back(other._attributes[column]);
+        }
+        else
+        {
+            shared.emplace_back(static_cast<size_t>(std::distance(std::cbegin(_attributes), it)), column);
+        }
+    }
+
+    // order the smaller side by its join columns and probe it with each row of the other
+    bool swapped = !shared.empty() && other._size > _size;
+    const Relation& inner = swapped ? *this : other;
+    const Relation& outer = swapped ? other : *this;
+    std::vector<size_t> innerKey;
+    std::vector<size_t> outerKey;
+    for (const auto& columns : shared)
+    {
+        innerKey.push_back(swapped ? columns.first : columns.second);
+        outerKey.push_back(swapped ? columns.second : columns.first);
+    }
+
+    std::pmr::vector<std::uint32_t> order(inner._size, resource());
+    std::iota(std::begin(order), std::end(order), 0);
+    auto keyLess = [&innerKey](const Symbol* lhs, const Symbol* rhs) {
+        for (size_t column : innerKey)
+        {
+            if (lhs[column] != rhs[column])
+                return lhs[column] < rhs[column];
+        }
+        return false;
+    };
+    if (!shared.empty())
+    {
+        std::sort(std::begin(order), std::end(order), [&inner, &keyLess](std::uint32_t lhs, std::uint32_t rhs) {
+            return keyLess(inner.row(lhs), inner.row(rhs));
+        });
+    }
+
+    // joins the outer rows [begin, end) into rows
+    auto probeRange = [&](size_t begin, size_t end, auto& rows) {
+        std::vector<Symbol> probe(inner.arity());
+        for (size_t i = begin; i < end; ++i)
+        {
+            const Symbol* current = outer.row(i);
+            for (size_t k = 0; k < innerKey.size(); ++k)
+                probe[innerKey[k]] = current[outerKey[k]];
+
+            auto first = std::lower_bound(std::cbegin(order), std::cend(order), probe, [&](std::uint32_t index, const std::vector<Symbol>& key) {
+                return keyLess(inner.row(index), key.data());
+            });
+            auto last = std::upper_bound(first, std::cend(order), probe, [&](const std::vector<Symbol>& key, std::uint32_t index) {
+                return keyLess(key.data(), inner.row(index));
+            });
+
+            for (auto it = first; it != last; ++it)
+            {
+                const Symbol* left = swapped ? inner.row(*it) : current;
+                const Symbol* right = swapped ? current : inner.row(*it);
+                rows.insert(std::end(rows), left, left + arity());
+                for (size_t column : added)
+                    rows.push_back(right[column]);
+            }
+        }
+    };
+
+    Relation result{ _name, attributes, resource() };
+    if (scheduler == nullptr || outer._size < 2 * ParallelGrain)
+    {
+        probeRange(0, outer._size, result._data);
+    }
+    else
+    {
+        std::vector<std::vector<Symbol>> pieces(outer._size / ParallelGrain);
+        scheduler->parallelFor(pieces.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t piece = begin; piece < end; ++piece)
+                probeRange(outer._size * piece / pieces.size(), outer._size * (piece + 1) / pieces.size(), pieces[piece]);
+        });
+        for (const auto& piece : pieces)
+            result._data.insert(std::end(result._data), std::cbegin(piece), std::cend(piece));
+    }
+    if (attributes.empty())
+        result._size = outer._size > 0 && inner._size > 0 ? 1 : 0;
+    else
+        result._size = result._data.size() / attributes.size();
+
+    result.normalize();
+    return result;
+}
+
+Relation Relation::unite(const Relation& other, Scheduler* scheduler)
+{
+    if (other.arity() != arity())
+        throw std::invalid_argument{ "union of relations with different arity" };
+    settle();
+
+    // merges rows [i, iEnd) here with rows [j, jEnd) of other
+    auto mergeRange = [this, &other](size_t i, size_t iEnd, size_t j, size_t jEnd, auto& merged, auto& added) {
+        while (i < iEnd || j < jEnd)
+        {
+            const Symbol* tuple;
+            if (j == jEnd || (i < iEnd && less(row(i), other.row(j))))
+            {
+                tuple = row(i++);
+            }
+            else if (i == iEnd || less(other.row(j), row(i)))
+            {
+                tuple = other.row(j++);
+                added.insert(std::end(added), tuple, tuple + arity());
+            }
+            else
+            {
+                tuple = row(i++);
+                ++j;
+            }
+            merged.insert(std::end(merged), tuple, tuple + arity());
+        }
+    };
+
+    Relation result{ _name, _attributes, resource() };
+    std::pmr::vector<Symbol> merged{ resource() };
+    if (scheduler == nullptr || arity() == 0 || other._size < 2 * ParallelGrain)
+    {
+        merged.reserve(_data.size() + other._data.size());
+        mergeRange(0, _size, 0, other._size, merged, result._data);
+    }
+    else
+    {
+        // split other evenly and this at the first row of each piece of other
+        size_t count = other._size / ParallelGrain;
+        std::vector<size_t> bounds(count + 1, _size);
+        bounds[0] = 0;
+        for (size_t piece = 1; piece < count; ++piece)
+        {
+            const Symbol* first = other.row(other._size * piece / count);
+            size_t low = bounds[piece - 1];
+            size_t high = _size;
+            while (low < high)
+            {
+                size_t middle = low + (high - low) / 2;
+                if (less(row(middle), first))
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            bounds[piece] = low;
+        }
+
+        std::vector<std::vector<Symbol>> mergedPieces(count);
+        std::vector<std::vector<Symbol>> addedPieces(count);
+        scheduler->parallelFor(count, 1, [&](size_t begin, size_t end) {
+            for (size_t piece = begin; piece < end; ++piece)
+            {
+                mergeRange(bounds[piece], bounds[piece + 1],
+                    other._size * piece / count, other._size * (piece + 1) / count,
+                    mergedPieces[piece], addedPieces[piece]);
+            }
+        });
+
+        merged.reserve(_data.size() + other._data.size());
+        for (size_t piece = 0; piece < count; ++piece)
+        {
+            merged.insert(std::end(merged), std::cbegin(mergedPieces[piece]), std::cend(mergedPieces[piece]));
+            result._data.insert(std::end(result._data), std::cbegin(addedPieces[piece]), std::cend(addedPieces[piece]));
+        }
+    }
+
+    if (arity() == 0)
+    {
+        // there is at most the one empty row
+        bool any = _size > 0 || other._size > 0;
+        result._size = _size == 0 && other._size > 0 ? 1 : 0;
+        _size = any ? 1 : 0;
+        return result;
+    }
+
+    _data.swap(merged);
+    _size = _data.size() / arity();
+    result._size = result._data.size() / arity();
+    return result;
+}
+
+bool Relation::less(const Symbol* lhs, const Symbol* rhs) const
+{
+    return std::lexicographical_compare(lhs, lhs + arity(), rhs, rhs + arity());
+}
+
+Relation Relation::subtract(const Relation& other)
+{
+    if (other.arity() != arity())
+        throw std::invalid_argument{ "difference of relations with different arity" };
+    settle();
+
+    Relation result{ _name, _attributes, resource() };
+    if (arity() == 0)
+    {
+        if (_size > 0 && other._size > 0)
+            std::swap(_size, result._size);
+        return result;
+    }
+
+    // compacts the kept rows in place
+    size_t kept = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < _size; ++i)
+    {
+        while (j < other._size && less(other.row(j), row(i)))
+            ++j;
+        if (j < other._size && !less(row(i), other.row(j)))
+        {
+            result.insert(row(i));
+            continue;
+        }
+        if (kept != i)
+            std::copy(row(i), row(i) + arity(), _data.data() + kept * arity());
+        ++kept;
+    }
+    _data.resize(kept * arity());
+    _size = kept;
+    return result;
+}
+
+Relation Relation::stage(const Relation& rows)
+{
+    if (rows.arity() != arity())
+        throw std::invalid_argument{ "union of relations with different arity" };
+    if (arity() == 0)
+        return unite(rows);
+
+    // rows removed since settling come back by dropping their positions;
+    // the others join the staged rows
+    Relation added{ _name, _attributes, resource() };
+    std::vector<size_t> restored;
+    std::pmr::vector<Symbol> merged{ resource() };
+    merged.reserve(_staged.size() + rows._data.size());
+    size_t j = 0;
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const Symbol* tuple = rows.row(i);
+        size_t position = lowerBound(_data.data(), _size, tuple);
+        if (position < _size && !less(tuple, row(position)))
+        {
+            if (erased(position))
+            {
+                restored.push_back(position);
+                added.insert(tuple);
+            }
+            continue;
+        }
+        for (; j < staged() && less(_staged.data() + j * arity(), tuple); ++j)
+            merged.insert(std::end(merged), _staged.data() + j * arity(), _staged.data() + (j + 1) * arity());
+        if (j < staged() && !less(tuple, _staged.data() + j * arity()))
+            continue;
+        merged.insert(std::end(merged), tuple, tuple + arity());
+        added.insert(tuple);
+    }
+    merged.insert(std::end(merged), _staged.data() + j * arity(), _staged.data() + _staged.size());
+    _staged.swap(merged);
+
+    if (!restored.empty())
+    {
+        std::vector<size_t> kept;
+        std::set_difference(std::cbegin(_erased), std::cend(_erased), std::cbegin(restored), std::cend(restored), std::back_inserter(kept));
+        _erased.swap(kept);
+    }
+    settleIfLarge();
+    return added;
+}
+
+Relation Relation::retract(const Relation& rows)
+{
+    if (rows.arity() != arity())
+        throw std::invalid_argument{ "difference of relations with different arity" };
+    if (arity() == 0)
+        return subtract(rows);
+
+    // sorted rows are removed by position, staged ones dropped outright
+    Relation removed{ _name, _attributes, resource() };
+    std::vector<size_t> positions;
+    std::pmr::vector<Symbol> kept{ resource() };
+    kept.reserve(_staged.size());
+    size_t j = 0;
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const Symbol* tuple = rows.row(i);
+        size_t position = lowerBound(_data.data(), _size, tuple);
+        if (position < _size && !less(tuple, row(position)))
+        {
+            if (!erased(position))
+            {
+                positions.push_back(position);
+                removed.insert(tuple);
+            }
+            continue;
+        }
+        for (; j < staged() && less(_staged.data() + j * arity(), tuple); ++j)
+            kept.insert(std::end(kept), _staged.data() + j * arity(), _staged.data() + (j + 1) * arity());
+        if (j < staged() && !less(tuple, _staged.data() + j * arity()))
+        {
+            removed.insert(tuple);
+            ++j;
+        }
+    }
+    kept.insert(std::end(kept), _staged.data() + j * arity(), _staged.data() + _staged.size());
+    _staged.swap(kept);
+
+    if (!positions.empty())
+    {
+        std::vector<size_t> merged;
+        merged.reserve(_erased.size() + positions.size());
+        std::merge(std::cbegin(_erased), std::cend(_erased), std::cbegin(positions), std::cend(positions), std::back_inserter(merged));
+        _erased.swap(merged);
+    }
+    settleIfLarge();
+    return removed;
+}
+
+bool Relation::settled() const { return _staged.empty() && _erased.empty(); }
+
+void Relation::settle()
+{
+    if (settled())
+        return;
+
+    std::pmr::vector<Symbol> merged{ resource() };
+    merged.reserve((_size - _erased.size() + staged()) * arity());
+    size_t erasedAt = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < _size; ++i)
+    {
+        if (erasedAt < _erased.size() && _erased[erasedAt] == i)
+        {
+            ++erasedAt;
+            continue;
+        }
+        for (; j < staged() && less(_staged.data() + j * arity(), row(i)); ++j)
+            merged.insert(std::end(merged), _staged.data() + j * arity(), _staged.data() + (j + 1) * arity());
+        merged.insert(std::end(merged), row(i), row(i) + arity());
+    }
+    merged.insert(std::end(merged), _staged.data() + j * arity(), _staged.data() + _staged.size());
+
+    _data.swap(merged);
+    _size = _data.size() / arity();
+    _staged.clear();
+    _erased.clear();
+}
+
+size_t Relation::lowerBound(const Symbol* rows, size_t count, const Symbol* tuple) const
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (less(rows + middle * arity(), tuple))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+bool Relation::erased(size_t position) const
+{
+    return std::binary_search(std::cbegin(_erased), std::cend(_erased), position);
+}
+
+size_t Relation::staged() const { return arity() == 0 ? 0 : _staged.size() / arity(); }
+
+void Relation::settleIfLarge()
+{
+    if ((staged() + _erased.size()) * 8 > _size)
+        settle();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+#include "symbols.h"
+
+class Scheduler;
+
+// A named relation stored as one flat row-major array of Symbols. After
+// normalize() the rows are sorted lexicographically by Symbol and unique, which
+// every operator below relies on and preserves in its result.
+//
+// Rows are allocated from a memory resource, and the result of an operator
+// comes from the same resource as the relation it was called on, so a chain
+// of operators starting in an arena stays in that arena. Copies allocate from
+// the default resource.
+class Relation
+{
+public:
+    Relation(Symbol name, std::vector<Symbol> attributes,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    Symbol name() const;
+    const std::vector<Symbol>& attributes() const;
+    size_t arity() const;
+    size_t size() const;
+    bool empty() const;
+
+    const Symbol* row(size_t index) const;
+    const std::pmr::vector<Symbol>& data() const;
+    std::pmr::memory_resource* resource() const;
+    bool contains(const Symbol* tuple) const;
+    // estimated number of distinct values in a column, from a sample of rows
+    size_t distinct(size_t column) const;
+
+    // appends without restoring order; call normalize() before using operators
+    void insert(const Symbol* tuple);
+    void reserve(size_t rows);
+    // with a scheduler, a large relation is sorted in pieces in parallel
+    // that are then merged pairwise
+    void normalize(Scheduler* scheduler = nullptr);
+    // replaces the rows with count rows that are already normalized
+    void assign(const Symbol* rows, size_t count);
+
+    Relation select(size_t column, Symbol value) const;
+    Relation select(size_t column, size_t other) const;
+    Relation project(const std::vector<size_t>& columns) const;
+    // the rows whose flag in keep is set
+    Relation filter(const std::vector<std::uint8_t>& keep) const;
+    Relation rename(std::vector<Symbol> attributes) const;
+    // with a scheduler, large inputs are split into ranges evaluated in
+    // parallel; the result does not depend on the split
+    Relation join(const Relation& other, Scheduler* scheduler = nullptr) const;
+
+    // adds the rows of other (same arity) and returns the rows that were new
+    Relation unite(const Relation& other, Scheduler* scheduler = nullptr);
+    // removes the rows of other (same arity) and returns the rows that were here
+    Relation subtract(const Relation& other);
+
+    // Changes staged beside the sorted rows: stage() and retract() take
+    // normalized rows and return those that were new or were here, like unite
+    // and subtract, but leave the sorted rows where they are. Added rows wait
+    // in a sorted run of their own and removed ones as positions, until
+    // settle() merges them in, which happens by itself once they are an
+    // eighth of the relation; a small change to a large relation costs what
+    // it changes. Only contains() sees staged changes, so settle() before
+    // using the other accessors and operators; unite and subtract do.
+    Relation stage(const Relation& rows);
+    Relation retract(const Relation& rows);
+    bool settled() const;
+    void settle();
+
+    static constexpr size_t ParallelGrain = 4096;
+    static constexpr size_t SampleSize = 1024;
+
+private:
+    bool less(const Symbol* lhs, const Symbol* rhs) const;
+    // the first of count rows at rows not less than tuple
+    size_t lowerBound(const Symbol* rows, size_t count, const Symbol* tuple) const;
+    bool erased(size_t position) const;
+    size_t staged() const;
+    void settleIfLarge();
+
+    Symbol _name;
+    std::vector<Symbol> _attributes;
+    std::pmr::vector<Symbol> _data;
+    size_t _size;
+    std::pmr::vector<Symbol> _staged;  // rows added since settling, sorted
+    std::vector<size_t> _erased;  // positions of sorted rows removed since, ascending
+};
@@ -0,0 +1,176 @@
+#include "report.h"
+#include <iomanip>
+#include <string>
+
+namespace
+{
+    std::string quoted(const std::string& text)
+    {
+        std::string result{ "\"" };
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                result.push_back('\\');
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                result += c == '\n' ? "\\n" : " ";
+                continue;
+            }
+            result.push_back(c);
+        }
+        return result + "\"";
+    }
+
+    double rate(size_t count, double seconds) { return seconds > 0 ? static_cast<double>(count) / seconds : 0; }
+
+    std::string keyOf(const Relation& relation, const Index& index)
+    {
+        std::string key;
+        for (size_t column : index.key())
+        {
+            if (!key.empty())
+                key += ",";
+            key += SymbolTable::global().text(relation.attributes()[column]);
+        }
+        return key;
+    }
+
+    void printText(std::ostream& out, const RunReport& report, const DatalogProgram& program)
+    {
+        const auto& evaluation = report.evaluation;
+        double parse = report.phases.wall("parse");
+
+        out << std::fixed << std::setprecision(3);
+        out << "Statistics\n";
+        out << "  phase            wall ms     cpu ms\n";
+        auto line = [&out](const std::string& name, double wall, double cpu) {
+            out << "  " << std::left << std::setw(14) << name << std::right
+                << std::setw(10) << wall * 1e3 << " " << std::setw(10) << cpu * 1e3 << "\n";
+        };
+        for (const auto& phase : report.phases.phases())
+        {
+            line(phase.name, phase.wall, phase.cpu);
+            if (phase.name == "load")
+            {
+                for (const auto& step : program.times().phases())
+                {
+                    if (step.name != "evaluate")
+                        line("  " + step.name, step.wall, step.cpu);
+                }
+            }
+        }
+        out << "  input: " << report.bytes << " bytes (" << rate(report.bytes, parse) / 1e6 << " MB/s), "
+            << report.tokens << " tokens (" << rate(report.tokens, parse) << "/s), " << report.facts << " facts\n";
+        out << "  peak memory: " << static_cast<double>(peakMemory()) / (1024 * 1024) << " MB\n";
+        out << "  evaluation: " << (program.demandDriven() ? "demand-driven" : "full");
+        if (!program.rewriteFallback().empty())
+            out << ", magic sets rewrite skipped: " << program.rewriteFallback();
+        out << "\n";
+
+        out << "SCCs\n";
+        for (size_t s = 0; s < program.strata().size() && s < evaluation.passes.size(); ++s)
+        {
+            const Stratum& stratum = program.strata()[s];
+            out << "  ";
+            for (size_t r : stratum.rules)
+                out << (r == stratum.rules.front() ? "R" : ",R") << r;
+            out << (stratum.recursive ? " (recursive)" : "") << ": " << evaluation.passes[s] << " passes, "
+                << evaluation.seconds[s] * 1e3 << " ms\n";
+        }
+
+        out << "Rules\n";
+        for (size_t r = 0; r < program.rules().size() && r < evaluation.derived.size(); ++r)
+        {
+            out << "  R" << r << " derived " << evaluation.derived[r] << ", by pass:";
+            for (size_t added : evaluation.derivedByPass[r])
+                out << " " << added;
+            out << "\n";
+        }
+
+        out << "Indexes\n";
+        for (const Relation& relation : program.relations())
+        {
+            for (const Index& index : program.indexes(relation.name()))
+            {
+                out << "  " << SymbolTable::global().text(relation.name())
+                    << (index.kind() == Index::Kind::Hash ? " hash(" : " sorted(") << keyOf(relation, index)
+                    << "): " << index.lookups() << " lookups, " << index.hits() << " hits";
+                if (index.lookups() > 0)
+                    out << " (" << 100.0 * static_cast<double>(index.hits()) / static_cast<double>(index.lookups()) << "%)";
+                out << "\n";
+            }
+        }
+        out << std::defaultfloat;
+    }
+
+    void printJson(std::ostream& out, const RunReport& report, const DatalogProgram& program)
+    {
+        const auto& evaluation = report.evaluation;
+        double parse = report.phases.wall("parse");
+        auto phases = [&out](const PhaseTimes& times, bool skipEvaluate) {
+            bool first = true;
+            for (const auto& phase : times.phases())
+            {
+                if (skipEvaluate && phase.name == "evaluate")
+                    continue;
+                out << (first ? "" : ",") << "{\"name\":" << quoted(phase.name) << ",\"wall_s\":" << phase.wall
+                    << ",\"cpu_s\":" << phase.cpu << "}";
+                first = false;
+            }
+        };
+
+        out << "{\"phases\":[";
+        phases(report.phases, false);
+        out << "],\"load\":[";
+        phases(program.times(), true);
+        out << "],\"input\":{\"bytes\":" << report.bytes << ",\"tokens\":" << report.tokens << ",\"facts\":" << report.facts
+            << ",\"bytes_per_s\":" << rate(report.bytes, parse) << ",\"tokens_per_s\":" << rate(report.tokens, parse)
+            << "},\"peak_memory_bytes\":" << peakMemory()
+            << ",\"evaluation\":" << (program.demandDriven() ? "\"demand\"" : "\"full\"")
+            << ",\"rewrite_fallback\":" << quoted(program.rewriteFallback());
+
+        out << ",\"sccs\":[";
+        for (size_t s = 0; s < program.strata().size() && s < evaluation.passes.size(); ++s)
+        {
+            const Stratum& stratum = program.strata()[s];
+            out << (s == 0 ? "" : ",") << "{\"rules\":[";
+            for (size_t r : stratum.rules)
+                out << (r == stratum.rules.front() ? "" : ",") << r;
+            out << "],\"recursive\":" << (stratum.recursive ? "true" : "false") << ",\"passes\":" << evaluation.passes[s]
+                << ",\"wall_s\":" << evaluation.seconds[s] << "}";
+        }
+
+        out << "],\"rules\":[";
+        for (size_t r = 0; r < program.rules().size() && r < evaluation.derived.size(); ++r)
+        {
+            out << (r == 0 ? "" : ",") << "{\"rule\":" << quoted(program.describe(program.rules()[r]))
+                << ",\"derived\":" << evaluation.derived[r] << ",\"by_pass\":[";
+            for (size_t p = 0; p < evaluation.derivedByPass[r].size(); ++p)
+                out << (p == 0 ? "" : ",") << evaluation.derivedByPass[r][p];
+            out << "]}";
+        }
+
+        out << "],\"indexes\":[";
+        bool first = true;
+        for (const Relation& relation : program.relations())
+        {
+            for (const Index& index : program.indexes(relation.name()))
+            {
+                out << (first ? "" : ",") << "{\"relation\":" << quoted(std::string{ SymbolTable::global().text(relation.name()) })
+                    << ",\"kind\":" << (index.kind() == Index::Kind::Hash ? "\"hash\"" : "\"sorted\"")
+                    << ",\"key\":" << quoted(keyOf(relation, index)) << ",\"lookups\":" << index.lookups()
+                    << ",\"hits\":" << index.hits() << "}";
+                first = false;
+            }
+        }
+        out << "]}\n";
+    }
+}
+
+void printReport(std::ostream& out, const RunReport& report, const DatalogProgram& program, bool json)
+{
+    if (json)
+        printJson(out, report, program);
+    else
+        printText(out, report, program);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <ostream>
+#include "datalog.h"
+#include "stats.h"
+
+// What one run of the datalog executable measured, for --stats. The program
+// adds the times of its own load and evaluation phases and its index use.
+struct RunReport
+{
+    PhaseTimes phases;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t facts = 0;
+    EvaluationStats evaluation;
+};
+
+void printReport(std::ostream& out, const RunReport& report, const DatalogProgram& program, bool json);
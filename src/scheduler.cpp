@@ -0,0 +1,176 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    // the scheduler and deque index of the worker running on this thread
+    thread_local const Scheduler* currentScheduler = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
+Scheduler::Scheduler(size_t threads)
+{
+    // one deque per worker plus one shared by threads outside the pool
+    size_t workers = std::max<size_t>(threads, 1) - 1;
+    for (size_t i = 0; i <= workers; ++i)
+        _workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < workers; ++i)
+        _threads.emplace_back([this, i] { work(i + 1); });
+}
+
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (std::thread& thread : _threads)
+        thread.join();
+}
+
+Scheduler& Scheduler::shared()
+{
+    static Scheduler instance;
+    return instance;
+}
+
+size_t Scheduler::threads() const { return _workers.size(); }
+
+void Scheduler::run(Group& group, std::function<void()> task)
+{
+    group._pending.fetch_add(1);
+    if (_threads.empty())
+    {
+        Task immediate{ std::move(task), &group };
+        execute(immediate);
+        return;
+    }
+
+    size_t index = currentScheduler == this
+        ? currentWorker
+        : _next.fetch_add(1) % _workers.size();
+    {
+        std::lock_guard<std::mutex> lock{ _workers[index]->mutex };
+        _workers[index]->tasks.push_back(Task{ std::move(task), &group });
+    }
+    {
+        std::lock_guard<std::mutex> lock{ _mutex };
+        _queued.fetch_add(1);
+    }
+    _wake.notify_one();
+}
+
+void Scheduler::wait(Group& group)
+{
+    size_t index = currentScheduler == this ? currentWorker : 0;
+    while (group._pending.load() != 0)
+    {
+        if (tryRun(index))
+            continue;
+
+        // woken when some group finishes or a task is queued
+        std::unique_lock<std::mutex> lock{ _mutex };
+        _wake.wait(lock, [this, &group] { return group._pending.load() == 0 || _queued.load() != 0; });
+    }
+
+    std::lock_guard<std::mutex> lock{ group._mutex };
+    if (group._error)
+        std::rethrow_exception(std::exchange(group._error, nullptr));
+}
+
+void Scheduler::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+    size_t chunks = std::min(count / std::max<size_t>(grain, 1), threads() * 4);
+    if (chunks <= 1)
+    {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+
+    Group group;
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        size_t begin = count * chunk / chunks;
+        size_t end = count * (chunk + 1) / chunks;
+        run(group, [&body, begin, end] { body(begin, end); });
+    }
+    wait(group);
+}
+
+void Scheduler::work(size_t index)
+{
+    currentScheduler = this;
+    currentWorker = index;
+    while (true)
+    {
+        if (tryRun(index))
+            continue;
+
+        std::unique_lock<std::mutex> lock{ _mutex };
+        _wake.wait(lock, [this] { return _stop || _queued.load() != 0; });
+        if (_stop && _queued.load() == 0)
+            return;
+    }
+}
+
+bool Scheduler::tryRun(size_t index)
+{
+    if (_queued.load() == 0)
+        return false;
+
+    Task task;
+    bool found = false;
+    {
+        Worker& own = *_workers[index];
+        std::lock_guard<std::mutex> lock{ own.mutex };
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+    for (size_t offset = 1; !found && offset < _workers.size(); ++offset)
+    {
+        Worker& victim = *_workers[(index + offset) % _workers.size()];
+        std::lock_guard<std::mutex> lock{ victim.mutex };
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+
+    _queued.fetch_sub(1);
+    execute(task);
+    return true;
+}
+
+void Scheduler::execute(Task& task)
+{
+    try
+    {
+        task.work();
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock{ task.group->_mutex };
+        if (!task.group->_error)
+            task.group->_error = std::current_exception();
+    }
+    // the group may be gone once its count reaches zero, so only the lock is
+    // touched afterwards; taking it keeps the waiter from missing the notice
+    if (task.group->_pending.fetch_sub(1) == 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock{ _mutex };
+        }
+        _wake.notify_all();
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: tasks spawned on a
+// worker go to the back of its own deque and it pops from the back, while idle
+// workers steal from the front of the others. A thread waiting for a group
+// runs queued tasks and sleeps only when there are none, so tasks may spawn
+// and wait for nested groups without deadlock.
+class Scheduler
+{
+public:
+    // the calling thread counts as one of the threads, so 1 starts no workers
+    explicit Scheduler(size_t threads = std::thread::hardware_concurrency());
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // one pool with a thread per core, for everything that does not ask for
+    // a particular number of threads
+    static Scheduler& shared();
+
+    size_t threads() const;
+
+    // Tasks that can be waited for together. The first exception thrown by a
+    // task is rethrown by wait().
+    class Group
+    {
+    public:
+        Group() = default;
+        Group(const Group&) = delete;
+        Group& operator=(const Group&) = delete;
+
+    private:
+        friend class Scheduler;
+        std::atomic<size_t> _pending{ 0 };
+        std::mutex _mutex;
+        std::exception_ptr _error;
+    };
+
+    void run(Group& group, std::function<void()> task);
+    void wait(Group& group);
+
+    // calls body(begin, end) over consecutive ranges of at least grain items
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+private:
+    struct Task
+    {
+        std::function<void()> work;
+        Group* group;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void work(size_t index);
+    bool tryRun(size_t index);
+    void execute(Task& task);
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+    std::atomic<size_t> _queued{ 0 };
+    std::atomic<size_t> _next{ 0 };
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _stop{ false };
+};
@@ -0,0 +1,443 @@
+#include "server.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <list>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "parser/ast.h"
+#include "parser/grammar.h"
+#include "parser/stream.h"
+
+namespace
+{
+    std::string_view trim(std::string_view text)
+    {
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+            text.remove_prefix(1);
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+            text.remove_suffix(1);
+        return text;
+    }
+
+    template <typename T>
+    void append(std::string& key, T value)
+    {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    bool sameTerms(const Atom& lhs, const Atom& rhs)
+    {
+        if (lhs.terms.size() != rhs.terms.size())
+            return false;
+        for (size_t i = 0; i < lhs.terms.size(); ++i)
+        {
+            if (lhs.terms[i].kind != rhs.terms[i].kind || lhs.terms[i].value != rhs.terms[i].value)
+                return false;
+        }
+        return true;
+    }
+}
+
+QueryServer::Entry::Entry(Symbol relation, Relation rows, Atom query, std::string text, std::uint64_t used)
+    : relation{ relation }, rows{ std::move(rows) }, query{ std::move(query) }, text{ std::move(text) }, used{ used } {}
+
+QueryServer::QueryServer(DatalogProgram& program, size_t capacity)
+    : _program{ program }, _parser{ DatalogGrammarFactory::createShardParser() }, _capacity{ capacity }
+{
+    if (program.demandDriven())
+        throw std::invalid_argument{ "a demand-driven program cannot answer other queries; load it with full evaluation" };
+    if (capacity == 0)
+        throw std::invalid_argument{ "the query cache needs room for an entry" };
+    if (!program.evaluated())
+        program.evaluateRules();
+}
+
+std::string QueryServer::handle(std::string_view request)
+{
+    request = trim(request);
+    try
+    {
+        if (request == "stats")
+        {
+            Stats counters = stats();
+            std::ostringstream out;
+            out << "Cache: " << counters.entries << " entries, " << counters.hits << " hits, " << counters.misses
+                << " misses, " << counters.invalidated << " invalidated, " << counters.evicted << " evicted\n\n";
+            return out.str();
+        }
+        if (!request.empty() && (request.front() == '+' || request.front() == '-'))
+            return change(request);
+        if (!request.empty() && request.back() == '?')
+        {
+            std::string text{ request };
+            std::string response;
+            if (cached(text, response))
+                return response;
+            return answer(text);
+        }
+        throw std::invalid_argument{ "unknown request '" + std::string{ request } + "'" };
+    }
+    catch (const std::exception& error)
+    {
+        return std::string{ "ERROR: " } + error.what() + "\n\n";
+    }
+}
+
+bool QueryServer::cached(const std::string& request, std::string& response) const
+{
+    std::shared_lock<std::shared_mutex> lock{ _mutex };
+    auto parsed = _parsed.find(request);
+    if (parsed == std::end(_parsed))
+        return false;
+
+    std::vector<const Entry*> entries;
+    for (const Atom& query : parsed->second)
+    {
+        auto entry = _cache.find(keyOf(query));
+        if (entry == std::end(_cache))
+            return false;
+        entries.push_back(&entry->second);
+    }
+    for (size_t q = 0; q < entries.size(); ++q)
+    {
+        const Entry& entry = *entries[q];
+        entry.used.store(++_clock, std::memory_order_relaxed);
+        response += sameTerms(entry.query, parsed->second[q]) ? entry.text : render(entry, parsed->second[q]);
+    }
+    _hits.fetch_add(entries.size(), std::memory_order_relaxed);
+    response += "\n";
+    return true;
+}
+
+std::string QueryServer::answer(const std::string& request)
+{
+    std::unique_lock<std::shared_mutex> lock{ _mutex };
+    auto parsed = _parsed.find(request);
+    if (parsed == std::end(_parsed))
+    {
+        std::string source = "Queries: " + request;
+        TokenStream tokens{ _parser.lexer(), source };
+        DatalogAst ast = parseDatalog(_parser, tokens);
+        std::vector<Atom> queries;
+        for (std::uint32_t index : ast.queries)
+            queries.push_back(_program.query(ast, index));
+        if (_parsed.size() >= _capacity)
+            _parsed.clear();
+        parsed = _parsed.emplace(request, std::move(queries)).first;
+    }
+
+    std::string response;
+    for (const Atom& query : parsed->second)
+    {
+        std::string key = keyOf(query);
+        auto cached = _cache.find(key);
+        if (cached != std::end(_cache))
+        {
+            // cached by a request handled while this one waited for the lock
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            cached->second.used.store(++_clock, std::memory_order_relaxed);
+            response += sameTerms(cached->second.query, query) ? cached->second.text : render(cached->second, query);
+            continue;
+        }
+
+        Relation rows = _program.evaluate(query);
+        ++_stats.misses;
+        if (_cache.size() >= _capacity)
+        {
+            auto oldest = std::min_element(std::begin(_cache), std::end(_cache), [](const auto& lhs, const auto& rhs) {
+                return lhs.second.used.load(std::memory_order_relaxed) < rhs.second.used.load(std::memory_order_relaxed);
+            });
+            _cache.erase(oldest);
+            ++_stats.evicted;
+        }
+        std::ostringstream out;
+        _program.printAnswer(out, query, rows);
+        auto& entry = _cache.try_emplace(key, query.name, std::move(rows), query, out.str(), ++_clock).first->second;
+        response += entry.text;
+    }
+    return response + "\n";
+}
+
+std::string QueryServer::render(const Entry& entry, const Atom& query) const
+{
+    // the same shape may have been asked with other variable names; they
+    // correspond in the order they first appear
+    std::vector<Symbol> before;
+    std::vector<Symbol> after;
+    std::string unused;
+    for (const Term& term : entry.query.terms)
+        shape(term, before, unused);
+    for (const Term& term : query.terms)
+        shape(term, after, unused);
+    std::vector<Symbol> attributes;
+    for (Symbol attribute : entry.rows.attributes())
+        attributes.push_back(after[std::find(std::begin(before), std::end(before), attribute) - std::begin(before)]);
+
+    std::ostringstream out;
+    _program.printAnswer(out, query, entry.rows.rename(attributes));
+    return out.str();
+}
+
+std::string QueryServer::change(std::string_view request)
+{
+    // every fact on the line is inserted, or every one retracted, as one batch
+    bool retract = request.front() == '-';
+    std::string source = "Facts: " + std::string{ request.substr(1) };
+    std::unique_lock<std::shared_mutex> lock{ _mutex };
+    TokenStream tokens{ _parser.lexer(), source };
+    DatalogAst ast = parseDatalog(_parser, tokens);
+
+    std::vector<FactChange> changes;
+    for (const auto& table : ast.facts)
+    {
+        for (size_t row = 0; row < table.size(); ++row)
+        {
+            const Symbol* values = table.values.data() + row * table.arity;
+            changes.push_back(FactChange{ table.name, { values, values + table.arity }, retract });
+        }
+    }
+    UpdateStats changed = _program.update(changes);
+    invalidate(changed);
+
+    size_t added = 0;
+    size_t removed = 0;
+    for (size_t r = 0; r < changed.added.size(); ++r)
+    {
+        added += changed.added[r];
+        removed += changed.removed[r];
+    }
+    return "OK +" + std::to_string(added) + " -" + std::to_string(removed) + "\n\n";
+}
+
+std::string QueryServer::keyOf(const Atom& query) const
+{
+    std::string key;
+    append(key, query.name);
+    std::vector<Symbol> variables;
+    for (const Term& term : query.terms)
+        shape(term, variables, key);
+    return key;
+}
+
+void QueryServer::shape(const Term& term, std::vector<Symbol>& variables, std::string& key) const
+{
+    append(key, term.kind);
+    switch (term.kind)
+    {
+    case Term::Kind::Constant:
+        append(key, term.value);
+        return;
+    case Term::Kind::Variable:
+    {
+        auto it = std::find(std::begin(variables), std::end(variables), term.value);
+        append(key, static_cast<std::uint32_t>(it - std::begin(variables)));
+        if (it == std::end(variables))
+            variables.push_back(term.value);
+        return;
+    }
+    case Term::Kind::Expression:
+        break;
+    }
+    const Expression& expression = _program.expressions()[term.value];
+    append(key, expression.op);
+    shape(expression.lhs, variables, key);
+    shape(expression.rhs, variables, key);
+}
+
+void QueryServer::invalidate(const UpdateStats& changed)
+{
+    std::vector<Symbol> relations;
+    for (size_t r = 0; r < changed.added.size(); ++r)
+    {
+        if (changed.added[r] > 0 || changed.removed[r] > 0)
+            relations.push_back(changed.relations[r]);
+    }
+    if (relations.empty())
+        return;
+
+    for (auto it = std::begin(_cache); it != std::end(_cache);)
+    {
+        if (std::find(std::begin(relations), std::end(relations), it->second.relation) == std::end(relations))
+        {
+            ++it;
+            continue;
+        }
+        it = _cache.erase(it);
+        ++_stats.invalidated;
+    }
+}
+
+QueryServer::Stats QueryServer::stats() const
+{
+    std::shared_lock<std::shared_mutex> lock{ _mutex };
+    Stats stats = _stats;
+    stats.hits = _hits.load(std::memory_order_relaxed);
+    stats.entries = _cache.size();
+    return stats;
+}
+
+void QueryServer::serve(std::istream& in, std::ostream& out)
+{
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::string_view request = trim(line);
+        if (request == "quit")
+            return;
+        if (!request.empty())
+            out << handle(request) << std::flush;
+    }
+}
+
+void QueryServer::listen(const std::filesystem::path& socket)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::string path = socket.string();
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument{ "socket path is too long: " + path };
+    std::copy(std::begin(path), std::end(path), address.sun_path);
+
+    // a socket left by an earlier server is replaced; any other file is not
+    if (std::filesystem::is_socket(socket))
+        std::filesystem::remove(socket);
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw std::system_error{ errno, std::generic_category(), "socket" };
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(listener, SOMAXCONN) != 0)
+    {
+        int error = errno;
+        ::close(listener);
+        throw std::system_error{ error, std::generic_category(), "listen on " + path };
+    }
+
+    // a connection's socket is closed here once its thread is joined, so it
+    // cannot be reused while the thread still has it
+    struct Connection
+    {
+        int socket;
+        std::atomic<bool> done{ false };
+        std::thread thread;
+    };
+    std::list<Connection> connections;
+    auto reap = [&connections](bool all) {
+        for (auto it = std::begin(connections); it != std::end(connections);)
+        {
+            if (!all && !it->done.load(std::memory_order_acquire))
+            {
+                ++it;
+                continue;
+            }
+            if (all)
+                ::shutdown(it->socket, SHUT_RDWR);
+            it->thread.join();
+            ::close(it->socket);
+            it = connections.erase(it);
+        }
+    };
+
+    while (true)
+    {
+        int connection = ::accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            int error = errno;
+            ::close(listener);
+            reap(true);
+            throw std::system_error{ error, std::generic_category(), "accept on " + path };
+        }
+
+        reap(false);
+        if (connections.size() >= MaxConnections)
+        {
+            static const std::string busy = "ERROR: too many connections\n\n";
+            ::send(connection, busy.data(), busy.size(), MSG_NOSIGNAL);
+            ::close(connection);
+            continue;
+        }
+        Connection& added = connections.emplace_back();
+        added.socket = connection;
+        try
+        {
+            added.thread = std::thread{ [this, &added] {
+                serveConnection(added.socket);
+                added.done.store(true, std::memory_order_release);
+            } };
+        }
+        catch (...)
+        {
+            connections.pop_back();
+            ::close(connection);
+            ::close(listener);
+            reap(true);
+            throw;
+        }
+    }
+}
+
+void QueryServer::serveConnection(int connection)
+{
+    // the peer sees the end at once; the socket itself is closed by listen()
+    struct Shutdown
+    {
+        int connection;
+        ~Shutdown() { ::shutdown(connection, SHUT_RDWR); }
+    } shutdown{ connection };
+
+    auto send = [connection](const std::string& response) {
+        for (size_t sent = 0; sent < response.size();)
+        {
+            ssize_t count = ::send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            sent += static_cast<size_t>(count);
+        }
+        return true;
+    };
+    // answers a request; false once the connection is to end
+    auto respond = [this, &send](std::string_view request) {
+        request = trim(request);
+        if (request == "quit")
+            return false;
+        return request.empty() || send(handle(request));
+    };
+
+    std::string pending;
+    char buffer[4096];
+    while (true)
+    {
+        ssize_t count = ::recv(connection, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+        {
+            // a last request without a newline, as on stdin
+            if (count == 0)
+                respond(pending);
+            return;
+        }
+        pending.append(buffer, static_cast<size_t>(count));
+
+        size_t begin = 0;
+        for (size_t end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', begin))
+        {
+            std::string_view request = std::string_view{ pending }.substr(begin, end - begin);
+            begin = end + 1;
+            if (!respond(request))
+                return;
+        }
+        pending.erase(0, begin);
+    }
+}
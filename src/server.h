@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "datalog.h"
+#include "relation.h"
+#include "parser/parser.h"
+
+// Answers requests against a program that stays loaded and evaluated, one
+// line per request and a response ending in an empty line:
+//
+//   path('0',X)?          the answer, as answerQueries() prints it
+//   +edge('1','2'). ...   inserts facts; "OK +added -removed" in tuples of
+//   -edge('1','2'). ...   any relation, derived ones included
+//   stats                 the cache counters
+//   quit                  ends the connection
+//
+// Answers are cached by query shape and constants, so path('0',X)? and
+// path('0',Y)? share an entry, and kept until the relation they are answered
+// from changes or the least recently used entry makes room. Cached answers
+// are read under a shared lock, so they never wait for each other; parsing a
+// new request, evaluating a query and changing facts take it exclusively.
+class QueryServer
+{
+public:
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t invalidated = 0;  // entries dropped because their relation changed
+        size_t evicted = 0;
+        size_t entries = 0;
+    };
+
+    // throws for a demand-driven program, whose derived relations only hold
+    // what its own queries asked for
+    explicit QueryServer(DatalogProgram& program, size_t capacity = DefaultCapacity);
+
+    // the response to one request; requests may come from several threads
+    std::string handle(std::string_view request);
+    // answers requests from in until it ends or asks to quit
+    void serve(std::istream& in, std::ostream& out);
+    // Accepts connections on a Unix socket, each served on its own thread,
+    // up to MaxConnections at once; more are turned away with an error. Only
+    // returns by throwing, after closing every connection and joining its
+    // thread.
+    void listen(const std::filesystem::path& socket);
+
+    Stats stats() const;
+
+    static constexpr size_t DefaultCapacity = 4096;
+    static constexpr size_t MaxConnections = 64;
+
+private:
+    struct Entry
+    {
+        Entry(Symbol relation, Relation rows, Atom query, std::string text, std::uint64_t used);
+
+        Symbol relation;
+        Relation rows;
+        Atom query;  // the one the text was printed for
+        std::string text;
+        mutable std::atomic<std::uint64_t> used;  // _clock when last read
+    };
+
+    // the response when every query of the request is cached, or false
+    bool cached(const std::string& request, std::string& response) const;
+    std::string answer(const std::string& request);
+    std::string change(std::string_view request);
+    // the entry's answer printed for a query of the same shape
+    std::string render(const Entry& entry, const Atom& query) const;
+    // the relation name, and per term its kind with the constant or the
+    // position where the variable first appeared
+    std::string keyOf(const Atom& query) const;
+    void shape(const Term& term, std::vector<Symbol>& variables, std::string& key) const;
+    void invalidate(const UpdateStats& changed);
+    void serveConnection(int connection);
+
+    DatalogProgram& _program;
+    LL1Parser _parser;
+    size_t _capacity;
+    // the queries of each request by its text, so repeating one skips the parser
+    std::unordered_map<std::string, std::vector<Atom>> _parsed;
+    std::unordered_map<std::string, Entry> _cache;
+    mutable std::atomic<std::uint64_t> _clock{ 0 };
+    mutable std::atomic<size_t> _hits{ 0 };
+    Stats _stats;
+    mutable std::shared_mutex _mutex;
+};
@@ -0,0 +1,168 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+namespace Snapshot
+{
+    namespace
+    {
+        std::uint64_t mix(std::uint64_t lane, std::uint64_t word)
+        {
+            lane ^= word;
+            lane *= 0xff51afd7ed558ccdull;
+            return lane ^ (lane >> 32);
+        }
+    }
+
+    bool isSnapshot(std::string_view bytes)
+    {
+        return bytes.size() >= sizeof(Header) && std::equal(std::begin(Magic), std::end(Magic), bytes.data());
+    }
+
+    void Checksum::update(const char* data, size_t size)
+    {
+        if (size % 8 != 0)
+            throw std::invalid_argument{ "checksum input must be whole words" };
+
+        size_t words = size / 8;
+        size_t w = 0;
+        auto word = [data](size_t index) {
+            std::uint64_t value;
+            std::memcpy(&value, data + index * 8, 8);
+            return value;
+        };
+        for (; w < words && (_words + w) % 4 != 0; ++w)
+            _lanes[(_words + w) % 4] = mix(_lanes[(_words + w) % 4], word(w));
+        for (; w + 4 <= words; w += 4)
+        {
+            _lanes[0] = mix(_lanes[0], word(w));
+            _lanes[1] = mix(_lanes[1], word(w + 1));
+            _lanes[2] = mix(_lanes[2], word(w + 2));
+            _lanes[3] = mix(_lanes[3], word(w + 3));
+        }
+        for (; w < words; ++w)
+            _lanes[(_words + w) % 4] = mix(_lanes[(_words + w) % 4], word(w));
+        _words += words;
+    }
+
+    std::uint64_t Checksum::value() const
+    {
+        std::uint64_t result = _words;
+        for (std::uint64_t lane : _lanes)
+            result = mix(result, lane);
+        return result;
+    }
+
+    Writer::Writer(const std::filesystem::path& filename, std::uint64_t flags)
+        : _filename{ filename },
+        _temporary{ filename.string() + ".tmp" },
+        _out{ _temporary, std::ios::binary | std::ios::trunc },
+        _header{}
+    {
+        if (!_out)
+            throw std::system_error{ errno, std::generic_category(), "open " + _temporary.string() };
+
+        std::copy(std::begin(Magic), std::end(Magic), _header.magic);
+        _header.version = Version;
+        _header.byteOrder = ByteOrder;
+        _header.flags = flags;
+        _out.write(reinterpret_cast<const char*>(&_header), sizeof(Header));
+        _buffer.reserve(BufferSize);
+    }
+
+    void Writer::write(const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            size_t part = std::min(size, BufferSize - _buffer.size());
+            _buffer.insert(std::end(_buffer), bytes, bytes + part);
+            bytes += part;
+            size -= part;
+            if (_buffer.size() == BufferSize)
+                flush();
+        }
+    }
+
+    void Writer::flush()
+    {
+        _checksum.update(_buffer.data(), _buffer.size());
+        _out.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _header.size += _buffer.size();
+        _buffer.clear();
+    }
+
+    void Writer::finish()
+    {
+        static const char padding[8] = {};
+        if (_buffer.size() % 8 != 0)
+            write(padding, 8 - _buffer.size() % 8);
+        flush();
+
+        _header.checksum = _checksum.value();
+        _out.seekp(0);
+        _out.write(reinterpret_cast<const char*>(&_header), sizeof(Header));
+        _out.close();
+        if (!_out)
+            throw std::runtime_error{ "could not write snapshot " + _filename.string() };
+        std::filesystem::rename(_temporary, _filename);
+        _temporary.clear();
+    }
+
+    Writer::~Writer()
+    {
+        if (_temporary.empty())
+            return;
+        _out.close();
+        std::error_code ignored;
+        std::filesystem::remove(_temporary, ignored);
+    }
+
+    Reader::Reader(std::string_view bytes, bool verify)
+    {
+        if (!isSnapshot(bytes))
+            throw std::runtime_error{ "not a snapshot" };
+        if (reinterpret_cast<std::uintptr_t>(bytes.data()) % 8 != 0)
+            throw std::invalid_argument{ "snapshot must be 8 byte aligned in memory" };
+
+        Header header;
+        std::memcpy(&header, bytes.data(), sizeof(Header));
+        if (header.byteOrder != ByteOrder)
+            throw std::runtime_error{ "snapshot was written with another byte order" };
+        if (header.version != Version)
+            throw std::runtime_error{ "snapshot version " + std::to_string(header.version) + " is not supported" };
+        if (header.size != bytes.size() - sizeof(Header) || header.size % 8 != 0)
+            throw std::runtime_error{ "snapshot is truncated" };
+
+        _flags = header.flags;
+        _at = bytes.data() + sizeof(Header);
+        _end = _at + header.size;
+        if (verify)
+        {
+            Checksum checksum;
+            checksum.update(_at, header.size);
+            if (checksum.value() != header.checksum)
+                throw std::runtime_error{ "snapshot checksum does not match" };
+        }
+    }
+
+    std::uint64_t Reader::flags() const { return _flags; }
+
+    std::uint64_t Reader::get()
+    {
+        std::uint64_t value;
+        std::memcpy(&value, take(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    const char* Reader::take(size_t size)
+    {
+        if (size > static_cast<size_t>(_end - _at))
+            throw std::runtime_error{ "snapshot is truncated" };
+        const char* data = _at;
+        _at += size;
+        return data;
+    }
+}
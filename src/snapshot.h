@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// The binary snapshot written by DatalogProgram::save(). A fixed header is
+// followed by a payload of native-endian fixed-width fields in which every
+// array starts on an 8 byte boundary, so a mapped snapshot is read in place:
+// rows and index contents are copied out in bulk, never parsed. They are
+// copied rather than used where they lie because relations and indexes own
+// their rows and change them as rules add tuples, and symbol texts are
+// interned because the symbol table is shared by the whole process.
+//
+//   header   magic, version, byte order mark, flags, payload size, checksum
+//   symbols  count, count + 1 text offsets, the texts; numbers are inline
+//            in the rows (see SymbolTable) and not listed
+//   program  relations with their rows, indexes and stated facts, rules,
+//            queries with the relations they are answered from, expressions
+namespace Snapshot
+{
+    inline constexpr char Magic[8] = { 'D', 'L', 'S', 'N', 'A', 'P', '\r', '\n' };
+    inline constexpr std::uint32_t Version = 4;
+    inline constexpr std::uint32_t ByteOrder = 0x01020304;
+
+    enum Flags : std::uint64_t
+    {
+        Evaluated = 1,  // the relations hold the fixpoint of the rules
+    };
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint64_t flags;
+        std::uint64_t size;      // payload bytes after the header
+        std::uint64_t checksum;  // of the payload
+    };
+
+    // whether bytes start like a snapshot, of any version
+    bool isSnapshot(std::string_view bytes);
+
+    // A 64 bit checksum of 8 byte words in four independent lanes, so it runs
+    // near memory bandwidth. Update with multiples of 8 bytes.
+    class Checksum
+    {
+    public:
+        void update(const char* data, size_t size);
+        std::uint64_t value() const;
+
+    private:
+        std::uint64_t _lanes[4] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0x27d4eb2f165667c5ull };
+        std::uint64_t _words = 0;
+    };
+
+    // Appends the payload through a buffer to a temporary file next to the
+    // snapshot, fills in the header on finish() and renames it into place, so
+    // an existing snapshot is only ever replaced by a complete one. The
+    // temporary file is removed if finish() is never reached.
+    class Writer
+    {
+    public:
+        Writer(const std::filesystem::path& filename, std::uint64_t flags);
+        ~Writer();
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        // fields are 64 bit and arrays are padded to 8 bytes, which keeps
+        // every array aligned
+        void put(std::uint64_t value) { write(&value, sizeof(value)); }
+        template <typename T>
+        void put(const T* values, size_t count);
+
+        void finish();
+
+    private:
+        static constexpr size_t BufferSize = 1 << 20;
+
+        void write(const void* data, size_t size);
+        void flush();
+
+        std::filesystem::path _filename;
+        std::filesystem::path _temporary;
+        std::ofstream _out;
+        Header _header;
+        std::vector<char> _buffer;
+        Checksum _checksum;
+    };
+
+    // Reads a payload in place; arrays are views into the snapshot.
+    class Reader
+    {
+    public:
+        // checks the header and, when verify is set, the checksum
+        explicit Reader(std::string_view bytes, bool verify = true);
+
+        std::uint64_t flags() const;
+
+        std::uint64_t get();
+        template <typename T>
+        const T* get(size_t count);
+
+    private:
+        const char* take(size_t size);
+
+        std::uint64_t _flags;
+        const char* _at;
+        const char* _end;
+    };
+
+    template <typename T>
+    void Writer::put(const T* values, size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(values, count * sizeof(T));
+        static const char padding[8] = {};
+        size_t used = (count * sizeof(T)) % 8;
+        if (used != 0)
+            write(padding, 8 - used);
+    }
+
+    template <typename T>
+    const T* Reader::get(size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (count > static_cast<size_t>(_end - _at) / sizeof(T))
+            throw std::runtime_error{ "snapshot is truncated" };
+        const T* values = reinterpret_cast<const T*>(take(count * sizeof(T)));
+        size_t used = (count * sizeof(T)) % 8;
+        if (used != 0)
+            take(8 - used);
+        return values;
+    }
+}
@@ -0,0 +1,52 @@
+#include "stats.h"
+#include <algorithm>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+PhaseTimes::Scope::Scope(PhaseTimes& times, std::string name)
+    : _times{ times }, _name{ std::move(name) }, _wall{ std::chrono::steady_clock::now() }, _cpu{ std::clock() } {}
+
+PhaseTimes::Scope::~Scope()
+{
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - _wall;
+    double cpu = static_cast<double>(std::clock() - _cpu) / CLOCKS_PER_SEC;
+    _times.add(_name, wall.count(), cpu);
+}
+
+PhaseTimes::Scope PhaseTimes::measure(std::string name) { return Scope{ *this, std::move(name) }; }
+
+void PhaseTimes::add(const std::string& name, double wall, double cpu)
+{
+    auto it = std::find_if(std::begin(_phases), std::end(_phases), [&name](const Phase& phase) { return phase.name == name; });
+    if (it == std::end(_phases))
+        it = _phases.insert(std::end(_phases), Phase{ name });
+    it->wall += wall;
+    it->cpu += cpu;
+}
+
+const std::vector<PhaseTimes::Phase>& PhaseTimes::phases() const { return _phases; }
+
+double PhaseTimes::wall(const std::string& name) const
+{
+    auto it = std::find_if(std::cbegin(_phases), std::cend(_phases), [&name](const Phase& phase) { return phase.name == name; });
+    return it == std::cend(_phases) ? 0 : it->wall;
+}
+
+size_t peakMemory()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Wall and CPU time of named phases, in the order they first ran. A phase
+// costs two clock reads at each end, so timing is always on. CPU time is the
+// whole process's, so it includes helper threads.
+class PhaseTimes
+{
+public:
+    struct Phase
+    {
+        std::string name;
+        double wall = 0;
+        double cpu = 0;
+    };
+
+    // adds the time until it is destroyed to the named phase
+    class Scope
+    {
+    public:
+        Scope(PhaseTimes& times, std::string name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        PhaseTimes& _times;
+        std::string _name;
+        std::chrono::steady_clock::time_point _wall;
+        std::clock_t _cpu;
+    };
+
+    Scope measure(std::string name);
+    template <typename Work>
+    decltype(auto) time(std::string name, Work&& work);
+    void add(const std::string& name, double wall, double cpu);
+
+    const std::vector<Phase>& phases() const;
+    // zero for a phase that never ran
+    double wall(const std::string& name) const;
+
+private:
+    std::vector<Phase> _phases;
+};
+
+template <typename Work>
+decltype(auto) PhaseTimes::time(std::string name, Work&& work)
+{
+    Scope scope{ *this, std::move(name) };
+    return work();
+}
+
+// the largest resident set of the process so far, in bytes, or 0 where unknown
+size_t peakMemory();
@@ -0,0 +1,203 @@
+#include "symbols.h"
+#include <cstring>
+#include <functional>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace
+{
+    // the value of a quoted decimal integer, with an optional minus sign
+    bool parseNumber(std::string_view text, std::int64_t& value)
+    {
+        if (text.size() < 3 || text.front() != '\'' || text.back() != '\'')
+            return false;
+        const char* first = text.data() + 1;
+        const char* last = text.data() + text.size() - 1;
+        if (*first == '+')
+            return false;
+        auto [end, error] = std::from_chars(first, last, value);
+        return error == std::errc{} && end == last && first != last;
+    }
+
+    // whether the text is the one number() makes for the value, so
+    // that it round trips through an inline Symbol: no sign, as '-0' has,
+    // and no leading zero
+    bool isCanonical(std::string_view text, std::int64_t value)
+    {
+        return value >= 0 && text[1] != '-' && (text.size() == 3 || text[1] != '0');
+    }
+}
+
+SymbolTable::SymbolTable()
+    : _next{ 0 }
+{
+    for (auto& directory : _directories)
+        directory.store(nullptr, std::memory_order_relaxed);
+}
+
+SymbolTable::~SymbolTable()
+{
+    for (auto& slot : _directories)
+    {
+        Directory* directory = slot.load(std::memory_order_relaxed);
+        if (directory == nullptr)
+            continue;
+        for (auto& page : *directory)
+            delete page.load(std::memory_order_relaxed);
+        delete directory;
+    }
+}
+
+SymbolTable& SymbolTable::global()
+{
+    static SymbolTable instance;
+    return instance;
+}
+
+Symbol SymbolTable::intern(std::string_view text)
+{
+    std::int64_t value;
+    if (parseNumber(text, value) && isCanonical(text, value) && value <= MaxNumber)
+        return NumberTag | static_cast<Symbol>(value);
+
+    Shard& owner = shard(text);
+    std::lock_guard<std::mutex> lock{ owner.mutex };
+
+    auto it = owner.symbols.find(text);
+    if (it != std::end(owner.symbols))
+        return it->second;
+
+    Symbol symbol = _next.fetch_add(1, std::memory_order_relaxed);
+    if (symbol >= NumberTag)
+        throw std::length_error{ "symbol table is full" };
+
+    // the size is written before the data is published, so a reader that
+    // sees the data sees the whole entry
+    auto stored = store(owner, text);
+    Entry& published = *entry(symbol, true);
+    published.size = stored.size();
+    published.data.store(stored.empty() ? "" : stored.data(), std::memory_order_release);
+    owner.symbols.emplace(stored, symbol);
+    return symbol;
+}
+
+bool SymbolTable::find(std::string_view text, Symbol& symbol) const
+{
+    std::int64_t value;
+    if (parseNumber(text, value) && isCanonical(text, value) && value <= MaxNumber)
+    {
+        symbol = NumberTag | static_cast<Symbol>(value);
+        return true;
+    }
+
+    Shard& owner = shard(text);
+    std::lock_guard<std::mutex> lock{ owner.mutex };
+
+    auto it = owner.symbols.find(text);
+    if (it == std::end(owner.symbols))
+        return false;
+
+    symbol = it->second;
+    return true;
+}
+
+std::string_view SymbolTable::text(Symbol symbol) const
+{
+    if (isNumber(symbol))
+    {
+        thread_local std::array<NumberText, NumberViews> buffers;
+        thread_local size_t next = 0;
+        return text(symbol, buffers[next++ % NumberViews]);
+    }
+    const Entry* found = entry(symbol, false);
+    const char* data = found != nullptr ? found->data.load(std::memory_order_acquire) : nullptr;
+    if (data == nullptr)
+        throw std::out_of_range{ "unknown symbol" };
+    return { data, found->size };
+}
+
+std::string_view SymbolTable::text(Symbol symbol, NumberText& buffer) const
+{
+    if (!isNumber(symbol))
+        return text(symbol);
+    buffer[0] = '\'';
+    char* end = std::to_chars(buffer.data() + 1, buffer.data() + buffer.size() - 1, numberOf(symbol)).ptr;
+    *end++ = '\'';
+    return { buffer.data(), static_cast<size_t>(end - buffer.data()) };
+}
+
+size_t SymbolTable::size() const { return _next.load(std::memory_order_acquire); }
+
+Symbol SymbolTable::number(std::int64_t value)
+{
+    if (value >= 0 && value <= MaxNumber)
+        return NumberTag | static_cast<Symbol>(value);
+    return intern("'" + std::to_string(value) + "'");
+}
+
+bool SymbolTable::numeric(Symbol symbol, std::int64_t& value) const
+{
+    if (isNumber(symbol))
+    {
+        value = numberOf(symbol);
+        return true;
+    }
+    return parseNumber(text(symbol), value);
+}
+
+SymbolTable::Entry* SymbolTable::entry(Symbol symbol, bool allocate) const
+{
+    // another thread may install the same directory or page first, in which
+    // case ours is dropped
+    auto level = [allocate](auto& slot) {
+        using Level = std::remove_pointer_t<decltype(slot.load())>;
+        Level* current = slot.load(std::memory_order_acquire);
+        if (current != nullptr || !allocate)
+            return current;
+        auto fresh = std::make_unique<Level>();
+        if (slot.compare_exchange_strong(current, fresh.get(), std::memory_order_acq_rel))
+            current = fresh.release();
+        return current;
+    };
+
+    Directory* directory = level(_directories[symbol >> (PageBits + DirectoryBits)]);
+    if (directory == nullptr)
+        return nullptr;
+    Page* page = level((*directory)[(symbol >> PageBits) & (DirectorySize - 1)]);
+    if (page == nullptr)
+        return nullptr;
+    return &(*page)[symbol & (PageSize - 1)];
+}
+
+SymbolTable::Shard& SymbolTable::shard(std::string_view text) const
+{
+    size_t hash = std::hash<std::string_view>{}(text);
+    return _shards[(hash >> 7) % ShardCount];
+}
+
+std::string_view SymbolTable::store(Shard& shard, std::string_view text)
+{
+    if (text.empty())
+        return std::string_view{};
+
+    // oversized strings get a block of their own so the current block keeps filling
+    if (text.size() > BlockSize / 4)
+    {
+        auto& block = shard.large.emplace_back(new char[text.size()]);
+        std::memcpy(block.get(), text.data(), text.size());
+        return std::string_view{ block.get(), text.size() };
+    }
+
+    if (shard.blockUsed + text.size() > BlockSize)
+    {
+        shard.blocks.emplace_back(new char[BlockSize]);
+        shard.blockUsed = 0;
+    }
+
+    char* target = shard.blocks.back().get() + shard.blockUsed;
+    std::memcpy(target, text.data(), text.size());
+    shard.blockUsed += text.size();
+    return std::string_view{ target, text.size() };
+}
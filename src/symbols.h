@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using Symbol = std::uint32_t;
+
+// Interns identifiers and string constants to dense 32 bit Symbols, so equality
+// is an integer compare and tuples can be arrays of Symbols. Characters live in
+// blocks that never move; the views handed out stay valid for the table's
+// lifetime. Interning is sharded by hash and safe to call from many threads.
+//
+// Numeric constants are typed: the Symbol of a quoted decimal integer in
+// canonical form below 2^31 - 1, such as '42', is the value itself with the
+// top bit set. Those never take a slot in the table, so arithmetic reads and
+// writes them without touching text.
+class SymbolTable
+{
+public:
+    SymbolTable();
+    ~SymbolTable();
+
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    // the table shared by the grammar, the lexers and every program
+    static SymbolTable& global();
+
+    // room for the text of any inline number, quotes included
+    using NumberText = std::array<char, 16>;
+
+    Symbol intern(std::string_view text);
+    bool find(std::string_view text, Symbol& symbol) const;
+    // The text of a symbol. An inline number's is formatted into one of
+    // NumberViews buffers per thread and is overwritten that many calls later,
+    // so copy it to keep it; the overload taking a buffer writes it there.
+    std::string_view text(Symbol symbol) const;
+    std::string_view text(Symbol symbol, NumberText& buffer) const;
+    // interned symbols; numbers are not counted
+    size_t size() const;
+
+    static constexpr size_t NumberViews = 8;
+    static constexpr Symbol NumberTag = Symbol{ 1 } << 31;
+    static constexpr std::int64_t MaxNumber = NumberTag - 2;
+
+    static bool isNumber(Symbol symbol) { return (symbol & NumberTag) != 0; }
+    static std::int64_t numberOf(Symbol symbol) { return symbol & ~NumberTag; }
+    // the symbol of value quoted, inline when it is in [0, MaxNumber]
+    Symbol number(std::int64_t value);
+    // the value of a symbol whose text is a quoted decimal integer, inline or not
+    bool numeric(Symbol symbol, std::int64_t& value) const;
+
+private:
+    static constexpr size_t ShardCount = 64;
+    static constexpr size_t BlockSize = 64 * 1024;
+    static constexpr unsigned PageBits = 12;
+    static constexpr unsigned DirectoryBits = 10;
+    static constexpr size_t PageSize = size_t{ 1 } << PageBits;
+    static constexpr size_t DirectorySize = size_t{ 1 } << DirectoryBits;
+    static constexpr size_t DirectoryCount = size_t{ NumberTag } >> (PageBits + DirectoryBits);
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, Symbol> symbols;
+        std::vector<std::unique_ptr<char[]>> blocks;
+        std::vector<std::unique_ptr<char[]>> large;
+        size_t blockUsed = BlockSize;
+    };
+
+    // a symbol's text; readers see the symbol once data is set
+    struct Entry
+    {
+        std::atomic<const char*> data{ nullptr };
+        size_t size = 0;
+    };
+    using Page = std::array<Entry, PageSize>;
+    using Directory = std::array<std::atomic<Page*>, DirectorySize>;
+
+    Shard& shard(std::string_view text) const;
+    // the symbol's entry, allocating its page when asked to, or null
+    Entry* entry(Symbol symbol, bool allocate) const;
+    static std::string_view store(Shard& shard, std::string_view text);
+
+    mutable std::array<Shard, ShardCount> _shards;
+    // pages of entries by symbol, both levels allocated when first needed
+    mutable std::array<std::atomic<Directory*>, DirectoryCount> _directories;
+    std::atomic<Symbol> _next;
+};
@@ -0,0 +1,291 @@
+#include "triejoin.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    // Iterator over a relation whose rows are sorted with the columns in trie
+    // order. At depth d it walks the distinct values of column d among the
+    // rows that share the keys of the levels above.
+    class TrieIterator
+    {
+    public:
+        explicit TrieIterator(const Relation& rows)
+            : _rows{ rows } {}
+
+        void open()
+        {
+            if (_levels.empty())
+                _levels.push_back(Level{ 0, _rows.size(), 0 });
+            else
+                _levels.push_back(Level{ position(), upperBound(key()), position() });
+        }
+
+        void up() { _levels.pop_back(); }
+
+        bool atEnd() const { return position() == _levels.back().end; }
+
+        Symbol key() const { return _rows.row(position())[_levels.size() - 1]; }
+
+        void next() { _levels.back().position = upperBound(key()); }
+
+        void seek(Symbol value)
+        {
+            // gallop forward, since leapfrogging mostly seeks to nearby keys
+            Level& level = _levels.back();
+            size_t column = _levels.size() - 1;
+            size_t low = level.position;
+            size_t step = 1;
+            while (low + step < level.end && _rows.row(low + step)[column] < value)
+            {
+                low += step;
+                step *= 2;
+            }
+            size_t high = std::min(low + step + 1, level.end);
+            while (low < high)
+            {
+                size_t middle = low + (high - low) / 2;
+                if (_rows.row(middle)[column] < value)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            level.position = low;
+        }
+
+    private:
+        struct Level
+        {
+            size_t begin;
+            size_t end;
+            size_t position;
+        };
+
+        size_t position() const { return _levels.back().position; }
+
+        size_t upperBound(Symbol value) const
+        {
+            const Level& level = _levels.back();
+            size_t column = _levels.size() - 1;
+            size_t low = level.position;
+            size_t high = level.end;
+            while (low < high)
+            {
+                size_t middle = low + (high - low) / 2;
+                if (_rows.row(middle)[column] <= value)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            return low;
+        }
+
+        const Relation& _rows;
+        std::vector<Level> _levels;
+    };
+
+    struct Search
+    {
+        std::vector<TrieIterator> iterators;
+        std::vector<std::vector<size_t>> participants;  // iterators per variable
+        std::vector<Symbol> tuple;
+        Relation& result;
+
+        void run(size_t variable)
+        {
+            if (variable == participants.size())
+            {
+                result.insert(tuple.data());
+                return;
+            }
+
+            std::vector<TrieIterator*> active;
+            for (size_t index : participants[variable])
+            {
+                iterators[index].open();
+                active.push_back(&iterators[index]);
+            }
+
+            bool done = std::any_of(std::cbegin(active), std::cend(active), [](const TrieIterator* iterator) { return iterator->atEnd(); });
+            if (!done)
+            {
+                std::sort(std::begin(active), std::end(active), [](const TrieIterator* lhs, const TrieIterator* rhs) {
+                    return lhs->key() < rhs->key();
+                });
+            }
+
+            size_t current = 0;
+            while (!done)
+            {
+                TrieIterator& lowest = *active[current];
+                Symbol highest = active[(current + active.size() - 1) % active.size()]->key();
+                if (lowest.key() == highest)
+                {
+                    tuple[variable] = highest;
+                    run(variable + 1);
+                    lowest.next();
+                }
+                else
+                {
+                    lowest.seek(highest);
+                }
+                done = lowest.atEnd();
+                current = (current + 1) % active.size();
+            }
+
+            for (TrieIterator* iterator : active)
+                iterator->up();
+        }
+    };
+}
+
+Relation leapfrogJoin(Symbol name, const std::vector<Relation>& inputs, const std::vector<Symbol>& order)
+{
+    Relation result{ name, order, inputs.empty() ? std::pmr::get_default_resource() : inputs.front().resource() };
+
+    // put the columns of every input in the global variable order, reusing
+    // the inputs whose columns already are
+    std::vector<Relation> projected;
+    projected.reserve(inputs.size());
+    std::vector<const Relation*> tries;
+    std::vector<std::vector<size_t>> participants(order.size());
+    for (const Relation& input : inputs)
+    {
+        if (input.arity() == 0)
+        {
+            if (input.empty())
+                return result;
+            continue;
+        }
+
+        std::vector<size_t> columns;
+        for (size_t variable = 0; variable < order.size(); ++variable)
+        {
+            const auto& attributes = input.attributes();
+            auto it = std::find(std::cbegin(attributes), std::cend(attributes), order[variable]);
+            if (it == std::cend(attributes))
+                continue;
+            columns.push_back(static_cast<size_t>(std::distance(std::cbegin(attributes), it)));
+            participants[variable].push_back(tries.size());
+        }
+        if (columns.size() != input.arity())
+            throw std::invalid_argument{ "an input column is missing from the variable order" };
+        if (std::is_sorted(std::cbegin(columns), std::cend(columns)))
+        {
+            tries.push_back(&input);
+        }
+        else
+        {
+            projected.push_back(input.project(columns));
+            tries.push_back(&projected.back());
+        }
+    }
+
+    for (const auto& variable : participants)
+    {
+        if (variable.empty())
+            throw std::invalid_argument{ "a variable of the order is in no input" };
+    }
+
+    Search search{ {}, participants, std::vector<Symbol>(order.size()), result };
+    for (const Relation* trie : tries)
+        search.iterators.emplace_back(*trie);
+    if (!order.empty())
+        search.run(0);
+    else if (!inputs.empty())
+        result.insert(nullptr);
+
+    // rows come out in order and unique
+    result.normalize();
+    return result;
+}
+
+std::vector<Symbol> leapfrogOrder(const std::vector<Relation>& inputs)
+{
+    std::vector<std::vector<Symbol>> variables;
+    for (const Relation& input : inputs)
+        variables.push_back(input.attributes());
+    return leapfrogOrder(variables);
+}
+
+std::vector<Symbol> leapfrogOrder(const std::vector<std::vector<Symbol>>& inputs)
+{
+    std::vector<Symbol> order;
+    std::vector<size_t> uses;
+    for (const auto& input : inputs)
+    {
+        for (Symbol variable : input)
+        {
+            auto it = std::find(std::cbegin(order), std::cend(order), variable);
+            if (it == std::cend(order))
+            {
+                order.push_back(variable);
+                uses.push_back(1);
+            }
+            else
+            {
+                ++uses[static_cast<size_t>(std::distance(std::cbegin(order), it))];
+            }
+        }
+    }
+
+    std::vector<size_t> positions(order.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+        positions[i] = i;
+    std::stable_sort(std::begin(positions), std::end(positions), [&uses](size_t lhs, size_t rhs) { return uses[lhs] > uses[rhs]; });
+
+    std::vector<Symbol> sorted;
+    for (size_t position : positions)
+        sorted.push_back(order[position]);
+    return sorted;
+}
+
+bool isCyclic(std::vector<std::vector<Symbol>> atoms)
+{
+    for (auto& atom : atoms)
+    {
+        std::sort(std::begin(atom), std::end(atom));
+        atom.erase(std::unique(std::begin(atom), std::end(atom)), std::end(atom));
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        // variables that only one atom has
+        for (auto& atom : atoms)
+        {
+            auto lonely = std::remove_if(std::begin(atom), std::end(atom), [&atoms, &atom](Symbol variable) {
+                return std::none_of(std::cbegin(atoms), std::cend(atoms), [&atom, variable](const auto& other) {
+                    return &other != &atom && std::binary_search(std::cbegin(other), std::cend(other), variable);
+                });
+            });
+            if (lonely != std::end(atom))
+            {
+                atom.erase(lonely, std::end(atom));
+                changed = true;
+            }
+        }
+
+        // atoms contained in another atom
+        auto contained = std::begin(atoms);
+        while (contained != std::end(atoms))
+        {
+            bool covered = std::any_of(std::cbegin(atoms), std::cend(atoms), [&contained](const auto& other) {
+                return &other != &*contained && std::includes(std::cbegin(other), std::cend(other), std::cbegin(*contained), std::cend(*contained));
+            });
+            if (covered)
+            {
+                contained = atoms.erase(contained);
+                changed = true;
+            }
+            else
+            {
+                ++contained;
+            }
+        }
+    }
+
+    return atoms.size() > 1;
+}
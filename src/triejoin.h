@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+#include "relation.h"
+
+// Leapfrog triejoin (Veldhuizen 2014): a worst-case optimal natural join of
+// any number of relations. Variables are bound one at a time in a global
+// order; for each variable the relations that contain it are intersected by
+// leapfrogging sorted iterators over their tries, so no intermediate result
+// is larger than the output allows, unlike pairwise joins on cyclic bodies.
+//
+// Each input names its columns by variable and its rows must be unique. An
+// input whose columns are already in the given order is searched in place;
+// the others are copied and sorted. The result has one column per variable,
+// in the given order, and is allocated like the first input.
+Relation leapfrogJoin(Symbol name, const std::vector<Relation>& inputs, const std::vector<Symbol>& order);
+
+// variables shared by the most inputs first, then in order of appearance
+std::vector<Symbol> leapfrogOrder(const std::vector<Relation>& inputs);
+// the same, from the variables of each input
+std::vector<Symbol> leapfrogOrder(const std::vector<std::vector<Symbol>>& inputs);
+
+// Whether the join of atoms over these variable sets is cyclic (not
+// alpha-acyclic), found by GYO reduction: drop variables only one atom has,
+// and atoms contained in another, until nothing changes.
+bool isCyclic(std::vector<std::vector<Symbol>> atoms);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include "src/datalog.h"
+
+// Helpers the scenarios share for running whole programs given as text.
+
+// the program parsed and loaded, single threaded unless asked otherwise so
+// results do not depend on the machine
+inline DatalogProgram load(const std::string& text, size_t threads = 1, QueryEvaluation evaluation = QueryEvaluation::Full)
+{
+    LL1Parser parser{ DatalogGrammarFactory::createDatalogGrammar() };
+    TokenStream tokens{ parser.lexer(), text };
+    DatalogProgram program{ threads };
+    program.load(parseDatalog(parser, tokens), evaluation);
+    return program;
+}
+
+// what answerQueries prints for the program as it stands
+inline std::string answers(const DatalogProgram& program)
+{
+    std::ostringstream out;
+    program.answerQueries(out);
+    return out.str();
+}
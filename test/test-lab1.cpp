@@ -1,7 +1,16 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <fstream>
+#include <sstream>
 #include "catch2/catch.hpp"
 #include "src/parser/grammar.h"
 #include "src/parser/lexer.h"
+#include "src/parser/dfa.h"
+#include "src/parser/scan.h"
+#include "src/parser/source.h"
+#include "src/parser/stream.h"
+#include "src/scheduler.h"
 
 SCENARIO("lab 1 examples are working", "[lab1]") {
     Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
@@ -54,4 +63,377 @@ SCENARIO("lab 1 examples are working", "[lab1]") {
             THEN("the number of tokens remaining should be 9") { REQUIRE(filtered.size() == 24); }
         }
     }
-}
\ No newline at end of file
+}
+
+SCENARIO("the table driven lexer agrees with the stream lexer", "[lab1]") {
+    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    Lexer lex{ datalogGrammar.terminals() };
+    DfaLexer dfa{ datalogGrammar.terminals() };
+
+    auto file = GENERATE(as<std::string>{}, "./examples/example1.txt", "./examples/example2.txt", "./examples/example3.txt");
+
+    GIVEN("the file " + file) {
+        std::ifstream streamData{ file, std::ios::in };
+        std::ifstream dfaData{ file, std::ios::in };
+        auto expected = lex.process(streamData);
+        std::string dfaText;
+        auto tokens = dfa.process(dfaData, dfaText);
+
+        THEN("both produce the same token types on the same lines") {
+            REQUIRE(tokens.size() == expected.size());
+            for (size_t i = 0; i < tokens.size(); ++i)
+            {
+                REQUIRE(tokens[i].type().name() == expected[i].type().name());
+                REQUIRE(tokens[i].line() == expected[i].line());
+            }
+        }
+    }
+
+    GIVEN("input that depends on ordering and maximal munch") {
+        std::string text{ "Schemes Schemesx Facts1:-:#|a|#'it''s'#x\n" };
+        auto tokens = dfa.process(text);
+
+        THEN("keywords, sequences and comments resolve like the stream lexer") {
+            std::vector<std::string> names;
+            std::vector<std::string> values;
+            for (const auto& token : tokens)
+            {
+                if (token.type().name() == TokenType::Whitespace.name())
+                    continue;
+                names.push_back(std::string{ token.type().name() });
+                values.push_back(std::string{ token.value() });
+            }
+            REQUIRE(names == std::vector<std::string>{ "SCHEMES", "ID", "FACTS", "COLON_DASH", "COLON",
+                "COMMENT", "STRING", "COMMENT", "EOF" });
+            REQUIRE(values == std::vector<std::string>{ "Schemes", "Schemesx", "Facts1", ":-", ":",
+                "#|a|#", "'it''s'", "#x", "" });
+        }
+    }
+}
+
+SCENARIO("memory mapped input lexes without copying", "[lab1]") {
+    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    DfaLexer dfa{ datalogGrammar.terminals() };
+
+    GIVEN("the example 3 file mapped into memory") {
+        MappedFile file{ "./examples/example3.txt" };
+        std::ifstream data{ "./examples/example3.txt", std::ios::in };
+        auto tokens = dfa.process(file.text());
+        std::string text;
+        auto expected = dfa.process(data, text);
+
+        THEN("the tokens view the mapping and match the stream input") {
+            REQUIRE(tokens.size() == expected.size());
+            for (size_t i = 0; i < tokens.size(); ++i)
+            {
+                REQUIRE(tokens[i].typeId() == expected[i].typeId());
+                REQUIRE(tokens[i].value() == expected[i].value());
+                REQUIRE(tokens[i].value().data() >= file.text().data());
+                REQUIRE(tokens[i].value().data() <= file.text().data() + file.text().size());
+            }
+        }
+    }
+}
+
+namespace
+{
+    // hands out one line each time it runs dry, like a terminal or a socket
+    class LineBuffer : public std::streambuf
+    {
+    public:
+        explicit LineBuffer(std::vector<std::string> lines)
+            : _lines{ std::move(lines) } {}
+
+        size_t delivered() const { return _next; }
+
+    protected:
+        int_type underflow() override
+        {
+            if (_next == _lines.size())
+                return traits_type::eof();
+            std::string& line = _lines[_next++];
+            setg(line.data(), line.data(), line.data() + line.size());
+            return traits_type::to_int_type(line.front());
+        }
+
+    private:
+        std::vector<std::string> _lines;
+        size_t _next = 0;
+    };
+
+    // Reads without a get area and never reports buffered input, like
+    // std::cin synced with stdio, counting how often it is asked for bytes.
+    class UnbufferedSource : public std::streambuf
+    {
+    public:
+        explicit UnbufferedSource(std::string text)
+            : _text{ std::move(text) } {}
+
+        size_t reads() const { return _reads; }
+
+    protected:
+        int_type underflow() override
+        {
+            ++_reads;
+            return _next == _text.size() ? traits_type::eof() : traits_type::to_int_type(_text[_next]);
+        }
+
+        int_type uflow() override
+        {
+            int_type value = underflow();
+            _next += value != traits_type::eof();
+            return value;
+        }
+
+        std::streamsize xsgetn(char* to, std::streamsize count) override
+        {
+            ++_reads;
+            size_t taken = std::min(static_cast<size_t>(count), _text.size() - _next);
+            std::copy_n(_text.data() + _next, taken, to);
+            _next += taken;
+            return static_cast<std::streamsize>(taken);
+        }
+
+    private:
+        std::string _text;
+        size_t _next = 0;
+        size_t _reads = 0;
+    };
+}
+
+SCENARIO("tokens can be pulled one at a time", "[lab1]") {
+    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    DfaLexer dfa{ datalogGrammar.terminals() };
+
+    auto file = GENERATE(as<std::string>{}, "./examples/example1.txt", "./examples/example2.txt", "./examples/example3.txt");
+
+    GIVEN("the file " + file + " read through a tiny buffer") {
+        std::ifstream whole{ file, std::ios::in };
+        std::vector<Token> expected;
+        std::string text;
+        auto tokens = dfa.process(whole, text);
+        std::copy_if(std::cbegin(tokens), std::cend(tokens), std::back_inserter(expected), [](const Token& token) {
+            return token.typeId() != TokenType::Whitespace.id();
+        });
+
+        std::ifstream data{ file, std::ios::in };
+        TokenStream stream{ dfa, data, { TokenType::Whitespace.id() }, 3 };
+
+        THEN("the stream yields the same tokens without whitespace") {
+            size_t count = 0;
+            for (const auto& token : stream)
+            {
+                REQUIRE(count < expected.size());
+                REQUIRE(token.typeId() == expected[count].typeId());
+                REQUIRE(token.value() == expected[count].value());
+                REQUIRE(token.line() == expected[count].line());
+                ++count;
+            }
+            REQUIRE(count == expected.size());
+        }
+    }
+
+    GIVEN("input that arrives a line at a time") {
+        LineBuffer lines{ { "Schemes: a(X)\n", "Facts:\n", "Rules:\n", "Queries: a(X)?\n" } };
+        std::istream data{ &lines };
+        TokenStream stream{ dfa, data };
+
+        THEN("each token is returned once its line has arrived") {
+            REQUIRE(stream.next().type().name() == "SCHEMES");
+            REQUIRE(lines.delivered() == 1);
+            while (stream.next().type().name() != "FACTS")
+                ;
+            REQUIRE(lines.delivered() == 2);
+        }
+    }
+
+    GIVEN("a long string literal read from a stream that reports nothing buffered") {
+        std::string literal(2 << 20, 'x');
+        std::string text = "Facts: f('" + literal + "'). f('y').\n";
+        UnbufferedSource source{ text };
+        std::istream data{ &source };
+        TokenStream stream{ dfa, data };
+
+        THEN("it is read in chunks that double, not byte by byte") {
+            size_t strings = 0;
+            for (const auto& token : stream)
+                strings += token.type().name() == "STRING";
+            REQUIRE(strings == 2);
+            REQUIRE(stream.bytes() == text.size());
+            REQUIRE(source.reads() < 2 * (text.size() / TokenStream::DefaultChunkSize + 1) + 8);
+        }
+    }
+
+    GIVEN("a stream that skips comments by default") {
+        std::string text{ "#| block |# Facts # line\n:" };
+        TokenStream stream{ dfa, text };
+
+        THEN("only the significant tokens remain") {
+            REQUIRE(stream.next().type().name() == "FACTS");
+            REQUIRE(stream.next().type().name() == "COLON");
+            REQUIRE(stream.next().typeId() == TokenType::EndOfFile.id());
+            REQUIRE(stream.finished());
+        }
+    }
+}
+
+namespace
+{
+    // long quoted strings and padding, like generated fact files
+    std::string paddedFacts(size_t count)
+    {
+        std::string text{ "Facts:\n" };
+        for (size_t i = 0; i < count; ++i)
+        {
+            text += "    label('" + std::string(40 + i % 37, 'x') + "''s',\t'n" + std::to_string(i) + "').";
+            text += i % 5 == 0 ? "   #| block\n comment |# \n" : "          # note\n";
+        }
+        return text;
+    }
+
+    // puts the scan level back when the test ends, failed REQUIREs included
+    struct ScanLevelGuard
+    {
+        ~ScanLevelGuard() { setScanLevel(previous); }
+
+        ScanLevel previous = scanLevel();
+    };
+}
+
+SCENARIO("the scanning kernels agree at every level", "[lab1]") {
+    auto level = GENERATE(ScanLevel::Scalar, ScanLevel::Sse42, ScanLevel::Avx2);
+    ScanLevelGuard guard;
+    ScanLevel used = setScanLevel(level);
+    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    DfaLexer dfa{ datalogGrammar.terminals() };
+
+    GIVEN("text with runs that end at every offset") {
+        std::string text;
+        for (size_t run = 0; run < 70; ++run)
+            text += std::string(run, run % 2 == 0 ? ' ' : '\n') + "\t\r|x" + std::string(run, 'a') + "'\n";
+
+        THEN("the results match a plain loop") {
+            REQUIRE(used <= level);
+            for (size_t at = 0; at < text.size(); ++at)
+            {
+                size_t space = at;
+                while (space < text.size() && std::isspace(static_cast<unsigned char>(text[space])))
+                    ++space;
+                REQUIRE(skipSpaces(text, at) == space);
+                REQUIRE(findAny(text, at, "'|") == std::min(text.find_first_of("'|", at), text.size()));
+            }
+            REQUIRE(countLines(text) == static_cast<size_t>(std::count(std::cbegin(text), std::cend(text), '\n')));
+        }
+    }
+
+    GIVEN("generated facts lexed by the table driven and stream lexers") {
+        std::string text = paddedFacts(200);
+        std::istringstream data{ text };
+        auto expected = Lexer{ datalogGrammar.terminals() }.process(data);
+        auto tokens = dfa.process(std::string_view{ text });
+
+        THEN("tokens and lines are the same") {
+            REQUIRE(tokens.size() == expected.size());
+            for (size_t i = 0; i < tokens.size(); ++i)
+            {
+                REQUIRE(tokens[i].typeId() == expected[i].typeId());
+                REQUIRE(tokens[i].line() == expected[i].line());
+            }
+        }
+
+        THEN("a stream skipping whitespace runs ends on the same line") {
+            TokenStream stream{ dfa, text };
+            size_t significant = 0;
+            for (const auto& token : stream)
+                significant += token.typeId() != TokenType::EndOfFile.id();
+            REQUIRE(significant == 200 * 7 + 2);
+            REQUIRE(stream.line() == tokens.back().line());
+        }
+    }
+}
+
+TEST_CASE("lexing throughput by scan level", "[.][benchmark]") {
+    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    DfaLexer dfa{ datalogGrammar.terminals() };
+    std::string text = paddedFacts(200000);
+    ScanLevelGuard guard;
+
+    for (ScanLevel level : { ScanLevel::Scalar, ScanLevel::Sse42, ScanLevel::Avx2 })
+    {
+        ScanLevel used = setScanLevel(level);
+        auto start = std::chrono::steady_clock::now();
+        TokenStream stream{ dfa, text };
+        size_t tokens = 0;
+        for (const auto& token : stream)
+            tokens += token.value().size() > 0;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        WARN("scan level " << static_cast<int>(used) << ": " << text.size() / elapsed.count() / 1e6
+            << " MB/s, " << tokens << " tokens");
+    }
+}
+
+SCENARIO("one input can be lexed in parallel chunks", "[lab1]") {
+    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    DfaLexer dfa{ datalogGrammar.terminals() };
+    Scheduler scheduler{ 4 };
+
+    auto chunkSize = GENERATE(as<size_t>{}, 1, 7, 64, 1000);
+
+    GIVEN("strings and block comments that span many lines, in chunks of " + std::to_string(chunkSize)) {
+        std::string text = paddedFacts(60) + "'a\nlong ''quoted''\n\nstring'\n#| a block\n'comment\n|# done\n'open";
+        auto expected = dfa.process(std::string_view{ text });
+        auto tokens = dfa.process(text, scheduler, chunkSize);
+
+        THEN("the stitched tokens and lines match lexing in one pass") {
+            REQUIRE(tokens.size() == expected.size());
+            for (size_t i = 0; i < tokens.size(); ++i)
+            {
+                REQUIRE(tokens[i].typeId() == expected[i].typeId());
+                REQUIRE(tokens[i].value().data() == expected[i].value().data());
+                REQUIRE(tokens[i].value().size() == expected[i].value().size());
+                REQUIRE(tokens[i].line() == expected[i].line());
+            }
+        }
+    }
+
+    GIVEN("the example 3 file mapped into memory") {
+        MappedFile file{ "./examples/example3.txt" };
+        auto expected = dfa.process(file.text());
+        auto tokens = dfa.process(file.text(), scheduler, chunkSize);
+
+        THEN("the same tokens come out") {
+            REQUIRE(tokens.size() == expected.size());
+            for (size_t i = 0; i < tokens.size(); ++i)
+            {
+                REQUIRE(tokens[i].value().data() == expected[i].value().data());
+                REQUIRE(tokens[i].line() == expected[i].line());
+            }
+        }
+    }
+}
+
+TEST_CASE("parallel lexing throughput", "[.][benchmark]") {
+    Grammar datalogGrammar = DatalogGrammarFactory::createDatalogGrammar();
+    DfaLexer dfa{ datalogGrammar.terminals() };
+    std::string text = paddedFacts(400000);
+
+    auto measure = [&](size_t threads) {
+        Scheduler scheduler{ threads };
+        auto start = std::chrono::steady_clock::now();
+        auto tokens = dfa.process(text, scheduler, DfaLexer::DefaultChunkSize);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        REQUIRE(tokens.size() > 400000);
+        return elapsed.count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    dfa.process(std::string_view{ text });
+    std::chrono::duration<double> sequential = std::chrono::steady_clock::now() - start;
+    WARN("one pass: " << text.size() / sequential.count() / 1e6 << " MB/s");
+    for (size_t threads = 1; threads <= std::max<size_t>(std::thread::hardware_concurrency(), 1); threads *= 2)
+    {
+        double elapsed = measure(threads);
+        WARN(threads << " threads: " << text.size() / elapsed / 1e6 << " MB/s ("
+            << sequential.count() / elapsed << "x)");
+    }
+}
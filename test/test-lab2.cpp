@@ -0,0 +1,327 @@
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include "catch2/catch.hpp"
+#include "src/parser/grammar.h"
+#include "src/parser/parser.h"
+#include "src/parser/ast.h"
+#include "src/parser/facts.h"
+#include "src/parser/syntax.h"
+#include "src/scheduler.h"
+
+namespace
+{
+    std::string text(Symbol symbol) { return std::string{ SymbolTable::global().text(symbol) }; }
+}
+
+SCENARIO("the datalog grammar parses with an LL(1) table", "[lab2]") {
+    LL1Parser parser{ DatalogGrammarFactory::createDatalogGrammar() };
+
+    GIVEN("the example 4 program") {
+        DatalogAst ast = parseDatalog(parser, "./examples/example4.txt");
+
+        THEN("every section is captured") {
+            REQUIRE(ast.schemes.size() == 4);
+            REQUIRE(ast.rules.size() == 2);
+            REQUIRE(ast.queries.size() == 3);
+            REQUIRE(ast.facts.size() == 2);
+        }
+
+        THEN("facts are grouped into row-major tables per relation") {
+            const auto& snap = ast.facts[0];
+            REQUIRE(text(snap.name) == "snap");
+            REQUIRE(snap.arity == 4);
+            REQUIRE(snap.size() == 3);
+            REQUIRE(text(snap.values[5]) == "'P. Patty'");
+            REQUIRE(ast.facts[1].size() == 5);
+        }
+
+        THEN("rules keep their head followed by the body predicates") {
+            const auto& rule = ast.rules[1];
+            const auto& head = ast.predicates[rule.head];
+            REQUIRE(text(head.name) == "ncg");
+            REQUIRE(head.count == 3);
+            REQUIRE(rule.count == 2);
+            REQUIRE(text(ast.predicates[rule.head + 2].name) == "csg");
+        }
+
+        THEN("expressions keep their operands next to each other") {
+            const auto& query = ast.predicates[ast.queries[2]];
+            REQUIRE(query.count == 3);
+            const auto& parameter = ast.parameters[query.first + 1];
+            REQUIRE(parameter.kind == DatalogAst::Parameter::Kind::Expression);
+            const auto& expression = ast.expressions[parameter.value];
+            REQUIRE(expression.op == '+');
+            REQUIRE(text(ast.parameters[expression.lhs].value) == "S");
+            REQUIRE(text(ast.parameters[expression.lhs + 1].value) == "'1'");
+            REQUIRE(ast.parameters[query.first + 2].kind == DatalogAst::Parameter::Kind::Id);
+        }
+    }
+
+    GIVEN("a program with a syntax error") {
+        std::string program{ "Schemes: a(X) Facts: a('1'). Rules: Queries: a(X)" };
+        TokenStream tokens{ parser.lexer(), program };
+
+        THEN("parsing reports the offending token") {
+            REQUIRE_THROWS_WITH(parseDatalog(parser, tokens), "unexpected token (EOF,\"\",1)");
+        }
+    }
+
+    GIVEN("a grammar that is not LL(1)") {
+        TokenType a{ "A", nullptr, nullptr, Pattern{ Pattern::Kind::Character, "a" } };
+        Variable start{ "START" };
+        Grammar grammar{ start };
+        grammar.addTerminal(a);
+        grammar.addProduction(std::make_pair(start, std::vector<Variable>{ a }));
+        grammar.addProduction(std::make_pair(start, std::vector<Variable>{ a, a }));
+
+        THEN("building the parse table fails") {
+            REQUIRE_THROWS_AS(LL1Parser{ grammar }, std::invalid_argument);
+        }
+    }
+
+    GIVEN("a grammar with two comments of its own") {
+        TokenType percent{ "COMMENT", nullptr, nullptr, Pattern{ Pattern::Kind::LineComment, "%" } };
+        TokenType semicolon{ "COMMENT", nullptr, nullptr, Pattern{ Pattern::Kind::LineComment, ";" } };
+        TokenType a{ "A", nullptr, nullptr, Pattern{ Pattern::Kind::Character, "a" } };
+        Variable start{ "START" };
+        Grammar grammar{ start };
+        grammar.addTerminal(percent);
+        grammar.addTerminal(semicolon);
+        grammar.addTerminal(a);
+        grammar.addProduction(std::make_pair(start, std::vector<Variable>{ Variable{ "COMMENT" }, a }));
+        LL1Parser comments{ grammar };
+
+        THEN("each gets an id apart from the datalog comment and the other") {
+            REQUIRE(percent.id() != DatalogSyntax::Comment);
+            REQUIRE(semicolon.id() != DatalogSyntax::Comment);
+            REQUIRE(semicolon.id() != percent.id());
+            REQUIRE(TokenType{ "COMMENT", nullptr, nullptr, Pattern{ Pattern::Kind::LineComment, "%" } }.id() == percent.id());
+        }
+
+        THEN("both are read as the grammar's one comment terminal") {
+            for (std::string program : { "% one\na", "; two\na" })
+            {
+                TokenStream tokens{ comments.lexer(), program, { TokenType::Whitespace.id() } };
+                ParseListener listener;
+                REQUIRE_NOTHROW(comments.process(tokens, listener));
+            }
+            REQUIRE(comments.predict("START", semicolon.id()) == comments.predict("START", percent.id()));
+        }
+
+        THEN("a name without a pattern cannot be registered twice") {
+            REQUIRE_THROWS_AS((TokenType{ "EOF", nullptr, nullptr }), std::invalid_argument);
+        }
+    }
+}
+
+
+SCENARIO("the datalog parse table is computed at compile time", "[lab2]") {
+    static_assert(DatalogSyntax::parseTable.conflicts == 0);
+    static_assert(DatalogSyntax::parseTable.cells[DatalogSyntax::Parameter * DatalogSyntax::TerminalCount + DatalogSyntax::LParen] == 18);
+
+    GIVEN("the compile time parser and one that derives its table from the grammar") {
+        LL1Parser compiled = DatalogGrammarFactory::createDatalogParser();
+        LL1Parser derived{ DatalogGrammarFactory::createDatalogGrammar() };
+
+        THEN("terminals keep their reserved ids") {
+            REQUIRE(compiled.terminal("ID") == DatalogSyntax::Id);
+            REQUIRE(derived.terminal("ADD") == DatalogSyntax::Add);
+            REQUIRE(TokenType::EndOfFile.id() == DatalogSyntax::EndOfFile);
+        }
+
+        THEN("both predict the same production everywhere") {
+            for (std::string_view nonterminal : DatalogSyntax::nonterminalNames)
+            {
+                for (TokenType::Id lookahead = 0; lookahead < DatalogSyntax::TerminalCount; ++lookahead)
+                    REQUIRE(compiled.predict(nonterminal, lookahead) == derived.predict(nonterminal, lookahead));
+            }
+        }
+
+        THEN("the compile time parser reads a program") {
+            DatalogAst ast = parseDatalog(compiled, "./examples/example4.txt");
+            REQUIRE(ast.rules.size() == 2);
+            REQUIRE(ast.queries.size() == 3);
+        }
+    }
+
+    GIVEN("a table that does not fit the grammar") {
+        THEN("the parser rejects it") {
+            REQUIRE_THROWS_AS(LL1Parser(DatalogGrammarFactory::createDatalogGrammar(), std::vector<std::int32_t>(3, -1)),
+                std::invalid_argument);
+        }
+    }
+}
+
+namespace
+{
+    std::vector<std::vector<std::string>> factRows(const DatalogAst& ast)
+    {
+        std::vector<std::vector<std::string>> rows;
+        for (const auto& table : ast.facts)
+        {
+            for (size_t row = 0; row < table.size(); ++row)
+            {
+                std::vector<std::string> values{ text(table.name) };
+                for (size_t column = 0; column < table.arity; ++column)
+                    values.push_back(text(table.values[row * table.arity + column]));
+                rows.push_back(values);
+            }
+        }
+        return rows;
+    }
+
+    std::string generateFacts(size_t count)
+    {
+        std::string program{ "Schemes: edge(A,B) label(A,B,C)\nFacts:\n" };
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i % 3 == 0)
+                program += "  label('n" + std::to_string(i) + "', 'it''s', 'x') # trailing comment\n";
+            else
+                program += "  edge('n" + std::to_string(i) + "','n" + std::to_string(i + 1) + "').\n";
+            if (i % 3 == 0)
+                program += "  .\n";
+        }
+        program += "Rules:\nQueries: edge('n1',B)?\n";
+        return program;
+    }
+}
+
+SCENARIO("the bulk fact loader matches the generic parser", "[lab2]") {
+    LL1Parser parser{ DatalogGrammarFactory::createDatalogGrammar() };
+
+    GIVEN("a generated program read through a small buffer") {
+        std::string program = generateFacts(500);
+        std::istringstream bulkData{ program };
+        TokenStream bulkTokens{ parser.lexer(), bulkData, 7 };
+        TokenStream genericTokens{ parser.lexer(), program };
+
+        DatalogAst bulk = parseDatalog(parser, bulkTokens, true);
+        DatalogAst generic = parseDatalog(parser, genericTokens, false);
+
+        THEN("both paths load the same facts and the rest of the program") {
+            REQUIRE(factRows(bulk) == factRows(generic));
+            REQUIRE(factRows(bulk).size() == 500);
+            REQUIRE(bulk.queries.size() == 1);
+            REQUIRE(bulkTokens.line() == genericTokens.line());
+        }
+
+        THEN("the fact tables are allocated from the AST's arena") {
+            auto* arena = bulk.predicates.get_allocator().resource();
+            REQUIRE(arena != std::pmr::get_default_resource());
+            REQUIRE(bulk.facts.front().values.get_allocator().resource() == arena);
+        }
+
+        WHEN("the AST is moved") {
+            const Symbol* values = bulk.facts.front().values.data();
+            DatalogAst moved = std::move(bulk);
+
+            THEN("its arrays keep their storage") {
+                REQUIRE(moved.facts.front().values.data() == values);
+            }
+        }
+    }
+
+    GIVEN("facts scanned in small chunks on several threads") {
+        // comments and strings spanning lines put chunk starts inside them
+        std::string facts;
+        for (size_t i = 0; i < 400; ++i)
+        {
+            std::string n = std::to_string(i);
+            if (i % 7 == 0)
+                facts += "#| edge('x','y').\n   edge('z','w'). |#\n";
+            if (i % 11 == 0)
+                facts += "label('n" + n + "', 'two\nlines', 'it''s').\n";
+            else
+                facts += "edge('n" + n + "','n" + std::to_string(i + 1) + "'). # edge('c','d').\n";
+        }
+        facts += "Rules:\nQueries: edge('n1',B)?\n";
+
+        Scheduler scheduler{ 4 };
+        DatalogAst sequential;
+        DatalogAst chunked;
+        TokenStream sequentialTokens{ parser.lexer(), facts };
+        TokenStream chunkedTokens{ parser.lexer(), facts };
+        size_t loaded = FactLoader{ parser, sequential }.load(sequentialTokens);
+        size_t chunkedLoaded = FactLoader{ parser, chunked, &scheduler, 64 }.load(chunkedTokens);
+
+        THEN("they load the same facts and stop at the same place") {
+            REQUIRE(loaded == 400);
+            REQUIRE(chunkedLoaded == loaded);
+            REQUIRE(factRows(chunked) == factRows(sequential));
+            REQUIRE(chunkedTokens.buffered() == sequentialTokens.buffered());
+            REQUIRE(chunkedTokens.line() == sequentialTokens.line());
+            REQUIRE(chunkedTokens.tokens() == sequentialTokens.tokens());
+        }
+    }
+
+    GIVEN("a fact the loader does not accept") {
+        std::string program{ "Schemes: a(X)\nFacts: a('1'). a('2' '3').\nRules: Queries: a(X)?" };
+        TokenStream tokens{ parser.lexer(), program };
+
+        THEN("the parser reports the error at the offending token") {
+            REQUIRE_THROWS_WITH(parseDatalog(parser, tokens, true), "unexpected token (STRING,\"'3'\",2)");
+        }
+    }
+}
+
+TEST_CASE("bulk fact loading throughput", "[.][benchmark]") {
+    LL1Parser parser{ DatalogGrammarFactory::createDatalogGrammar() };
+    std::string program = generateFacts(300000);
+
+    auto measure = [&](bool bulkFacts) {
+        auto start = std::chrono::steady_clock::now();
+        TokenStream tokens{ parser.lexer(), program };
+        DatalogAst ast = parseDatalog(parser, tokens, bulkFacts);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        REQUIRE(factRows(ast).size() == 300000);
+        return elapsed.count();
+    };
+
+    double generic = measure(false);
+    double bulk = measure(true);
+    WARN("generic parser: " << program.size() / generic / 1e6 << " MB/s, bulk loader: "
+        << program.size() / bulk / 1e6 << " MB/s (" << generic / bulk << "x)");
+}
+
+
+SCENARIO("identifiers and constants share one symbol space", "[lab2]") {
+    GIVEN("a symbol table filled from several threads") {
+        SymbolTable symbols;
+        std::vector<std::vector<Symbol>> results(4);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < results.size(); ++t)
+        {
+            threads.emplace_back([&symbols, &results, t]() {
+                for (int i = 0; i < 20000; ++i)
+                    results[t].push_back(symbols.intern("'value" + std::to_string(i) + "'"));
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        THEN("every thread sees the same dense ids") {
+            REQUIRE(symbols.size() == 20000);
+            for (const auto& result : results)
+                REQUIRE(result == results.front());
+            REQUIRE(symbols.text(results[2][1234]) == "'value1234'");
+        }
+
+        THEN("symbols past the last one interned are unknown") {
+            REQUIRE_THROWS_AS(symbols.text(20000), std::out_of_range);
+            REQUIRE_THROWS_AS(symbols.text(Symbol{ 1 } << 30), std::out_of_range);
+            REQUIRE(symbols.text(symbols.intern("")).empty());
+        }
+    }
+
+    GIVEN("grammar symbols and parsed identifiers") {
+        Variable scheme{ "SCHEME" };
+        Symbol fromText = SymbolTable::global().intern("SCHEME");
+
+        THEN("equal names map to the same symbol") {
+            REQUIRE(scheme.symbol() == fromText);
+            REQUIRE(Variable{ std::string{ "SCHEME" } }.symbol() == scheme.symbol());
+        }
+    }
+}
@@ -0,0 +1,197 @@
+#include "catch2/catch.hpp"
+#include "src/datalog.h"
+#include "src/relation.h"
+#include "src/scheduler.h"
+#include "test/programs.h"
+
+namespace
+{
+    Symbol symbol(const std::string& text) { return SymbolTable::global().intern(text); }
+
+    Relation relation(const std::string& name, std::vector<std::string> attributes, std::vector<std::vector<std::string>> rows)
+    {
+        std::vector<Symbol> names;
+        for (const auto& attribute : attributes)
+            names.push_back(symbol(attribute));
+
+        Relation result{ symbol(name), names };
+        for (const auto& row : rows)
+        {
+            std::vector<Symbol> tuple;
+            for (const auto& value : row)
+                tuple.push_back(symbol(value));
+            result.insert(tuple.data());
+        }
+        result.normalize();
+        return result;
+    }
+
+    std::vector<std::vector<std::string>> rows(const Relation& relation)
+    {
+        std::vector<std::vector<std::string>> result;
+        for (size_t i = 0; i < relation.size(); ++i)
+        {
+            std::vector<std::string> row;
+            for (size_t column = 0; column < relation.arity(); ++column)
+                row.emplace_back(SymbolTable::global().text(relation.row(i)[column]));
+            std::sort(std::begin(row), std::end(row));
+            result.push_back(row);
+        }
+        std::sort(std::begin(result), std::end(result));
+        return result;
+    }
+}
+
+SCENARIO("relations are flat sorted arrays of symbols", "[lab3]") {
+    GIVEN("a relation with duplicate rows") {
+        Relation edges = relation("e", { "A", "B" }, { { "'1'", "'2'" }, { "'2'", "'3'" }, { "'1'", "'2'" }, { "'3'", "'3'" } });
+
+        THEN("normalizing removes the duplicates") {
+            REQUIRE(edges.size() == 3);
+            REQUIRE(edges.data().size() == 6);
+        }
+
+        THEN("select keeps rows with a constant or with equal columns") {
+            REQUIRE(edges.select(0, symbol("'1'")).size() == 1);
+            REQUIRE(edges.select(0, size_t{ 1 }).size() == 1);
+        }
+
+        THEN("project removes columns and duplicates") {
+            REQUIRE(edges.project({ 1 }).size() == 2);
+            REQUIRE(edges.project({ 1, 0 }).attributes() == std::vector<Symbol>{ symbol("B"), symbol("A") });
+        }
+
+        WHEN("it is joined with a renamed copy of itself") {
+            Relation paths = edges.join(edges.rename({ symbol("B"), symbol("C") }));
+
+            THEN("rows pair up on the shared attribute") {
+                REQUIRE(paths.arity() == 3);
+                REQUIRE(rows(paths) == std::vector<std::vector<std::string>>{
+                    { "'1'", "'2'", "'3'" }, { "'2'", "'3'", "'3'" }, { "'3'", "'3'", "'3'" } });
+            }
+        }
+
+        WHEN("another relation is united into it") {
+            Relation added = edges.unite(relation("e", { "A", "B" }, { { "'1'", "'2'" }, { "'4'", "'1'" } }));
+
+            THEN("only the new rows are reported") {
+                REQUIRE(edges.size() == 4);
+                REQUIRE(added.size() == 1);
+                REQUIRE(edges.contains(added.row(0)));
+            }
+        }
+
+        WHEN("many rows are normalized on several threads") {
+            Relation serial{ edges.name(), edges.attributes() };
+            Relation parallel{ edges.name(), edges.attributes() };
+            std::uint32_t seed = 7;
+            for (size_t i = 0; i < 20 * Relation::ParallelGrain; ++i)
+            {
+                seed = seed * 1103515245 + 12345;
+                std::vector<Symbol> tuple{ symbol("'" + std::to_string(seed % 1000) + "'"), symbol("'" + std::to_string(i % 97) + "'") };
+                serial.insert(tuple.data());
+                parallel.insert(tuple.data());
+            }
+            Scheduler scheduler{ 4 };
+            serial.normalize();
+            parallel.normalize(&scheduler);
+
+            THEN("the pieces merge into the same sorted, unique rows") {
+                REQUIRE(parallel.size() == serial.size());
+                REQUIRE(parallel.data() == serial.data());
+            }
+        }
+
+        WHEN("a copy lives in an arena") {
+            std::pmr::monotonic_buffer_resource arena;
+            Relation local{ edges.name(), edges.attributes(), &arena };
+            local.unite(edges);
+
+            THEN("operator results are allocated from the same arena") {
+                REQUIRE(local.resource() == &arena);
+                REQUIRE(local.select(0, symbol("'1'")).resource() == &arena);
+                REQUIRE(local.join(edges.rename({ symbol("B"), symbol("C") })).resource() == &arena);
+                REQUIRE(local.project({ 1 }).rename({ symbol("C") }).resource() == &arena);
+                REQUIRE(local.data() == edges.data());
+            }
+        }
+    }
+
+    GIVEN("a large relation with a few rows staged and retracted") {
+        Relation numbers{ symbol("n"), { symbol("A"), symbol("B") } };
+        for (std::uint32_t i = 0; i < 100000; ++i)
+        {
+            std::vector<Symbol> tuple{ SymbolTable::global().number(i), SymbolTable::global().number(i % 10) };
+            numbers.insert(tuple.data());
+        }
+        numbers.normalize();
+        const Symbol* before = numbers.data().data();
+
+        std::vector<Symbol> gone{ SymbolTable::global().number(5), SymbolTable::global().number(5) };
+        std::vector<Symbol> added{ SymbolTable::global().number(200000), SymbolTable::global().number(0) };
+        Relation removals{ numbers.name(), numbers.attributes() };
+        removals.insert(gone.data());
+        Relation additions{ numbers.name(), numbers.attributes() };
+        additions.insert(added.data());
+        additions.insert(gone.data());
+        additions.normalize();
+
+        Relation removed = numbers.retract(removals);
+        Relation staged = numbers.stage(additions);
+
+        THEN("the sorted rows are neither copied nor touched") {
+            REQUIRE(numbers.data().data() == before);
+            REQUIRE(numbers.data().size() == 2 * 100000);
+            REQUIRE_FALSE(numbers.settled());
+        }
+
+        THEN("the changes are reported and seen by contains") {
+            REQUIRE(removed.size() == 1);
+            REQUIRE(staged.size() == 2);
+            REQUIRE(numbers.contains(gone.data()));
+            REQUIRE(numbers.contains(added.data()));
+        }
+
+        WHEN("they are settled") {
+            numbers.settle();
+
+            THEN("the rows are sorted in with the others") {
+                REQUIRE(numbers.settled());
+                REQUIRE(numbers.size() == 100001);
+                REQUIRE(numbers.contains(gone.data()));
+                REQUIRE(numbers.row(100000)[0] == added.front());
+            }
+        }
+    }
+}
+
+SCENARIO("queries are answered from the facts", "[lab3]") {
+    GIVEN("a program with constants, variables and repeated variables") {
+        std::string output = answers(load(
+            "Schemes: SK(A,B)\n"
+            "Facts: SK('a','c'). SK('b','c'). SK('b','b'). SK('b','c').\n"
+            "Rules:\n"
+            "Queries: SK(A,'c')? SK('b','c')? SK(X,X)? SK(A,B)? SK('c',B)?\n"));
+
+        THEN("each query prints its matching rows in text order") {
+            REQUIRE(output ==
+                "SK(A,'c')? Yes(2)\n"
+                "  A='a'\n"
+                "  A='b'\n"
+                "SK('b','c')? Yes(1)\n"
+                "SK(X,X)? Yes(1)\n"
+                "  X='b'\n"
+                "SK(A,B)? Yes(3)\n"
+                "  A='a', B='c'\n"
+                "  A='b', B='b'\n"
+                "  A='b', B='c'\n"
+                "SK('c',B)? No\n");
+        }
+    }
+
+    GIVEN("facts for a scheme that was never declared") {
+        THEN("loading fails") {
+            REQUIRE_THROWS_AS(load("Schemes: a(X) Facts: b('1'). Rules: Queries: a(X)?"), std::invalid_argument);
+        }
+    }
+}
@@ -0,0 +1,914 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include "catch2/catch.hpp"
+#include "src/datalog.h"
+#include "src/server.h"
+#include "src/parser/source.h"
+#include "bench/workload.h"
+#include "test/programs.h"
+
+namespace
+{
+    std::string chain(size_t length)
+    {
+        std::string text{ "Schemes: edge(A,B) path(A,B)\nFacts:\n" };
+        for (size_t i = 0; i < length; ++i)
+            text += "edge('" + std::to_string(i) + "','" + std::to_string(i + 1) + "').\n";
+        text += "Rules:\npath(X,Y) :- edge(X,Y).\npath(X,Z) :- edge(X,Y), path(Y,Z).\nQueries: path('0',X)?\n";
+        return text;
+    }
+
+    // the chain program split into a directory: schemes, rules and queries in
+    // files of their own and the edges in count fact files
+    std::filesystem::path shardedChain(const std::string& name, size_t length, size_t count)
+    {
+        auto directory = std::filesystem::temp_directory_path() / name;
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directory(directory);
+        std::ofstream{ directory / "0-schemes.dl" } << "Schemes: edge(A,B) path(A,B)\n";
+        std::ofstream{ directory / "9-rules.dl" }
+            << "Rules:\npath(X,Y) :- edge(X,Y).\npath(X,Z) :- edge(X,Y), path(Y,Z).\nQueries: path('0',X)?\n";
+        for (size_t shard = 0; shard < count; ++shard)
+        {
+            std::ofstream out{ directory / ("5-facts-" + std::to_string(shard) + ".dl") };
+            out << "Facts:\n";
+            for (size_t i = shard; i < length; i += count)
+                out << "edge('" << i << "','" << i + 1 << "').\n";
+        }
+        return directory;
+    }
+
+    // a resource that counts the bytes allocated through it
+    class CountingResource : public std::pmr::memory_resource
+    {
+    public:
+        size_t allocated = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            allocated += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+        {
+            std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+}
+
+SCENARIO("rules are evaluated to a fixpoint", "[lab4]") {
+    GIVEN("the transitive closure of a chain") {
+        DatalogProgram program = load(chain(20));
+        auto stats = program.evaluateRules();
+        const Relation& path = std::as_const(program).relation(SymbolTable::global().intern("path"));
+
+        THEN("every pair along the chain is derived") {
+            REQUIRE(path.size() == 20 * 21 / 2);
+        }
+
+        THEN("each pass extends the paths by one edge until a pass adds nothing") {
+            REQUIRE(stats.iterations == 20);
+            REQUIRE(stats.derived == std::vector<size_t>{ 20, 190 });
+        }
+
+        THEN("running the rules again derives nothing new") {
+            auto again = program.evaluateRules();
+            REQUIRE(again.derived == std::vector<size_t>{ 0, 0 });
+            REQUIRE(path.size() == 210);
+        }
+    }
+
+    GIVEN("the lab example with joins across schemes") {
+        DatalogProgram program = load(
+            "Schemes: snap(S,N,A,P) csg(C,S,G) cn(C,N)\n"
+            "Facts: snap('1','Charlie','A','P'). snap('2','Snoopy','A','P').\n"
+            "  csg('CS101','1','A'). csg('CS101','2','B'). csg('EE200','1','B').\n"
+            "Rules: cn(c,n) :- snap(S,n,A,P),csg(c,S,G).\n"
+            "Queries: cn('CS101',Name)? cn(C,'Charlie')?\n");
+        program.evaluateRules();
+
+        THEN("the queries see the derived tuples") {
+            REQUIRE(answers(program) ==
+                "cn('CS101',Name)? Yes(2)\n"
+                "  Name='Charlie'\n"
+                "  Name='Snoopy'\n"
+                "cn(C,'Charlie')? Yes(2)\n"
+                "  C='CS101'\n"
+                "  C='EE200'\n");
+        }
+    }
+
+    GIVEN("a rule whose head variable is not bound by the body") {
+        THEN("loading rejects it") {
+            REQUIRE_THROWS_AS(load("Schemes: a(X) b(X) Facts: Rules: a(Y) :- b(X). Queries: a(X)?"), std::invalid_argument);
+        }
+    }
+}
+
+SCENARIO("synthetic workloads load and evaluate", "[lab4]") {
+    WorkloadOptions options;
+    options.facts = 64;
+    options.depth = 4;
+    options.queries = 10;
+
+    GIVEN("a transitive closure over chains of four edges") {
+        DatalogProgram program = load(generateWorkload(options));
+        auto stats = program.evaluateRules();
+
+        THEN("each chain reaches every later node") {
+            REQUIRE(stats.derived == std::vector<size_t>{ 64, 16 * 6 });
+            REQUIRE(program.queries().size() == 10);
+        }
+    }
+
+    GIVEN("the chain shape with extra schemes and long strings") {
+        options.shape = WorkloadOptions::Shape::Chain;
+        options.schemes = 2;
+        options.stringLength = 24;
+        std::string text = generateWorkload(options);
+        DatalogProgram program = load(text);
+        auto stats = program.evaluateRules();
+
+        THEN("the facts are split between the schemes") {
+            REQUIRE(std::as_const(program).relation(SymbolTable::global().intern("edge")).size() == 32);
+            REQUIRE(text.find("'xxxxxxxxxxxxxxxxxxxxn0'") != std::string::npos);
+            REQUIRE(stats.derived == std::vector<size_t>{ 8 * 3, 8 * 2 });
+        }
+    }
+
+    GIVEN("the triangle shape") {
+        options.shape = WorkloadOptions::Shape::Triangles;
+        DatalogProgram program = load(generateWorkload(options));
+
+        THEN("the cyclic rule is joined with the leapfrog triejoin") {
+            REQUIRE(program.joinAlgorithm(0) == JoinAlgorithm::Leapfrog);
+            REQUIRE_NOTHROW(program.evaluateRules());
+        }
+    }
+}
+
+SCENARIO("fact changes are maintained incrementally", "[lab4]") {
+    auto& symbols = SymbolTable::global();
+    auto fact = [&symbols](const char* relation, std::string from, std::string to, bool retract = false) {
+        return FactChange{ symbols.intern(relation), { symbols.intern("'" + from + "'"), symbols.intern("'" + to + "'") }, retract };
+    };
+    auto rows = [&symbols](const DatalogProgram& program, const char* name) {
+        return program.relation(symbols.intern(name)).data();
+    };
+
+    GIVEN("the transitive closure of a chain") {
+        DatalogProgram program = load(chain(10));
+        program.evaluateRules();
+
+        WHEN("an edge in the middle is retracted") {
+            auto stats = program.update({ fact("edge", "4", "5", true) });
+
+            THEN("exactly the paths through it are gone") {
+                REQUIRE(std::as_const(program).relation(symbols.intern("path")).size() == 55 - 5 * 6);
+                REQUIRE(stats.removed == std::vector<size_t>{ 1, 30 });
+                REQUIRE(stats.added == std::vector<size_t>{ 0, 0 });
+            }
+
+            AND_WHEN("it is inserted again") {
+                stats = program.update({ fact("edge", "4", "5") });
+
+                THEN("the paths come back") {
+                    REQUIRE(std::as_const(program).relation(symbols.intern("path")).size() == 55);
+                    REQUIRE(stats.added == std::vector<size_t>{ 1, 30 });
+                    DatalogProgram fresh = load(chain(10));
+                    fresh.evaluateRules();
+                    REQUIRE(rows(program, "path") == rows(fresh, "path"));
+                }
+            }
+        }
+
+        WHEN("a bypass is added and then an edge it bypasses is retracted") {
+            program.update({ fact("edge", "3", "6") });
+            auto stats = program.update({ fact("edge", "4", "5", true) });
+
+            THEN("paths with another derivation are rederived") {
+                REQUIRE(stats.overdeleted > stats.removed[1]);
+                REQUIRE(std::as_const(program).relation(symbols.intern("path")).contains(
+                    std::vector<Symbol>{ symbols.intern("'0'"), symbols.intern("'9'") }.data()));
+            }
+        }
+
+        THEN("changes to undeclared schemes or with the wrong arity are rejected") {
+            REQUIRE_THROWS_AS(program.update({ fact("nothing", "1", "2") }), std::invalid_argument);
+            REQUIRE_THROWS_AS(program.update({ FactChange{ symbols.intern("edge"), { symbols.intern("'1'") } } }), std::invalid_argument);
+        }
+    }
+
+    GIVEN("random batches against a program with facts in a derived relation") {
+        // reach has facts of its own and is read by a later stratum
+        auto text = [](const std::set<std::pair<int, int>>& edges, const std::set<std::pair<int, int>>& stated) {
+            std::string program{ "Schemes: e(A,B) reach(A,B) out(A)\nFacts:\n" };
+            for (const auto& [from, to] : edges)
+                program += "e('" + std::to_string(from) + "','" + std::to_string(to) + "').\n";
+            for (const auto& [from, to] : stated)
+                program += "reach('" + std::to_string(from) + "','" + std::to_string(to) + "').\n";
+            return program + "Rules: reach(X,Y) :- e(X,Y). reach(X,Z) :- reach(X,Y), e(Y,Z).\n"
+                "out(X) :- reach(X,Y), e(Y,X).\nQueries: out(X)?\n";
+        };
+
+        std::uint32_t seed = 5;
+        auto next = [&seed](int bound) {
+            seed = seed * 1103515245 + 12345;
+            return static_cast<int>((seed >> 8) % static_cast<std::uint32_t>(bound));
+        };
+        std::set<std::pair<int, int>> edges;
+        std::set<std::pair<int, int>> stated{ { 0, 9 }, { 3, 3 } };
+        for (int i = 0; i < 30; ++i)
+            edges.emplace(next(20), next(20));
+        DatalogProgram program = load(text(edges, stated));
+        program.evaluateRules();
+
+        THEN("every batch leaves the same relations as evaluating from scratch") {
+            for (int batch = 0; batch < 25; ++batch)
+            {
+                // retractions apply before insertions
+                std::vector<FactChange> changes;
+                std::vector<std::pair<std::set<std::pair<int, int>>*, std::pair<int, int>>> inserted;
+                for (int c = 0; c < 4; ++c)
+                {
+                    auto& facts = next(5) == 0 ? stated : edges;
+                    const char* name = &facts == &stated ? "reach" : "e";
+                    if (next(2) == 0 && !facts.empty())
+                    {
+                        auto victim = std::next(std::begin(facts), next(static_cast<int>(facts.size())));
+                        changes.push_back(fact(name, std::to_string(victim->first), std::to_string(victim->second), true));
+                        facts.erase(victim);
+                    }
+                    else
+                    {
+                        std::pair<int, int> added{ next(20), next(20) };
+                        inserted.emplace_back(&facts, added);
+                        changes.push_back(fact(name, std::to_string(added.first), std::to_string(added.second)));
+                    }
+                }
+                for (const auto& [facts, added] : inserted)
+                    facts->insert(added);
+
+                program.update(changes);
+                DatalogProgram fresh = load(text(edges, stated));
+                fresh.evaluateRules();
+                for (const char* name : { "e", "reach", "out" })
+                {
+                    INFO("batch " << batch << ", relation " << name);
+                    REQUIRE(rows(program, name) == rows(fresh, name));
+                }
+            }
+        }
+    }
+
+    GIVEN("a large relation read by a rule through an index") {
+        std::string text{ "Schemes: e(A,B) k(A) t(A,B)\nFacts: k('1'). k('2').\n" };
+        for (int i = 0; i < 50000; ++i)
+            text += "e('" + std::to_string(i) + "','" + std::to_string(i % 10) + "').\n";
+        text += "Rules: t(X,Y) :- k(X), e(X,Y).\nQueries: t(X,Y)?\n";
+
+        // the relations allocate from the resource that was the default
+        // when they were loaded
+        CountingResource counting;
+        std::pmr::memory_resource* previous = std::pmr::set_default_resource(&counting);
+        DatalogProgram program = load(text);
+        program.evaluateRules();
+        counting.allocated = 0;
+        program.update({ fact("e", "7", "7", true), fact("e", "1", "99") });
+        size_t allocated = counting.allocated;
+        std::pmr::set_default_resource(previous);
+
+        THEN("updating a few rows does not copy the rest") {
+            size_t bytes = std::as_const(program).relation(symbols.intern("e")).data().size() * sizeof(Symbol);
+            REQUIRE(allocated * 16 < bytes);
+            const Relation& t = std::as_const(program).relation(symbols.intern("t"));
+            REQUIRE(t.size() == 3);
+            REQUIRE(t.contains(std::vector<Symbol>{ symbols.intern("'1'"), symbols.intern("'99'") }.data()));
+        }
+    }
+}
+
+SCENARIO("programs are saved to and restored from snapshots", "[lab4]") {
+    auto path = std::filesystem::temp_directory_path() / "datalog-test.snap";
+    auto& symbols = SymbolTable::global();
+
+    GIVEN("an evaluated program saved to a snapshot") {
+        DatalogProgram program = load(chain(30) + "path(X,'7')?\n");
+        program.evaluateRules();
+        program.save(path);
+
+        WHEN("it is restored") {
+            MappedFile file{ path };
+            REQUIRE(Snapshot::isSnapshot(file.text()));
+            DatalogProgram restored;
+            restored.restore(file.text());
+
+            THEN("relations, indexes, rules and queries are the same") {
+                for (const char* name : { "edge", "path" })
+                {
+                    Symbol symbol = symbols.intern(name);
+                    REQUIRE(std::as_const(restored).relation(symbol).data() == std::as_const(program).relation(symbol).data());
+                    REQUIRE(restored.indexes(symbol).size() == program.indexes(symbol).size());
+                    for (size_t i = 0; i < program.indexes(symbol).size(); ++i)
+                    {
+                        REQUIRE(restored.indexes(symbol)[i].kind() == program.indexes(symbol)[i].kind());
+                        REQUIRE(restored.indexes(symbol)[i].key() == program.indexes(symbol)[i].key());
+                        REQUIRE(restored.indexes(symbol)[i].size() == program.indexes(symbol)[i].size());
+                    }
+                }
+                REQUIRE(restored.describe(restored.rules()[1]) == program.describe(program.rules()[1]));
+                REQUIRE(restored.strata().size() == program.strata().size());
+                REQUIRE(answers(restored) == answers(program));
+            }
+
+            THEN("it knows the rules were evaluated and evaluating again adds nothing") {
+                REQUIRE(restored.evaluated());
+                REQUIRE(restored.evaluateRules().derived == std::vector<size_t>{ 0, 0 });
+            }
+
+            THEN("it cannot be restored over a loaded program") {
+                REQUIRE_THROWS_AS(program.restore(file.text()), std::logic_error);
+            }
+        }
+
+        WHEN("it is saved again while the snapshot is mapped") {
+            MappedFile file{ path };
+            program.save(path);
+
+            THEN("the new snapshot replaces the old one, which stays whole") {
+                DatalogProgram restored;
+                restored.restore(file.text());
+                REQUIRE(answers(restored) == answers(program));
+                REQUIRE_FALSE(std::filesystem::exists(path.string() + ".tmp"));
+            }
+        }
+
+        WHEN("a byte of the snapshot changes") {
+            std::fstream out{ path, std::ios::in | std::ios::out | std::ios::binary };
+            out.seekp(static_cast<std::streamoff>(std::filesystem::file_size(path) / 2));
+            out.put('\x7f');
+            out.close();
+            MappedFile file{ path };
+
+            THEN("the checksum catches it") {
+                DatalogProgram restored;
+                REQUIRE_THROWS_WITH(restored.restore(file.text()), "snapshot checksum does not match");
+            }
+        }
+
+        WHEN("the snapshot is cut short") {
+            std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+            MappedFile file{ path };
+
+            THEN("restoring it fails") {
+                DatalogProgram restored;
+                REQUIRE_THROWS_WITH(restored.restore(file.text()), "snapshot is truncated");
+            }
+        }
+    }
+
+    GIVEN("a program saved before evaluation") {
+        DatalogProgram program = load(generateWorkload(WorkloadOptions{}));
+        program.save(path);
+        MappedFile file{ path };
+        DatalogProgram restored;
+        restored.restore(file.text());
+
+        THEN("the restored program evaluates to the same relations") {
+            REQUIRE_FALSE(restored.evaluated());
+            REQUIRE(restored.evaluateRules().derived == program.evaluateRules().derived);
+            REQUIRE(answers(restored) == answers(program));
+        }
+    }
+
+    std::filesystem::remove(path);
+}
+
+SCENARIO("programs are merged from many input files", "[lab4]") {
+    namespace fs = std::filesystem;
+    LL1Parser parser = DatalogGrammarFactory::createShardParser();
+    DatalogProgram single = load(chain(200));
+    single.evaluateRules();
+
+    GIVEN("a directory of scheme, fact and rule files") {
+        fs::path directory = shardedChain("datalog-test-shards", 200, 7);
+        std::ofstream{ directory / "README.md" } << "Facts for the chain, in 7 files.\n";
+
+        WHEN("the directory is loaded") {
+            DatalogProgram program{ 4 };
+            program.load(parser, std::vector<fs::path>{ directory });
+            program.evaluateRules();
+
+            THEN("it is the program the files make up together") {
+                REQUIRE(std::as_const(program).relation(SymbolTable::global().intern("edge")).size() == 200);
+                REQUIRE(program.rules().size() == 2);
+                REQUIRE(answers(program) == answers(single));
+            }
+        }
+
+        WHEN("the files are parsed concurrently or one after another") {
+            std::vector<fs::path> files;
+            for (const auto& entry : fs::directory_iterator{ directory })
+            {
+                if (entry.path().extension() == ".dl")
+                    files.push_back(entry.path());
+            }
+            std::sort(std::begin(files), std::end(files));
+            Scheduler scheduler{ 4 };
+            auto concurrent = parseDatalogInputs(parser, files, &scheduler);
+            auto sequential = parseDatalogInputs(parser, { directory }, nullptr);
+
+            THEN("every Datalog file gets its own AST, in input order") {
+                REQUIRE(concurrent.size() == 9);
+                REQUIRE(sequential.size() == 9);
+                for (size_t f = 0; f < files.size(); ++f)
+                {
+                    REQUIRE(concurrent[f].source == files[f].string());
+                    REQUIRE(sequential[f].source == files[f].string());
+                    REQUIRE(concurrent[f].facts.size() == sequential[f].facts.size());
+                }
+                REQUIRE(concurrent.front().schemes.size() == 2);
+                REQUIRE(concurrent.back().rules.size() == 2);
+            }
+        }
+
+        WHEN("another file declares a scheme again") {
+            std::ofstream{ directory / "6-more.dl" } << "Schemes: edge(A,B)\nFacts: edge('200','201').\n";
+            std::ofstream{ directory / "7-other.dl" } << "Schemes: edge(From,To)\n";
+
+            THEN("the same attributes merge and different ones are a conflict naming both files") {
+                fs::remove(directory / "7-other.dl");
+                DatalogProgram program;
+                program.load(parser, std::vector<fs::path>{ directory });
+                REQUIRE(std::as_const(program).relation(SymbolTable::global().intern("edge")).size() == 201);
+
+                std::ofstream{ directory / "7-other.dl" } << "Schemes: edge(From,To)\n";
+                DatalogProgram conflicting;
+                REQUIRE_THROWS_WITH(conflicting.load(parser, std::vector<fs::path>{ directory }),
+                    Catch::Contains("edge(From,To) in " + (directory / "7-other.dl").string()) &&
+                    Catch::Contains("edge(A,B) in " + (directory / "0-schemes.dl").string()));
+            }
+        }
+
+        WHEN("a file does not parse") {
+            std::ofstream{ directory / "5-facts-bad.dl" } << "Facts: edge('1',).\n";
+
+            THEN("the error names it") {
+                DatalogProgram program;
+                REQUIRE_THROWS_WITH(program.load(parser, std::vector<fs::path>{ directory }),
+                    Catch::StartsWith((directory / "5-facts-bad.dl").string() + ": unexpected token"));
+            }
+        }
+
+        fs::remove_all(directory);
+    }
+
+    GIVEN("a whole program in one file") {
+        fs::path file = fs::temp_directory_path() / "datalog-test-whole.dl";
+        std::ofstream{ file } << chain(200);
+
+        THEN("it is also a valid input on its own") {
+            DatalogProgram program;
+            program.load(parser, std::vector<fs::path>{ file });
+            program.evaluateRules();
+            REQUIRE(answers(program) == answers(single));
+        }
+        fs::remove(file);
+    }
+}
+
+SCENARIO("arithmetic expressions are evaluated a column at a time", "[lab4]") {
+    auto& symbols = SymbolTable::global();
+
+    GIVEN("quoted integers") {
+        THEN("canonical ones are inline numbers and the rest stay text") {
+            Symbol twelve = symbols.intern("'12'");
+            REQUIRE(SymbolTable::isNumber(twelve));
+            REQUIRE(SymbolTable::numberOf(twelve) == 12);
+            REQUIRE(symbols.text(twelve) == "'12'");
+            REQUIRE(symbols.number(12) == twelve);
+            std::vector<std::string_view> recent;
+            for (std::int64_t i = 0; i < static_cast<std::int64_t>(SymbolTable::NumberViews); ++i)
+                recent.push_back(symbols.text(symbols.number(1000 + i)));
+            for (size_t i = 0; i < recent.size(); ++i)
+                REQUIRE(recent[i] == "'" + std::to_string(1000 + i) + "'");
+            for (const char* text : { "'012'", "'-3'", "'-0'", "'-00'", "'+3'", "'1x'", "'99999999999'", "12" })
+            {
+                REQUIRE_FALSE(SymbolTable::isNumber(symbols.intern(text)));
+                REQUIRE(symbols.text(symbols.intern(text)) == text);
+            }
+
+            std::int64_t value = 0;
+            REQUIRE(symbols.numeric(symbols.intern("'-3'"), value));
+            REQUIRE(value == -3);
+            REQUIRE(symbols.numeric(symbols.intern("'99999999999'"), value));
+            REQUIRE(value == 99999999999);
+            REQUIRE_FALSE(symbols.numeric(symbols.intern("'1x'"), value));
+        }
+    }
+
+    GIVEN("rules computing metrics in their heads") {
+        DatalogProgram program = load(
+            "Schemes: rect(R,W,H) area(R,A) padded(R,A) tagged(R,T)\n"
+            "Facts: rect('a','3','4'). rect('b','10','20'). rect('c','x','2'). rect('d','-2','5').\n"
+            "  rect('e','3000000000','3000000000'). rect('f','3037000500','3037000500').\n"
+            "Rules: area(r,(w*h)) :- rect(r,w,h).\n"
+            "  padded(r,((w+'1')*(h+'1'))) :- rect(r,w,h).\n"
+            "  tagged(r,'square') :- rect(r,w,w).\n"
+            "Queries: area(R,A)? padded('a',A)? tagged(R,T)?\n");
+        program.evaluateRules();
+
+        THEN("every row with numbers gets its value, inline or as text, and the rest none") {
+            REQUIRE(answers(program) ==
+                "area(R,A)? Yes(4)\n"
+                "  R='a', A='12'\n"
+                "  R='b', A='200'\n"
+                "  R='d', A='-10'\n"
+                "  R='e', A='9000000000000000000'\n"
+                "padded('a',A)? Yes(1)\n"
+                "  A='20'\n"
+                "tagged(R,T)? Yes(2)\n"
+                "  R='e', T='square'\n"
+                "  R='f', T='square'\n");
+        }
+    }
+
+    GIVEN("expressions in rule bodies and queries") {
+        DatalogProgram program = load(
+            "Schemes: step(A,B) inc(A) area(R,A) rect(R,W,H) exact(R)\n"
+            "Facts: step('1','2'). step('2','4'). step('4','5'). step('007','8').\n"
+            "  rect('a','3','4'). rect('b','2','2'). area('a','12'). area('b','5').\n"
+            "Rules: inc(a) :- step(a,(a+'1')).\n"
+            "  exact(r) :- rect(r,w,h), area(r,(w*h)).\n"
+            "Queries: inc(A)? exact(R)? step(A,(A*'2'))?\n");
+        program.evaluateRules();
+
+        THEN("a row matches when its column equals the expression's value, whatever way its operands are written") {
+            REQUIRE(answers(program) ==
+                "inc(A)? Yes(3)\n"
+                "  A='007'\n"
+                "  A='1'\n"
+                "  A='4'\n"
+                "exact(R)? Yes(1)\n"
+                "  R='a'\n"
+                "step(A,(A*'2'))? Yes(2)\n"
+                "  A='1'\n"
+                "  A='2'\n");
+        }
+    }
+
+    GIVEN("an expression over a variable nothing binds") {
+        THEN("loading rejects it") {
+            REQUIRE_THROWS_WITH(load("Schemes: a(X,Y) Facts: Rules: Queries: a(X,(Y+'1'))?"),
+                "variable Y of (Y+'1') is not bound in a(X,(Y+'1'))");
+            REQUIRE_THROWS_AS(load("Schemes: a(X) b(X) Facts: Rules: a((X+Y)) :- b(X). Queries: a(X)?"), std::invalid_argument);
+        }
+    }
+
+    GIVEN("a column of random numbers, some of them not inline") {
+        std::mt19937 random{ 7 };
+        Relation rows{ symbols.intern("r"), { symbols.intern("X"), symbols.intern("Y") } };
+        std::vector<std::int64_t> xs, ys;
+        for (size_t i = 0; i < 5000; ++i)
+        {
+            std::int64_t x = random() % 4 == 0 ? static_cast<std::int64_t>(random()) * 1000 : random() % 100000;
+            std::int64_t y = random() % 50 == 0 ? -static_cast<std::int64_t>(random() % 100) : random() % 100000;
+            Symbol row[] = { symbols.number(x), random() % 100 == 0 ? symbols.intern("'n/a'") : symbols.number(y) };
+            rows.insert(row);
+        }
+        rows.normalize();
+        using Op = ArithmeticKernel::Instruction::Op;
+        ArithmeticKernel kernel{ { { Op::Column, 0 }, { Op::Column, 1 }, { Op::Multiply, 0 }, { Op::Constant, symbols.intern("'3'") },
+            { Op::Add, 0 } } };
+
+        THEN("each kernel level computes x * y + 3 for every row with numbers") {
+            for (ArithmeticLevel level : { ArithmeticLevel::Scalar, ArithmeticLevel::Avx2 })
+            {
+                setArithmeticLevel(level);
+                std::vector<Symbol> values(rows.size());
+                std::vector<std::uint8_t> valid(rows.size());
+                kernel.evaluate(rows.data().data(), 2, rows.size(), values.data(), valid.data());
+                for (size_t i = 0; i < rows.size(); ++i)
+                {
+                    std::int64_t x = 0, y = 0, result = 0;
+                    bool numbers = symbols.numeric(rows.row(i)[0], x) && symbols.numeric(rows.row(i)[1], y);
+                    REQUIRE(valid[i] == numbers);
+                    if (numbers)
+                    {
+                        REQUIRE(symbols.numeric(values[i], result));
+                        REQUIRE(result == x * y + 3);
+                    }
+                }
+            }
+            setArithmeticLevel(ArithmeticLevel::Avx2);
+        }
+    }
+
+    GIVEN("a program with computed heads saved and updated") {
+        auto path = std::filesystem::temp_directory_path() / "datalog-test-arithmetic.snap";
+        DatalogProgram program = load(
+            "Schemes: price(I,P) qty(I,Q) total(I,T)\n"
+            "Facts: price('a','5'). price('b','7'). qty('a','3'). qty('b','2').\n"
+            "Rules: total(i,(p*q)) :- price(i,p), qty(i,q).\n"
+            "Queries: total(I,T)?\n");
+        program.evaluateRules();
+        program.save(path);
+        MappedFile file{ path };
+        DatalogProgram restored;
+        restored.restore(file.text());
+
+        THEN("the snapshot keeps the numbers and the rule") {
+            REQUIRE(answers(restored) == answers(program));
+            REQUIRE(restored.describe(restored.rules()[0]) == "total(i,(p*q)) :- price(i,p),qty(i,q).");
+        }
+
+        THEN("changing a fact recomputes the metric") {
+            Symbol qty = symbols.intern("qty");
+            program.update({ FactChange{ qty, { symbols.intern("'b'"), symbols.intern("'2'") }, true },
+                FactChange{ qty, { symbols.intern("'b'"), symbols.intern("'10'") } } });
+            REQUIRE(answers(program) == "total(I,T)? Yes(2)\n  I='a', T='15'\n  I='b', T='70'\n");
+        }
+        std::filesystem::remove(path);
+    }
+}
+
+SCENARIO("a query server answers from a warm program and a result cache", "[lab4]") {
+    GIVEN("a server over the chain program") {
+        DatalogProgram program = load(chain(4));
+        QueryServer server{ program, 2 };
+
+        THEN("queries are answered as answerQueries() prints them") {
+            REQUIRE(server.handle("path('2',X)?") == "path('2',X)? Yes(2)\n  X='3'\n  X='4'\n\n");
+            REQUIRE(server.handle("  edge('9',X)?\n") == "edge('9',X)? No\n\n");
+            REQUIRE(server.handle("path('0','4')? edge(X,'1')?") == "path('0','4')? Yes(1)\nedge(X,'1')? Yes(1)\n  X='0'\n\n");
+        }
+
+        THEN("a query of the same shape and constants is a hit under any variable names") {
+            server.handle("path('2',X)?");
+            REQUIRE(server.handle("path('2',Other)?") == "path('2',Other)? Yes(2)\n  Other='3'\n  Other='4'\n\n");
+            REQUIRE(server.handle("path('2',X)?") == "path('2',X)? Yes(2)\n  X='3'\n  X='4'\n\n");
+            server.handle("path('3',X)?");
+            auto stats = server.stats();
+            REQUIRE(stats.hits == 2);
+            REQUIRE(stats.misses == 2);
+            REQUIRE(stats.entries == 2);
+        }
+
+        THEN("the least recently used answer makes room") {
+            server.handle("path('1',X)?");
+            server.handle("path('2',X)?");
+            server.handle("path('1',X)?");
+            server.handle("path('3',X)?");
+            server.handle("path('1',X)?");
+            server.handle("path('2',X)?");
+            auto stats = server.stats();
+            REQUIRE(stats.evicted == 2);
+            REQUIRE(stats.hits == 2);
+            REQUIRE(stats.misses == 4);
+        }
+
+        WHEN("facts change") {
+            server.handle("path('2',X)?");
+            server.handle("edge(X,Y)?");
+            REQUIRE(server.handle("+edge('4','5'). edge('5','6').") == "OK +13 -0\n\n");
+
+            THEN("answers from the changed relations are recomputed") {
+                REQUIRE(server.stats().invalidated == 2);
+                REQUIRE(server.handle("path('2',X)?") == "path('2',X)? Yes(4)\n  X='3'\n  X='4'\n  X='5'\n  X='6'\n\n");
+                REQUIRE(server.handle("-edge('3','4').") == "OK +0 -13\n\n");
+                REQUIRE(server.handle("path('2',X)?") == "path('2',X)? Yes(1)\n  X='3'\n\n");
+                REQUIRE(server.stats().misses == 4);
+            }
+
+            THEN("answers from unchanged relations stay cached") {
+                DatalogProgram other = load("Schemes: a(X) b(X)\nFacts: a('1'). b('2').\nRules:\nQueries: a(X)?\n");
+                QueryServer separate{ other };
+                separate.handle("a(X)?");
+                separate.handle("+b('3').");
+                REQUIRE(separate.handle("a(X)?") == "a(X)? Yes(1)\n  X='1'\n\n");
+                REQUIRE(separate.stats().hits == 1);
+                REQUIRE(separate.stats().invalidated == 0);
+            }
+        }
+
+        THEN("asking for an expression again does not grow the program") {
+            server.handle("path(X,(X+'1'))?");
+            size_t expressions = program.expressions().size();
+            REQUIRE(server.handle("path(X, (X+'1'))?") == "path(X,(X+'1'))? Yes(4)\n  X='0'\n  X='1'\n  X='2'\n  X='3'\n\n");
+            REQUIRE(program.expressions().size() == expressions);
+        }
+
+        THEN("cached answers are read by many threads at once") {
+            server.handle("path('1',X)?");
+            std::vector<std::thread> readers;
+            std::atomic<size_t> same{ 0 };
+            for (size_t t = 0; t < 4; ++t)
+            {
+                readers.emplace_back([&server, &same] {
+                    for (size_t i = 0; i < 1000; ++i)
+                        same += server.handle("path('1',X)?") == "path('1',X)? Yes(3)\n  X='2'\n  X='3'\n  X='4'\n\n";
+                });
+            }
+            server.handle("+edge('7','8').");
+            for (std::thread& reader : readers)
+                reader.join();
+            REQUIRE(same == 4000);
+            REQUIRE(server.stats().hits + server.stats().misses == 4001);
+        }
+
+        THEN("bad requests get an error and leave the server running") {
+            REQUIRE(server.handle("path('2',X)").rfind("ERROR: unknown request", 0) == 0);
+            REQUIRE(server.handle("nothing(X)?") == "ERROR: unknown relation nothing\n\n");
+            REQUIRE(server.handle("+nothing('1').").rfind("ERROR: facts for undeclared scheme", 0) == 0);
+            REQUIRE(server.handle("path(X,(Y+'1'))?").rfind("ERROR: variable Y", 0) == 0);
+            REQUIRE(server.handle("stats") == "Cache: 0 entries, 0 hits, 0 misses, 0 invalidated, 0 evicted\n\n");
+        }
+
+        THEN("a stream of requests is served until quit") {
+            std::istringstream in{ "path('3',X)?\n\nstats\nquit\npath('2',X)?\n" };
+            std::ostringstream out;
+            server.serve(in, out);
+            REQUIRE(out.str() == "path('3',X)? Yes(1)\n  X='4'\n\nCache: 1 entries, 0 hits, 1 misses, 0 invalidated, 0 evicted\n\n");
+        }
+    }
+
+    GIVEN("a program loaded for demand-driven evaluation") {
+        DatalogProgram program = load(chain(4), 1, QueryEvaluation::Demand);
+
+        THEN("it cannot be served") {
+            REQUIRE_THROWS_AS(QueryServer{ program }, std::invalid_argument);
+        }
+    }
+}
+
+TEST_CASE("incremental updates against evaluating from scratch", "[.][benchmark]") {
+    WorkloadOptions options;
+    options.shape = WorkloadOptions::Shape::TransitiveClosure;
+    options.facts = 50000;
+    options.depth = 20;
+    DatalogProgram program = load(generateWorkload(options));
+
+    auto start = std::chrono::steady_clock::now();
+    program.evaluateRules();
+    std::chrono::duration<double> evaluated = std::chrono::steady_clock::now() - start;
+
+    auto& symbols = SymbolTable::global();
+    Symbol edge = symbols.intern("edge");
+    std::vector<Symbol> row(std::as_const(program).relation(edge).row(100), std::as_const(program).relation(edge).row(100) + 2);
+    start = std::chrono::steady_clock::now();
+    auto removed = program.update({ FactChange{ edge, row, true } });
+    auto added = program.update({ FactChange{ edge, row } });
+    std::chrono::duration<double> updated = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(removed.removed == added.added);
+    WARN("evaluate: " << evaluated.count() << " s, retract and insert one edge: " << updated.count() << " s ("
+        << evaluated.count() / updated.count() << "x), " << removed.removed.back() << " paths changed");
+}
+
+TEST_CASE("restoring a snapshot against loading and evaluating", "[.][benchmark]") {
+    WorkloadOptions options;
+    options.shape = WorkloadOptions::Shape::TransitiveClosure;
+    options.facts = 100000;
+    options.depth = 20;
+    std::string text = generateWorkload(options);
+    auto path = std::filesystem::temp_directory_path() / "datalog-bench.snap";
+
+    auto start = std::chrono::steady_clock::now();
+    DatalogProgram program = load(text);
+    program.evaluateRules();
+    std::chrono::duration<double> evaluated = std::chrono::steady_clock::now() - start;
+    program.save(path);
+
+    start = std::chrono::steady_clock::now();
+    MappedFile file{ path };
+    DatalogProgram restored;
+    restored.restore(file.text());
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(restored.relations().back().size() == program.relations().back().size());
+    WARN(file.text().size() << " byte snapshot, load and evaluate: " << evaluated.count() << " s, restore: "
+        << elapsed.count() << " s (" << evaluated.count() / elapsed.count() << "x)");
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("loading fact shards in parallel against one file", "[.][benchmark]") {
+    namespace fs = std::filesystem;
+    size_t length = 400000;
+    fs::path directory = shardedChain("datalog-bench-shards", length, 8);
+    fs::path whole = fs::temp_directory_path() / "datalog-bench-whole.dl";
+    std::ofstream{ whole } << chain(length);
+
+    LL1Parser parser = DatalogGrammarFactory::createDatalogParser();
+    auto start = std::chrono::steady_clock::now();
+    DatalogProgram single;
+    single.load(parser, whole);
+    std::chrono::duration<double> one = std::chrono::steady_clock::now() - start;
+
+    LL1Parser shardParser = DatalogGrammarFactory::createShardParser();
+    start = std::chrono::steady_clock::now();
+    DatalogProgram sharded;
+    sharded.load(shardParser, std::vector<fs::path>{ directory });
+    std::chrono::duration<double> many = std::chrono::steady_clock::now() - start;
+
+    Symbol edge = SymbolTable::global().intern("edge");
+    REQUIRE(std::as_const(sharded).relation(edge).data() == std::as_const(single).relation(edge).data());
+    WARN(length << " facts, one file: " << one.count() << " s, 8 shards on " << std::thread::hardware_concurrency()
+        << " threads: " << many.count() << " s (" << one.count() / many.count() << "x)");
+    fs::remove_all(directory);
+    fs::remove(whole);
+}
+
+TEST_CASE("column arithmetic kernels", "[.][benchmark]") {
+    auto& symbols = SymbolTable::global();
+    std::mt19937 random{ 1 };
+    Relation rows{ symbols.intern("r"), { symbols.intern("X"), symbols.intern("Y"), symbols.intern("Z") } };
+    std::vector<Symbol> row(3);
+    for (size_t i = 0; i < 2000000; ++i)
+    {
+        row = { symbols.number(static_cast<std::int64_t>(i)), symbols.number(random() % 100000), symbols.number(random() % 1000) };
+        rows.insert(row.data());
+    }
+    using Op = ArithmeticKernel::Instruction::Op;
+    ArithmeticKernel kernel{ { { Op::Column, 1 }, { Op::Column, 2 }, { Op::Multiply, 0 }, { Op::Column, 0 }, { Op::Add, 0 } } };
+    std::vector<Symbol> values(rows.size());
+    std::vector<std::uint8_t> valid(rows.size());
+
+    auto time = [&](ArithmeticLevel level) {
+        setArithmeticLevel(level);
+        auto start = std::chrono::steady_clock::now();
+        kernel.evaluate(rows.data().data(), 3, rows.size(), values.data(), valid.data());
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    double scalar = time(ArithmeticLevel::Scalar);
+    double avx2 = time(setArithmeticLevel(ArithmeticLevel::Avx2));
+    // Before typed numbers every constant was interned text: evaluating tuple
+    // by tuple read each operand's text from the table, parsed it and
+    // interned the result's text under the shard's lock.
+    std::vector<std::string> texts(rows.size() * 3);
+    SymbolTable::NumberText buffer;
+    for (size_t i = 0; i < texts.size(); ++i)
+        texts[i] = symbols.text(rows.data()[i], buffer);
+    std::mutex mutex;
+    std::unordered_map<std::string, Symbol> interned;
+    std::vector<Symbol> results(rows.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const std::string* operands = texts.data() + i * 3;
+        std::int64_t value = std::stoll(operands[1].substr(1)) * std::stoll(operands[2].substr(1)) + std::stoll(operands[0].substr(1));
+        std::lock_guard<std::mutex> lock{ mutex };
+        results[i] = interned.emplace("'" + std::to_string(value) + "'", static_cast<Symbol>(interned.size())).first->second;
+    }
+    std::chrono::duration<double> textual = std::chrono::steady_clock::now() - start;
+
+    std::vector<std::string_view> resultTexts(interned.size());
+    for (const auto& [text, symbol] : interned)
+        resultTexts[symbol] = text;
+    size_t checked = 0;
+    for (size_t i = 0; i < rows.size(); ++i)
+        checked += resultTexts[results[i]] == symbols.text(values[i], buffer);
+    REQUIRE(checked == rows.size());
+    WARN(rows.size() << " rows of y * z + x, per tuple through interned text: " << textual.count() << " s, scalar kernel: "
+        << scalar << " s (" << textual.count() / scalar << "x), " << (arithmeticLevel() == ArithmeticLevel::Avx2 ? "AVX2" : "scalar")
+        << " kernel: " << avx2 << " s (" << textual.count() / avx2 << "x)");
+}
+
+TEST_CASE("cached queries against evaluating each query", "[.][benchmark]") {
+    DatalogProgram program = load(chain(2000));
+    QueryServer server{ program };
+    std::string request = "path('1000',X)?";
+
+    auto start = std::chrono::steady_clock::now();
+    std::string first = server.handle(request);
+    std::chrono::duration<double> cold = std::chrono::steady_clock::now() - start;
+
+    size_t repeats = 10000;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; ++i)
+        REQUIRE(server.handle(request).size() == first.size());
+    std::chrono::duration<double> warm = (std::chrono::steady_clock::now() - start) / repeats;
+
+    start = std::chrono::steady_clock::now();
+    std::ostringstream out;
+    Atom query = program.queries().front();
+    query.terms.front().value = SymbolTable::global().intern("'1000'");
+    program.printAnswer(out, query, program.evaluate(query));
+    std::chrono::duration<double> direct = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(out.str() + "\n" == first);
+    WARN("path over " << std::as_const(program).relation(SymbolTable::global().intern("path")).size()
+        << " tuples, first request: " << cold.count() * 1e6 << " us, evaluating the query: " << direct.count() * 1e6
+        << " us, cached request: " << warm.count() * 1e6 << " us (" << direct.count() / warm.count() << "x)");
+}
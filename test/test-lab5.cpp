@@ -0,0 +1,715 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include "catch2/catch.hpp"
+#include "bench/workload.h"
+#include "src/datalog.h"
+#include "src/graph.h"
+#include "src/index.h"
+#include "src/report.h"
+#include "src/scheduler.h"
+#include "src/triejoin.h"
+#include "test/programs.h"
+
+namespace
+{
+    // a random graph in e(A,B) and the given schemes, rules and queries over it
+    std::string graph(size_t nodes, size_t edges, std::uint32_t seed, const std::string& schemes, const std::string& rest)
+    {
+        std::string text{ "Schemes: e(A,B) " + schemes + "\nFacts:\n" };
+        for (size_t i = 0; i < edges; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            size_t from = (seed >> 8) % nodes;
+            seed = seed * 1103515245 + 12345;
+            size_t to = (seed >> 8) % nodes;
+            text += "e('" + std::to_string(from) + "','" + std::to_string(to) + "').\n";
+        }
+        return text + rest;
+    }
+
+    // several unrelated transitive closures over pseudo random graphs, which
+    // are large enough to split joins and unions
+    std::string closures(size_t groups, size_t edges)
+    {
+        std::string text{ "Schemes:\n" };
+        for (size_t g = 0; g < groups; ++g)
+            text += "e" + std::to_string(g) + "(A,B) t" + std::to_string(g) + "(A,B)\n";
+        text += "Facts:\n";
+        std::uint32_t seed = 7;
+        for (size_t g = 0; g < groups; ++g)
+        {
+            for (size_t i = 0; i < edges; ++i)
+            {
+                seed = seed * 1103515245 + 12345;
+                size_t from = (seed >> 8) % (edges / 16);
+                seed = seed * 1103515245 + 12345;
+                size_t to = (seed >> 8) % (edges / 16);
+                text += "e" + std::to_string(g) + "('" + std::to_string(from) + "','" + std::to_string(to) + "').\n";
+            }
+        }
+        text += "Rules:\n";
+        for (size_t g = 0; g < groups; ++g)
+        {
+            std::string e = "e" + std::to_string(g);
+            std::string t = "t" + std::to_string(g);
+            text += t + "(X,Y) :- " + e + "(X,Y).\n" + t + "(X,Z) :- " + t + "(X,Y), " + e + "(Y,Z).\n";
+        }
+        return text + "Queries: t0('1',X)?\n";
+    }
+
+    // a random graph with many triangles and the rule that finds them
+    std::string triangles(size_t nodes, size_t edges)
+    {
+        std::string text{ "Schemes: r(A,B) t(A,B,C)\nFacts:\n" };
+        std::uint32_t seed = 11;
+        for (size_t i = 0; i < edges; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            size_t from = (seed >> 8) % nodes;
+            seed = seed * 1103515245 + 12345;
+            size_t to = (seed >> 8) % nodes;
+            text += "r('" + std::to_string(from) + "','" + std::to_string(to) + "').\n";
+        }
+        return text + "Rules: t(X,Y,Z) :- r(X,Y), r(Y,Z), r(X,Z).\nQueries: t('1',Y,Z)?\n";
+    }
+
+    size_t rows(const DatalogProgram& program, std::string_view name)
+    {
+        return program.relation(SymbolTable::global().intern(name)).size();
+    }
+}
+
+SCENARIO("strongly connected components", "[lab5]") {
+    GIVEN("a graph with two cycles joined by an edge") {
+        Graph graph{ 6 };
+        graph.addEdge(0, 1);
+        graph.addEdge(1, 2);
+        graph.addEdge(2, 0);
+        graph.addEdge(2, 3);
+        graph.addEdge(3, 4);
+        graph.addEdge(4, 3);
+        graph.addEdge(5, 5);
+        graph.addEdge(5, 0);
+
+        auto components = graph.components();
+
+        THEN("each cycle is one component") {
+            REQUIRE(components.size() == 3);
+            REQUIRE(std::find(std::cbegin(components), std::cend(components), std::vector<size_t>{ 0, 1, 2 }) != std::cend(components));
+            REQUIRE(std::find(std::cbegin(components), std::cend(components), std::vector<size_t>{ 3, 4 }) != std::cend(components));
+            REQUIRE(std::find(std::cbegin(components), std::cend(components), std::vector<size_t>{ 5 }) != std::cend(components));
+        }
+
+        THEN("components come after the components they point to") {
+            REQUIRE(components[0] == std::vector<size_t>{ 3, 4 });
+            REQUIRE(components[1] == std::vector<size_t>{ 0, 1, 2 });
+            REQUIRE(components[2] == std::vector<size_t>{ 5 });
+        }
+    }
+
+    GIVEN("a long chain") {
+        Graph graph{ 200000 };
+        for (size_t i = 0; i + 1 < graph.size(); ++i)
+            graph.addEdge(i, i + 1);
+
+        THEN("every node is its own component, deepest first") {
+            auto components = graph.components();
+            REQUIRE(components.size() == graph.size());
+            REQUIRE(components.front() == std::vector<size_t>{ graph.size() - 1 });
+            REQUIRE(components.back() == std::vector<size_t>{ 0 });
+        }
+    }
+}
+
+SCENARIO("rules are evaluated stratum by stratum", "[lab5]") {
+    GIVEN("two unrelated recursive rule groups and rules reading them") {
+        DatalogProgram program = load(
+            "Schemes: e(A,B) f(A,B) p(A,B) q(A,B) r(A,B) both(A,B)\n"
+            "Facts: e('1','2'). e('2','3'). e('3','4'). f('a','b'). f('b','a').\n"
+            "Rules:\n"
+            "  both(X,Y) :- p(X,Y), r(X,Y).\n"
+            "  p(X,Y) :- e(X,Y).\n"
+            "  p(X,Z) :- e(X,Y), q(Y,Z).\n"
+            "  q(X,Y) :- p(X,Y).\n"
+            "  r(X,Y) :- f(X,Y).\n"
+            "  r(X,Z) :- r(X,Y), r(Y,Z).\n"
+            "Queries: p('1',X)?\n");
+        const auto& strata = program.strata();
+
+        THEN("mutually recursive heads share a stratum") {
+            REQUIRE(strata.size() == 3);
+            auto pq = std::find_if(std::cbegin(strata), std::cend(strata), [](const Stratum& stratum) {
+                return stratum.rules == std::vector<size_t>{ 1, 2, 3 };
+            });
+            REQUIRE(pq != std::cend(strata));
+            REQUIRE(pq->recursive);
+        }
+
+        THEN("a rule that reads recursive strata is not recursive itself and comes last") {
+            REQUIRE(strata.back().rules == std::vector<size_t>{ 0 });
+            REQUIRE_FALSE(strata.back().recursive);
+        }
+
+        THEN("a self-recursive rule group is recursive") {
+            auto r = std::find_if(std::cbegin(strata), std::cend(strata), [](const Stratum& stratum) {
+                return stratum.rules == std::vector<size_t>{ 4, 5 };
+            });
+            REQUIRE(r != std::cend(strata));
+            REQUIRE(r->recursive);
+        }
+
+        WHEN("the rules are evaluated") {
+            auto stats = program.evaluateRules();
+
+            THEN("every relation reaches its fixpoint") {
+                REQUIRE(rows(program, "p") == 6);
+                REQUIRE(rows(program, "q") == 6);
+                REQUIRE(rows(program, "r") == 4);
+                REQUIRE(rows(program, "both") == 0);
+            }
+
+            THEN("the non-recursive stratum runs once") {
+                REQUIRE(stats.passes.size() == strata.size());
+                REQUIRE(stats.passes.back() == 1);
+            }
+        }
+    }
+
+    GIVEN("a rule reading a scheme that was never declared") {
+        THEN("loading rejects it") {
+            REQUIRE_THROWS_AS(load("Schemes: a(X) Facts: Rules: a(X) :- b(X). Queries: a(X)?"), std::invalid_argument);
+        }
+    }
+}
+
+SCENARIO("work-stealing scheduler", "[lab5]") {
+    GIVEN("a pool of threads") {
+        Scheduler scheduler{ 4 };
+
+        THEN("every task of a group has run when wait returns") {
+            std::atomic<size_t> count{ 0 };
+            Scheduler::Group group;
+            for (size_t i = 0; i < 1000; ++i)
+                scheduler.run(group, [&count] { ++count; });
+            scheduler.wait(group);
+            REQUIRE(count == 1000);
+        }
+
+        THEN("tasks can wait for tasks they spawn") {
+            std::atomic<size_t> count{ 0 };
+            Scheduler::Group outer;
+            for (size_t i = 0; i < 16; ++i)
+            {
+                scheduler.run(outer, [&scheduler, &count] {
+                    scheduler.parallelFor(1000, 10, [&count](size_t begin, size_t end) { count += end - begin; });
+                });
+            }
+            scheduler.wait(outer);
+            REQUIRE(count == 16000);
+        }
+
+        THEN("an exception in a task is rethrown by wait") {
+            Scheduler::Group group;
+            scheduler.run(group, [] { throw std::runtime_error{ "failed" }; });
+            REQUIRE_THROWS_AS(scheduler.wait(group), std::runtime_error);
+        }
+
+        THEN("a thread waiting for a slow task sleeps instead of spinning") {
+            Scheduler::Group group;
+            std::atomic<bool> done{ false };
+            scheduler.run(group, [&done] {
+                std::this_thread::sleep_for(std::chrono::milliseconds{ 300 });
+                done = true;
+            });
+            // give a worker the time to take the task
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+            std::clock_t start = std::clock();
+            scheduler.wait(group);
+            double cpu = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+            REQUIRE(done);
+            REQUIRE(cpu < 0.1);
+        }
+    }
+
+    GIVEN("the shared scheduler") {
+        THEN("it is one pool with a thread per core") {
+            REQUIRE(&Scheduler::shared() == &Scheduler::shared());
+            REQUIRE(Scheduler::shared().threads() == std::max<size_t>(std::thread::hardware_concurrency(), 1));
+        }
+    }
+}
+
+SCENARIO("parallel evaluation is deterministic", "[lab5]") {
+    GIVEN("independent recursive strata with large joins") {
+        std::string text = closures(4, 3000);
+        DatalogProgram sequential = load(text, 1);
+        DatalogProgram parallel = load(text, 8);
+
+        auto expected = sequential.evaluateRules();
+        auto actual = parallel.evaluateRules();
+
+        THEN("both derive the same tuples in the same passes") {
+            REQUIRE(actual.derived == expected.derived);
+            REQUIRE(actual.passes == expected.passes);
+            for (size_t i = 0; i < sequential.relations().size(); ++i)
+                REQUIRE(parallel.relations()[i].data() == sequential.relations()[i].data());
+        }
+    }
+}
+
+SCENARIO("secondary indexes", "[lab5]") {
+    SymbolTable& symbols = SymbolTable::global();
+    Symbol a = symbols.intern("'a'");
+    Symbol b = symbols.intern("'b'");
+    Symbol c = symbols.intern("'c'");
+    Relation rows{ symbols.intern("r"), { symbols.intern("X"), symbols.intern("Y"), symbols.intern("Z") } };
+    for (const auto& row : std::vector<std::vector<Symbol>>{ { a, b, c }, { a, c, c }, { b, b, a }, { c, b, a } })
+        rows.insert(row.data());
+    rows.normalize();
+
+    auto sorted = [](std::vector<std::vector<Symbol>> expected) {
+        std::sort(std::begin(expected), std::end(expected));
+        return expected;
+    };
+    auto collect = [](const Index& index, std::vector<Symbol> key) {
+        std::vector<std::vector<Symbol>> found;
+        index.lookup(key.data(), key.size(), [&found](const Symbol* row) { found.emplace_back(row, row + 3); });
+        std::sort(std::begin(found), std::end(found));
+        return found;
+    };
+
+    GIVEN("a hash index on the last two columns") {
+        Index index{ Index::Kind::Hash, { 1, 2 }, 3 };
+        index.insert(rows);
+
+        THEN("lookups return whole rows in column order") {
+            REQUIRE(collect(index, { b, a }) == sorted({ { b, b, a }, { c, b, a } }));
+            REQUIRE(collect(index, { c, c }) == std::vector<std::vector<Symbol>>{ { a, c, c } });
+            REQUIRE(collect(index, { a, a }).empty());
+        }
+    }
+
+    GIVEN("a sorted index keyed on the second column, then the first") {
+        Index index{ Index::Kind::Sorted, { 1, 0 }, 3 };
+        index.insert(rows);
+
+        THEN("any prefix of the key can be looked up") {
+            REQUIRE(collect(index, { b }).size() == 3);
+            REQUIRE(collect(index, { b, c }) == std::vector<std::vector<Symbol>>{ { c, b, a } });
+        }
+
+        WHEN("rows are added") {
+            Relation more{ rows.name(), rows.attributes() };
+            more.insert(std::vector<Symbol>{ b, b, b }.data());
+            index.insert(more);
+
+            THEN("they are found in order with the old ones") {
+                REQUIRE(index.size() == 5);
+                REQUIRE(collect(index, { b, b }) == sorted({ { b, b, a }, { b, b, b } }));
+            }
+        }
+    }
+
+    GIVEN("indexes filled a row at a time, then half emptied") {
+        Index hashed{ Index::Kind::Hash, { 1 }, 3 };
+        Index ordered{ Index::Kind::Sorted, { 1, 0 }, 3 };
+        Relation odd{ rows.name(), rows.attributes() };
+        for (std::uint32_t i = 0; i < 300; ++i)
+        {
+            std::vector<Symbol> row{ SymbolTable::global().number(i), SymbolTable::global().number(i % 7), c };
+            Relation one{ rows.name(), rows.attributes() };
+            one.insert(row.data());
+            hashed.insert(one);
+            ordered.insert(one);
+            if (i % 2 == 1)
+                odd.insert(row.data());
+        }
+        odd.normalize();
+        hashed.erase(odd);
+        ordered.erase(odd);
+
+        THEN("lookups find exactly the rows left") {
+            REQUIRE(hashed.size() == 150);
+            REQUIRE(ordered.size() == 150);
+            for (std::uint32_t k = 0; k < 7; ++k)
+            {
+                std::vector<std::vector<Symbol>> expected;
+                for (std::uint32_t i = k; i < 300; i += 7)
+                {
+                    if (i % 2 == 0)
+                        expected.push_back({ SymbolTable::global().number(i), SymbolTable::global().number(k), c });
+                }
+                Symbol key = SymbolTable::global().number(k);
+                REQUIRE(collect(hashed, { key }) == sorted(expected));
+                REQUIRE(collect(ordered, { key }) == sorted(expected));
+            }
+        }
+    }
+
+    GIVEN("a program whose queries and rules bind columns") {
+        DatalogProgram program = load(
+            "Schemes: e(A,B) t(A,B) s(A,B,C)\n"
+            "Facts: e('1','2'). e('2','3'). e('3','4'). s('1','2','3'). s('1','3','3').\n"
+            "Rules: t(X,Y) :- e(X,Y). t(X,Z) :- t(X,Y), e(Y,Z).\n"
+            "Queries: t('1',X)? s('1',X,Y)? s('1',X,'3')? t(X,X)?\n");
+        auto& symbols = SymbolTable::global();
+
+        THEN("nested patterns share a sorted index and others get a hash index") {
+            const auto& s = program.indexes(symbols.intern("s"));
+            REQUIRE(s.size() == 1);
+            REQUIRE(s[0].kind() == Index::Kind::Sorted);
+            REQUIRE(s[0].key() == std::vector<size_t>{ 0, 2 });
+
+            const auto& e = program.indexes(symbols.intern("e"));
+            REQUIRE(e.size() == 1);
+            REQUIRE(e[0].kind() == Index::Kind::Hash);
+            REQUIRE(e[0].key() == std::vector<size_t>{ 0 });
+        }
+
+        WHEN("the rules add tuples") {
+            program.evaluateRules();
+
+            THEN("the indexes include them") {
+                REQUIRE(program.indexes(symbols.intern("t"))[0].size() == 6);
+            }
+
+            THEN("queries answered through indexes match a scan") {
+                REQUIRE(answers(program) ==
+                    "t('1',X)? Yes(3)\n  X='2'\n  X='3'\n  X='4'\n"
+                    "s('1',X,Y)? Yes(2)\n  X='2', Y='3'\n  X='3', Y='3'\n"
+                    "s('1',X,'3')? Yes(2)\n  X='2'\n  X='3'\n"
+                    "t(X,X)? No\n");
+            }
+        }
+    }
+}
+
+SCENARIO("cost-based join planning", "[lab5]") {
+    GIVEN("a relation with few distinct values in one column") {
+        auto& symbols = SymbolTable::global();
+        Relation rows{ symbols.intern("r"), { symbols.intern("X"), symbols.intern("Y") } };
+        for (size_t i = 0; i < 50000; ++i)
+        {
+            std::vector<Symbol> row{ symbols.intern(std::to_string(i)), symbols.intern(std::to_string(i % 10)) };
+            rows.insert(row.data());
+        }
+        rows.normalize();
+
+        THEN("distinct values are estimated from a sample") {
+            REQUIRE(rows.distinct(1) == 10);
+            REQUIRE(rows.distinct(0) > 25000);
+            REQUIRE(rows.distinct(0) <= 50000);
+        }
+    }
+
+    GIVEN("a rule body written as a cross product") {
+        DatalogProgram program = load(
+            "Schemes: a(A,B) b(B,C) c(C,D) r(A,D)\n"
+            "Facts: a('1','2'). a('1','3'). a('4','5'). b('2','6'). b('5','7'). b('9','9').\n"
+            "  c('6','8'). c('7','0'). c('x','y'). c('z','w').\n"
+            "Rules: r(A,D) :- a(A,B), c(C,D), b(B,C).\n"
+            "Queries: r(A,D)?\n");
+        const Rule& rule = program.rules().front();
+        JoinPlan plan = program.plan(rule);
+
+        THEN("every step after the first shares a variable with the ones before") {
+            REQUIRE(plan.steps.size() == 3);
+            REQUIRE(plan.steps[1].atom == 2);
+        }
+
+        THEN("the plan can be printed") {
+            std::string text = program.describe(rule, plan);
+            REQUIRE(text.find("r(A,D) :- a(A,B),c(C,D),b(B,C).\n") == 0);
+            REQUIRE(text.find("  2. b(B,C)") != std::string::npos);
+        }
+
+        THEN("the reordered join derives the same tuples") {
+            program.evaluateRules();
+            REQUIRE(answers(program) == "r(A,D)? Yes(2)\n  A='1', D='8'\n  A='4', D='0'\n");
+        }
+    }
+
+    GIVEN("a body atom with a constant") {
+        DatalogProgram program = load(
+            "Schemes: big(A,B) small(B,C) r(A,C)\n"
+            "Facts: big('1','a'). big('2','b'). big('3','c'). big('4','d').\n"
+            "  small('a','x'). small('b','y'). small('c','x'). small('d','y').\n"
+            "Rules: r(A,C) :- big(A,B), small(B,C), small(B,'x').\n"
+            "Queries: r(A,C)?\n");
+
+        THEN("its selection is planned first") {
+            REQUIRE(program.plan(program.rules().front()).steps.front().atom == 2);
+        }
+    }
+}
+
+SCENARIO("leapfrog triejoin", "[lab5]") {
+    auto& symbols = SymbolTable::global();
+    Symbol x = symbols.intern("X");
+    Symbol y = symbols.intern("Y");
+    Symbol z = symbols.intern("Z");
+
+    GIVEN("join graphs of different shapes") {
+        THEN("triangles and longer cycles are cyclic") {
+            REQUIRE(isCyclic({ { x, y }, { y, z }, { x, z } }));
+            REQUIRE(isCyclic({ { x, y }, { y, z }, { z, symbols.intern("W") }, { symbols.intern("W"), x } }));
+        }
+
+        THEN("chains, stars and covered cycles are not") {
+            REQUIRE_FALSE(isCyclic({ { x, y }, { y, z } }));
+            REQUIRE_FALSE(isCyclic({ { x, y }, { x, z }, { x, symbols.intern("W") } }));
+            REQUIRE_FALSE(isCyclic({ { x, y }, { y, z }, { x, z }, { x, y, z } }));
+        }
+    }
+
+    GIVEN("a graph with triangles") {
+        DatalogProgram binary = load(triangles(60, 600));
+        DatalogProgram leapfrog = load(triangles(60, 600));
+
+        THEN("a triangle body picks leapfrog triejoin automatically") {
+            REQUIRE(leapfrog.joinAlgorithm(0) == JoinAlgorithm::Leapfrog);
+        }
+
+        WHEN("one program is forced to binary joins") {
+            binary.setJoinAlgorithm(0, JoinAlgorithm::Binary);
+            binary.evaluateRules();
+            leapfrog.evaluateRules();
+
+            THEN("both find the same triangles") {
+                REQUIRE(rows(leapfrog, "t") > 0);
+                REQUIRE(std::as_const(leapfrog).relation(symbols.intern("t")).data() == std::as_const(binary).relation(symbols.intern("t")).data());
+            }
+        }
+    }
+
+    GIVEN("a body whose atoms a sorted index keeps in the variable order, after a constant") {
+        std::string text = triangles(60, 600);
+        text = text.substr(0, text.find("Rules:")) + "Rules: t(X,Y,Z) :- r('1',Y), r(Y,Z), r('1',Z), r(X,Y).\nQueries: r('1',Y)?\n";
+        DatalogProgram binary = load(text);
+        DatalogProgram leapfrog = load(text);
+        binary.setJoinAlgorithm(0, JoinAlgorithm::Binary);
+        leapfrog.setJoinAlgorithm(0, JoinAlgorithm::Leapfrog);
+        binary.evaluateRules();
+        leapfrog.evaluateRules();
+
+        THEN("reading the inputs from the index finds the same tuples") {
+            REQUIRE(rows(leapfrog, "t") > 0);
+            REQUIRE(std::as_const(leapfrog).relation(symbols.intern("t")).data() == std::as_const(binary).relation(symbols.intern("t")).data());
+        }
+    }
+
+    GIVEN("two inputs sharing one variable, whose values are the variable names") {
+        Relation r{ symbols.intern("r"), { x, y } };
+        Relation s{ symbols.intern("s"), { y, z } };
+        for (const auto& row : std::vector<std::vector<Symbol>>{ { x, y }, { x, z }, { y, z } })
+            r.insert(row.data());
+        for (const auto& row : std::vector<std::vector<Symbol>>{ { y, x }, { z, z }, { z, y } })
+            s.insert(row.data());
+        r.normalize();
+        s.normalize();
+
+        THEN("the result matches the pairwise join") {
+            Relation expected = r.join(s);
+            Relation actual = leapfrogJoin(r.name(), { r, s }, { x, y, z });
+            REQUIRE(actual.data() == expected.data());
+        }
+    }
+}
+
+SCENARIO("phase timings and counters", "[lab5]") {
+    auto& symbols = SymbolTable::global();
+
+    GIVEN("a program with a recursive rule and a bound query") {
+        DatalogProgram program = load(
+            "Schemes: e(A,B) t(A,B)\n"
+            "Facts: e('1','2'). e('2','3'). e('3','4').\n"
+            "Rules: t(X,Y) :- e(X,Y). t(X,Z) :- t(X,Y), e(Y,Z).\n"
+            "Queries: t('1',X)?\n");
+
+        THEN("the input's tokens are counted, bulk loaded facts included") {
+            std::string text = "Schemes: e(A,B)\nFacts: e('1','2'). e('2', '3').\nRules:\nQueries: e(X,Y)?\n";
+            LL1Parser parser = DatalogGrammarFactory::createDatalogParser();
+            size_t lexed = 0;
+            for (const Token& token : TokenStream{ parser.lexer(), text })
+                lexed += token.typeId() != parser.lexer().endOfFile();
+            TokenStream tokens{ parser.lexer(), text };
+            parseDatalog(parser, tokens);
+            REQUIRE(tokens.tokens() == lexed);
+        }
+
+        THEN("loading times its phases") {
+            for (const char* phase : { "relations", "rules", "stratify", "indexes" })
+            {
+                bool found = std::any_of(std::begin(program.times().phases()), std::end(program.times().phases()),
+                    [phase](const PhaseTimes::Phase& p) { return p.name == phase; });
+                REQUIRE(found);
+            }
+        }
+
+        WHEN("the rules are evaluated and the queries answered") {
+            RunReport report;
+            report.evaluation = program.evaluateRules();
+            answers(program);
+
+            THEN("each stratum has a time and each rule its tuples by pass") {
+                REQUIRE(report.evaluation.seconds.size() == program.strata().size());
+                for (size_t r = 0; r < program.rules().size(); ++r)
+                {
+                    const auto& byPass = report.evaluation.derivedByPass[r];
+                    REQUIRE(std::accumulate(std::begin(byPass), std::end(byPass), size_t{ 0 }) == report.evaluation.derived[r]);
+                }
+            }
+
+            THEN("the index answering the query counts its hits") {
+                const Index& index = program.indexes(symbols.intern("t"))[0];
+                REQUIRE(index.lookups() >= 1);
+                REQUIRE(index.hits() >= 1);
+                REQUIRE(index.hits() <= index.lookups());
+            }
+
+            THEN("the json report has every section") {
+                std::ostringstream out;
+                printReport(out, report, program, true);
+                for (const char* key : { "\"phases\"", "\"load\"", "\"input\"", "\"peak_memory_bytes\"", "\"sccs\"", "\"rules\"", "\"indexes\"" })
+                    REQUIRE(out.str().find(key) != std::string::npos);
+            }
+        }
+    }
+}
+
+SCENARIO("magic sets answer selective queries goal-directed", "[lab5]") {
+    const std::vector<std::pair<std::string, std::string>> programs{
+        { "t(A,B)", "Rules: t(X,Y) :- e(X,Y). t(X,Z) :- e(X,Y), t(Y,Z).\n"
+            "Queries: t('1',X)? t(X,'3')? t('2','5')? t(X,X)?\n" },
+        { "t(A,B)", "Rules: t(X,Y) :- e(X,Y). t(X,Z) :- t(X,Y), e(Y,Z).\n"
+            "Queries: t('1',X)? t(X,'3')? t('4','4')?\n" },
+        { "up(A,B) down(A,B) sg(A,B)", "up('1','2'). up('2','3'). down('3','4'). down('2','5').\n"
+            "Rules: sg(X,Y) :- e(X,Y). sg(X,Y) :- up(X,A), sg(A,B), down(B,Y).\n"
+            "Queries: sg('1',Y)? sg(X,'4')?\n" },
+        { "reach(A,B) out(A) from1(A)", "reach('0','19'). reach('3','3').\n"
+            "Rules: reach(X,Y) :- e(X,Y). reach(X,Z) :- reach(X,Y), e(Y,Z).\n"
+            "out(X) :- reach(X,Y), e(Y,X). from1(X) :- reach('1',X), out(X).\n"
+            "Queries: out('3')? from1(X)? reach('0',Y)?\n" },
+    };
+
+    GIVEN("programs over random graphs") {
+        for (std::uint32_t seed = 1; seed <= 8; ++seed)
+        {
+            for (const auto& [schemes, rest] : programs)
+            {
+                std::string text = graph(20, 30, seed, schemes, rest);
+                DatalogProgram full = load(text);
+                DatalogProgram demand = load(text, 1, QueryEvaluation::Demand);
+                INFO(text);
+
+                THEN("the rewritten rules give the same answers") {
+                    REQUIRE(demand.demandDriven());
+                    demand.evaluateRules();
+                    full.evaluateRules();
+                    REQUIRE(answers(demand) == answers(full));
+                }
+            }
+        }
+    }
+
+    GIVEN("a transitive closure with a point query") {
+        std::string text = graph(200, 400, 3, "t(A,B)",
+            "Rules: t(X,Y) :- e(X,Y). t(X,Z) :- e(X,Y), t(Y,Z).\nQueries: t('1',X)?\n");
+        DatalogProgram full = load(text);
+        DatalogProgram automatic = load(text, 1, QueryEvaluation::Automatic);
+
+        THEN("the rewrite is picked automatically and derives less") {
+            REQUIRE(automatic.demandDriven());
+            REQUIRE(automatic.answers()[0] == SymbolTable::global().intern("t^bf"));
+            auto derived = [](DatalogProgram& program) {
+                auto stats = program.evaluateRules();
+                return std::accumulate(std::begin(stats.derived), std::end(stats.derived), size_t{ 0 });
+            };
+            REQUIRE(derived(automatic) < derived(full));
+            REQUIRE(answers(automatic) == answers(full));
+        }
+
+        THEN("a query without constants keeps the full evaluation") {
+            DatalogProgram open = load(text + "t(X,Y)?\n", 1, QueryEvaluation::Automatic);
+            REQUIRE_FALSE(open.demandDriven());
+            REQUIRE(open.rewriteFallback().empty());
+        }
+
+        THEN("every rewritten rule is traced to the rule it copies, or marked internal") {
+            REQUIRE(automatic.loadedRules().size() == 2);
+            std::vector<size_t> copied;
+            for (size_t r = 0; r < automatic.rules().size(); ++r)
+            {
+                size_t origin = automatic.origin(r);
+                if (origin == DatalogProgram::Internal)
+                    continue;
+                copied.push_back(origin);
+                REQUIRE(automatic.rules()[r].body.size() == automatic.loadedRules()[origin].body.size() + 1);
+            }
+            std::sort(std::begin(copied), std::end(copied));
+            REQUIRE(copied == std::vector<size_t>{ 0, 1 });
+            REQUIRE(full.origin(1) == 1);
+        }
+    }
+
+    GIVEN("a selective query over a rule with an expression") {
+        std::string text = graph(20, 30, 1, "t(A,B)",
+            "Rules: t(X,Y) :- e(X,Y). t(X,Z) :- e(X,Y), t(Y,Z), e(Z,(Y+'1')).\nQueries: t('1',X)?\n");
+        DatalogProgram automatic = load(text, 1, QueryEvaluation::Automatic);
+
+        THEN("the rewrite falls back to full evaluation and says why") {
+            REQUIRE_FALSE(automatic.demandDriven());
+            REQUIRE(automatic.rewriteFallback() == automatic.describe(automatic.rules()[1]) + " has an expression in its body");
+        }
+    }
+}
+
+TEST_CASE("leapfrog triejoin against binary joins", "[.][benchmark]") {
+    std::string text = triangles(2000, 60000);
+
+    auto measure = [&text](JoinAlgorithm algorithm) {
+        DatalogProgram program = load(text);
+        program.setJoinAlgorithm(0, algorithm);
+        auto start = std::chrono::steady_clock::now();
+        program.evaluateRules();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return std::make_pair(elapsed.count(), rows(program, "t"));
+    };
+
+    auto binary = measure(JoinAlgorithm::Binary);
+    auto leapfrog = measure(JoinAlgorithm::Leapfrog);
+    REQUIRE(binary.second == leapfrog.second);
+    WARN(leapfrog.second << " triangles, binary joins: " << binary.first << " s, leapfrog triejoin: "
+        << leapfrog.first << " s (" << binary.first / leapfrog.first << "x)");
+}
+
+TEST_CASE("magic sets against full evaluation for a point query", "[.][benchmark]") {
+    WorkloadOptions options;
+    options.shape = WorkloadOptions::Shape::TransitiveClosure;
+    options.facts = 100000;
+    options.depth = 50;
+    options.queries = 1;
+    options.boundQueries = 1;
+    std::string text = generateWorkload(options);
+
+    auto measure = [&text](QueryEvaluation evaluation) {
+        DatalogProgram program = load(text, 1, evaluation);
+        auto start = std::chrono::steady_clock::now();
+        program.evaluateRules();
+        std::string result = answers(program);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return std::make_pair(elapsed.count(), result);
+    };
+
+    auto demand = measure(QueryEvaluation::Demand);
+    auto full = measure(QueryEvaluation::Full);
+    REQUIRE(demand.second == full.second);
+    WARN("point query on a closure, evaluating fully: " << full.first << " s, magic sets: " << demand.first << " s ("
+        << full.first / demand.first << "x)");
+}